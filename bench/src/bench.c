@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "connection.h"
+#include "err_codes.h"
+#include "logger.h"
+#include "metrics.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static err_t bench_sink(void* ctx, client_t client[static 1],
+                        const proto_frame_t frame[static 1]);
+static err_t bench_io(int32_t fd, uint8_t* data, uint64_t length,
+                      int32_t write_data);
+
+static err_t bench_sink(void* ctx, client_t client[static 1],
+                        const proto_frame_t frame[static 1])
+{
+    (void)ctx;
+    (void)client;
+    (void)frame;
+    return DISFS_SUCCESS;
+}
+
+err_t bench_cluster_start(bench_cluster_t cluster[static 1], uint32_t count,
+                          int32_t discovery, uint32_t discovery_interval_ms)
+{
+    return bench_cluster_start_setup(cluster, count, discovery,
+                                     discovery_interval_ms, NULL, NULL);
+}
+
+err_t bench_cluster_start_setup(bench_cluster_t cluster[static 1],
+                                uint32_t count, int32_t discovery,
+                                uint32_t discovery_interval_ms,
+                                bench_setup_fn setup, void* ctx)
+{
+    if (count == 0 || count > BENCH_MAX_NODES)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    const char* port = getenv("DISFS_BENCH_PORT");
+    *cluster = (bench_cluster_t){
+        .nodes = calloc(count, sizeof(*cluster->nodes)),
+        .base_port = (uint16_t)(port ? atoi(port) : BENCH_BASE_PORT),
+    };
+    if (cluster->nodes == NULL)
+    {
+        return DISFS_ERR_ALLOC;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        connection_t* node = &cluster->nodes[i];
+        connection_register_handler(node, BENCH_MSG_SINK, bench_sink, NULL);
+        if (setup)
+        {
+            setup(ctx, i, node);
+        }
+        /* port below base has no listener */
+        err_t ret = create_connection(
+            node, .port_tcp = bench_tcp_port(cluster, i),
+            .port_udp = cluster->base_port + (int32_t)i,
+            .discovery_ip = "127.0.0.1",
+            .discovery_port = discovery ? cluster->base_port
+                                        : cluster->base_port - 1,
+            .discovery_ports = discovery ? count : 1,
+            .discovery_interval_ms = discovery_interval_ms,
+            .probe_interval_ms = discovery_interval_ms);
+        if (ret != DISFS_SUCCESS)
+        {
+            LOG_ERROR("Cannot start bench node %u\n", i);
+            bench_cluster_stop(cluster);
+            return ret;
+        }
+        cluster->count++;
+    }
+    return DISFS_SUCCESS;
+}
+
+void bench_cluster_stop(bench_cluster_t cluster[static 1])
+{
+    /* all nodes wind down together instead of one wait per node */
+    for (uint32_t i = 0; i < cluster->count; i++)
+    {
+        cluster->nodes[i].tcp_th_run = 0;
+        cluster->nodes[i].udp_th_run = 0;
+    }
+    for (uint32_t i = 0; i < cluster->count; i++)
+    {
+        close_connection(&cluster->nodes[i]);
+    }
+    free(cluster->nodes);
+    cluster->nodes = NULL;
+    cluster->count = 0;
+}
+
+uint16_t bench_tcp_port(const bench_cluster_t cluster[static 1],
+                        uint32_t node)
+{
+    return (uint16_t)(cluster->base_port + BENCH_TCP_OFFSET + node);
+}
+
+uint64_t bench_cluster_counter(bench_cluster_t cluster[static 1],
+                               uint32_t counter)
+{
+    metrics_shard_t* total = malloc(sizeof(*total));
+    if (total == NULL)
+    {
+        return 0;
+    }
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < cluster->count; i++)
+    {
+        metrics_collect(&cluster->nodes[i].metrics, total);
+        sum += total->counters[counter];
+    }
+    free(total);
+    return sum;
+}
+
+int32_t bench_client_connect(uint16_t port)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    int32_t fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("Cannot create bench client socket: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return -1;
+    }
+    int32_t opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    /* reset on close, so connection churn leaves no TIME_WAIT sockets */
+    struct linger linger = {.l_onoff = 1, .l_linger = 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        LOG_ERROR("Cannot connect bench client to port %u: errno=%d : %s\n",
+                  port, errno, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static err_t bench_io(int32_t fd, uint8_t* data, uint64_t length,
+                      int32_t write_data)
+{
+    uint64_t done = 0;
+    while (done < length)
+    {
+        ssize_t n = write_data ? send(fd, data + done, length - done,
+                                      MSG_NOSIGNAL)
+                               : recv(fd, data + done, length - done, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return DISFS_ERR_SOCK;
+        }
+        done += (uint64_t)n;
+    }
+    return DISFS_SUCCESS;
+}
+
+err_t bench_client_send(int32_t fd, uint16_t type, uint64_t request_id,
+                        const void* payload, uint32_t length)
+{
+    uint8_t header[PROTO_HEADER_SIZE];
+    proto_header_t h = {.version = PROTO_VERSION,
+                        .type = type,
+                        .length = length,
+                        .request_id = request_id};
+    proto_header_encode(&h, header);
+    uint8_t trailer[PROTO_TRAILER_SIZE];
+    proto_put_u32(trailer, crc32c(crc32c(0, header, sizeof(header)), payload,
+                                  length));
+    /* header, payload and trailer leave in one segment */
+    int32_t more = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &more, sizeof(more));
+    err_t ret = bench_io(fd, header, sizeof(header), 1);
+    if (ret == DISFS_SUCCESS && length > 0)
+    {
+        ret = bench_io(fd, (uint8_t*)(uintptr_t)payload, length, 1);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = bench_io(fd, trailer, sizeof(trailer), 1);
+    }
+    more = 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &more, sizeof(more));
+    return ret;
+}
+
+err_t bench_client_recv(int32_t fd, proto_header_t header[static 1],
+                        uint8_t* payload, uint32_t capacity)
+{
+    uint8_t raw[PROTO_HEADER_SIZE];
+    err_t ret = bench_io(fd, raw, sizeof(raw), 0);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    ret = proto_header_decode(header, raw);
+    if (ret != DISFS_SUCCESS || header->length > capacity)
+    {
+        return DISFS_ERR_PROTO;
+    }
+    uint8_t trailer[PROTO_TRAILER_SIZE];
+    ret = bench_io(fd, payload, header->length, 0);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = bench_io(fd, trailer, sizeof(trailer), 0);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    checksum_t sum;
+    checksum_init(&sum, proto_checksum_kind(header->flags));
+    checksum_update(&sum, raw, sizeof(raw));
+    checksum_update(&sum, payload, header->length);
+    return checksum_final(&sum) == proto_get_u32(trailer) ? DISFS_SUCCESS
+                                                          : DISFS_ERR_CORRUPT;
+}
+
+FILE* bench_output(int argc, char* argv[])
+{
+    if (argc < 2 || strcmp(argv[1], "-") == 0)
+    {
+        return stdout;
+    }
+    FILE* out = fopen(argv[1], "w");
+    if (out == NULL)
+    {
+        LOG_ERROR("Cannot open bench output %s: errno=%d : %s\n", argv[1],
+                  errno, strerror(errno));
+    }
+    return out;
+}
+
+void bench_print_histogram(FILE* out, const char* name,
+                           const metrics_histogram_t histogram[static 1])
+{
+    fprintf(out,
+            "\"%s\": {\"count\": %lu, \"mean\": %lu, \"p50\": %lu, "
+            "\"p90\": %lu, \"p99\": %lu, \"p999\": %lu, \"max\": %lu}",
+            name, histogram->count,
+            histogram->count ? histogram->sum / histogram->count : 0,
+            metrics_quantile(histogram, 0.5), metrics_quantile(histogram, 0.9),
+            metrics_quantile(histogram, 0.99),
+            metrics_quantile(histogram, 0.999), histogram->max);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_BENCH_H_
+#define DISFS_BENCH_H_
+
+#include "connection.h"
+#include "err_codes.h"
+#include "metrics.h"
+#include "protocol.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* first port of nodes, overridden by DISFS_BENCH_PORT environment variable */
+#define BENCH_BASE_PORT 21000
+/* tcp ports follow block of udp ports */
+#define BENCH_TCP_OFFSET 1000
+#define BENCH_MAX_NODES 64
+/* frame type consumed and ignored by bench nodes */
+#define BENCH_MSG_SINK (PROTO_MSG_MAX - 1)
+
+/**
+ * @brief nodes of one process, node i uses udp port base + i and tcp port
+ *        base + BENCH_TCP_OFFSET + i on loopback
+ */
+typedef struct bench_cluster_t
+{
+    connection_t* nodes;
+    uint32_t count;
+    uint16_t base_port;
+    char _padded[2];
+} bench_cluster_t;
+
+/**
+ * @brief registers handlers of node before it is started
+ */
+typedef void (*bench_setup_fn)(void* ctx, uint32_t node,
+                               connection_t conn[static 1]);
+
+/**
+ * @brief start count nodes, with discovery nodes announce themselves to udp
+ *        ports of each other every discovery_interval_ms, otherwise their
+ *        announcements go to unused port, membership protocol period is
+ *        discovery_interval_ms as well
+ */
+err_t bench_cluster_start(bench_cluster_t cluster[static 1], uint32_t count,
+                          int32_t discovery, uint32_t discovery_interval_ms);
+
+/**
+ * @brief as bench_cluster_start, setup is called for every node first
+ */
+err_t bench_cluster_start_setup(bench_cluster_t cluster[static 1],
+                                uint32_t count, int32_t discovery,
+                                uint32_t discovery_interval_ms,
+                                bench_setup_fn setup, void* ctx);
+void bench_cluster_stop(bench_cluster_t cluster[static 1]);
+
+uint16_t bench_tcp_port(const bench_cluster_t cluster[static 1],
+                        uint32_t node);
+
+/**
+ * @brief sum of counter over metrics of all nodes
+ */
+uint64_t bench_cluster_counter(bench_cluster_t cluster[static 1],
+                               uint32_t counter);
+
+/**
+ * @brief blocking client socket connected to node on loopback
+ */
+int32_t bench_client_connect(uint16_t port);
+err_t bench_client_send(int32_t fd, uint16_t type, uint64_t request_id,
+                        const void* payload, uint32_t length);
+
+/**
+ * @brief read one frame and check its trailer, payload longer than capacity is
+ *        an error
+ */
+err_t bench_client_recv(int32_t fd, proto_header_t header[static 1],
+                        uint8_t* payload, uint32_t capacity);
+
+/**
+ * @brief open JSON output, path NULL or "-" means stdout
+ */
+FILE* bench_output(int argc, char* argv[]);
+
+void bench_print_histogram(FILE* out, const char* name,
+                           const metrics_histogram_t histogram[static 1]);
+
+#endif
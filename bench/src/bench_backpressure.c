@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "buf_pool.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* pings of slow peer, their pongs are not read until fast peer is done */
+#define SLOW_REQUESTS 2048
+#define SLOW_PAYLOAD (64 * 1024)
+#define FAST_ROUND_TRIPS 5000
+#define FAST_PAYLOAD 64
+/* time for slow peer to fill its queue on node */
+#define STALL_MS 300
+
+typedef struct slow_peer_t
+{
+    pthread_t th;
+    int32_t fd;
+    uint32_t failed;
+} slow_peer_t;
+
+static void* slow_sender(void* arg);
+
+static void* slow_sender(void* arg)
+{
+    slow_peer_t* peer = arg;
+    uint8_t* payload = calloc(1, SLOW_PAYLOAD);
+    for (uint32_t i = 0; payload && i < SLOW_REQUESTS; i++)
+    {
+        if (bench_client_send(peer->fd, PROTO_MSG_PING, i, payload,
+                              SLOW_PAYLOAD) != DISFS_SUCCESS)
+        {
+            peer->failed = 1;
+            break;
+        }
+    }
+    peer->failed |= payload == NULL;
+    free(payload);
+    return NULL;
+}
+
+/* round trips of fast peer sharing reactor with stalled slow peer */
+static uint32_t fast_peer(uint16_t port, metrics_shard_t shard[static 1])
+{
+    int32_t fd = bench_client_connect(port);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    uint8_t ping[FAST_PAYLOAD] = {};
+    uint8_t pong[FAST_PAYLOAD];
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < FAST_ROUND_TRIPS && !failed; i++)
+    {
+        proto_header_t header;
+        uint64_t start = metrics_now_ns();
+        failed = bench_client_send(fd, PROTO_MSG_PING, i, ping,
+                                   sizeof(ping)) != DISFS_SUCCESS ||
+                 bench_client_recv(fd, &header, pong, sizeof(pong)) !=
+                     DISFS_SUCCESS ||
+                 header.request_id != i;
+        metrics_record(shard, METRIC_PEER_RTT_NS, metrics_now_ns() - start);
+    }
+    close(fd);
+    return failed;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    metrics_shard_t* total = malloc(sizeof(*total));
+    uint8_t* pong = malloc(SLOW_PAYLOAD);
+    bench_cluster_t cluster;
+    if (out == NULL || total == NULL || pong == NULL ||
+        bench_cluster_start(&cluster, 1, 0, 1000) != DISFS_SUCCESS)
+    {
+        return 1;
+    }
+    uint16_t port = bench_tcp_port(&cluster, 0);
+    slow_peer_t slow = {.fd = bench_client_connect(port)};
+    if (slow.fd < 0)
+    {
+        return 1;
+    }
+    pthread_create(&slow.th, NULL, slow_sender, &slow);
+    usleep(STALL_MS * 1000);
+
+    metrics_t latency;
+    metrics_init(&latency);
+    uint32_t failed = fast_peer(port, metrics_shard(&latency));
+    buf_pool_stats_t stats;
+    buf_pool_stats(&stats);
+
+    /* slow peer catches up, every pong must arrive in order */
+    uint32_t replies = 0;
+    for (; replies < SLOW_REQUESTS; replies++)
+    {
+        proto_header_t header;
+        if (bench_client_recv(slow.fd, &header, pong, SLOW_PAYLOAD) !=
+                DISFS_SUCCESS ||
+            header.request_id != replies)
+        {
+            break;
+        }
+    }
+    pthread_join(slow.th, NULL);
+    close(slow.fd);
+
+    metrics_collect(&latency, total);
+    fprintf(out,
+            "{\"bench\": \"backpressure\", \"slow_requests\": %u, "
+            "\"slow_payload\": %u, \"slow_replies\": %u, "
+            "\"throttled\": %lu, \"pool_bytes\": %lu, "
+            "\"failed_clients\": %u, ",
+            SLOW_REQUESTS, SLOW_PAYLOAD, replies,
+            bench_cluster_counter(&cluster, METRIC_TX_THROTTLED),
+            stats.slab_bytes, failed + slow.failed);
+    bench_print_histogram(out, "fast_rtt_ns",
+                          &total->histograms[METRIC_PEER_RTT_NS]);
+    fprintf(out, "}\n");
+    metrics_destroy(&latency);
+    bench_cluster_stop(&cluster);
+    free(total);
+    free(pong);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
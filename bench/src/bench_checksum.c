@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "checksum.h"
+#include <stdlib.h>
+
+#define DATA_SIZE (64 * 1024 * 1024)
+#define BYTES_PER_SIZE (1024ULL * 1024 * 1024)
+
+/* small frames, chunk sized reads and whole files */
+static const uint32_t sizes[] = {64, 4096, 65536, DATA_SIZE};
+
+static double run_crc32c(const uint8_t* data, uint32_t size)
+{
+    uint64_t rounds = BYTES_PER_SIZE / size;
+    uint32_t crc = 0;
+    uint64_t start = metrics_now_ns();
+    for (uint64_t i = 0; i < rounds; i++)
+    {
+        crc = crc32c(crc, data, size);
+    }
+    uint64_t elapsed = metrics_now_ns() - start;
+    /* keep result alive */
+    __asm__ volatile("" : : "r"(crc));
+    return (double)(rounds * size) / (double)(elapsed ? elapsed : 1);
+}
+
+static double run_xxh32(const uint8_t* data, uint32_t size)
+{
+    uint64_t rounds = BYTES_PER_SIZE / size;
+    uint32_t hash = 0;
+    uint64_t start = metrics_now_ns();
+    for (uint64_t i = 0; i < rounds; i++)
+    {
+        hash ^= xxh32(data, size, 0);
+    }
+    uint64_t elapsed = metrics_now_ns() - start;
+    __asm__ volatile("" : : "r"(hash));
+    return (double)(rounds * size) / (double)(elapsed ? elapsed : 1);
+}
+
+static void print_sizes(FILE* out, const char* name, const uint8_t* data,
+                        double (*run)(const uint8_t*, uint32_t))
+{
+    fprintf(out, "\"%s\": {", name);
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        fprintf(out, "%s\"%u\": %.2f", i ? ", " : "", sizes[i],
+                run(data, sizes[i]));
+    }
+    fprintf(out, "}");
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    uint8_t* data = malloc(DATA_SIZE);
+    if (out == NULL || data == NULL)
+    {
+        return 1;
+    }
+    for (uint32_t i = 0; i < DATA_SIZE; i++)
+    {
+        data[i] = (uint8_t)(i * 131 + (i >> 11));
+    }
+
+    /* GB/s on one core for each buffer size */
+    fprintf(out, "{\"bench\": \"checksum\", \"crc32c\": {");
+    const char* separator = "";
+    for (int32_t impl = CHECKSUM_IMPL_SCALAR; impl < CHECKSUM_IMPL_MAX; impl++)
+    {
+        if (checksum_select_impl(impl) != DISFS_SUCCESS)
+        {
+            continue;
+        }
+        fprintf(out, "%s", separator);
+        print_sizes(out, checksum_impl_name(impl), data, run_crc32c);
+        separator = ", ";
+    }
+    checksum_select_impl(CHECKSUM_IMPL_AUTO);
+    fprintf(out, "}, ");
+    print_sizes(out, "xxh32", data, run_xxh32);
+    fprintf(out, "}\n");
+
+    free(data);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DATA_SIZE (16 * 1024 * 1024)
+#define FRAME_SIZE (64 * 1024)
+#define ROUNDS 8
+
+static const char* const words[] = {"chunk ", "replica ", "metadata ",
+                                    "inode ",  "peer ",    "\n",
+                                    "frame ",  "ring ",    "directory "};
+
+/* MB/s of compressing and decompressing data in frame sized blocks */
+static void run(FILE* out, const char* name, const uint8_t* data)
+{
+    uint8_t* packed = malloc(DATA_SIZE / FRAME_SIZE * (FRAME_SIZE + 512));
+    uint8_t* restored = malloc(FRAME_SIZE);
+    uint64_t sizes[DATA_SIZE / FRAME_SIZE];
+    uint64_t wire = 0;
+    uint64_t start = metrics_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        wire = 0;
+        for (uint32_t i = 0; i < DATA_SIZE / FRAME_SIZE; i++)
+        {
+            sizes[i] = compress_lz(data + (uint64_t)i * FRAME_SIZE, FRAME_SIZE,
+                                   packed + wire, FRAME_SIZE);
+            wire += sizes[i] ? sizes[i] : FRAME_SIZE;
+        }
+    }
+    uint64_t compress_ns = metrics_now_ns() - start;
+
+    /* frames sent uncompressed cost nothing on receiver */
+    uint64_t decoded = 0;
+    start = metrics_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        uint64_t offset = 0;
+        for (uint32_t i = 0; i < DATA_SIZE / FRAME_SIZE; i++)
+        {
+            if (sizes[i] == 0)
+            {
+                offset += FRAME_SIZE;
+                continue;
+            }
+            decompress_lz(packed + offset, sizes[i], restored, FRAME_SIZE);
+            offset += sizes[i];
+            decoded += FRAME_SIZE;
+        }
+    }
+    uint64_t decompress_ns = metrics_now_ns() - start;
+
+    double total = (double)DATA_SIZE * ROUNDS * 1000.0;
+    if (decompress_ns == 0)
+    {
+        decompress_ns = 1;
+    }
+    fprintf(out,
+            "\"%s\": {\"ratio\": %.3f, \"compress_mb_s\": %.1f, "
+            "\"decompress_mb_s\": %.1f, \"worthwhile\": %d}",
+            name, (double)wire / DATA_SIZE,
+            total / (double)(compress_ns ? compress_ns : 1),
+            (double)decoded * 1000.0 / (double)decompress_ns,
+            compress_worthwhile(data, DATA_SIZE));
+    free(packed);
+    free(restored);
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    uint8_t* text = malloc(DATA_SIZE);
+    uint8_t* noise = malloc(DATA_SIZE);
+    if (out == NULL || text == NULL || noise == NULL)
+    {
+        return 1;
+    }
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t used = 0; used < DATA_SIZE;)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        const char* word = words[(rng >> 33) % 9];
+        uint32_t length = (uint32_t)strlen(word);
+        length = length > DATA_SIZE - used ? DATA_SIZE - used : length;
+        memcpy(text + used, word, length);
+        used += length;
+    }
+    for (uint32_t i = 0; i < DATA_SIZE; i++)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        noise[i] = (uint8_t)(rng >> 56);
+    }
+
+    /* incompressible data shows cost of failed attempt the adaptive switch
+       avoids */
+    fprintf(out, "{\"bench\": \"compress\", ");
+    run(out, "text", text);
+    fprintf(out, ", ");
+    run(out, "random", noise);
+    fprintf(out, "}\n");
+
+    free(text);
+    free(noise);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
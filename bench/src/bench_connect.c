@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* connections opened and closed by client of every node */
+#define CONNECTIONS 2000
+
+typedef struct connect_client_t
+{
+    pthread_t th;
+    uint16_t port;
+    char _padded[2];
+    uint32_t failed;
+} connect_client_t;
+
+static void* connect_thread(void* arg);
+
+static void* connect_thread(void* arg)
+{
+    connect_client_t* client = arg;
+    for (uint32_t i = 0; i < CONNECTIONS; i++)
+    {
+        /* connection is set up once node answers on it */
+        int32_t fd = bench_client_connect(client->port);
+        proto_header_t header;
+        uint8_t payload[8];
+        if (fd < 0 ||
+            bench_client_send(fd, PROTO_MSG_PING, i, NULL, 0) !=
+                DISFS_SUCCESS ||
+            bench_client_recv(fd, &header, payload, sizeof(payload)) !=
+                DISFS_SUCCESS)
+        {
+            client->failed++;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    if (out == NULL)
+    {
+        return 1;
+    }
+    fprintf(out, "{\"bench\": \"connect\", \"connections_per_node\": %u, "
+                 "\"results\": [",
+            CONNECTIONS);
+    const uint32_t sizes[] = {1, 2, 4, 8};
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        uint32_t count = sizes[s];
+        bench_cluster_t cluster;
+        if (bench_cluster_start(&cluster, count, 0, 1000) != DISFS_SUCCESS)
+        {
+            return 1;
+        }
+        connect_client_t clients[BENCH_MAX_NODES] = {};
+        uint64_t start = metrics_now_ns();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            clients[i].port = bench_tcp_port(&cluster, i);
+            pthread_create(&clients[i].th, NULL, connect_thread, &clients[i]);
+        }
+        uint32_t failed = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            pthread_join(clients[i].th, NULL);
+            failed += clients[i].failed;
+        }
+        uint64_t accepted = bench_cluster_counter(&cluster, METRIC_ACCEPTS);
+        double seconds = (double)(metrics_now_ns() - start) / 1e9;
+        uint64_t done = (uint64_t)count * CONNECTIONS - failed;
+        fprintf(out,
+                "%s{\"nodes\": %u, \"accepted\": %lu, \"failed\": %u, "
+                "\"seconds\": %.6f, \"connections_per_sec\": %.1f}",
+                s ? ", " : "", count, accepted, failed, seconds,
+                (double)done / seconds);
+        bench_cluster_stop(&cluster);
+    }
+    fprintf(out, "]}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
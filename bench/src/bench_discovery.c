@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "connection.h"
+#include "metrics.h"
+#include <time.h>
+
+#define ANNOUNCE_INTERVAL_MS 50
+#define CONVERGE_TIMEOUT_MS 30000
+#define DETECT_TIMEOUT_MS 30000
+#define POLL_MS 1
+
+static void nap(void);
+static uint64_t detect_failure(bench_cluster_t cluster[static 1]);
+
+static void nap(void)
+{
+    struct timespec ts = {.tv_nsec = POLL_MS * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+/* stops last node, returns ns until every other node declares it dead */
+static uint64_t detect_failure(bench_cluster_t cluster[static 1])
+{
+    uint32_t count = cluster->count;
+    close_connection(&cluster->nodes[count - 1]);
+    cluster->count--;
+    uint64_t start = metrics_now_ns();
+    uint64_t deadline = start + DETECT_TIMEOUT_MS * 1000000ULL;
+    while (metrics_now_ns() < deadline)
+    {
+        uint32_t detected = 0;
+        for (uint32_t i = 0; i < count - 1; i++)
+        {
+            detected += membership_live_count(
+                            &cluster->nodes[i].membership) == count - 2;
+        }
+        if (detected == count - 1)
+        {
+            return metrics_now_ns() - start;
+        }
+        nap();
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    if (out == NULL)
+    {
+        return 1;
+    }
+    fprintf(out,
+            "{\"bench\": \"discovery\", \"announce_interval_ms\": %u, "
+            "\"probe_interval_ms\": %u, \"results\": [",
+            ANNOUNCE_INTERVAL_MS, ANNOUNCE_INTERVAL_MS);
+    const uint32_t sizes[] = {2, 4, 8, 16, 32};
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        uint32_t count = sizes[s];
+        bench_cluster_t cluster;
+        uint64_t start = metrics_now_ns();
+        if (bench_cluster_start(&cluster, count, 1, ANNOUNCE_INTERVAL_MS) !=
+            DISFS_SUCCESS)
+        {
+            return 1;
+        }
+        /* converged when every node has connection to every other node */
+        uint64_t deadline = start + CONVERGE_TIMEOUT_MS * 1000000ULL;
+        uint64_t first_full = 0;
+        uint32_t converged = 0;
+        while (converged < count && metrics_now_ns() < deadline)
+        {
+            converged = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (connection_established_count(&cluster.nodes[i]) ==
+                    count - 1)
+                {
+                    converged++;
+                }
+            }
+            if (converged > 0 && first_full == 0)
+            {
+                first_full = metrics_now_ns();
+            }
+            nap();
+        }
+        uint64_t end = metrics_now_ns();
+        uint64_t detect_ns = converged == count ? detect_failure(&cluster) : 0;
+        fprintf(out,
+                "%s{\"nodes\": %u, \"converged_nodes\": %u, "
+                "\"first_node_ms\": %.3f, \"all_nodes_ms\": %.3f, "
+                "\"failure_detected_ms\": %.3f}",
+                s ? ", " : "", count, converged,
+                first_full ? (double)(first_full - start) / 1e6 : -1.0,
+                converged == count ? (double)(end - start) / 1e6 : -1.0,
+                detect_ns ? (double)detect_ns / 1e6 : -1.0);
+        bench_cluster_stop(&cluster);
+    }
+    fprintf(out, "]}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "erasure.h"
+#include <stdlib.h>
+
+#define DATA_SHARDS 10
+#define PARITY_SHARDS 4
+#define FRAGMENT_SIZE (1024 * 1024)
+#define ROUNDS 20
+
+typedef struct kernel_result_t
+{
+    double encode_gbps; /* bytes of data encoded per second on one core */
+    double decode_gbps; /* bytes of stripe restored after losing 4 */
+} kernel_result_t;
+
+static kernel_result_t run_kernel(const erasure_t code[static 1],
+                                  uint8_t* shards[static 1])
+{
+    uint64_t start = metrics_now_ns();
+    for (uint32_t i = 0; i < ROUNDS; i++)
+    {
+        erasure_encode(code, (const uint8_t* const*)shards,
+                       shards + DATA_SHARDS, FRAGMENT_SIZE);
+    }
+    uint64_t encode_ns = metrics_now_ns() - start;
+
+    /* two data and two parity fragments lost */
+    const uint32_t erased = 0x3003;
+    start = metrics_now_ns();
+    for (uint32_t i = 0; i < ROUNDS; i++)
+    {
+        erasure_decode(code, shards, erased, FRAGMENT_SIZE);
+    }
+    uint64_t decode_ns = metrics_now_ns() - start;
+
+    double bytes = (double)ROUNDS * DATA_SHARDS * FRAGMENT_SIZE;
+    return (kernel_result_t){
+        .encode_gbps = bytes / (double)(encode_ns ? encode_ns : 1),
+        .decode_gbps = bytes / (double)(decode_ns ? decode_ns : 1),
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    erasure_t code;
+    uint8_t* shards[DATA_SHARDS + PARITY_SHARDS] = {};
+    if (out == NULL ||
+        erasure_init(&code, DATA_SHARDS, PARITY_SHARDS) != DISFS_SUCCESS)
+    {
+        return 1;
+    }
+    for (uint32_t i = 0; i < DATA_SHARDS + PARITY_SHARDS; i++)
+    {
+        shards[i] = malloc(FRAGMENT_SIZE);
+        if (shards[i] == NULL)
+        {
+            return 1;
+        }
+        for (uint32_t j = 0; j < FRAGMENT_SIZE; j++)
+        {
+            shards[i][j] = (uint8_t)(j * 31 + i);
+        }
+    }
+
+    fprintf(out,
+            "{\"bench\": \"erasure\", \"data_shards\": %u, "
+            "\"parity_shards\": %u, \"fragment_size\": %u, \"kernels\": {",
+            DATA_SHARDS, PARITY_SHARDS, FRAGMENT_SIZE);
+    const char* separator = "";
+    for (int32_t kernel = ERASURE_KERNEL_SCALAR; kernel < ERASURE_KERNEL_MAX;
+         kernel++)
+    {
+        if (erasure_select_kernel(kernel) != DISFS_SUCCESS)
+        {
+            continue;
+        }
+        kernel_result_t result = run_kernel(&code, shards);
+        fprintf(out,
+                "%s\"%s\": {\"encode_gbps\": %.2f, \"decode_gbps\": %.2f}",
+                separator, erasure_kernel_name(kernel), result.encode_gbps,
+                result.decode_gbps);
+        separator = ", ";
+    }
+    fprintf(out, "}}\n");
+
+    for (uint32_t i = 0; i < DATA_SHARDS + PARITY_SHARDS; i++)
+    {
+        free(shards[i]);
+    }
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "chunk_store.h"
+#include "metrics.h"
+#include "read_plan.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+/* node 0 reads, every other node holds replica of every chunk */
+#define NODES 4
+#define FILE_CHUNKS 64
+#define READS 200
+#define WARMUP 10
+/* every n-th request of last node waits, as on disk with stalls */
+#define SLOW_EVERY 16
+#define SLOW_MS 20
+
+typedef struct read_bench_t
+{
+    chunk_store_t stores[NODES];
+    char dirs[NODES][32];
+    chunk_hash_t hashes[FILE_CHUNKS];
+    connection_handler_t store_get; /* wrapped by slow_get */
+    uint32_t slow_requests;
+    char _padded[4];
+    err_t ret;
+} read_bench_t;
+
+typedef struct read_mode_t
+{
+    const char* name;
+    uint32_t window;
+    int32_t disable_hedging;
+} read_mode_t;
+
+static void setup(void* ctx, uint32_t node, connection_t conn[static 1]);
+static err_t slow_get(void* ctx, client_t client[static 1],
+                      const proto_frame_t frame[static 1]);
+static err_t count_sink(void* ctx, uint32_t index, const void* data,
+                        uint32_t length);
+
+static void setup(void* ctx, uint32_t node, connection_t conn[static 1])
+{
+    read_bench_t* bench = ctx;
+    if (node == 0)
+    {
+        return;
+    }
+    snprintf(bench->dirs[node], sizeof(bench->dirs[node]),
+             "/tmp/disfs_read_XXXXXX");
+    if (mkdtemp(bench->dirs[node]) == NULL ||
+        chunk_store_open(&bench->stores[node], bench->dirs[node]) !=
+            DISFS_SUCCESS)
+    {
+        bench->ret = DISFS_ERR_IO;
+        return;
+    }
+    /* random content, so chunks go out with sendfile as they would */
+    uint8_t data[CHUNK_MAX_SIZE];
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = 0; i < FILE_CHUNKS; i++)
+    {
+        for (uint32_t j = 0; j < CHUNK_MAX_SIZE; j++)
+        {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            data[j] = (uint8_t)(rng >> 56);
+        }
+        chunk_store_put(&bench->stores[node], data, CHUNK_MAX_SIZE,
+                        &bench->hashes[i]);
+    }
+    chunk_store_attach(&bench->stores[node], conn);
+    if (node == NODES - 1)
+    {
+        bench->store_get = conn->handlers[PROTO_MSG_CHUNK_GET];
+        connection_register_handler(conn, PROTO_MSG_CHUNK_GET, slow_get,
+                                    bench);
+    }
+}
+
+/* stall blocks whole reactor of node, as synchronous read of slow disk does */
+static err_t slow_get(void* ctx, client_t client[static 1],
+                      const proto_frame_t frame[static 1])
+{
+    read_bench_t* bench = ctx;
+    if (++bench->slow_requests % SLOW_EVERY == 0)
+    {
+        usleep(SLOW_MS * 1000);
+    }
+    return bench->store_get.fn(bench->store_get.ctx, client, frame);
+}
+
+static err_t count_sink(void* ctx, uint32_t index, const void* data,
+                        uint32_t length)
+{
+    (void)index;
+    (void)data;
+    *(uint64_t*)ctx += length;
+    return DISFS_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    read_bench_t* bench = calloc(1, sizeof(*bench));
+    metrics_shard_t* total = malloc(sizeof(*total));
+    bench_cluster_t cluster;
+    if (out == NULL || bench == NULL || total == NULL ||
+        bench_cluster_start_setup(&cluster, NODES, 1, 100, setup, bench) !=
+            DISFS_SUCCESS ||
+        bench->ret != DISFS_SUCCESS)
+    {
+        return 1;
+    }
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        if (connection_established_count(&cluster.nodes[0]) == NODES - 1)
+        {
+            break;
+        }
+        usleep(50000);
+    }
+
+    /* one by one, striped over replicas, striped with hedged requests */
+    const read_mode_t modes[] = {
+        {"sequential", 1, 1},
+        {"striped", 32, 1},
+        {"hedged", 32, 0},
+    };
+    fprintf(out,
+            "{\"bench\": \"read\", \"replicas\": %u, \"file_bytes\": %u, "
+            "\"slow_every\": %u, \"slow_ms\": %u, \"results\": [",
+            NODES - 1, FILE_CHUNKS * CHUNK_MAX_SIZE, SLOW_EVERY, SLOW_MS);
+    for (uint32_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        read_plan_t plan;
+        metrics_t latency;
+        metrics_init(&latency);
+        metrics_shard_t* shard = metrics_shard(&latency);
+        read_plan_init(&plan, &cluster.nodes[0], .window = modes[m].window,
+                       .replicas = NODES,
+                       .disable_hedging = modes[m].disable_hedging);
+        uint64_t bytes = 0;
+        uint32_t failed = 0;
+        uint64_t start = 0;
+        for (uint32_t i = 0; i < WARMUP + READS; i++)
+        {
+            if (i == WARMUP)
+            {
+                bytes = 0;
+                start = metrics_now_ns();
+            }
+            uint64_t read_start = metrics_now_ns();
+            failed += read_plan_read(&plan, bench->hashes, FILE_CHUNKS,
+                                     count_sink, &bytes) != DISFS_SUCCESS;
+            if (i >= WARMUP)
+            {
+                metrics_record(shard, METRIC_LOOP_NS,
+                               metrics_now_ns() - read_start);
+            }
+        }
+        double seconds = (double)(metrics_now_ns() - start) / 1e9;
+        read_plan_stats_t stats;
+        read_plan_stats(&plan, &stats);
+        metrics_collect(&latency, total);
+        fprintf(out, "%s{\"mode\": \"%s\", \"window\": %u, \"failed\": %u, ",
+                m ? ", " : "", modes[m].name, modes[m].window, failed);
+        bench_print_histogram(out, "read_ns",
+                              &total->histograms[METRIC_LOOP_NS]);
+        fprintf(out,
+                ", \"mib_per_sec\": %.1f, \"requests\": %lu, \"hedges\": %lu, "
+                "\"hedge_wins\": %lu}",
+                (double)bytes / seconds / (1024.0 * 1024.0), stats.requests,
+                stats.hedges, stats.hedge_wins);
+        read_plan_destroy(&plan);
+        metrics_destroy(&latency);
+    }
+    fprintf(out, "]}\n");
+
+    bench_cluster_stop(&cluster);
+    for (uint32_t i = 1; i < NODES; i++)
+    {
+        char cmd[64];
+        chunk_store_close(&bench->stores[i]);
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", bench->dirs[i]);
+        if (system(cmd) != 0)
+        {
+            return 1;
+        }
+    }
+    free(bench);
+    free(total);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
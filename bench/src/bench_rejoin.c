@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "connection.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NODES 8
+/* default of connection, so restart without cache waits as in deployment */
+#define ANNOUNCE_INTERVAL_MS 1000
+#define CONVERGE_TIMEOUT_MS 30000
+#define POLL_MS 1
+
+static void nap(void);
+static int32_t wait_peers(connection_t conn[static 1], uint32_t peers);
+static double restart(bench_cluster_t cluster[static 1], const char* cache);
+
+static void nap(void)
+{
+    struct timespec ts = {.tv_nsec = POLL_MS * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+static int32_t wait_peers(connection_t conn[static 1], uint32_t peers)
+{
+    uint64_t deadline = metrics_now_ns() + CONVERGE_TIMEOUT_MS * 1000000ULL;
+    while (connection_established_count(conn) < peers)
+    {
+        if (metrics_now_ns() > deadline)
+        {
+            return 0;
+        }
+        nap();
+    }
+    return 1;
+}
+
+/* stops last node and starts it again, returns ms until it has every peer */
+static double restart(bench_cluster_t cluster[static 1], const char* cache)
+{
+    uint32_t node = cluster->count - 1;
+    connection_t* conn = &cluster->nodes[node];
+    close_connection(conn);
+    memset(conn, 0, sizeof(*conn));
+    uint64_t start = metrics_now_ns();
+    err_t ret = create_connection(
+        conn, .port_tcp = bench_tcp_port(cluster, node),
+        .port_udp = cluster->base_port + (int32_t)node,
+        .discovery_ip = "127.0.0.1", .discovery_port = cluster->base_port,
+        .discovery_ports = cluster->count,
+        .discovery_interval_ms = ANNOUNCE_INTERVAL_MS,
+        .probe_interval_ms = ANNOUNCE_INTERVAL_MS, .peer_cache_path = cache);
+    if (ret != DISFS_SUCCESS)
+    {
+        /* node is gone, it must not be closed by bench_cluster_stop */
+        cluster->count--;
+        return -1.0;
+    }
+    if (!wait_peers(conn, cluster->count - 1))
+    {
+        return -1.0;
+    }
+    return (double)(metrics_now_ns() - start) / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    char cache[32];
+    snprintf(cache, sizeof(cache), "/tmp/disfs_rejoin_XXXXXX");
+    int32_t fd = mkstemp(cache);
+    if (out == NULL || fd < 0)
+    {
+        return 1;
+    }
+    close(fd);
+    unlink(cache);
+
+    bench_cluster_t cluster;
+    if (bench_cluster_start(&cluster, NODES, 1, ANNOUNCE_INTERVAL_MS) !=
+        DISFS_SUCCESS)
+    {
+        return 1;
+    }
+    for (uint32_t i = 0; i < NODES; i++)
+    {
+        if (!wait_peers(&cluster.nodes[i], NODES - 1))
+        {
+            bench_cluster_stop(&cluster);
+            return 1;
+        }
+    }
+    /* first restart finds cache empty and fills it, second one uses it */
+    double cold_ms = restart(&cluster, cache);
+    double warm_ms = cold_ms >= 0 ? restart(&cluster, cache) : -1.0;
+    fprintf(out,
+            "{\"bench\": \"rejoin\", \"nodes\": %u, "
+            "\"announce_interval_ms\": %u, \"without_cache_ms\": %.3f, "
+            "\"with_cache_ms\": %.3f}\n",
+            NODES, ANNOUNCE_INTERVAL_MS, cold_ms, warm_ms);
+    bench_cluster_stop(&cluster);
+    unlink(cache);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return warm_ms >= 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* round trips of client of every node */
+#define ROUND_TRIPS 20000
+#define WARMUP 1000
+#define PAYLOAD_SIZE 64
+
+typedef struct rtt_client_t
+{
+    pthread_t th;
+    metrics_shard_t* shard;
+    uint16_t port;
+    char _padded[2];
+    uint32_t failed;
+} rtt_client_t;
+
+static void* rtt_thread(void* arg);
+
+static void* rtt_thread(void* arg)
+{
+    rtt_client_t* client = arg;
+    int32_t fd = bench_client_connect(client->port);
+    if (fd < 0)
+    {
+        client->failed = 1;
+        return NULL;
+    }
+    uint8_t ping[PAYLOAD_SIZE] = {};
+    uint8_t pong[PAYLOAD_SIZE];
+    for (uint32_t i = 0; i < WARMUP + ROUND_TRIPS; i++)
+    {
+        proto_header_t header;
+        uint64_t start = metrics_now_ns();
+        if (bench_client_send(fd, PROTO_MSG_PING, i, ping, sizeof(ping)) !=
+                DISFS_SUCCESS ||
+            bench_client_recv(fd, &header, pong, sizeof(pong)) !=
+                DISFS_SUCCESS ||
+            header.type != PROTO_MSG_PONG || header.request_id != i)
+        {
+            client->failed = 1;
+            break;
+        }
+        if (i >= WARMUP)
+        {
+            metrics_record(client->shard, METRIC_PEER_RTT_NS,
+                           metrics_now_ns() - start);
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    if (out == NULL)
+    {
+        return 1;
+    }
+    fprintf(out,
+            "{\"bench\": \"rtt\", \"round_trips_per_node\": %u, "
+            "\"payload_bytes\": %u, \"results\": [",
+            ROUND_TRIPS, PAYLOAD_SIZE);
+    const uint32_t sizes[] = {1, 2, 4, 8};
+    metrics_shard_t* total = malloc(sizeof(*total));
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        uint32_t count = sizes[s];
+        bench_cluster_t cluster;
+        if (total == NULL ||
+            bench_cluster_start(&cluster, count, 0, 1000) != DISFS_SUCCESS)
+        {
+            return 1;
+        }
+        metrics_t latency;
+        metrics_init(&latency);
+        rtt_client_t clients[BENCH_MAX_NODES] = {};
+        uint64_t start = metrics_now_ns();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            clients[i].port = bench_tcp_port(&cluster, i);
+            clients[i].shard = metrics_shard(&latency);
+            pthread_create(&clients[i].th, NULL, rtt_thread, &clients[i]);
+        }
+        uint32_t failed = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            pthread_join(clients[i].th, NULL);
+            failed += clients[i].failed;
+        }
+        double seconds = (double)(metrics_now_ns() - start) / 1e9;
+        metrics_collect(&latency, total);
+        const metrics_histogram_t* rtt =
+            &total->histograms[METRIC_PEER_RTT_NS];
+        fprintf(out, "%s{\"nodes\": %u, \"failed_clients\": %u, ",
+                s ? ", " : "", count, failed);
+        bench_print_histogram(out, "rtt_ns", rtt);
+        fprintf(out, ", \"round_trips_per_sec\": %.1f}",
+                (double)rtt->count / seconds);
+        metrics_destroy(&latency);
+        bench_cluster_stop(&cluster);
+    }
+    fprintf(out, "]}\n");
+    free(total);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
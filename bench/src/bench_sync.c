@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "cdc.h"
+#include "chunk_store.h"
+#include "chunk_sync.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DATA_SIZE (64 * 1024 * 1024)
+#define ROUNDS 4
+#define FILE_SIZE (32 * 1024 * 1024)
+#define MAX_HASHES (FILE_SIZE / CDC_MIN_SIZE + 1)
+/* small edits spread over file, every one inserts bytes */
+#define EDITS 8
+#define EDIT_SIZE 100
+
+/* node 0 pushes file to node 1 */
+typedef struct sync_bench_t
+{
+    chunk_store_t stores[2];
+    char dirs[2][32];
+    err_t ret;
+} sync_bench_t;
+
+static void setup(void* ctx, uint32_t node, connection_t conn[static 1]);
+static void chunking(FILE* out, const uint8_t* data);
+static err_t sync_file(FILE* out, const char* name,
+                       bench_cluster_t cluster[static 1],
+                       sync_bench_t bench[static 1], const uint8_t* content,
+                       uint32_t size, chunk_hash_t* hashes);
+
+static void setup(void* ctx, uint32_t node, connection_t conn[static 1])
+{
+    sync_bench_t* bench = ctx;
+    snprintf(bench->dirs[node], sizeof(bench->dirs[node]),
+             "/tmp/disfs_sync_XXXXXX");
+    if (mkdtemp(bench->dirs[node]) == NULL ||
+        chunk_store_open(&bench->stores[node], bench->dirs[node]) !=
+            DISFS_SUCCESS)
+    {
+        bench->ret = DISFS_ERR_IO;
+        return;
+    }
+    chunk_store_attach(&bench->stores[node], conn);
+}
+
+/* GB/s of splitting data, best of rounds */
+static void chunking(FILE* out, const uint8_t* data)
+{
+    const char* names[] = {"cdc_gb_s", "cdc_scalar_gb_s"};
+    uint64_t chunks = 0;
+    for (uint32_t impl = 0; impl < 2; impl++)
+    {
+        uint64_t best = UINT64_MAX;
+        for (uint32_t round = 0; round < ROUNDS; round++)
+        {
+            uint64_t start = metrics_now_ns();
+            chunks = 0;
+            for (uint32_t offset = 0; offset < DATA_SIZE; chunks++)
+            {
+                uint32_t left = DATA_SIZE - offset;
+                offset += impl ? cdc_cut_scalar(data + offset, left)
+                               : cdc_cut(data + offset, left);
+            }
+            uint64_t elapsed = metrics_now_ns() - start;
+            best = elapsed < best ? elapsed : best;
+        }
+        fprintf(out, "\"%s\": %.2f, ", names[impl],
+                (double)DATA_SIZE / (double)(best ? best : 1));
+    }
+    fprintf(out, "\"avg_chunk\": %lu", DATA_SIZE / chunks);
+}
+
+static err_t sync_file(FILE* out, const char* name,
+                       bench_cluster_t cluster[static 1],
+                       sync_bench_t bench[static 1], const uint8_t* content,
+                       uint32_t size, chunk_hash_t* hashes)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/file", bench->dirs[0]);
+    int32_t fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, content, size) != size)
+    {
+        return DISFS_ERR_IO;
+    }
+    lseek(fd, 0, SEEK_SET);
+    uint64_t count = 0;
+    err_t ret = chunk_store_put_file(&bench->stores[0], fd, hashes,
+                                     MAX_HASHES, &count);
+    close(fd);
+    struct sockaddr_in target = {
+        .sin_family = AF_INET,
+        .sin_port = htons(bench_tcp_port(cluster, 1)),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    chunk_sync_stats_t stats = {};
+    uint64_t start = metrics_now_ns();
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = chunk_sync_push(&cluster->nodes[0], &target, &bench->stores[0],
+                              hashes, count, &stats);
+    }
+    uint64_t elapsed = metrics_now_ns() - start;
+    fprintf(out,
+            "\"%s\": {\"chunks\": %lu, \"sent\": %lu, \"sent_bytes\": %lu, "
+            "\"manifest_bytes\": %lu, \"present_bytes\": %lu, "
+            "\"wire_ratio\": %.4f, \"ms\": %.1f}",
+            name, stats.chunks, stats.sent, stats.sent_bytes,
+            stats.manifest_bytes, stats.present_bytes,
+            (double)(stats.sent_bytes + stats.manifest_bytes) / size,
+            (double)elapsed / 1e6);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    uint8_t* data = malloc(DATA_SIZE);
+    uint8_t* edited = malloc(FILE_SIZE + EDITS * EDIT_SIZE);
+    chunk_hash_t* hashes = malloc(MAX_HASHES * sizeof(*hashes));
+    sync_bench_t* bench = calloc(1, sizeof(*bench));
+    if (out == NULL || data == NULL || edited == NULL || hashes == NULL ||
+        bench == NULL)
+    {
+        return 1;
+    }
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = 0; i < DATA_SIZE; i++)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[i] = (uint8_t)(rng >> 56);
+    }
+    /* file after edits, every edit inserts bytes and shifts rest of file */
+    uint32_t size = 0;
+    for (uint32_t i = 0; i < EDITS; i++)
+    {
+        uint32_t piece = FILE_SIZE / EDITS;
+        memcpy(edited + size, data + i * piece, piece / 2);
+        memset(edited + size + piece / 2, 'e', EDIT_SIZE);
+        memcpy(edited + size + piece / 2 + EDIT_SIZE,
+               data + i * piece + piece / 2, piece - piece / 2);
+        size += piece + EDIT_SIZE;
+    }
+
+    fprintf(out, "{\"bench\": \"sync\", ");
+    chunking(out, data);
+
+    bench_cluster_t cluster;
+    if (bench_cluster_start_setup(&cluster, 2, 1, 100, setup, bench) !=
+            DISFS_SUCCESS ||
+        bench->ret != DISFS_SUCCESS)
+    {
+        return 1;
+    }
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        if (connection_established_count(&cluster.nodes[0]) == 1)
+        {
+            break;
+        }
+        usleep(50000);
+    }
+    /* whole file first, then the same file after small edits */
+    fprintf(out, ", ");
+    err_t ret = sync_file(out, "initial", &cluster, bench, data, FILE_SIZE,
+                          hashes);
+    fprintf(out, ", ");
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = sync_file(out, "edited", &cluster, bench, edited, size, hashes);
+    }
+    fprintf(out, "}\n");
+
+    bench_cluster_stop(&cluster);
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        char cmd[64];
+        chunk_store_close(&bench->stores[i]);
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", bench->dirs[i]);
+        if (system(cmd) != 0)
+        {
+            return 1;
+        }
+    }
+    free(bench);
+    free(hashes);
+    free(edited);
+    free(data);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return ret == DISFS_SUCCESS ? 0 : 1;
+}
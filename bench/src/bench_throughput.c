@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bench.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* bytes sent by client of every node */
+#define TRANSFER_SIZE (512ULL * 1024 * 1024)
+#define FRAME_PAYLOAD (64 * 1024)
+
+typedef struct bulk_client_t
+{
+    pthread_t th;
+    uint16_t port;
+    char _padded[2];
+    uint32_t failed;
+} bulk_client_t;
+
+static void* bulk_thread(void* arg);
+
+static void* bulk_thread(void* arg)
+{
+    bulk_client_t* client = arg;
+    uint8_t* payload = calloc(1, FRAME_PAYLOAD);
+    int32_t fd = bench_client_connect(client->port);
+    if (fd < 0 || payload == NULL)
+    {
+        client->failed = 1;
+        free(payload);
+        return NULL;
+    }
+    for (uint64_t sent = 0; sent < TRANSFER_SIZE; sent += FRAME_PAYLOAD)
+    {
+        if (bench_client_send(fd, BENCH_MSG_SINK, 0, payload, FRAME_PAYLOAD) !=
+            DISFS_SUCCESS)
+        {
+            client->failed = 1;
+            break;
+        }
+    }
+    /* frames are handled in order, so pong means node consumed all of them */
+    proto_header_t header;
+    if (client->failed == 0 &&
+        (bench_client_send(fd, PROTO_MSG_PING, 1, NULL, 0) != DISFS_SUCCESS ||
+         bench_client_recv(fd, &header, payload, FRAME_PAYLOAD) !=
+             DISFS_SUCCESS))
+    {
+        client->failed = 1;
+    }
+    close(fd);
+    free(payload);
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out = bench_output(argc, argv);
+    if (out == NULL)
+    {
+        return 1;
+    }
+    fprintf(out,
+            "{\"bench\": \"throughput\", \"bytes_per_node\": %llu, "
+            "\"frame_payload\": %u, \"results\": [",
+            TRANSFER_SIZE, FRAME_PAYLOAD);
+    const uint32_t sizes[] = {1, 2, 4};
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        uint32_t count = sizes[s];
+        bench_cluster_t cluster;
+        if (bench_cluster_start(&cluster, count, 0, 1000) != DISFS_SUCCESS)
+        {
+            return 1;
+        }
+        bulk_client_t clients[BENCH_MAX_NODES] = {};
+        uint64_t start = metrics_now_ns();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            clients[i].port = bench_tcp_port(&cluster, i);
+            pthread_create(&clients[i].th, NULL, bulk_thread, &clients[i]);
+        }
+        uint32_t failed = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            pthread_join(clients[i].th, NULL);
+            failed += clients[i].failed;
+        }
+        double seconds = (double)(metrics_now_ns() - start) / 1e9;
+        uint64_t received = bench_cluster_counter(&cluster, METRIC_BYTES_IN);
+        fprintf(out,
+                "%s{\"nodes\": %u, \"failed_clients\": %u, "
+                "\"bytes_received\": %lu, \"seconds\": %.6f, "
+                "\"mib_per_sec\": %.1f}",
+                s ? ", " : "", count, failed, received, seconds,
+                (double)received / seconds / (1024.0 * 1024.0));
+        bench_cluster_stop(&cluster);
+    }
+    fprintf(out, "]}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
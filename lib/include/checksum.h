@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_CHECKSUM_H_
+#define DISFS_CHECKSUM_H_
+
+#include "err_codes.h"
+#include <stdint.h>
+
+#define CHECKSUM_SIZE 4
+
+typedef enum checksum_kind
+{
+    CHECKSUM_CRC32C = 0, /* Castagnoli, iSCSI and ext4 polynomial */
+    CHECKSUM_XXH32 = 1,  /* seed 0 */
+    CHECKSUM_KIND_MAX = 2,
+} checksum_kind;
+
+typedef enum checksum_impl
+{
+    CHECKSUM_IMPL_AUTO = 0, /* best implementation supported by cpu */
+    CHECKSUM_IMPL_SCALAR = 1,
+    CHECKSUM_IMPL_SSE42 = 2,  /* crc32 instruction, single stream */
+    CHECKSUM_IMPL_PCLMUL = 3, /* three crc32 streams joined by pclmulqdq */
+    CHECKSUM_IMPL_ARMV8 = 4,  /* crc32c instructions, three streams */
+    CHECKSUM_IMPL_MAX = 5,
+} checksum_impl;
+
+typedef struct xxh32_state_t
+{
+    uint64_t total; /* bytes hashed */
+    uint32_t lanes[4];
+    uint32_t seed;
+    uint32_t buffered;
+    uint8_t buffer[16]; /* bytes of incomplete stripe */
+} xxh32_state_t;
+
+/**
+ * @brief running checksum of data which arrives in pieces, result does not
+ *        depend on how data is split
+ */
+typedef struct checksum_t
+{
+    xxh32_state_t xxh;
+    uint32_t crc;
+    uint32_t kind; /* checksum_kind */
+} checksum_t;
+
+/**
+ * @brief pick CRC32C implementation used by all callers,
+ *        DISFS_ERR_INVALID_ARG when cpu does not support it
+ */
+err_t checksum_select_impl(int32_t impl);
+
+/**
+ * @brief implementation in use, selected by cpu detection until
+ *        checksum_select_impl
+ */
+int32_t checksum_active_impl(void);
+const char* checksum_impl_name(int32_t impl);
+
+/**
+ * @brief extend CRC32C of previous data by data, crc of no data is 0
+ */
+uint32_t crc32c(uint32_t crc, const void* data, uint64_t length);
+
+/**
+ * @brief CRC32C of concatenation of data with CRC32C crc1 and data of length2
+ *        bytes with CRC32C crc2, without reading either
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t length2);
+
+void xxh32_init(xxh32_state_t state[static 1], uint32_t seed);
+void xxh32_update(xxh32_state_t state[static 1], const void* data,
+                  uint64_t length);
+uint32_t xxh32_digest(const xxh32_state_t state[static 1]);
+uint32_t xxh32(const void* data, uint64_t length, uint32_t seed);
+
+void checksum_init(checksum_t sum[static 1], uint32_t kind);
+void checksum_update(checksum_t sum[static 1], const void* data,
+                     uint64_t length);
+uint32_t checksum_final(const checksum_t sum[static 1]);
+
+#endif
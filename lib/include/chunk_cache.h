@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_CHUNK_CACHE_H_
+#define DISFS_CHUNK_CACHE_H_
+
+#include "chunk_store.h"
+#include "err_codes.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/* power of two, shard is picked by chunk hash */
+#define CHUNK_CACHE_SHARDS 16
+
+struct buf_t;
+struct chunk_cache_t;
+
+/**
+ * @brief start fetch of missing chunk, it completes with chunk_cache_fill
+ *        called from any thread, possibly before fetch returns
+ *
+ * Fetch is started once for all concurrent readers of the chunk and must
+ * always complete, with error when chunk cannot be fetched.
+ */
+typedef void (*chunk_cache_fetch_fn)(void* ctx, struct chunk_cache_t* cache,
+                                     const chunk_hash_t hash[static 1]);
+
+typedef enum chunk_cache_list
+{
+    CHUNK_CACHE_RECENT = 0,          /* T1, cached chunks read once */
+    CHUNK_CACHE_FREQUENT = 1,        /* T2, cached chunks read again */
+    CHUNK_CACHE_RECENT_GHOST = 2,    /* B1, evicted from T1, no data */
+    CHUNK_CACHE_FREQUENT_GHOST = 3,  /* B2, evicted from T2, no data */
+    CHUNK_CACHE_LISTS = 4,
+} chunk_cache_list;
+
+typedef struct chunk_cache_entry_t
+{
+    chunk_hash_t hash;
+    struct chunk_cache_entry_t* hash_next;
+    /* circular links of its list, head of list is least recently used */
+    struct chunk_cache_entry_t* prev;
+    struct chunk_cache_entry_t* next;
+    struct buf_t* data; /* NULL for ghost */
+    uint32_t length;    /* bytes of chunk */
+    uint32_t size;      /* bytes charged to budget, kept by ghost too */
+    uint32_t list;      /* chunk_cache_list */
+    char _padded[4];
+} chunk_cache_entry_t;
+
+/* fetch of chunk shared by readers which missed it */
+typedef struct chunk_cache_miss_t
+{
+    chunk_hash_t hash;
+    struct chunk_cache_miss_t* next;
+    struct buf_t* data;
+    err_t status;
+    uint32_t length;
+    uint32_t waiters; /* readers which still have to copy result */
+    uint8_t done;
+    uint8_t frequent; /* chunk was ghost, it is cached as frequent */
+    uint8_t in_b2;    /* that ghost was evicted from T2 */
+    char _padded[5];
+} chunk_cache_miss_t;
+
+typedef struct chunk_cache_queue_t
+{
+    chunk_cache_entry_t* head;
+    uint64_t bytes;
+} chunk_cache_queue_t;
+
+typedef struct chunk_cache_stats_t
+{
+    uint64_t hits;
+    uint64_t misses;     /* reads which started fetch */
+    uint64_t coalesced;  /* reads which waited for fetch of other read */
+    uint64_t ghost_hits; /* misses of recently evicted chunks */
+    uint64_t evictions;
+    uint64_t fetch_errors;
+    uint64_t bytes_saved; /* served from memory instead of fetched */
+    uint64_t bytes_fetched;
+    uint64_t resident_bytes;
+    uint64_t resident_chunks;
+} chunk_cache_stats_t;
+
+typedef struct chunk_cache_shard_t
+{
+    pthread_mutex_t lock;
+    pthread_cond_t fetched;
+    chunk_cache_entry_t** buckets;
+    uint32_t bucket_count;
+    uint32_t count; /* entries including ghosts */
+    chunk_cache_queue_t lists[CHUNK_CACHE_LISTS];
+    chunk_cache_miss_t* misses;
+    uint64_t capacity;
+    uint64_t target; /* bytes of T1 which ARC adapts towards */
+    chunk_cache_stats_t stats;
+} chunk_cache_shard_t;
+
+/**
+ * @brief read-through cache of remote chunks bounded by bytes of memory
+ *
+ * Every shard is adaptive replacement cache with own lock. Chunks read once
+ * and chunks read again are kept in separate lists whose split adapts to
+ * hits of recently evicted chunks, so single pass over large file cannot
+ * flush chunks which are read repeatedly. Chunks are content addressed and
+ * never change, so cached chunk is never invalidated.
+ */
+typedef struct chunk_cache_t
+{
+    chunk_cache_shard_t shards[CHUNK_CACHE_SHARDS];
+    chunk_cache_fetch_fn fetch;
+    void* fetch_ctx;
+} chunk_cache_t;
+
+/**
+ * @brief create cache holding at most capacity bytes of chunk buffers
+ */
+err_t chunk_cache_init(chunk_cache_t cache[static 1], uint64_t capacity,
+                       chunk_cache_fetch_fn fetch, void* fetch_ctx);
+
+/**
+ * @brief destroy cache, no read or fetch may be in progress
+ */
+void chunk_cache_destroy(chunk_cache_t cache[static 1]);
+
+/**
+ * @brief copy chunk to buffer, missing chunk is fetched and caller blocks
+ *        until fetch completes, concurrent misses of one chunk share fetch
+ *
+ * Must not be called from thread which completes fetches, e.g. reactor.
+ */
+err_t chunk_cache_get(chunk_cache_t cache[static 1],
+                      const chunk_hash_t hash[static 1], void* buffer,
+                      uint32_t buffer_len, uint32_t length[static 1]);
+
+/**
+ * @brief complete fetch of chunk, data is verified against hash and copied
+ *        into cache, it is ignored when chunk is not being fetched
+ */
+void chunk_cache_fill(chunk_cache_t cache[static 1],
+                      const chunk_hash_t hash[static 1], err_t status,
+                      const void* data, uint32_t length);
+
+/**
+ * @brief sum statistics of all shards into stats
+ */
+void chunk_cache_stats(chunk_cache_t cache[static 1],
+                       chunk_cache_stats_t stats[static 1]);
+
+/**
+ * @brief append statistics to stats report
+ */
+void chunk_cache_report(chunk_cache_t cache[static 1],
+                        metrics_writer_t writer[static 1]);
+
+/**
+ * @brief fetch function reading chunk from its owner on placement ring of
+ *        connection passed as ctx
+ */
+void chunk_cache_fetch_peer(void* ctx, chunk_cache_t* cache,
+                            const chunk_hash_t hash[static 1]);
+
+#endif
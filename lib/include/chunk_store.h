@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_CHUNK_STORE_H_
+#define DISFS_CHUNK_STORE_H_
+
+#include "err_codes.h"
+#include "sha256.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#define CHUNK_HASH_SIZE SHA256_DIGEST_SIZE
+#define CHUNK_MAX_SIZE (64 * 1024)
+#define CHUNK_STORE_PATH_MAX 256
+
+struct connection_t;
+
+typedef struct chunk_hash_t
+{
+    uint8_t bytes[CHUNK_HASH_SIZE];
+} chunk_hash_t;
+
+typedef struct chunk_location_t
+{
+    uint64_t offset; /* offset of chunk data in pack file */
+    uint32_t length;
+    uint32_t flags;
+    uint32_t crc; /* CRC32C of chunk data, checked on every read */
+    char _padded[4];
+} chunk_location_t;
+
+/* slot of on-disk open-addressing index, hash to location */
+typedef struct chunk_index_slot_t
+{
+    chunk_hash_t hash;
+    chunk_location_t location;
+} chunk_index_slot_t;
+
+typedef struct chunk_index_header_t
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t _padded;
+    uint64_t capacity;  /* number of slots, power of two */
+    uint64_t count;     /* used slots */
+    uint64_t pack_size; /* bytes of pack file covered by index */
+    uint64_t _reserved[3];
+} chunk_index_header_t;
+
+/**
+ * @brief content addressed chunk store
+ *
+ * Chunks are appended to single pack file and named by SHA-256 of their
+ * content. Location of every chunk is kept in memory mapped index file, so
+ * lookup never reads from disk and opening store does not rescan pack.
+ */
+typedef struct chunk_store_t
+{
+    pthread_rwlock_t lock;
+    chunk_index_header_t* index;
+    chunk_index_slot_t* slots;
+    uint64_t index_map_size;
+    int32_t pack_fd;
+    int32_t index_fd;
+    char dir[CHUNK_STORE_PATH_MAX];
+} chunk_store_t;
+
+err_t chunk_store_open(chunk_store_t store[static 1], const char* dir);
+void chunk_store_close(chunk_store_t store[static 1]);
+
+/**
+ * @brief flush pack and index to disk, after return stored chunks survive
+ *        power loss
+ */
+err_t chunk_store_sync(chunk_store_t store[static 1]);
+
+/**
+ * @brief store chunk, stored chunk is deduplicated by its hash
+ */
+err_t chunk_store_put(chunk_store_t store[static 1], const void* data,
+                      uint32_t length, chunk_hash_t hash[static 1]);
+err_t chunk_store_lookup(chunk_store_t store[static 1],
+                         const chunk_hash_t hash[static 1],
+                         chunk_location_t location[static 1]);
+/**
+ * @brief copy chunk to buffer, DISFS_ERR_CORRUPT when data read from pack
+ *        does not match its checksum
+ */
+err_t chunk_store_get(chunk_store_t store[static 1],
+                      const chunk_hash_t hash[static 1], void* buffer,
+                      uint32_t buffer_len, uint32_t length[static 1]);
+
+/**
+ * @brief split file into content defined chunks (cdc_cut) and store them,
+ *        hashes of chunks are written in file order, so edit of file changes
+ *        only hashes of chunks around it
+ */
+err_t chunk_store_put_file(chunk_store_t store[static 1], int32_t fd,
+                           chunk_hash_t* hashes, uint64_t max_hashes,
+                           uint64_t count[static 1]);
+
+/**
+ * @brief serve get/put chunk requests and manifests from peers of connection
+ */
+err_t chunk_store_attach(chunk_store_t store[static 1],
+                         struct connection_t* conn);
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_CHUNK_SYNC_H_
+#define DISFS_CHUNK_SYNC_H_
+
+#include "chunk_store.h"
+#include "err_codes.h"
+#include <netinet/in.h>
+#include <stdint.h>
+
+/* hashes of one manifest frame */
+#define CHUNK_SYNC_BATCH 4096
+/* chunk puts in flight */
+#define CHUNK_SYNC_WINDOW 16
+
+struct connection_t;
+
+typedef struct chunk_sync_stats_t
+{
+    uint64_t chunks;         /* distinct chunks of manifest */
+    uint64_t sent;           /* chunks peer lacked */
+    uint64_t sent_bytes;     /* data of sent chunks */
+    uint64_t present_bytes;  /* data peer held already, not sent */
+    uint64_t manifest_bytes; /* hashes sent to find missing chunks */
+} chunk_sync_stats_t;
+
+/**
+ * @brief make peer on addr hold every chunk of hashes, e.g. of file split by
+ *        chunk_store_put_file, sending only chunks peer does not have
+ *
+ * Manifest of hashes goes to peer in batches and peer answers which of them
+ * its chunk store lacks, only those are read from store and put to peer. As
+ * chunks are content defined, after small edit of file the manifest is most
+ * of the traffic. Blocks until peer acknowledged every chunk, so must not be
+ * called from reactor.
+ */
+err_t chunk_sync_push(struct connection_t* conn,
+                      const struct sockaddr_in addr[static 1],
+                      chunk_store_t store[static 1], const chunk_hash_t* hashes,
+                      uint64_t count, chunk_sync_stats_t stats[static 1]);
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_COMPRESS_H_
+#define DISFS_COMPRESS_H_
+
+#include "err_codes.h"
+#include <stdint.h>
+
+/* shorter payloads are never compressed, header overhead eats the gain */
+#define COMPRESS_MIN_LENGTH 512
+/* block which does not save 1/16 of input is not worth decompressing */
+#define COMPRESS_MIN_SAVING_SHIFT 4
+
+typedef enum compress_codec
+{
+    COMPRESS_NONE = 0,
+    COMPRESS_LZ = 1, /* LZ4 block format, greedy single-pass matcher */
+    COMPRESS_CODEC_MAX = 2,
+} compress_codec;
+
+/* codecs this build can encode and decode, bit per compress_codec */
+#define COMPRESS_SUPPORTED (1u << COMPRESS_LZ)
+
+/**
+ * @brief per-link switch deciding which frames are compressed
+ *
+ * Keeps moving averages of compression ratio and compressor cost per saved
+ * byte. Once either gets too poor, frames are sent as they are and only
+ * every skip-th one probes whether data became compressible again, probe
+ * interval doubles with every failed probe.
+ */
+typedef struct compress_adapt_t
+{
+    uint32_t ratio;   /* average compressed size per 1024 bytes */
+    uint32_t cost;    /* average compressor ns per 1024 input bytes */
+    uint32_t skip;    /* frames left to send uncompressed */
+    uint32_t backoff; /* skip set by next failed probe */
+} compress_adapt_t;
+
+/**
+ * @brief compress length bytes of src into LZ4 block in dst, returns size of
+ *        block or 0 when it does not fit capacity
+ */
+uint64_t compress_lz(const void* src, uint64_t length, uint8_t* dst,
+                     uint64_t capacity);
+
+/**
+ * @brief decode LZ4 block which has to expand to exactly length bytes,
+ *        DISFS_ERR_PROTO for malformed block
+ */
+err_t decompress_lz(const uint8_t* src, uint64_t src_length, uint8_t* dst,
+                    uint64_t length);
+
+/**
+ * @brief cheap guess whether data compresses, data of known compressed
+ *        formats is rejected by its signature and anything else by trying
+ *        to compress its sample
+ */
+int32_t compress_worthwhile(const void* data, uint64_t length);
+
+void compress_adapt_init(compress_adapt_t adapt[static 1]);
+
+/**
+ * @brief whether next frame should be compressed, frame sent uncompressed
+ *        anyway has to be reported by compress_adapt_skip
+ */
+static inline int32_t
+compress_adapt_wants(const compress_adapt_t adapt[static 1])
+{
+    return adapt->skip == 0;
+}
+
+void compress_adapt_skip(compress_adapt_t adapt[static 1]);
+
+/**
+ * @brief outcome of compressing raw bytes into packed ones in ns, packed is
+ *        0 when block did not pay off and frame went uncompressed
+ */
+void compress_adapt_record(compress_adapt_t adapt[static 1], uint64_t raw,
+                           uint64_t packed, uint64_t ns);
+
+#endif
@@ -7,39 +7,104 @@
 #define DISFS_CONNECTION_H_
 
 #include "err_codes.h"
+#include "hash_ring.h"
+#include "membership.h"
+#include "metrics.h"
+#include "peer.h"
+#include "peer_cache.h"
+#include "protocol.h"
+#include "ring_buffer.h"
+#include "udp_discovery.h"
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
-#define MAX_NEIGHBOURS 5
+/**
+ * @brief handler for received frame, frame payload is valid only during call
+ */
+typedef err_t (*connection_handler_fn)(void* ctx, client_t client[static 1],
+                                       const proto_frame_t frame[static 1]);
 
-typedef struct client_t
+typedef struct connection_handler_t
 {
-    int_fast8_t active;
-    char ip[INET_ADDRSTRLEN];
-    char _padded[3];
-    int32_t fd;
-    socklen_t len;
-    struct sockaddr_in addr;
-} client_t;
+    connection_handler_fn fn;
+    void* ctx;
+} connection_handler_t;
+
+/**
+ * @brief event loop thread with own io backend and own SO_REUSEPORT listener
+ */
+typedef struct reactor_t
+{
+    struct connection_t* connection;
+    pthread_t th;
+    event_source_t listener;
+    client_t* graveyard;  /* dropped peers waiting for release */
+    client_t* connecting; /* outbound peers waiting for connect completion */
+    client_t* requesting; /* peers with requests in flight */
+    uint64_t rng;         /* state for backoff jitter */
+    metrics_shard_t* metrics;
+    uint64_t peer_check_ms; /* next sampling and eviction of peers */
+    uint64_t membership_ms; /* next membership tick, first reactor only */
+    uint32_t id;
+    int32_t cpu; /* -1 when thread is not pinned */
+    io_backend_t backend;
+    /* requests posted by other threads, see connection_call */
+    pthread_mutex_t calls_lock;
+    struct buf_t* calls;
+    event_source_t wakeup;
+} reactor_t;
 
 typedef struct connection_t
 {
     struct sockaddr_in addr;
     socklen_t addr_len;
-    int32_t fd;
-    client_t clients[MAX_NEIGHBOURS];
+    uint32_t reactor_count;
+    reactor_t* reactors;
+    uint32_t next_reactor;
+    uint32_t connect_timeout_ms;
+    uint64_t tx_high_watermark;
+    uint64_t tx_low_watermark;
+    uint32_t frame_checksum; /* checksum_kind of sent frames */
+    uint32_t codecs;         /* compress_codec bits offered by hello */
 
     char local_ip[INET_ADDRSTRLEN];
 
-    int32_t udp_fd;
+    event_source_t udp;
     struct sockaddr_in udp_addr;
+    /*
+       first of discovery_ports consecutive ports receiving announcements,
+       they are sent only until first member is known
+     */
+    struct sockaddr_in discovery_addr;
+    uint32_t discovery_ports;
+    uint32_t discovery_interval_ms;
+    /* owned by first reactor, which serves udp socket */
+    udp_batch_t* udp_rx;
+    membership_t membership;
+    /* known peers kept across restarts, NULL when disabled */
+    peer_cache_t* peer_cache;
+
+    peer_table_t peers;
+    /* backing off peers replaced by inbound link, under lock of peers */
+    client_t* retired;
+    /* placement ring of this node and established member peers */
+    hash_ring_t ring;
 
     pthread_t udp_th;
-    pthread_t tcp_th;
 
     volatile int udp_th_run;
     volatile int tcp_th_run;
+    /* close_connection started, connection_call fails at once */
+    volatile int closing;
+    /* cached peers were asked to rejoin and none of peers got connected yet,
+       announcements are sent even though cached members look live */
+    volatile int rejoining;
+
+    connection_handler_t handlers[PROTO_MSG_MAX];
 
+    metrics_t metrics;
 } connection_t;
 
 /**
@@ -49,6 +114,40 @@ typedef struct
 {
     int32_t port_tcp;
     int32_t port_udp;
+    /* number of reactor threads, 0 means single reactor */
+    uint32_t reactor_threads;
+    /* pin reactor i to cpu i modulo number of online cpus */
+    int32_t pin_reactors;
+    /* deadline for single outbound connect attempt, 0 means default */
+    uint32_t connect_timeout_ms;
+    /* io_backend_kind of reactors, io_uring with epoll fallback by default */
+    int32_t io_backend;
+    /* unix socket serving stats report, NULL disables it */
+    const char* stats_path;
+    /* destination of discovery announcements, broadcast by default */
+    const char* discovery_ip;
+    /* destination port, port_udp by default */
+    int32_t discovery_port;
+    /* announce to this many consecutive ports, e.g. to reach several nodes
+       on loopback, 0 means 1 */
+    uint32_t discovery_ports;
+    /* delay between announcements, 0 means default */
+    uint32_t discovery_interval_ms;
+    /* membership protocol period, 0 means default */
+    uint32_t probe_interval_ms;
+    /* peer with this many bytes queued is throttled, 0 means default */
+    uint64_t tx_high_watermark;
+    /* throttled peer is released once queue drains to this, 0 means quarter
+       of high watermark */
+    uint64_t tx_low_watermark;
+    /* checksum_kind of sent frames, CRC32C by default, frames ending with
+       file range always carry CRC32C */
+    int32_t frame_checksum;
+    /* frames are never compressed, peers learn it from hello */
+    int32_t disable_compression;
+    /* file remembering peers across restarts, they are connected at start
+       before any discovery announcement, NULL disables it */
+    const char* peer_cache_path;
 } connection_params_opt;
 
 err_t _internal_create_connection(connection_t conn[static 1],
@@ -56,6 +155,118 @@ err_t _internal_create_connection(connection_t conn[static 1],
 
 void close_connection(connection_t conn[static 1]);
 
+/**
+ * @brief register handler for message type, should be called before
+ *        create_connection
+ */
+err_t connection_register_handler(connection_t conn[static 1], uint16_t type,
+                                  connection_handler_fn fn, void* ctx);
+
+/**
+ * @brief number of nodes linked by established member peer
+ */
+uint32_t connection_established_count(connection_t conn[static 1]);
+
+/**
+ * @brief id of node listening on addr, used as its placement ring id
+ */
+uint64_t connection_node_id(const struct sockaddr_in addr[static 1]);
+
+/**
+ * @brief queue frame with payload gathered from iov and start writing it,
+ *        must be called from reactor owning the client (e.g. from handler)
+ *
+ * Frames are always queued. Peer whose queue reaches high watermark is
+ * throttled: nothing more is read from it, so its requests stop producing
+ * replies until the queue drains below low watermark.
+ */
+err_t connection_send(client_t client[static 1], uint16_t type,
+                      uint64_t request_id, const struct iovec* iov,
+                      uint32_t iov_count);
+
+/**
+ * @brief queue frame whose payload is iov followed by file_length bytes of
+ *        file_fd starting at file_offset, file range is sent with sendfile()
+ *        straight from page cache, file_fd must stay open and range unchanged
+ *        until frame is written, file_crc is CRC32C of range which is never
+ *        read by sender
+ */
+err_t connection_send_file(client_t client[static 1], uint16_t type,
+                           uint64_t request_id, const struct iovec* iov,
+                           uint32_t iov_count, int32_t file_fd,
+                           uint64_t file_offset, uint32_t file_length,
+                           uint32_t file_crc);
+
+/**
+ * @brief queue reply to request frame received from client
+ */
+err_t connection_reply(client_t client[static 1],
+                       const proto_frame_t request[static 1], uint16_t type,
+                       const struct iovec* iov, uint32_t iov_count);
+
+/**
+ * @brief queue reply whose payload ends with file range, as
+ *        connection_send_file
+ */
+err_t connection_reply_file(client_t client[static 1],
+                            const proto_frame_t request[static 1],
+                            uint16_t type, const struct iovec* iov,
+                            uint32_t iov_count, int32_t file_fd,
+                            uint64_t file_offset, uint32_t file_length,
+                            uint32_t file_crc);
+
+/**
+ * @brief send request to established peer, fn is called once with its reply,
+ *        on timeout_ms deadline (0 means default) or when peer is dropped
+ *
+ * Every request gets own id, so any number of them is pipelined on the peer
+ * stream and replies complete them in whatever order peer sends them. Must
+ * be called from reactor owning the client, e.g. from handler or completion.
+ * When error is returned fn is never called.
+ */
+err_t connection_request(client_t client[static 1], uint16_t type,
+                         const struct iovec* iov, uint32_t iov_count,
+                         uint32_t timeout_ms, inflight_fn fn, void* ctx);
+
+/**
+ * @brief send request to peer listening on addr from any thread, fn is called
+ *        from reactor owning the peer as with connection_request
+ *
+ * Payload is copied, so it may be freed on return. DISFS_ERR_PEER_CLOSED is
+ * returned when there is no peer with addr. Request which cannot be sent
+ * once it reaches reactor is completed with its error and client may be
+ * NULL in that call.
+ */
+err_t connection_call(connection_t conn[static 1],
+                      const struct sockaddr_in addr[static 1], uint16_t type,
+                      const void* payload, uint32_t length,
+                      uint32_t timeout_ms, inflight_fn fn, void* ctx);
+
+/**
+ * @brief complete request sent by connection_call with fn and ctx now, with
+ *        DISFS_ERR_CANCELLED, from any thread
+ *
+ * Cancel is queued behind requests posted before it. Request which completed
+ * meanwhile is left alone, so request with same fn and ctx posted after the
+ * cancel may be hit only when peer moves to other reactor in between.
+ */
+err_t connection_cancel(connection_t conn[static 1],
+                        const struct sockaddr_in addr[static 1],
+                        inflight_fn fn, void* ctx);
+
+/**
+ * @brief 0 while client is throttled, producers which do not reply to client
+ *        (e.g. replication) should hold their frames meanwhile
+ */
+int32_t connection_writable(const client_t client[static 1]);
+
+/**
+ * @brief 1 when next frame to client is going to be compressed, producers
+ *        which would send file range (e.g. chunk store) may pass its data in
+ *        memory instead, so it can be compressed
+ */
+int32_t connection_compressing(const client_t client[static 1]);
+
 #define create_connection(conn, ...)                                           \
     _internal_create_connection(conn, (connection_params_opt){__VA_ARGS__})
 
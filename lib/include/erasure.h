@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_ERASURE_H_
+#define DISFS_ERASURE_H_
+
+#include "err_codes.h"
+#include <stdint.h>
+
+/* data and parity fragments of one stripe together */
+#define ERASURE_MAX_SHARDS 16
+/* bytes of GF(2^8) multiplication table of one coefficient, products of low
+ * nibbles followed by products of high nibbles */
+#define ERASURE_TABLE_SIZE 32
+
+typedef enum erasure_kernel
+{
+    ERASURE_KERNEL_AUTO = 0, /* best kernel supported by cpu */
+    ERASURE_KERNEL_SCALAR = 1,
+    ERASURE_KERNEL_SSSE3 = 2,
+    ERASURE_KERNEL_AVX2 = 3,
+    ERASURE_KERNEL_AVX512 = 4,
+    ERASURE_KERNEL_MAX = 5,
+} erasure_kernel;
+
+/**
+ * @brief systematic Reed-Solomon code over GF(2^8)
+ *
+ * Data fragments are stored as they are and parity fragment i is sum of data
+ * fragments multiplied by row i of Cauchy matrix, so any data_shards of the
+ * data_shards + parity_shards fragments restore the stripe. Fragments of one
+ * stripe have equal length and belong on distinct peers, e.g. fragment i on
+ * i-th owner returned by hash_ring_lookup.
+ */
+typedef struct erasure_t
+{
+    uint32_t data_shards;
+    uint32_t parity_shards;
+    /* rows of parity, data_shards coefficients each */
+    uint8_t matrix[ERASURE_MAX_SHARDS][ERASURE_MAX_SHARDS];
+    uint8_t tables[ERASURE_MAX_SHARDS][ERASURE_MAX_SHARDS][ERASURE_TABLE_SIZE];
+} erasure_t;
+
+/**
+ * @brief pick multiplication kernel used by all codes, DISFS_ERR_INVALID_ARG
+ *        when cpu does not support it
+ */
+err_t erasure_select_kernel(int32_t kernel);
+
+/**
+ * @brief kernel in use, selected by cpu detection until erasure_select_kernel
+ */
+int32_t erasure_active_kernel(void);
+const char* erasure_kernel_name(int32_t kernel);
+
+/**
+ * @brief data_shards and parity_shards are at least 1 and their sum is at
+ *        most ERASURE_MAX_SHARDS
+ */
+err_t erasure_init(erasure_t code[static 1], uint32_t data_shards,
+                   uint32_t parity_shards);
+
+/**
+ * @brief compute parity fragments of data fragments, each length bytes
+ */
+void erasure_encode(const erasure_t code[static 1], const uint8_t* const* data,
+                    uint8_t* const* parity, uint64_t length);
+
+/**
+ * @brief restore fragments with bit set in erased, shards holds all
+ *        data_shards + parity_shards fragments in stripe order and erased
+ *        ones are overwritten, DISFS_ERR_INVALID_ARG when fewer than
+ *        data_shards fragments are left
+ */
+err_t erasure_decode(const erasure_t code[static 1], uint8_t* const* shards,
+                     uint32_t erased, uint64_t length);
+
+/**
+ * @brief update parity after range of one data fragment changed from
+ *        old_data to new_data, parity points to the same range of every
+ *        parity fragment, other data fragments are not read
+ */
+void erasure_update(const erasure_t code[static 1], uint32_t index,
+                    const uint8_t* old_data, const uint8_t* new_data,
+                    uint8_t* const* parity, uint64_t length);
+
+#endif
@@ -21,6 +21,18 @@ typedef long long int err_t;
 
 #define DISFS_ERR_MAX_PEER (-10)
 #define DISFS_ERR_READED (-11)
+#define DISFS_ERR_PROTO (-12)
+#define DISFS_ERR_PEER_EXISTS (-13)
+#define DISFS_ERR_TIMEOUT (-14)
+#define DISFS_ERR_PEER_CLOSED (-15)
+#define DISFS_ERR_CANCELLED (-16)
+
+#define DISFS_ERR_IO (-20)
+#define DISFS_ERR_NOT_FOUND (-21)
+#define DISFS_ERR_CORRUPT (-22)
+#define DISFS_ERR_EXISTS (-23)
+#define DISFS_ERR_NOT_DIR (-24)
+#define DISFS_ERR_NOT_EMPTY (-25)
 
 #define ASSERT(cond, msg) assert(cond || (_Bool)msg)
 
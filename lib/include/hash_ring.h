@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_HASH_RING_H_
+#define DISFS_HASH_RING_H_
+
+#include "err_codes.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define HASH_RING_DEFAULT_VNODES 128
+#define HASH_RING_MAX_REPLICAS 16
+
+/* copied out by lookup, so it stays valid after node leaves the ring */
+typedef struct hash_ring_node_t
+{
+    uint64_t id;
+    struct sockaddr_in addr; /* listening address, zero for local node */
+    int32_t local;
+    char _padded[4];
+} hash_ring_node_t;
+
+typedef struct hash_ring_point_t
+{
+    uint64_t hash;
+    uint32_t node; /* index into nodes */
+    uint32_t _padded;
+} hash_ring_point_t;
+
+/**
+ * @brief consistent hashing ring with virtual nodes
+ *
+ * Points are kept sorted, so adding or removing node only merges or filters
+ * its own points. Lookup is binary search and walk over the ring, it takes
+ * read lock and never allocates.
+ */
+typedef struct hash_ring_t
+{
+    pthread_rwlock_t lock;
+    hash_ring_point_t* points;
+    uint32_t point_count;
+    uint32_t point_capacity;
+    hash_ring_node_t* nodes; /* slots with id == 0 are free */
+    uint32_t node_count;     /* used slots including free ones */
+    uint32_t node_capacity;
+    uint32_t live_nodes;
+    uint32_t vnodes;
+} hash_ring_t;
+
+err_t hash_ring_init(hash_ring_t ring[static 1], uint32_t vnodes);
+void hash_ring_destroy(hash_ring_t ring[static 1]);
+
+/**
+ * @brief add node listening on addr, NULL addr adds local node, id must be
+ *        non-zero and unique
+ */
+err_t hash_ring_add(hash_ring_t ring[static 1], uint64_t id,
+                    const struct sockaddr_in* addr);
+err_t hash_ring_remove(hash_ring_t ring[static 1], uint64_t id);
+
+/**
+ * @brief find up to count distinct nodes owning key, walking clockwise from
+ *        key, returns number of nodes written to owners
+ */
+uint32_t hash_ring_lookup(hash_ring_t ring[static 1], uint64_t key,
+                          hash_ring_node_t* owners, uint32_t count);
+
+static inline uint64_t hash_ring_mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* ring key of content hash, its leading bytes are already uniform */
+static inline uint64_t hash_ring_key(const uint8_t* digest)
+{
+    uint64_t key = 0;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        key = (key << 8) | digest[i];
+    }
+    return key;
+}
+
+#endif
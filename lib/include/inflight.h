@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_INFLIGHT_H_
+#define DISFS_INFLIGHT_H_
+
+#include "err_codes.h"
+#include "protocol.h"
+#include <stdint.h>
+
+struct client_t;
+
+/**
+ * @brief completion of request, called once from reactor owning the peer
+ *
+ * Status is DISFS_SUCCESS with reply frame, error code carried by
+ * PROTO_MSG_ERROR reply together with that frame, or DISFS_ERR_TIMEOUT,
+ * DISFS_ERR_PEER_CLOSED and DISFS_ERR_CANCELLED with reply NULL. Reply is
+ * valid only during call.
+ */
+typedef void (*inflight_fn)(void* ctx, struct client_t* client, err_t status,
+                            const proto_frame_t* reply);
+
+typedef struct inflight_entry_t
+{
+    uint64_t id; /* request id, 0 while slot is free */
+    uint64_t deadline_ms;
+    inflight_fn fn;
+    void* ctx;
+    uint32_t heap_index; /* position in deadline heap */
+    uint32_t next_free;
+} inflight_entry_t;
+
+/**
+ * @brief requests of one peer waiting for reply
+ *
+ * Request id holds slot of its entry in low half and sequence number in high
+ * half, so reply is matched without search and late reply to slot which was
+ * reused is recognized. Deadlines are kept in binary heap of slots. Zeroed
+ * table is empty and allocates on first add.
+ */
+typedef struct inflight_t
+{
+    inflight_entry_t* entries;
+    uint32_t* heap;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t free_head;
+    uint32_t sequence;
+} inflight_t;
+
+void inflight_destroy(inflight_t table[static 1]);
+
+/**
+ * @brief track new request, its non-zero id is written to id
+ */
+err_t inflight_add(inflight_t table[static 1], uint64_t deadline_ms,
+                   inflight_fn fn, void* ctx, uint64_t id[static 1]);
+
+/**
+ * @brief remove request with id and copy it to entry, DISFS_ERR_NOT_FOUND
+ *        when request is unknown or was already completed
+ */
+err_t inflight_take(inflight_t table[static 1], uint64_t id,
+                    inflight_entry_t entry[static 1]);
+
+/**
+ * @brief remove request which completes with fn and ctx and copy it to entry,
+ *        DISFS_ERR_NOT_FOUND when there is no such request
+ */
+err_t inflight_take_ctx(inflight_t table[static 1], inflight_fn fn, void* ctx,
+                        inflight_entry_t entry[static 1]);
+
+/**
+ * @brief remove request with earliest deadline when it is not after now_ms,
+ *        returns 1 when entry was taken
+ */
+int32_t inflight_expire(inflight_t table[static 1], uint64_t now_ms,
+                        inflight_entry_t entry[static 1]);
+
+/**
+ * @brief earliest deadline, UINT64_MAX when no request is in flight
+ */
+uint64_t inflight_next_deadline(const inflight_t table[static 1]);
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_IO_BACKEND_H_
+#define DISFS_IO_BACKEND_H_
+
+#include "err_codes.h"
+#include <stdint.h>
+
+/* upper bound of events returned by single io_backend_wait */
+#define IO_BACKEND_MAX_EVENTS 1024
+/* receive buffers provided to kernel by io_uring backend */
+#define IO_URING_BUFFER_COUNT 128
+#define IO_URING_BUFFER_SIZE (16 * 1024)
+
+struct epoll_event;
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+/**
+ * @brief kind of object registered in backend, every backend operation carries
+ *        pointer to event_source_t which is first member of owning object
+ */
+typedef enum event_kind
+{
+    EVENT_KIND_LISTENER = 1,
+    EVENT_KIND_UDP = 2,
+    EVENT_KIND_PEER = 3,
+    EVENT_KIND_WAKEUP = 4, /* eventfd signalled by other threads */
+} event_kind;
+
+typedef struct event_source_t
+{
+    int32_t kind;
+    int32_t fd;
+    uint32_t inflight; /* operations kernel still holds, owner must outlive */
+    uint8_t wants;     /* io_want flags requested by owner */
+    uint8_t armed;     /* io_want flags with operation queued in backend */
+    char _padded[2];
+} event_source_t;
+
+typedef enum io_backend_kind
+{
+    IO_BACKEND_AUTO = 0, /* io_uring when kernel supports it, else epoll */
+    IO_BACKEND_EPOLL = 1,
+    IO_BACKEND_URING = 2,
+} io_backend_kind;
+
+typedef enum io_want
+{
+    IO_WANT_READ = 1 << 0,  /* report readable */
+    IO_WANT_WRITE = 1 << 1, /* report writable */
+    /* receive data on behalf of owner, only reported readable by epoll */
+    IO_WANT_RECV = 1 << 2,
+    /* accept connections on behalf of owner, only reported readable by epoll */
+    IO_WANT_ACCEPT = 1 << 3,
+} io_want;
+
+typedef enum io_event_type
+{
+    IO_EVENT_READY = 1,    /* result holds IO_WANT_READ and/or IO_WANT_WRITE */
+    IO_EVENT_ACCEPTED = 2, /* result is accepted non-blocking fd */
+    IO_EVENT_RECEIVED = 3, /* result bytes were received to data */
+    IO_EVENT_CLOSED = 4,   /* peer closed stream, result is 0 or -errno */
+} io_event_type;
+
+typedef struct io_event_t
+{
+    event_source_t* source;
+    const uint8_t* data; /* received bytes, valid until next io_backend_wait */
+    int32_t type;
+    int32_t result;
+} io_event_t;
+
+/**
+ * @brief completion loop of single reactor thread
+ *
+ * Epoll backend reports readiness and owner does the syscalls itself.
+ * io_uring backend keeps multishot accept and receive operations armed, takes
+ * receive buffers from provided buffer ring and submits all operations queued
+ * during a loop iteration with the same io_uring_enter that waits for next
+ * completions. Owner handles both kinds of events, so every event type is
+ * completion of an operation bound to event source and other operations, e.g.
+ * file reads, can share the same loop.
+ */
+typedef struct io_backend_t
+{
+    int32_t kind;
+    int32_t fd; /* epoll or io_uring instance */
+    struct epoll_event* epoll_events;
+
+    /* io_uring only */
+    void* ring_map;
+    uint64_t ring_map_size;
+    struct io_uring_sqe* sqes;
+    uint64_t sqes_map_size;
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sq_local_tail; /* queued entries, published on submit */
+    uint32_t sq_submitted;
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    struct io_uring_cqe* cqes;
+    uint32_t cq_mask;
+    uint32_t returned_count; /* buffers handed out by last wait */
+    struct io_uring_buf_ring* buf_ring;
+    uint8_t* buffers;
+    uint16_t returned[IO_BACKEND_MAX_EVENTS];
+} io_backend_t;
+
+/**
+ * @brief create backend of given kind, IO_BACKEND_AUTO falls back to epoll
+ *        when io_uring is missing, disabled or lacks used features
+ */
+err_t io_backend_init(io_backend_t backend[static 1], int32_t kind);
+void io_backend_destroy(io_backend_t backend[static 1]);
+
+/**
+ * @brief start watching source with io_want flags
+ */
+err_t io_backend_add(io_backend_t backend[static 1],
+                     event_source_t source[static 1], uint8_t wants);
+
+/**
+ * @brief change io_want flags of watched source, no-op when flags are same
+ *
+ * Dropping IO_WANT_RECV stops receiving, data which io_uring received before
+ * the receive was cancelled is still reported while any flag is wanted.
+ */
+err_t io_backend_modify(io_backend_t backend[static 1],
+                        event_source_t source[static 1], uint8_t wants);
+
+/**
+ * @brief stop watching source, must be called before its fd is closed, owner
+ *        of source must stay allocated until source->inflight drops to zero
+ */
+void io_backend_remove(io_backend_t backend[static 1],
+                       event_source_t source[static 1]);
+
+/**
+ * @brief move idle source to backend of other reactor thread, caller must be
+ *        thread of from, source is watched by to with wants afterwards
+ */
+err_t io_backend_handoff(io_backend_t from[static 1], io_backend_t to[static 1],
+                         event_source_t source[static 1], uint8_t wants);
+
+/**
+ * @brief submit queued operations and wait up to timeout_ms for events
+ * @return number of events written to events, 0 on timeout or interrupt
+ */
+int32_t io_backend_wait(io_backend_t backend[static 1], io_event_t* events,
+                        int32_t max_events, int32_t timeout_ms);
+
+#endif
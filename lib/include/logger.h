@@ -6,30 +6,214 @@
 #ifndef DISFS_LOGGER_H_
 #define DISFS_LOGGER_H_
 
-#include <stdio.h>
-#define RED "\x1B[31m"
-#define GREEN "\x1B[32m"
-#define PURPLE "\x1B[35m"
-#define BLUE "\x1B[36m"
-#define YELLOW "\x1B[90m"
-#define RESET "\x1B[0m"
-
-#define _log(stream, file, line, level, ...)                                   \
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_ERROR 4
+
+/* calls below minimum level compile to nothing, their arguments are never
+ * evaluated */
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+/* most arguments after format of single log call */
+#define LOG_MAX_ARGS 10
+
+typedef enum log_arg_kind
+{
+    LOG_ARG_I64 = 1,
+    LOG_ARG_U64 = 2,
+    LOG_ARG_F64 = 3,
+    LOG_ARG_STR = 4, /* copied into record, so it may be transient */
+    LOG_ARG_PTR = 5,
+} log_arg_kind;
+
+/**
+ * @brief log call argument captured by its C type, format string is applied
+ *        later by logger thread
+ */
+typedef struct log_arg_t
+{
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const char* s;
+        const void* p;
+    };
+    uint32_t kind;
+    uint32_t _padded;
+} log_arg_t;
+
+/**
+ * @brief append binary record to ring of calling thread, never blocks and
+ *        never formats, record is dropped and counted when ring is full
+ *
+ * Error records are the exception, they are written out with every record
+ * logged before them by the time the call returns, so they survive abort.
+ */
+void logger_write(uint32_t level, const char* file, uint32_t line,
+                  const char* fmt, const log_arg_t* args, uint32_t arg_count);
+
+/**
+ * @brief format and write every record logged so far by any thread
+ */
+void logger_flush(void);
+
+static inline log_arg_t log_arg_i64(int64_t v)
+{
+    return (log_arg_t){.i = v, .kind = LOG_ARG_I64};
+}
+
+static inline log_arg_t log_arg_u64(uint64_t v)
+{
+    return (log_arg_t){.u = v, .kind = LOG_ARG_U64};
+}
+
+static inline log_arg_t log_arg_f64(double v)
+{
+    return (log_arg_t){.d = v, .kind = LOG_ARG_F64};
+}
+
+static inline log_arg_t log_arg_str(const char* v)
+{
+    return (log_arg_t){.s = v, .kind = LOG_ARG_STR};
+}
+
+static inline log_arg_t log_arg_ptr(const void* v)
+{
+    return (log_arg_t){.p = v, .kind = LOG_ARG_PTR};
+}
+
+/* never called, lets compiler check format against arguments */
+__attribute__((format(printf, 1, 2))) static inline void
+log_check_format(const char* fmt, ...)
+{
+    (void)fmt;
+}
+
+#define LOG_ARG(x)                                                             \
+    _Generic((x),                                                              \
+        char*: log_arg_str,                                                    \
+        const char*: log_arg_str,                                              \
+        char: log_arg_i64,                                                     \
+        signed char: log_arg_i64,                                              \
+        short: log_arg_i64,                                                    \
+        int: log_arg_i64,                                                      \
+        long: log_arg_i64,                                                     \
+        long long: log_arg_i64,                                                \
+        _Bool: log_arg_u64,                                                    \
+        unsigned char: log_arg_u64,                                            \
+        unsigned short: log_arg_u64,                                           \
+        unsigned int: log_arg_u64,                                             \
+        unsigned long: log_arg_u64,                                            \
+        unsigned long long: log_arg_u64,                                       \
+        float: log_arg_f64,                                                    \
+        double: log_arg_f64,                                                   \
+        default: log_arg_ptr)(x)
+
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+#define LOG_CAT_(a, b) a##b
+/* number of arguments after format, last placeholder keeps ... non-empty */
+#define LOG_NARGS(...)                                                         \
+    LOG_NARGS_(__VA_ARGS__, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, _)
+#define LOG_NARGS_(fmt, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, n, ...) n
+
+#define LOG_ARGS_0(f) f, NULL, 0
+#define LOG_ARGS_1(f, a) f, (const log_arg_t[]){LOG_ARG(a)}, 1
+#define LOG_ARGS_2(f, a, b) f, (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b)}, 2
+#define LOG_ARGS_3(f, a, b, c)                                                 \
+    f, (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c)}, 3
+#define LOG_ARGS_4(f, a, b, c, d)                                              \
+    f, (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d)}, 4
+#define LOG_ARGS_5(f, a, b, c, d, e)                                           \
+    f,                                                                         \
+        (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d),    \
+                            LOG_ARG(e)},                                       \
+        5
+#define LOG_ARGS_6(f, a, b, c, d, e, g)                                        \
+    f,                                                                         \
+        (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d),    \
+                            LOG_ARG(e), LOG_ARG(g)},                           \
+        6
+#define LOG_ARGS_7(f, a, b, c, d, e, g, h)                                     \
+    f,                                                                         \
+        (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d),    \
+                            LOG_ARG(e), LOG_ARG(g), LOG_ARG(h)},               \
+        7
+#define LOG_ARGS_8(f, a, b, c, d, e, g, h, i)                                  \
+    f,                                                                         \
+        (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d),    \
+                            LOG_ARG(e), LOG_ARG(g), LOG_ARG(h), LOG_ARG(i)},   \
+        8
+#define LOG_ARGS_9(f, a, b, c, d, e, g, h, i, j)                               \
+    f,                                                                         \
+        (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d),    \
+                            LOG_ARG(e), LOG_ARG(g), LOG_ARG(h), LOG_ARG(i),    \
+                            LOG_ARG(j)},                                       \
+        9
+#define LOG_ARGS_10(f, a, b, c, d, e, g, h, i, j, k)                           \
+    f,                                                                         \
+        (const log_arg_t[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d),    \
+                            LOG_ARG(e), LOG_ARG(g), LOG_ARG(h), LOG_ARG(i),    \
+                            LOG_ARG(j), LOG_ARG(k)},                           \
+        10
+
+#define _log(level, ...)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (0)                                                                 \
+        {                                                                      \
+            log_check_format(__VA_ARGS__);                                     \
+        }                                                                      \
+        logger_write(level, __FILE__, __LINE__,                                \
+                     LOG_CAT(LOG_ARGS_, LOG_NARGS(__VA_ARGS__))(__VA_ARGS__)); \
+    } while (0)
+
+/* keeps disabled call type checked without generating any code */
+#define _log_disabled(...)                                                     \
     do                                                                         \
     {                                                                          \
-        fprintf(stream, "%s %s:%d  --  ", level, file, line);                  \
-        fprintf(stream, __VA_ARGS__);                                          \
+        if (0)                                                                 \
+        {                                                                      \
+            log_check_format(__VA_ARGS__);                                     \
+        }                                                                      \
     } while (0)
 
-#define LOG_ERROR(...)                                                         \
-    _log(stderr, __FILE__, __LINE__, RED "[ERROR] " RESET, __VA_ARGS__)
-#define LOG_WARNING(...)                                                       \
-    _log(stderr, __FILE__, __LINE__, YELLOW "[WARNING] " RESET, __VA_ARGS__)
-#define LOG_TRACE(...)                                                         \
-    _log(stderr, __FILE__, __LINE__, BLUE "[TRACE] " RESET, __VA_ARGS__)
-#define LOG_DEBUG(...)                                                         \
-    _log(stderr, __FILE__, __LINE__, PURPLE "[DEBUG] " RESET, __VA_ARGS__)
-#define LOG_INFO(...)                                                          \
-    _log(stderr, __FILE__, __LINE__, GREEN "[INFO] " RESET, __VA_ARGS__)
+#define LOG_ERROR(...) _log(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) _log(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) _log_disabled(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) _log(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) _log_disabled(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) _log(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) _log_disabled(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) _log(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) _log_disabled(__VA_ARGS__)
+#endif
 
 #endif
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_MEMBERSHIP_H_
+#define DISFS_MEMBERSHIP_H_
+
+#include "err_codes.h"
+#include "udp_discovery.h"
+#include <netinet/in.h>
+#include <stdint.h>
+
+/*
+   Packets share first 8 bytes with discovery announcement, tcp port of sender
+   and magic number, so both arrive on the same udp socket.
+ */
+#define MEMBERSHIP_MAGIC 0x4D495753
+#define MEMBERSHIP_HEADER_SIZE 32
+#define MEMBERSHIP_UPDATE_SIZE 16
+/* membership deltas piggybacked on single packet */
+#define MEMBERSHIP_MAX_UPDATES 16
+#define MEMBERSHIP_MAX_PACKET                                                  \
+    (MEMBERSHIP_HEADER_SIZE + MEMBERSHIP_MAX_UPDATES * MEMBERSHIP_UPDATE_SIZE)
+#define MEMBERSHIP_DEFAULT_PERIOD_MS 500
+/* members asked to probe target which did not answer direct ping */
+#define MEMBERSHIP_INDIRECT_PROBES 3
+/* ping-req requests relayed by this node at the same time */
+#define MEMBERSHIP_RELAY_SLOTS 32
+
+typedef enum member_state
+{
+    MEMBER_ALIVE = 0,
+    MEMBER_SUSPECT = 1, /* missed probe, declared dead unless it refutes */
+    MEMBER_DEAD = 2,
+} member_state;
+
+typedef enum membership_msg
+{
+    MEMBERSHIP_MSG_PING = 1,
+    MEMBERSHIP_MSG_ACK = 2,
+    MEMBERSHIP_MSG_PING_REQ = 3, /* probe target on behalf of sender */
+} membership_msg;
+
+typedef struct member_t
+{
+    struct sockaddr_in addr; /* udp address */
+    uint64_t state_ms;       /* suspect deadline or time of death */
+    uint32_t incarnation;    /* raised only by member itself to refute */
+    uint16_t tcp_port;
+    uint8_t state;
+    uint8_t gossip_left; /* remaining piggybacked transmissions of state */
+} member_t;
+
+/**
+ * @brief called when member becomes live after being unknown or dead and when
+ *        it is declared dead
+ */
+typedef void (*membership_event_fn)(void* ctx, const member_t member[static 1]);
+
+typedef struct membership_relay_t
+{
+    struct sockaddr_in requester;
+    uint64_t expire_ms;
+    uint32_t requester_seq;
+    uint32_t seq; /* of ping sent to target, 0 for free slot */
+} membership_relay_t;
+
+/**
+ * @brief SWIM failure detector and gossip of cluster membership
+ *
+ * Every period one member, in shuffled round robin, is pinged. When it does
+ * not answer in time, MEMBERSHIP_INDIRECT_PROBES other members ping it on our
+ * behalf and when even that fails until the period ends it becomes suspect.
+ * Suspect which does not refute by raising its incarnation is declared dead.
+ * State changes travel piggybacked on probe traffic, each one about
+ * 3 * log2(n) times, so every node sends constant number of packets per
+ * period regardless of cluster size.
+ *
+ * Outgoing packets are queued and leave together in one sendmmsg call on
+ * membership_flush, which membership_tick does on its own.
+ *
+ * Not thread safe, everything except membership_live_count has to be called
+ * from single thread.
+ */
+typedef struct membership_t
+{
+    member_t* members; /* alive, suspect and recently dead */
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t live_count; /* alive and suspect, readable from any thread */
+    uint32_t probe_index;
+    struct sockaddr_in probe_addr; /* target of current probe */
+    uint64_t probe_ms;             /* start of current probe */
+    uint64_t next_probe_ms;
+    uint32_t probe_seq; /* 0 when there is no probe waiting for ack */
+    uint32_t probe_indirect;
+    uint32_t seq;
+    uint32_t incarnation;
+    uint32_t gossip_cursor;
+    uint32_t period_ms;
+    struct in_addr local_ip;
+    int32_t fd;
+    uint64_t rng;
+    uint16_t udp_port;
+    uint16_t tcp_port;
+    char _padded[4];
+    membership_event_fn on_event;
+    void* ctx;
+    udp_batch_t* tx; /* packets queued until membership_flush */
+    membership_relay_t relays[MEMBERSHIP_RELAY_SLOTS];
+} membership_t;
+
+/**
+ * @brief start with no members, packets are sent through fd bound to
+ *        udp_port, local_ip is address of this node seen by others
+ */
+err_t membership_init(membership_t membership[static 1], int32_t fd,
+                      struct in_addr local_ip, uint16_t udp_port,
+                      uint16_t tcp_port, uint32_t period_ms,
+                      membership_event_fn on_event, void* ctx);
+void membership_destroy(membership_t membership[static 1]);
+
+/**
+ * @brief add member found by bootstrap, e.g. its discovery announcement
+ */
+void membership_join(membership_t membership[static 1],
+                     const struct sockaddr_in addr[static 1], uint16_t tcp_port,
+                     uint64_t now_ms);
+
+int32_t membership_is_packet(const uint8_t* data, uint32_t length);
+
+void membership_receive(membership_t membership[static 1], const uint8_t* data,
+                        uint32_t length,
+                        const struct sockaddr_in from[static 1],
+                        uint64_t now_ms);
+
+/**
+ * @brief run probes and timeouts due at now_ms, returns time of next call
+ */
+uint64_t membership_tick(membership_t membership[static 1], uint64_t now_ms);
+
+/**
+ * @brief send packets queued by membership_join and membership_receive
+ */
+void membership_flush(membership_t membership[static 1]);
+
+uint32_t membership_live_count(membership_t membership[static 1]);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_METADATA_H_
+#define DISFS_METADATA_H_
+
+#include "chunk_store.h"
+#include "err_codes.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#define META_NAME_MAX 255
+#define META_PATH_MAX 4096
+#define META_DIR_MAX 256
+#define META_ROOT_INO 1
+/* write-ahead log size which triggers background snapshot */
+#define META_SNAPSHOT_WAL_SIZE (64ULL * 1024 * 1024)
+#define META_SNAPSHOT_CHECK_MS 1000
+
+struct connection_t;
+
+typedef enum meta_type
+{
+    META_TYPE_FREE = 0,
+    META_TYPE_FILE = 1,
+    META_TYPE_DIR = 2,
+} meta_type;
+
+/**
+ * @brief inode record, exactly one cache line, inode number is its index
+ *
+ * Directory entries are intrusive sibling lists, so listing directory walks
+ * records only. Names and chunk hashes are kept out of line in append-only
+ * pools, which keeps records fixed size.
+ */
+typedef struct meta_inode_t
+{
+    uint64_t size;
+    uint64_t mtime_ns;
+    uint64_t chunks; /* index of first hash in chunk pool */
+    uint64_t name;   /* offset of name in name pool */
+    uint32_t chunk_count;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling; /* next free inode for free records */
+    uint32_t prev_sibling;
+    uint32_t child_count;
+    uint16_t name_len;
+    uint8_t type;
+    uint8_t data_shards; /* 0 when file is replicated, see meta_set_policy */
+    uint8_t parity_shards;
+    char _padded[3];
+} meta_inode_t;
+
+typedef struct meta_attr_t
+{
+    uint64_t size;
+    uint64_t mtime_ns;
+    uint32_t ino;
+    uint32_t chunk_count;
+    uint8_t type;
+    uint8_t data_shards;
+    uint8_t parity_shards;
+    char _padded[5];
+} meta_attr_t;
+
+/**
+ * @brief growable array backed by reserved address space, snapshot section
+ *        is mapped privately at its start so loading never copies
+ */
+typedef struct meta_table_t
+{
+    uint8_t* base;
+    uint64_t size;     /* bytes in use */
+    uint64_t reserved; /* bytes of address space at base */
+} meta_table_t;
+
+/**
+ * @brief namespace tree of paths, inodes and chunk lists
+ *
+ * Every mutation is appended to write-ahead log before it is applied in
+ * memory and returns once log is synced, one sync commits every mutation
+ * appended before it. Background thread writes compact snapshot when log
+ * grows, it copies tables and starts new log, then writes copy while
+ * mutations go on and drops old log once snapshot is durable. Opening maps
+ * snapshot and replays log tail, so restart cost does not depend on number
+ * of entries.
+ */
+typedef struct meta_t
+{
+    pthread_rwlock_t lock;
+    pthread_mutex_t snapshot_lock;
+    pthread_mutex_t wal_lock; /* serializes log syncs and log switch */
+    pthread_cond_t snapshot_cond;
+    pthread_t snapshot_th;
+    meta_table_t inodes;  /* meta_inode_t */
+    meta_table_t index;   /* open addressing, (parent, name) -> inode */
+    meta_table_t names;   /* name bytes */
+    meta_table_t chunks;  /* chunk_hash_t */
+    uint64_t index_used;  /* live entries and tombstones */
+    uint64_t garbage;     /* unreferenced bytes of name and chunk pools */
+    uint64_t lsn;         /* last applied log record */
+    uint64_t wal_size;
+    uint64_t synced_lsn;  /* records up to it are durable, under wal_lock */
+    int32_t wal_fd;
+    int32_t wal_rotated;  /* log is not yet renamed, under snapshot_lock */
+    int32_t wal_failed;   /* log sync failed, nothing commits any more */
+    uint32_t free_inodes; /* head of free record list */
+    uint32_t live_inodes;
+    volatile int snapshot_th_run;
+    char dir[META_DIR_MAX];
+} meta_t;
+
+/**
+ * @brief callback of meta_list, returns non-zero to stop before entry
+ */
+typedef int32_t (*meta_list_fn)(void* ctx, const char* name,
+                                uint16_t name_len,
+                                const meta_attr_t attr[static 1]);
+
+err_t meta_open(meta_t meta[static 1], const char* dir);
+void meta_close(meta_t meta[static 1]);
+
+/**
+ * @brief flush write-ahead log, after return applied mutations survive
+ *        power loss
+ */
+err_t meta_sync(meta_t meta[static 1]);
+
+/**
+ * @brief write compact snapshot and drop write-ahead log before it, only
+ *        copying tables waits for mutations
+ */
+err_t meta_snapshot(meta_t meta[static 1]);
+
+err_t meta_lookup(meta_t meta[static 1], const char* path,
+                  meta_attr_t attr[static 1]);
+err_t meta_create(meta_t meta[static 1], const char* path, uint8_t type,
+                  meta_attr_t attr[static 1]);
+
+/**
+ * @brief remove file or empty directory
+ */
+err_t meta_remove(meta_t meta[static 1], const char* path);
+
+/**
+ * @brief move entry, destination must not exist
+ */
+err_t meta_rename(meta_t meta[static 1], const char* from, const char* to);
+
+/**
+ * @brief pass entries of directory to fn starting at cookie (0 is first),
+ *        cookie is set to entry which was not consumed, 0 when all were
+ */
+err_t meta_list(meta_t meta[static 1], const char* path, meta_list_fn fn,
+                void* ctx, uint32_t cookie[static 1]);
+
+err_t meta_set_chunks(meta_t meta[static 1], const char* path, uint64_t size,
+                      const chunk_hash_t* hashes, uint32_t count);
+
+/**
+ * @brief set redundancy of file, data_shards and parity_shards of zero keep
+ *        whole chunks on replicas, otherwise chunk list of file holds
+ *        data_shards + parity_shards fragment hashes per stripe, see erasure_t
+ */
+err_t meta_set_policy(meta_t meta[static 1], const char* path,
+                      uint8_t data_shards, uint8_t parity_shards);
+
+/**
+ * @brief copy up to max_hashes chunk hashes of file, count is set to number of
+ *        chunks of file
+ */
+err_t meta_get_chunks(meta_t meta[static 1], const char* path,
+                      chunk_hash_t* hashes, uint32_t max_hashes,
+                      uint32_t count[static 1]);
+
+/**
+ * @brief serve lookup, create, remove, rename and list requests from peers
+ *        of connection
+ */
+err_t meta_attach(meta_t meta[static 1], struct connection_t* conn);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_METRICS_H_
+#define DISFS_METRICS_H_
+
+#include "err_codes.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+/* histogram keeps 2^METRICS_SUB_BITS buckets per power of two */
+#define METRICS_SUB_BITS 4
+#define METRICS_SUB_COUNT (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS ((64 - METRICS_SUB_BITS + 1) * METRICS_SUB_COUNT)
+#define METRICS_PATH_MAX 108
+
+typedef enum metric_counter
+{
+    METRIC_BYTES_IN = 0,
+    METRIC_BYTES_OUT = 1,
+    METRIC_FRAMES_IN = 2,
+    METRIC_FRAMES_OUT = 3,
+    METRIC_ACCEPTS = 4,
+    METRIC_CONNECT_FAILURES = 5,
+    METRIC_TX_WRITES = 6,       /* write syscalls of tx queues */
+    METRIC_TX_THROTTLED = 7,    /* peers throttled by full tx queue */
+    METRIC_CHECKSUM_ERRORS = 8, /* frames dropped with their peer */
+    /* payload bytes of compressed frames before and after compression */
+    METRIC_COMPRESS_RAW_BYTES = 9,
+    METRIC_COMPRESS_WIRE_BYTES = 10,
+    METRIC_COUNTER_MAX = 11,
+} metric_counter;
+
+typedef enum metric_histogram
+{
+    METRIC_LOOP_NS = 0,     /* busy part of reactor loop iteration */
+    METRIC_PEER_RTT_NS = 1, /* round trip time samples of all peers */
+    METRIC_HISTOGRAM_MAX = 2,
+} metric_histogram;
+
+/**
+ * @brief log-linear histogram, every bucket spans at most 1/16 of its value,
+ *        so any quantile is reported with relative error below 6.25%
+ */
+typedef struct metrics_histogram_t
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[METRICS_BUCKETS];
+} metrics_histogram_t;
+
+/**
+ * @brief statistics of single thread, only owning thread writes to it
+ *
+ * Updates are relaxed load and store of own cache lines without lock prefix,
+ * readers sum all shards on demand and may see slightly stale values.
+ */
+typedef struct metrics_shard_t
+{
+    uint64_t counters[METRIC_COUNTER_MAX];
+    struct metrics_shard_t* next;
+    metrics_histogram_t histograms[METRIC_HISTOGRAM_MAX];
+} metrics_shard_t;
+
+/**
+ * @brief growable text buffer of stats report
+ */
+typedef struct metrics_writer_t
+{
+    char* data;
+    uint32_t used;
+    uint32_t capacity;
+} metrics_writer_t;
+
+/**
+ * @brief appends lines of caller to stats report, e.g. per-peer statistics
+ */
+typedef void (*metrics_report_fn)(void* ctx, metrics_writer_t writer[static 1]);
+
+/**
+ * @brief registry of shards and local query endpoint
+ */
+typedef struct metrics_t
+{
+    pthread_mutex_t lock;
+    metrics_shard_t* shards;
+    uint64_t start_ns;
+    metrics_report_fn report;
+    void* report_ctx;
+    pthread_t th;
+    int32_t fd; /* listening unix socket, -1 when not served */
+    volatile int th_run;
+    char path[METRICS_PATH_MAX];
+    char _padded[4];
+} metrics_t;
+
+err_t metrics_init(metrics_t metrics[static 1]);
+
+/**
+ * @brief stop query endpoint and free all shards
+ */
+void metrics_destroy(metrics_t metrics[static 1]);
+
+/**
+ * @brief allocate zeroed shard for one thread, shard lives until
+ *        metrics_destroy, so its values are kept after thread exits
+ */
+metrics_shard_t* metrics_shard(metrics_t metrics[static 1]);
+
+/**
+ * @brief sum all shards into out
+ */
+void metrics_collect(metrics_t metrics[static 1],
+                     metrics_shard_t out[static 1]);
+
+/**
+ * @brief value below which is fraction q of recorded values
+ */
+uint64_t metrics_quantile(const metrics_histogram_t histogram[static 1],
+                          double q);
+
+__attribute__((format(printf, 2, 3))) void
+metrics_printf(metrics_writer_t writer[static 1], const char* fmt, ...);
+
+/**
+ * @brief write text report of all metrics followed by lines of report
+ *        callback
+ */
+void metrics_report(metrics_t metrics[static 1],
+                    metrics_writer_t writer[static 1]);
+
+/**
+ * @brief serve text report to every client connecting to unix socket at path,
+ *        report callback is called from thread of endpoint
+ */
+err_t metrics_serve(metrics_t metrics[static 1], const char* path,
+                    metrics_report_fn report, void* ctx);
+
+/* single writer, so plain relaxed store is enough and costs no lock prefix */
+static inline void metrics_inc(uint64_t value[static 1], uint64_t n)
+{
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + n,
+                     __ATOMIC_RELAXED);
+}
+
+static inline void metrics_add(metrics_shard_t shard[static 1],
+                               uint32_t counter, uint64_t n)
+{
+    metrics_inc(&shard->counters[counter], n);
+}
+
+static inline uint32_t metrics_bucket(uint64_t value)
+{
+    if (value < METRICS_SUB_COUNT)
+    {
+        return (uint32_t)value;
+    }
+    uint32_t exponent = 63 - (uint32_t)__builtin_clzll(value);
+    uint32_t sub = (uint32_t)(value >> (exponent - METRICS_SUB_BITS)) &
+                   (METRICS_SUB_COUNT - 1);
+    return (exponent - METRICS_SUB_BITS + 1) * METRICS_SUB_COUNT + sub;
+}
+
+static inline void metrics_record(metrics_shard_t shard[static 1],
+                                  uint32_t histogram, uint64_t value)
+{
+    metrics_histogram_t* h = &shard->histograms[histogram];
+    metrics_inc(&h->buckets[metrics_bucket(value)], 1);
+    metrics_inc(&h->count, 1);
+    metrics_inc(&h->sum, value);
+    if (value > h->max)
+    {
+        __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+    }
+}
+
+static inline uint64_t metrics_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_PEER_H_
+#define DISFS_PEER_H_
+
+#include "compress.h"
+#include "err_codes.h"
+#include "inflight.h"
+#include "io_backend.h"
+#include "protocol.h"
+#include "ring_buffer.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define PEER_SLAB_SIZE 64
+
+typedef enum peer_state
+{
+    PEER_STATE_IDLE = 0,
+    PEER_STATE_CONNECTING = 1,  /* non-blocking connect in flight */
+    PEER_STATE_ESTABLISHED = 2, /* frames can be exchanged */
+    PEER_STATE_BACKOFF = 3,     /* last connect failed, retry after retry_at */
+} peer_state;
+
+struct reactor_t;
+struct buf_t;
+
+/*
+   queued outbound bytes, either buffer in data (usually one whole frame) or
+   range of file_fd which is sent by kernel without copy to userspace,
+   segment lives at start of buf_pool buffer and is freed with its buffer
+ */
+typedef struct tx_segment_t
+{
+    struct tx_segment_t* next;
+    uint32_t length;
+    uint32_t offset; /* bytes already written to socket */
+    int32_t file_fd; /* -1 for in-memory segment, not owned by segment */
+    char _padded[4];
+    uint64_t file_offset; /* start of range in file_fd */
+    uint8_t data[];
+} tx_segment_t;
+
+typedef struct client_t
+{
+    event_source_t source;
+    /* written by owner with release, other threads load it before looking
+       at rest of peer */
+    int_fast8_t active;
+    char ip[INET_ADDRSTRLEN];
+    uint8_t evict; /* member is dead or linked twice, owner drops peer */
+    /* tx queue went over high watermark, receiving is paused until it drains
+       below low watermark */
+    uint8_t throttled;
+    uint8_t requesting; /* on requesting list of its reactor */
+    /* indexed by listening address of its node, set for outbound peers and
+       for inbound ones once hello names node */
+    int32_t member;
+    struct sockaddr_in addr;
+    int32_t state;
+    uint32_t connect_failures;
+    uint64_t deadline_ms; /* connect attempt deadline, monotonic clock */
+    uint64_t retry_at_ms; /* earliest reconnect time in backoff state */
+    ring_buffer_t rx;
+    proto_verify_t rx_verify; /* checksum of partially received frame */
+    tx_segment_t* tx_head;
+    tx_segment_t* tx_tail;
+    /* bytes queued and not yet written, stored atomically for stats */
+    uint64_t tx_pending;
+    /* bytes received while throttled which did not fit receive ring */
+    struct buf_t* rx_backlog;
+    inflight_t inflight; /* requests sent to peer waiting for reply */
+    /* compression of sent frames, codec is agreed by hello */
+    compress_adapt_t compress;
+    uint32_t codec;
+    /* member peer stands for its node in ring, under peer table lock */
+    int32_t ringed;
+    struct client_t* requesting_next;
+    struct reactor_t* reactor; /* reactor owning this peer */
+    /* link in at most one of: free list, connecting list, reactor graveyard,
+       retired list of connection */
+    struct client_t* next;
+    /* statistics, written only by owning reactor */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t frames_in;
+    uint64_t frames_out;
+    uint64_t rtt_ns; /* smoothed round trip time reported by kernel */
+} client_t;
+
+/**
+ * @brief growable table of peers, peers are slab allocated so pointer to peer
+ *        stays valid until it is removed, every peer is indexed by address
+ */
+typedef struct peer_table_t
+{
+    pthread_mutex_t lock;
+    client_t** slabs;
+    uint32_t slab_count;
+    uint32_t slab_capacity;
+    client_t* free_list;
+    client_t** index;
+    uint32_t index_capacity;
+    uint32_t index_used; /* live entries and tombstones */
+    uint32_t count;
+    char _padded[4];
+} peer_table_t;
+
+err_t peer_table_init(peer_table_t table[static 1]);
+void peer_table_destroy(peer_table_t table[static 1]);
+
+/**
+ * @brief add zeroed peer with given address, when peer with this address
+ *        already exists DISFS_ERR_PEER_EXISTS is returned and peer is not added
+ */
+err_t peer_table_add(peer_table_t table[static 1],
+                     const struct sockaddr_in addr[static 1],
+                     client_t* peer[static 1]);
+void peer_table_remove(peer_table_t table[static 1], client_t peer[static 1]);
+
+/* locked variants let caller check and update peer state atomically */
+void peer_table_lock(peer_table_t table[static 1]);
+void peer_table_unlock(peer_table_t table[static 1]);
+client_t* peer_table_find_locked(peer_table_t table[static 1],
+                                 const struct sockaddr_in addr[static 1]);
+err_t peer_table_add_locked(peer_table_t table[static 1],
+                            const struct sockaddr_in addr[static 1],
+                            client_t* peer[static 1]);
+
+/**
+ * @brief index peer by addr instead of its current address, fails with
+ *        DISFS_ERR_PEER_EXISTS when other peer has addr
+ */
+err_t peer_table_rekey_locked(peer_table_t table[static 1],
+                              client_t peer[static 1],
+                              const struct sockaddr_in addr[static 1]);
+
+/**
+ * @brief take peer out of index, it stays allocated and is no longer found
+ *        by its address until it is removed
+ */
+void peer_table_detach_locked(peer_table_t table[static 1],
+                              client_t peer[static 1]);
+
+int32_t peer_table_contains(peer_table_t table[static 1],
+                            const struct sockaddr_in addr[static 1]);
+uint32_t peer_table_count(peer_table_t table[static 1]);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_PEER_CACHE_H_
+#define DISFS_PEER_CACHE_H_
+
+#include "err_codes.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/* peers remembered, the least recently connected one is forgotten first */
+#define PEER_CACHE_MAX 64
+#define PEER_CACHE_PATH_MAX 256
+/* peer failing this many connects in a row is forgotten until seen again */
+#define PEER_CACHE_MAX_FAILURES 8
+/* peer not connected for this long is not loaded */
+#define PEER_CACHE_MAX_AGE_S (7 * 24 * 3600)
+
+typedef struct peer_cache_entry_t
+{
+    uint32_t ip;        /* network byte order */
+    uint16_t udp_port;  /* membership port */
+    uint16_t tcp_port;  /* listening port */
+    uint64_t last_seen; /* unix time of last connect, or of being learned */
+    uint32_t successes; /* connects which got established */
+    uint32_t failures;  /* failed connects since last success */
+} peer_cache_entry_t;
+
+/**
+ * @brief peers this node knew, kept in small file so restarted node can
+ *        connect to them before any discovery announcement arrives
+ *
+ * Cache is only a hint, file which cannot be read or is corrupted is treated
+ * as empty. Updates are kept in memory until peer_cache_save, which replaces
+ * the file atomically. Thread safe.
+ */
+typedef struct peer_cache_t
+{
+    pthread_mutex_t lock;
+    peer_cache_entry_t entries[PEER_CACHE_MAX];
+    uint32_t count;
+    int32_t dirty; /* entries differ from file */
+    char path[PEER_CACHE_PATH_MAX];
+} peer_cache_t;
+
+/**
+ * @brief load cache from path, missing file gives empty cache, entries older
+ *        than PEER_CACHE_MAX_AGE_S at now_s are dropped
+ */
+err_t peer_cache_open(peer_cache_t cache[static 1], const char* path,
+                      uint64_t now_s);
+
+/**
+ * @brief save pending updates and release cache
+ */
+void peer_cache_close(peer_cache_t cache[static 1]);
+
+/**
+ * @brief write entries to file when they changed since last save
+ */
+err_t peer_cache_save(peer_cache_t cache[static 1]);
+
+/**
+ * @brief remember member with udp address addr listening on tcp_port
+ */
+void peer_cache_learn(peer_cache_t cache[static 1],
+                      const struct sockaddr_in addr[static 1],
+                      uint16_t tcp_port, uint64_t now_s);
+
+/**
+ * @brief record outcome of connect to peer listening on tcp address addr,
+ *        unknown peer is ignored
+ */
+void peer_cache_result(peer_cache_t cache[static 1],
+                       const struct sockaddr_in addr[static 1],
+                       int32_t success, uint64_t now_s);
+
+/**
+ * @brief copy up to capacity entries, most promising first: fewer failures
+ *        since last success, more successful connects, then more recently
+ *        seen, returns number of entries copied
+ */
+uint32_t peer_cache_list(peer_cache_t cache[static 1],
+                         peer_cache_entry_t* entries, uint32_t capacity);
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_PROTOCOL_H_
+#define DISFS_PROTOCOL_H_
+
+#include "checksum.h"
+#include "err_codes.h"
+#include "ring_buffer.h"
+#include <stdint.h>
+
+/*
+ * Peer wire protocol. Every message on a peer TCP stream is a frame:
+ *
+ *   0       1       2               4                               8
+ *   +-------+-------+---------------+-------------------------------+
+ *   |version| flags |     type      |            length             |
+ *   +-------+-------+---------------+-------------------------------+
+ *   |                          request id                           |
+ *   +---------------------------------------------------------------+
+ *   |                     payload (length bytes)                    |
+ *   +-------------------------------+-------------------------------+
+ *   |           checksum            |
+ *   +-------------------------------+
+ *
+ * All integers are little endian. Whole frame must fit into receive ring.
+ * Checksum is CRC32C of header and payload, or XXH32 with PROTO_FLAG_XXH32,
+ * receiver folds bytes into it as they arrive and drops peer on mismatch.
+ * Connecting side opens with hello, which agrees on compression of frames.
+ * Payload layouts below are declared as schemas in wire.h.
+ */
+
+/* version 2 added checksum trailer */
+#define PROTO_VERSION 0x02
+#define PROTO_HEADER_SIZE 16
+#define PROTO_TRAILER_SIZE CHECKSUM_SIZE
+#define PROTO_MAX_FRAME_SIZE (256 * 1024)
+#define PROTO_MAX_PAYLOAD                                                      \
+    (PROTO_MAX_FRAME_SIZE - PROTO_HEADER_SIZE - PROTO_TRAILER_SIZE)
+
+/*
+   frame answers request of receiver with the same request id, ids of both
+   directions are independent
+ */
+#define PROTO_FLAG_REPLY 0x01
+/* trailer is XXH32 instead of CRC32C */
+#define PROTO_FLAG_XXH32 0x02
+/*
+   payload is u32 length of original payload followed by it compressed with
+   codec agreed by hello, checksum covers payload as sent
+ */
+#define PROTO_FLAG_COMPRESSED 0x04
+
+typedef enum proto_msg_type
+{
+    PROTO_MSG_INVALID = 0,
+    PROTO_MSG_PING = 1,
+    PROTO_MSG_PONG = 2,
+    /* payload: i64 error code, reply to any failed request */
+    PROTO_MSG_ERROR = 3,
+    /* payload: chunk hash */
+    PROTO_MSG_CHUNK_GET = 4,
+    /* payload: chunk hash, chunk data */
+    PROTO_MSG_CHUNK_DATA = 5,
+    /* payload: chunk data */
+    PROTO_MSG_CHUNK_PUT = 6,
+    /* payload: chunk hash */
+    PROTO_MSG_CHUNK_PUT_ACK = 7,
+    /* payload: path */
+    PROTO_MSG_META_LOOKUP = 8,
+    /* payload: u8 meta_type, path */
+    PROTO_MSG_META_CREATE = 9,
+    /* payload: path */
+    PROTO_MSG_META_REMOVE = 10,
+    /* payload: u16 length of source path, source path, destination path */
+    PROTO_MSG_META_RENAME = 11,
+    /* payload: u32 cookie, path of directory */
+    PROTO_MSG_META_LIST = 12,
+    /* payload: attributes, reply to lookup and create */
+    PROTO_MSG_META_ATTR = 13,
+    /* empty payload, reply to remove and rename */
+    PROTO_MSG_META_DONE = 14,
+    /* payload: u32 next cookie, u32 count, count x (attributes, u16 name
+     * length, name), next cookie is 0 after last entry */
+    PROTO_MSG_META_ENTRIES = 15,
+    /* payload: u32 codecs offered by connecting side, reply carries codec
+     * both sides use, one bit per compress_codec */
+    PROTO_MSG_HELLO = 16,
+    /* payload: u32 count, count x chunk hash, asks which chunks peer lacks */
+    PROTO_MSG_MANIFEST = 17,
+    /* payload: u32 count, bitmap of count bits, bit i is set when chunk i of
+     * manifest is missing, reply to manifest */
+    PROTO_MSG_MANIFEST_MISSING = 18,
+
+    PROTO_MSG_MAX = 64
+} proto_msg_type;
+
+typedef struct proto_header_t
+{
+    uint32_t length;
+    uint16_t type;
+    uint8_t version;
+    uint8_t flags;
+    uint64_t request_id;
+} proto_header_t;
+
+/**
+ * @brief complete frame, payload points directly into receive buffer and is
+ *        valid only during handler call
+ */
+typedef struct proto_frame_t
+{
+    proto_header_t header;
+    const uint8_t* payload;
+} proto_frame_t;
+
+/**
+ * @brief checksum of frame at head of receive ring, kept between calls of
+ *        proto_process so every byte is folded once, right after it arrives
+ */
+typedef struct proto_verify_t
+{
+    checksum_t sum;
+    uint64_t folded; /* bytes of frame already in sum, 0 before frame */
+} proto_verify_t;
+
+/* returned by dispatch to leave frames after current one in ring for later */
+#define PROTO_STOP 1
+
+typedef err_t (*proto_dispatch_fn)(void* arg,
+                                  const proto_frame_t frame[static 1]);
+
+static inline void proto_put_u16(uint8_t* out, uint16_t v)
+{
+    out[0] = (uint8_t)v;
+    out[1] = (uint8_t)(v >> 8);
+}
+
+static inline void proto_put_u32(uint8_t* out, uint32_t v)
+{
+    proto_put_u16(out, (uint16_t)v);
+    proto_put_u16(out + 2, (uint16_t)(v >> 16));
+}
+
+static inline void proto_put_u64(uint8_t* out, uint64_t v)
+{
+    proto_put_u32(out, (uint32_t)v);
+    proto_put_u32(out + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint16_t proto_get_u16(const uint8_t* in)
+{
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static inline uint32_t proto_get_u32(const uint8_t* in)
+{
+    return (uint32_t)proto_get_u16(in) |
+           ((uint32_t)proto_get_u16(in + 2) << 16);
+}
+
+static inline uint64_t proto_get_u64(const uint8_t* in)
+{
+    return (uint64_t)proto_get_u32(in) |
+           ((uint64_t)proto_get_u32(in + 4) << 32);
+}
+
+void proto_header_encode(const proto_header_t header[static 1],
+                         uint8_t out[static PROTO_HEADER_SIZE]);
+err_t proto_header_decode(proto_header_t header[static 1],
+                          const uint8_t in[static PROTO_HEADER_SIZE]);
+
+static inline uint32_t proto_checksum_kind(uint8_t flags)
+{
+    return flags & PROTO_FLAG_XXH32 ? CHECKSUM_XXH32 : CHECKSUM_CRC32C;
+}
+
+/**
+ * @brief parse every complete frame from receive ring and pass it to dispatch,
+ *        partial frame is left in ring until more data arrives, parsing
+ *        ends early with success when dispatch returns PROTO_STOP, frame
+ *        with wrong checksum is DISFS_ERR_CORRUPT and is not dispatched
+ */
+err_t proto_process(ring_buffer_t rx[static 1],
+                    proto_verify_t verify[static 1], proto_dispatch_fn dispatch,
+                    void* arg);
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_READ_PLAN_H_
+#define DISFS_READ_PLAN_H_
+
+#include "chunk_store.h"
+#include "err_codes.h"
+#include "metrics.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define READ_PLAN_DEFAULT_WINDOW 32
+#define READ_PLAN_DEFAULT_REPLICAS 3
+/* at most this many ring owners of chunk are asked for it */
+#define READ_PLAN_MAX_REPLICAS 8
+/* quantile of peer latency after which duplicate request is sent */
+#define READ_PLAN_HEDGE_QUANTILE 0.95
+
+struct connection_t;
+
+/**
+ * @brief receives chunk index of file in order, data is valid only during
+ *        call, non-zero return stops the read with that error
+ */
+typedef err_t (*read_plan_sink_fn)(void* ctx, uint32_t index,
+                                   const void* data, uint32_t length);
+
+/* latency of chunk replies of one peer, old samples fade out */
+typedef struct read_plan_peer_t
+{
+    struct sockaddr_in addr;
+    uint32_t inflight; /* requests of all reads waiting for reply */
+    char _padded[4];
+    metrics_histogram_t latency;
+} read_plan_peer_t;
+
+typedef struct read_plan_stats_t
+{
+    uint64_t reads;
+    uint64_t chunks;
+    uint64_t bytes;
+    uint64_t local_chunks; /* read from local store */
+    uint64_t requests;
+    uint64_t hedges;       /* duplicate requests sent after p95 */
+    uint64_t hedge_wins;   /* duplicates which answered first */
+    uint64_t cancelled;    /* losing requests cancelled */
+    uint64_t retries;      /* requests resent after error of replica */
+    uint64_t errors;       /* reads which failed */
+} read_plan_stats_t;
+
+/**
+ * @brief reader of whole files striped across replicas of their chunks
+ *
+ * Up to window chunks of a file are fetched at once, every one from the
+ * least busy of its owners on placement ring, so sequential read is spread
+ * over all replicas. Request which takes longer than p95 of its peer is
+ * duplicated to other owner, whichever reply comes second is cancelled.
+ * Failed request moves to next owner. Plan is shared by concurrent reads,
+ * which also share the latency history of peers.
+ */
+typedef struct read_plan_t
+{
+    pthread_mutex_t lock;
+    struct connection_t* conn;
+    chunk_store_t* store; /* local chunks, NULL when node stores none */
+    read_plan_peer_t* peers;
+    uint32_t peer_count;
+    uint32_t peer_capacity;
+    uint32_t window;
+    uint32_t replicas;
+    uint32_t timeout_ms;
+    /* hedge delay of peer without enough samples yet */
+    uint32_t hedge_default_ms;
+    int32_t disable_hedging;
+    char _padded[4];
+    read_plan_stats_t stats;
+} read_plan_t;
+
+/**
+ * @brief optional params of read plan
+ */
+typedef struct
+{
+    /* local store consulted before peers, may be NULL */
+    chunk_store_t* store;
+    /* chunks of one read in flight, 0 means default */
+    uint32_t window;
+    /* owners of chunk on ring which hold its replica, 0 means default */
+    uint32_t replicas;
+    /* deadline of single request, 0 means connection default */
+    uint32_t timeout_ms;
+    /* hedge delay until peer has latency history, 0 means default */
+    uint32_t hedge_default_ms;
+    /* late requests are only waited for, e.g. to save bandwidth */
+    int32_t disable_hedging;
+    char _padded[4];
+} read_plan_params_opt;
+
+err_t _internal_read_plan_init(read_plan_t plan[static 1],
+                               struct connection_t* conn,
+                               read_plan_params_opt params);
+
+/**
+ * @brief destroy plan, no read may be in progress
+ */
+void read_plan_destroy(read_plan_t plan[static 1]);
+
+/**
+ * @brief read count chunks of file, sink receives them in file order from
+ *        calling thread, returns first error which could not be recovered
+ *
+ * Blocks until all requests of the read completed, so must not be called
+ * from reactor.
+ */
+err_t read_plan_read(read_plan_t plan[static 1], const chunk_hash_t* hashes,
+                     uint32_t count, read_plan_sink_fn sink, void* ctx);
+
+void read_plan_stats(read_plan_t plan[static 1],
+                     read_plan_stats_t stats[static 1]);
+
+/**
+ * @brief append statistics and hedge delay of every peer to stats report
+ */
+void read_plan_report(read_plan_t plan[static 1],
+                      metrics_writer_t writer[static 1]);
+
+#define read_plan_init(plan, conn, ...)                                        \
+    _internal_read_plan_init(plan, conn, (read_plan_params_opt){__VA_ARGS__})
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_RING_BUFFER_H_
+#define DISFS_RING_BUFFER_H_
+
+#include "err_codes.h"
+#include <stdint.h>
+
+/**
+ * @brief byte ring buffer backed by a mirrored mapping
+ *
+ * The same physical pages are mapped twice, back to back, so every readable
+ * or writable region is contiguous in virtual memory. Frames that wrap the
+ * end of the buffer can therefore be parsed in place and sockets can be read
+ * straight into the free space with a single syscall.
+ */
+typedef struct ring_buffer_t
+{
+    uint8_t* base;
+    uint64_t capacity;
+    uint64_t head; /* read position, grows monotonically */
+    uint64_t tail; /* write position, grows monotonically */
+} ring_buffer_t;
+
+/**
+ * @brief create ring buffer, capacity must be power of two and multiple of
+ *        page size
+ */
+err_t ring_buffer_create(ring_buffer_t rb[static 1], uint64_t capacity);
+void ring_buffer_destroy(ring_buffer_t rb[static 1]);
+
+static inline uint64_t ring_buffer_used(const ring_buffer_t rb[static 1])
+{
+    return rb->tail - rb->head;
+}
+
+static inline uint64_t ring_buffer_free(const ring_buffer_t rb[static 1])
+{
+    return rb->capacity - ring_buffer_used(rb);
+}
+
+static inline uint8_t* ring_buffer_read_ptr(const ring_buffer_t rb[static 1])
+{
+    return rb->base + (rb->head & (rb->capacity - 1));
+}
+
+static inline uint8_t* ring_buffer_write_ptr(const ring_buffer_t rb[static 1])
+{
+    return rb->base + (rb->tail & (rb->capacity - 1));
+}
+
+static inline void ring_buffer_produce(ring_buffer_t rb[static 1], uint64_t n)
+{
+    ASSERT(n <= ring_buffer_free(rb), "Ring buffer overflow");
+    rb->tail += n;
+}
+
+static inline void ring_buffer_consume(ring_buffer_t rb[static 1], uint64_t n)
+{
+    ASSERT(n <= ring_buffer_used(rb), "Ring buffer underflow");
+    rb->head += n;
+}
+
+#endif
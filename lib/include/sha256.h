@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_SHA256_H_
+#define DISFS_SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+typedef struct sha256_ctx
+{
+    uint32_t state[8];
+    uint64_t length; /* total bytes hashed */
+    uint8_t block[SHA256_BLOCK_SIZE];
+} sha256_ctx;
+
+void sha256_init(sha256_ctx ctx[static 1]);
+void sha256_update(sha256_ctx ctx[static 1], const void* data, size_t len);
+void sha256_final(sha256_ctx ctx[static 1],
+                  uint8_t digest[static SHA256_DIGEST_SIZE]);
+void sha256(const void* data, size_t len,
+            uint8_t digest[static SHA256_DIGEST_SIZE]);
+
+#endif
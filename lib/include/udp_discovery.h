@@ -8,11 +8,22 @@
 
 #define UDP_DISCOVERY_HOSTNAME_MAX_LEN 24
 #define UDP_DISCOVERY_PACKET_MAGIC_NUMBER 0xAE
-#define UDP_DISCOVERY_PROTOCOL_VERSION 0x01
+/* version 2 widened timestamp seconds to 64 bits and fixed byte order,
+ * version 3 appended checksum */
+#define UDP_DISCOVERY_PROTOCOL_VERSION 0x03
+/* layout is WIRE_DISCOVERY in wire.h */
+#define UDP_DISCOVERY_PACKET_SIZE 56
 #include "err_codes.h"
+#include <netinet/in.h>
 #include <stdint.h>
+#include <sys/socket.h>
 #include <time.h>
 
+/* datagrams moved by one recvmmsg or sendmmsg call */
+#define UDP_BATCH_SIZE 64
+/* longer datagrams are truncated and dropped */
+#define UDP_BATCH_PACKET_SIZE 512
+
 typedef struct UDP_packet
 {
     int32_t tcp_port;
@@ -26,9 +37,62 @@ typedef struct UDP_packet
 err_t udp_discovery_packet_create(UDP_packet packet[static 1], int32_t tcp_port,
                                   const char* hostname,
                                   uint32_t hostname_length);
-err_t udp_discovery_packet_serialize(UDP_packet packet[static 1], char* buffer,
-                                     int64_t buffer_len);
+/**
+ * @brief encode packet as little endian, DISFS_ERR_INVALID_ARG when buffer is
+ *        shorter than UDP_DISCOVERY_PACKET_SIZE or packet is not valid
+ */
+err_t udp_discovery_packet_serialize(const UDP_packet packet[static 1],
+                                     char* buffer, int64_t buffer_len);
+/**
+ * @brief decode packet, DISFS_ERR_PROTO when buffer is truncated or malformed
+ *        and DISFS_ERR_CORRUPT when its checksum does not match
+ */
 err_t udp_discovery_packet_deserialize(UDP_packet packet[static 1],
-                                       char* buffer, int64_t buffer_len);
+                                       const char* buffer, int64_t buffer_len);
+
+/**
+ * @brief preallocated datagrams of udp socket, filled by udp_batch_recv or
+ *        queued for udp_batch_send
+ */
+typedef struct udp_batch_t
+{
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iov[UDP_BATCH_SIZE];
+    struct sockaddr_in addrs[UDP_BATCH_SIZE];
+    uint32_t count;
+    char _padded[4];
+    uint8_t data[UDP_BATCH_SIZE][UDP_BATCH_PACKET_SIZE];
+} udp_batch_t;
+
+udp_batch_t* udp_batch_create(void);
+void udp_batch_free(udp_batch_t* batch);
+
+/**
+ * @brief receive waiting datagrams without blocking, returns their count,
+ *        datagram i is data[i] of msgs[i].msg_len bytes from addrs[i]
+ */
+uint32_t udp_batch_recv(udp_batch_t batch[static 1], int32_t fd);
+
+/**
+ * @brief buffer of UDP_BATCH_PACKET_SIZE bytes for next datagram to addr,
+ *        NULL when batch is full, datagram is queued by udp_batch_commit
+ */
+uint8_t* udp_batch_prepare(udp_batch_t batch[static 1],
+                           const struct sockaddr_in addr[static 1]);
+void udp_batch_commit(udp_batch_t batch[static 1], uint32_t length);
+
+/**
+ * @brief send queued datagrams and empty batch, datagrams which would block
+ *        are dropped
+ */
+err_t udp_batch_send(udp_batch_t batch[static 1], int32_t fd);
+
+/**
+ * @brief decode every received datagram, packets[i] is announcement of
+ *        datagram i or zeroed when datagram is not valid announcement,
+ *        returns number of valid announcements
+ */
+uint32_t udp_discovery_packet_deserialize_batch(
+    udp_batch_t batch[static 1], UDP_packet packets[static UDP_BATCH_SIZE]);
 
 #endif
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_WIRE_H_
+#define DISFS_WIRE_H_
+
+#include "err_codes.h"
+#include "sha256.h"
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+ * Layout of every message which leaves this node, frame payloads as well as
+ * udp packets. Fields are laid out in listed order without gaps, integers
+ * are little endian. Adding message is one more line in WIRE_MESSAGES and
+ * list of its fields, struct, schema and typed codec are generated:
+ *
+ *   wire_<msg>_t                decoded message
+ *   wire_<msg>_schema           field table driving generic codec
+ *   wire_<msg>_decode/_encode   typed wrappers of wire_decode/wire_encode
+ *   WIRE_FIXED_SIZE(<msg>)      bytes of message without variable fields
+ *
+ * Field kinds:
+ *   U8 U16 U32 U64  integer, decoded into uint64_t, checked to fit on encode
+ *   BYTES n         exactly n bytes, shorter value is zero padded on encode
+ *   BLOB16          u16 length followed by that many bytes
+ *   TAIL            rest of message, has to be last field
+ *
+ * Byte fields decode lazily into wire_blob_t pointing into received buffer,
+ * nothing is copied until caller needs it.
+ */
+
+/* field list: F(msg, kind, name, size), size is used by BYTES only */
+#define WIRE_ERROR(F, m) F(m, U64, code, 0)
+#define WIRE_PING(F, m) F(m, TAIL, payload, 0)
+#define WIRE_CHUNK_GET(F, m) F(m, BYTES, hash, SHA256_DIGEST_SIZE)
+#define WIRE_CHUNK_DATA(F, m)                                                  \
+    F(m, BYTES, hash, SHA256_DIGEST_SIZE)                                      \
+    F(m, TAIL, data, 0)
+#define WIRE_CHUNK_PUT(F, m) F(m, TAIL, data, 0)
+#define WIRE_MANIFEST(F, m)                                                    \
+    F(m, U32, count, 0)                                                        \
+    F(m, TAIL, hashes, 0)
+/* chunk i of manifest is bit i % 8 of byte i / 8 */
+#define WIRE_MANIFEST_MISSING(F, m)                                            \
+    F(m, U32, count, 0)                                                        \
+    F(m, TAIL, bitmap, 0)
+#define WIRE_META_PATH(F, m) F(m, TAIL, path, 0)
+#define WIRE_META_CREATE(F, m)                                                 \
+    F(m, U8, meta_type, 0)                                                     \
+    F(m, TAIL, path, 0)
+#define WIRE_META_RENAME(F, m)                                                 \
+    F(m, BLOB16, from, 0)                                                      \
+    F(m, TAIL, to, 0)
+#define WIRE_META_LIST(F, m)                                                   \
+    F(m, U32, cookie, 0)                                                       \
+    F(m, TAIL, path, 0)
+#define WIRE_META_ATTR(F, m)                                                   \
+    F(m, U64, ino, 0)                                                          \
+    F(m, U64, size, 0)                                                         \
+    F(m, U64, mtime_ns, 0)                                                     \
+    F(m, U32, chunk_count, 0)                                                  \
+    F(m, U8, type, 0)                                                          \
+    F(m, U8, data_shards, 0)                                                   \
+    F(m, U8, parity_shards, 0)                                                 \
+    F(m, BYTES, reserved, 1)
+#define WIRE_META_ENTRIES(F, m)                                                \
+    F(m, U32, next_cookie, 0)                                                  \
+    F(m, U32, count, 0)                                                        \
+    F(m, TAIL, entries, 0)
+/* element of meta_entries, next cookie is 0 after last entry */
+#define WIRE_META_ENTRY(F, m)                                                  \
+    WIRE_META_ATTR(F, m)                                                       \
+    F(m, BLOB16, name, 0)
+/* newer peers may append fields, tcp_port is listening port of sender */
+#define WIRE_HELLO(F, m)                                                       \
+    F(m, U32, codecs, 0)                                                       \
+    F(m, U16, tcp_port, 0)
+/* udp, tcp port and magic lead, so both packets share one socket */
+#define WIRE_DISCOVERY(F, m)                                                   \
+    F(m, U32, tcp_port, 0)                                                     \
+    F(m, U32, magic, 0)                                                        \
+    F(m, U32, version, 0)                                                      \
+    F(m, U32, timestamp_nsec, 0)                                               \
+    F(m, U64, timestamp_sec, 0)                                                \
+    F(m, U32, hostname_len, 0)                                                 \
+    F(m, BYTES, hostname, 24)                                                  \
+    F(m, U32, checksum, 0) /* CRC32C of fields before it */
+#define WIRE_MEMBERSHIP(F, m)                                                  \
+    F(m, U32, tcp_port, 0)                                                     \
+    F(m, U32, magic, 0)                                                        \
+    F(m, U8, type, 0)                                                          \
+    F(m, U8, update_count, 0)                                                  \
+    F(m, BYTES, reserved, 2)                                                   \
+    F(m, U32, seq, 0)                                                          \
+    F(m, U32, incarnation, 0)                                                  \
+    F(m, BYTES, target_ip, 4) /* network order */                              \
+    F(m, U16, target_udp_port, 0)                                              \
+    F(m, U16, target_tcp_port, 0)                                              \
+    F(m, U32, checksum, 0) /* CRC32C of packet without this field */          \
+    F(m, TAIL, updates, 0)
+#define WIRE_MEMBER_UPDATE(F, m)                                               \
+    F(m, U8, state, 0)                                                         \
+    F(m, BYTES, reserved, 1)                                                   \
+    F(m, U16, udp_port, 0)                                                     \
+    F(m, BYTES, ip, 4) /* network order */                                     \
+    F(m, U16, tcp_port, 0)                                                     \
+    F(m, BYTES, reserved2, 2)                                                  \
+    F(m, U32, incarnation, 0)
+
+/* X(msg, fields), payloads of pong and meta_done are not decoded */
+#define WIRE_MESSAGES(X)                                                       \
+    X(error, WIRE_ERROR)                                                       \
+    X(ping, WIRE_PING)                                                         \
+    X(chunk_get, WIRE_CHUNK_GET)                                               \
+    X(chunk_data, WIRE_CHUNK_DATA)                                             \
+    X(chunk_put, WIRE_CHUNK_PUT)                                               \
+    X(chunk_put_ack, WIRE_CHUNK_GET)                                           \
+    X(manifest, WIRE_MANIFEST)                                                 \
+    X(manifest_missing, WIRE_MANIFEST_MISSING)                                 \
+    X(meta_path, WIRE_META_PATH)                                               \
+    X(meta_create, WIRE_META_CREATE)                                           \
+    X(meta_rename, WIRE_META_RENAME)                                           \
+    X(meta_list, WIRE_META_LIST)                                               \
+    X(meta_attr, WIRE_META_ATTR)                                               \
+    X(meta_entries, WIRE_META_ENTRIES)                                         \
+    X(meta_entry, WIRE_META_ENTRY)                                             \
+    X(hello, WIRE_HELLO)                                                       \
+    X(discovery, WIRE_DISCOVERY)                                               \
+    X(membership, WIRE_MEMBERSHIP)                                             \
+    X(member_update, WIRE_MEMBER_UPDATE)
+
+typedef enum wire_kind
+{
+    WIRE_U8 = 0,
+    WIRE_U16 = 1,
+    WIRE_U32 = 2,
+    WIRE_U64 = 3,
+    WIRE_BYTES = 4,
+    WIRE_BLOB16 = 5,
+    WIRE_TAIL = 6,
+} wire_kind;
+
+/**
+ * @brief bytes of message, after decode it points into decoded buffer
+ */
+typedef struct wire_blob_t
+{
+    const uint8_t* data;
+    uint64_t length;
+} wire_blob_t;
+
+typedef struct wire_field_t
+{
+    uint16_t kind;
+    uint16_t size;   /* of BYTES field */
+    uint32_t offset; /* of member in decoded struct */
+} wire_field_t;
+
+typedef struct wire_schema_t
+{
+    const char* name;
+    const wire_field_t* fields;
+    uint32_t field_count;
+    uint32_t fixed_size;
+} wire_schema_t;
+
+/* every member is 8 byte aligned, so generated structs have no padding */
+#define WIRE_MEMBER_U8(name) uint64_t name;
+#define WIRE_MEMBER_U16(name) uint64_t name;
+#define WIRE_MEMBER_U32(name) uint64_t name;
+#define WIRE_MEMBER_U64(name) uint64_t name;
+#define WIRE_MEMBER_BYTES(name) wire_blob_t name;
+#define WIRE_MEMBER_BLOB16(name) wire_blob_t name;
+#define WIRE_MEMBER_TAIL(name) wire_blob_t name;
+#define WIRE_MEMBER(m, kind, name, size) WIRE_MEMBER_##kind(name)
+
+#define WIRE_SIZE_U8(size) 1
+#define WIRE_SIZE_U16(size) 2
+#define WIRE_SIZE_U32(size) 4
+#define WIRE_SIZE_U64(size) 8
+#define WIRE_SIZE_BYTES(size) (size)
+#define WIRE_SIZE_BLOB16(size) 2
+#define WIRE_SIZE_TAIL(size) 0
+#define WIRE_SIZE(m, kind, name, size) +WIRE_SIZE_##kind(size)
+
+#define WIRE_FIXED_SIZE(msg) wire_##msg##_fixed_size
+
+/**
+ * @brief bytes needed to encode msg
+ */
+uint64_t wire_size(const wire_schema_t schema[static 1], const void* msg);
+
+/**
+ * @brief decode message from data, with consumed NULL whole data has to be
+ *        one message, otherwise message may be followed by other data and
+ *        its length is stored to consumed
+ */
+err_t wire_decode(const wire_schema_t schema[static 1], void* msg,
+                  const uint8_t* data, uint64_t length, uint64_t* consumed);
+
+/**
+ * @brief encode message into out, variable fields are copied
+ */
+err_t wire_encode(const wire_schema_t schema[static 1], const void* msg,
+                  uint8_t* out, uint64_t capacity, uint64_t length[static 1]);
+
+/**
+ * @brief encode message as iovecs for gather write, fixed fields go to
+ *        scratch and variable fields are referenced in place, so they and
+ *        scratch have to stay valid until iovecs are written
+ */
+err_t wire_encode_iov(const wire_schema_t schema[static 1], const void* msg,
+                      uint8_t* scratch, uint32_t scratch_size,
+                      struct iovec* iov, uint32_t iov_capacity,
+                      uint32_t iov_count[static 1]);
+
+#define WIRE_DECLARE(msg, FIELDS)                                              \
+    typedef struct wire_##msg##_t                                              \
+    {                                                                          \
+        FIELDS(WIRE_MEMBER, msg)                                               \
+    } wire_##msg##_t;                                                          \
+    enum                                                                       \
+    {                                                                          \
+        wire_##msg##_fixed_size = 0 FIELDS(WIRE_SIZE, msg)                     \
+    };                                                                         \
+    extern const wire_schema_t wire_##msg##_schema;                            \
+    static inline err_t wire_##msg##_decode(wire_##msg##_t out[static 1],      \
+                                            const uint8_t* data,               \
+                                            uint64_t length)                   \
+    {                                                                          \
+        return wire_decode(&wire_##msg##_schema, out, data, length, NULL);     \
+    }                                                                          \
+    static inline err_t wire_##msg##_encode(                                   \
+        const wire_##msg##_t in[static 1], uint8_t* out, uint64_t capacity,    \
+        uint64_t length[static 1])                                             \
+    {                                                                          \
+        return wire_encode(&wire_##msg##_schema, in, out, capacity, length);   \
+    }
+
+WIRE_MESSAGES(WIRE_DECLARE)
+
+#endif
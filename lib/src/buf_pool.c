@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "buf_pool.h"
+#include "err_codes.h"
+#include "logger.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/* buffers start on own cache line, so owners on other threads never share */
+#define BUF_POOL_ALIGN 64
+
+typedef struct buf_class_t
+{
+    pthread_mutex_t lock;
+    buf_t* free;
+    uint64_t free_count;
+} buf_class_t;
+
+/* free buffers of single thread, touched only by that thread */
+typedef struct buf_cache_t
+{
+    buf_t* free[BUF_POOL_CLASSES];
+    uint32_t count[BUF_POOL_CLASSES];
+    int32_t registered;
+} buf_cache_t;
+
+static buf_class_t buf_classes[BUF_POOL_CLASSES];
+static pthread_key_t buf_pool_key;
+static pthread_once_t buf_pool_once = PTHREAD_ONCE_INIT;
+static uint64_t buf_pool_slabs;
+static uint64_t buf_pool_slab_bytes;
+static _Thread_local buf_cache_t buf_cache;
+
+static void buf_pool_init(void);
+static uint32_t buf_class_capacity(uint32_t size_class);
+static uint32_t buf_class_stride(uint32_t size_class);
+static uint32_t buf_class_cache_max(uint32_t size_class);
+static err_t buf_class_grow(uint32_t size_class);
+static buf_cache_t* buf_cache_get(void);
+static void buf_cache_refill(buf_cache_t cache[static 1], uint32_t size_class);
+static void buf_cache_drain(buf_cache_t cache[static 1], uint32_t size_class,
+                            uint32_t keep);
+static void buf_cache_release(void* arg);
+
+static void buf_pool_init(void)
+{
+    pthread_key_create(&buf_pool_key, buf_cache_release);
+    for (uint32_t i = 0; i < BUF_POOL_CLASSES; i++)
+    {
+        pthread_mutex_init(&buf_classes[i].lock, NULL);
+    }
+}
+
+static uint32_t buf_class_capacity(uint32_t size_class)
+{
+    return (1u << (BUF_POOL_MIN_SHIFT + size_class)) + BUF_POOL_HEADROOM;
+}
+
+static uint32_t buf_class_stride(uint32_t size_class)
+{
+    uint32_t size =
+        (uint32_t)offsetof(buf_t, data) + buf_class_capacity(size_class);
+    return (size + BUF_POOL_ALIGN - 1) & ~(uint32_t)(BUF_POOL_ALIGN - 1);
+}
+
+/* refills and returns move half of this, big classes keep at least 2 */
+static uint32_t buf_class_cache_max(uint32_t size_class)
+{
+    uint32_t count =
+        BUF_POOL_CACHE_BYTES >> (BUF_POOL_MIN_SHIFT + size_class);
+    return count < 2 ? 2 : count;
+}
+
+/* called with class locked */
+static err_t buf_class_grow(uint32_t size_class)
+{
+    buf_class_t* pool_class = &buf_classes[size_class];
+    uint32_t stride = buf_class_stride(size_class);
+    uint32_t count = buf_class_cache_max(size_class);
+    count = count < BUF_POOL_SLAB_BUFFERS ? count : BUF_POOL_SLAB_BUFFERS;
+    uint8_t* slab = aligned_alloc(BUF_POOL_ALIGN, (size_t)stride * count);
+    if (slab == NULL)
+    {
+        LOG_ERROR("Cannot allocate slab of %u buffers of %u bytes\n", count,
+                  stride);
+        return DISFS_ERR_ALLOC;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        buf_t* buf = (buf_t*)(void*)(slab + (size_t)i * stride);
+        *buf = (buf_t){.next = pool_class->free,
+                       .capacity = buf_class_capacity(size_class),
+                       .size_class = size_class};
+        pool_class->free = buf;
+    }
+    pool_class->free_count += count;
+    __atomic_add_fetch(&buf_pool_slabs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&buf_pool_slab_bytes, (uint64_t)stride * count,
+                       __ATOMIC_RELAXED);
+    return DISFS_SUCCESS;
+}
+
+static buf_cache_t* buf_cache_get(void)
+{
+    buf_cache_t* cache = &buf_cache;
+    if (!cache->registered)
+    {
+        /* cache goes back to global pool when thread exits */
+        pthread_once(&buf_pool_once, buf_pool_init);
+        pthread_setspecific(buf_pool_key, cache);
+        cache->registered = 1;
+    }
+    return cache;
+}
+
+static void buf_cache_refill(buf_cache_t cache[static 1], uint32_t size_class)
+{
+    buf_class_t* pool_class = &buf_classes[size_class];
+    uint32_t batch = buf_class_cache_max(size_class) / 2;
+    pthread_mutex_lock(&pool_class->lock);
+    if (pool_class->free == NULL)
+    {
+        buf_class_grow(size_class);
+    }
+    while (pool_class->free && cache->count[size_class] < batch)
+    {
+        buf_t* buf = pool_class->free;
+        pool_class->free = buf->next;
+        pool_class->free_count--;
+        buf->next = cache->free[size_class];
+        cache->free[size_class] = buf;
+        cache->count[size_class]++;
+    }
+    pthread_mutex_unlock(&pool_class->lock);
+}
+
+/* return all but keep buffers of class to global pool in one lock */
+static void buf_cache_drain(buf_cache_t cache[static 1], uint32_t size_class,
+                            uint32_t keep)
+{
+    uint32_t count = cache->count[size_class] - keep;
+    if (count == 0)
+    {
+        return;
+    }
+    buf_t* first = cache->free[size_class];
+    buf_t* last = first;
+    for (uint32_t i = 1; i < count; i++)
+    {
+        last = last->next;
+    }
+    cache->free[size_class] = last->next;
+    cache->count[size_class] = keep;
+
+    buf_class_t* pool_class = &buf_classes[size_class];
+    pthread_mutex_lock(&pool_class->lock);
+    last->next = pool_class->free;
+    pool_class->free = first;
+    pool_class->free_count += count;
+    pthread_mutex_unlock(&pool_class->lock);
+}
+
+static void buf_cache_release(void* arg)
+{
+    buf_cache_t* cache = arg;
+    for (uint32_t i = 0; i < BUF_POOL_CLASSES; i++)
+    {
+        buf_cache_drain(cache, i, 0);
+    }
+    cache->registered = 0;
+}
+
+buf_t* buf_alloc(uint64_t size)
+{
+    uint32_t size_class = 0;
+    while (size_class < BUF_POOL_CLASSES &&
+           size > buf_class_capacity(size_class))
+    {
+        size_class++;
+    }
+    if (size_class == BUF_POOL_CLASSES)
+    {
+        LOG_ERROR("Buffer of %lu bytes is bigger than largest class\n",
+                  size);
+        return NULL;
+    }
+    buf_cache_t* cache = buf_cache_get();
+    if (cache->free[size_class] == NULL)
+    {
+        buf_cache_refill(cache, size_class);
+        if (cache->free[size_class] == NULL)
+        {
+            return NULL;
+        }
+    }
+    buf_t* buf = cache->free[size_class];
+    cache->free[size_class] = buf->next;
+    cache->count[size_class]--;
+    buf->next = NULL;
+    buf->refs = 1;
+    buf->length = 0;
+    return buf;
+}
+
+void buf_ref(buf_t buf[static 1])
+{
+    __atomic_add_fetch(&buf->refs, 1, __ATOMIC_RELAXED);
+}
+
+void buf_unref(buf_t* buf)
+{
+    if (buf == NULL ||
+        __atomic_sub_fetch(&buf->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+    buf_cache_t* cache = buf_cache_get();
+    uint32_t size_class = buf->size_class;
+    buf->next = cache->free[size_class];
+    cache->free[size_class] = buf;
+    uint32_t max = buf_class_cache_max(size_class);
+    if (++cache->count[size_class] > max)
+    {
+        buf_cache_drain(cache, size_class, max / 2);
+    }
+}
+
+void buf_pool_stats(buf_pool_stats_t stats[static 1])
+{
+    *stats = (buf_pool_stats_t){
+        .slabs = __atomic_load_n(&buf_pool_slabs, __ATOMIC_RELAXED),
+        .slab_bytes = __atomic_load_n(&buf_pool_slab_bytes, __ATOMIC_RELAXED),
+    };
+    pthread_once(&buf_pool_once, buf_pool_init);
+    for (uint32_t i = 0; i < BUF_POOL_CLASSES; i++)
+    {
+        pthread_mutex_lock(&buf_classes[i].lock);
+        stats->global_free += buf_classes[i].free_count;
+        pthread_mutex_unlock(&buf_classes[i].lock);
+    }
+}
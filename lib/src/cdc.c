@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cdc.h"
+#include <pthread.h>
+
+/* mask of bits high in hash, bit 63 is left out so mask << 1 keeps them */
+#define CDC_MASK(bits) (((1ULL << (bits)) - 1) << (63 - (bits)))
+/* normalization level 2, avg is 2^14 */
+#define CDC_MASK_S CDC_MASK(16)
+#define CDC_MASK_L CDC_MASK(12)
+#define CDC_GEAR_SEED 0x6A09E667F3BCC908ULL
+
+typedef uint32_t (*cdc_scan_fn)(const uint8_t* data, uint32_t i,
+                                uint32_t end, uint64_t mask,
+                                uint64_t hash[static 1]);
+
+/* every node has to cut the same data in the same place */
+static uint64_t cdc_gear[256];
+static uint64_t cdc_gear_ls[256]; /* cdc_gear << 1 */
+static pthread_once_t cdc_once = PTHREAD_ONCE_INIT;
+
+static void cdc_setup(void);
+static uint32_t cdc_cut_with(const uint8_t* data, uint32_t length,
+                             cdc_scan_fn scan);
+static uint32_t cdc_scan_scalar(const uint8_t* data, uint32_t i,
+                                uint32_t end, uint64_t mask,
+                                uint64_t hash[static 1]);
+static uint32_t cdc_scan_pairs(const uint8_t* data, uint32_t i, uint32_t end,
+                               uint64_t mask, uint64_t hash[static 1]);
+
+/* splitmix64 of fixed seed */
+static void cdc_setup(void)
+{
+    uint64_t state = CDC_GEAR_SEED;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        state += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        cdc_gear[i] = z ^ (z >> 31);
+        cdc_gear_ls[i] = cdc_gear[i] << 1;
+    }
+}
+
+uint32_t cdc_cut(const void* data, uint32_t length)
+{
+    return cdc_cut_with(data, length, cdc_scan_pairs);
+}
+
+uint32_t cdc_cut_scalar(const void* data, uint32_t length)
+{
+    return cdc_cut_with(data, length, cdc_scan_scalar);
+}
+
+static uint32_t cdc_cut_with(const uint8_t* data, uint32_t length,
+                             cdc_scan_fn scan)
+{
+    pthread_once(&cdc_once, cdc_setup);
+    if (length <= CDC_MIN_SIZE)
+    {
+        return length;
+    }
+    uint32_t end = length < CDC_MAX_SIZE ? length : CDC_MAX_SIZE;
+    uint32_t normal = end < CDC_AVG_SIZE ? end : CDC_AVG_SIZE;
+    uint64_t hash = 0;
+    uint32_t cut = scan(data, CDC_MIN_SIZE, normal, CDC_MASK_S, &hash);
+    if (cut == 0)
+    {
+        cut = scan(data, normal, end, CDC_MASK_L, &hash);
+    }
+    return cut ? cut : end;
+}
+
+/* cut after byte i is i + 1, so 0 means no cut before end */
+static uint32_t cdc_scan_scalar(const uint8_t* data, uint32_t i,
+                                uint32_t end, uint64_t mask,
+                                uint64_t hash[static 1])
+{
+    uint64_t h = *hash;
+    for (; i < end; i++)
+    {
+        h = (h << 1) + cdc_gear[data[i]];
+        if (!(h & mask))
+        {
+            return i + 1;
+        }
+    }
+    *hash = h;
+    return 0;
+}
+
+/*
+ * Two bytes per step. Hash after first byte is checked shifted left once
+ * more, against shifted mask, so table of shifted entries saves the shift and
+ * one step is one shift and two adds instead of two of each.
+ */
+static uint32_t cdc_scan_pairs(const uint8_t* data, uint32_t i, uint32_t end,
+                               uint64_t mask, uint64_t hash[static 1])
+{
+    uint64_t h = *hash;
+    uint64_t mask_ls = mask << 1;
+    const uint8_t* p = data + i;
+    const uint8_t* last = data + end - 1;
+    for (; p < last; p += 2)
+    {
+        uint64_t first = (h << 2) + cdc_gear_ls[p[0]];
+        h = first + cdc_gear[p[1]];
+        if (!(first & mask_ls))
+        {
+            return (uint32_t)(p - data) + 1;
+        }
+        if (!(h & mask))
+        {
+            return (uint32_t)(p - data) + 2;
+        }
+    }
+    *hash = h;
+    i = (uint32_t)(p - data);
+    return i < end ? cdc_scan_scalar(data, i, end, mask, hash) : 0;
+}
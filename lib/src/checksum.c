@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "checksum.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#define CHECKSUM_ARM 1
+#endif
+
+/* CRC32C polynomial 0x1EDC6F41, bit reflected */
+#define CRC32C_POLY 0x82F63B78u
+/* bytes of each of three interleaved streams, long ones hide latency of
+ * crc32 instruction on large buffers, short ones on medium */
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+#define XXH32_PRIME1 2654435761u
+#define XXH32_PRIME2 2246822519u
+#define XXH32_PRIME3 3266489917u
+#define XXH32_PRIME4 668265263u
+#define XXH32_PRIME5 374761393u
+
+/**
+ * @brief CRC32C register after data, without initial and final inversion
+ */
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t* data,
+                              uint64_t length);
+
+static uint32_t crc32c_table[8][256];
+/* x^(2^k) mod P */
+static uint32_t crc32c_x2n[64];
+/* x^(8 * bytes - 33) mod P, multiplier of pclmulqdq shift of stream */
+static uint32_t crc32c_clmul_long[2];
+static uint32_t crc32c_clmul_short[2];
+/* x^(8 * bytes) mod P, multiplier of software shift of stream */
+static uint32_t crc32c_shift_long[2];
+static uint32_t crc32c_shift_short[2];
+static pthread_once_t checksum_once = PTHREAD_ONCE_INIT;
+static crc32c_fn crc32c_update;
+static int32_t checksum_impl_in_use;
+
+static void checksum_setup(void);
+static int32_t checksum_supported(int32_t impl);
+static crc32c_fn checksum_impl_fn(int32_t impl);
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b);
+static uint32_t crc32c_xpow(uint64_t exponent);
+static uint64_t crc32c_load(const uint8_t* data);
+static uint32_t xxh32_load(const uint8_t* data);
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t* data,
+                              uint64_t length);
+#ifdef CHECKSUM_X86
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data,
+                             uint64_t length);
+static uint32_t crc32c_clmul_shift(uint32_t crc0, uint32_t crc1,
+                                   const uint32_t k[static 2]);
+static uint32_t crc32c_pclmul(uint32_t crc, const uint8_t* data,
+                              uint64_t length);
+#endif
+#ifdef CHECKSUM_ARM
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t* data,
+                             uint64_t length);
+#endif
+static uint32_t xxh32_round(uint32_t acc, uint32_t input);
+static uint32_t xxh32_rotl(uint32_t x, uint32_t r);
+
+static void checksum_setup(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (uint32_t bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[0][i] = crc;
+    }
+    /* table k advances crc over byte followed by k zero bytes */
+    for (uint32_t k = 1; k < 8; k++)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (crc >> 8) ^ crc32c_table[0][crc & 0xFF];
+        }
+    }
+    crc32c_x2n[0] = 1u << 30; /* x^1 */
+    for (uint32_t k = 1; k < 64; k++)
+    {
+        crc32c_x2n[k] = crc32c_multiply(crc32c_x2n[k - 1], crc32c_x2n[k - 1]);
+    }
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        uint64_t shift = 8 * (i + 1);
+        crc32c_clmul_long[i] = crc32c_xpow(shift * CRC32C_LONG - 33);
+        crc32c_clmul_short[i] = crc32c_xpow(shift * CRC32C_SHORT - 33);
+        crc32c_shift_long[i] = crc32c_xpow(shift * CRC32C_LONG);
+        crc32c_shift_short[i] = crc32c_xpow(shift * CRC32C_SHORT);
+    }
+
+    int32_t best = CHECKSUM_IMPL_SCALAR;
+    for (int32_t impl = CHECKSUM_IMPL_SSE42; impl < CHECKSUM_IMPL_MAX; impl++)
+    {
+        best = checksum_supported(impl) ? impl : best;
+    }
+    checksum_impl_in_use = best;
+    __atomic_store_n(&crc32c_update, checksum_impl_fn(best), __ATOMIC_RELEASE);
+}
+
+static int32_t checksum_supported(int32_t impl)
+{
+    switch (impl)
+    {
+    case CHECKSUM_IMPL_SCALAR:
+        return 1;
+#ifdef CHECKSUM_X86
+    case CHECKSUM_IMPL_SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case CHECKSUM_IMPL_PCLMUL:
+        return __builtin_cpu_supports("sse4.2") &&
+               __builtin_cpu_supports("pclmul");
+#endif
+#ifdef CHECKSUM_ARM
+    case CHECKSUM_IMPL_ARMV8:
+        return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static crc32c_fn checksum_impl_fn(int32_t impl)
+{
+    switch (impl)
+    {
+#ifdef CHECKSUM_X86
+    case CHECKSUM_IMPL_SSE42:
+        return crc32c_sse42;
+    case CHECKSUM_IMPL_PCLMUL:
+        return crc32c_pclmul;
+#endif
+#ifdef CHECKSUM_ARM
+    case CHECKSUM_IMPL_ARMV8:
+        return crc32c_armv8;
+#endif
+    default:
+        return crc32c_scalar;
+    }
+}
+
+err_t checksum_select_impl(int32_t impl)
+{
+    pthread_once(&checksum_once, checksum_setup);
+    if (impl == CHECKSUM_IMPL_AUTO)
+    {
+        for (impl = CHECKSUM_IMPL_MAX - 1; !checksum_supported(impl); impl--)
+        {
+        }
+    }
+    if (!checksum_supported(impl))
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    checksum_impl_in_use = impl;
+    __atomic_store_n(&crc32c_update, checksum_impl_fn(impl), __ATOMIC_RELEASE);
+    return DISFS_SUCCESS;
+}
+
+int32_t checksum_active_impl(void)
+{
+    pthread_once(&checksum_once, checksum_setup);
+    return checksum_impl_in_use;
+}
+
+const char* checksum_impl_name(int32_t impl)
+{
+    static const char* names[CHECKSUM_IMPL_MAX] = {"auto", "scalar", "sse42",
+                                                   "pclmul", "armv8"};
+    return impl >= 0 && impl < CHECKSUM_IMPL_MAX ? names[impl] : "?";
+}
+
+/* product of polynomials modulo P, both bit reflected */
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m != 0; m >>= 1)
+    {
+        if (a & m)
+        {
+            product ^= b;
+        }
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+static uint32_t crc32c_xpow(uint64_t exponent)
+{
+    uint32_t p = 1u << 31; /* x^0 */
+    for (uint32_t k = 0; exponent != 0; exponent >>= 1, k++)
+    {
+        if (exponent & 1)
+        {
+            p = crc32c_multiply(crc32c_x2n[k], p);
+        }
+    }
+    return p;
+}
+
+static uint64_t crc32c_load(const uint8_t* data)
+{
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, uint64_t length)
+{
+    pthread_once(&checksum_once, checksum_setup);
+    crc32c_fn update = __atomic_load_n(&crc32c_update, __ATOMIC_ACQUIRE);
+    return ~update(~crc, data, length);
+}
+
+/*
+ * Register is linear in message, so CRC of concatenation is CRC of first
+ * part followed by length2 zero bytes, i.e. multiplied by x^(8 * length2),
+ * plus CRC of second part. Initial and final inversions cancel out.
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t length2)
+{
+    pthread_once(&checksum_once, checksum_setup);
+    return crc32c_multiply(crc32c_xpow(8 * length2), crc1) ^ crc2;
+}
+
+/* slicing by 8, eight bytes advance register with one lookup per byte */
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t* data,
+                              uint64_t length)
+{
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        uint64_t word = crc32c_load(data) ^ crc;
+        crc = crc32c_table[7][word & 0xFF] ^
+              crc32c_table[6][(word >> 8) & 0xFF] ^
+              crc32c_table[5][(word >> 16) & 0xFF] ^
+              crc32c_table[4][(word >> 24) & 0xFF] ^
+              crc32c_table[3][(word >> 32) & 0xFF] ^
+              crc32c_table[2][(word >> 40) & 0xFF] ^
+              crc32c_table[1][(word >> 48) & 0xFF] ^
+              crc32c_table[0][word >> 56];
+    }
+    for (; length > 0; data++, length--)
+    {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CHECKSUM_X86
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t* data, uint64_t length)
+{
+    uint64_t wide = crc;
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        wide = _mm_crc32_u64(wide, crc32c_load(data));
+    }
+    crc = (uint32_t)wide;
+    for (; length > 0; data++, length--)
+    {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+/*
+ * crc0 * x^(16 * stream) + crc1 * x^(8 * stream). Carry-less product of
+ * reflected crc and x^(8 * stream - 33) is 64-bit message whose CRC adds the
+ * missing x^33, so crc32 instruction also reduces product modulo P.
+ */
+__attribute__((target("sse4.2,pclmul"))) static uint32_t
+crc32c_clmul_shift(uint32_t crc0, uint32_t crc1, const uint32_t k[static 2])
+{
+    __m128i a = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int32_t)crc0),
+                                     _mm_cvtsi32_si128((int32_t)k[1]), 0x00);
+    __m128i b = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int32_t)crc1),
+                                     _mm_cvtsi32_si128((int32_t)k[0]), 0x00);
+    uint64_t product = (uint64_t)_mm_cvtsi128_si64(_mm_xor_si128(a, b));
+    return (uint32_t)_mm_crc32_u64(0, product);
+}
+
+/* three independent streams keep crc32 unit busy despite its latency */
+__attribute__((target("sse4.2,pclmul"))) static uint32_t
+crc32c_pclmul(uint32_t crc, const uint8_t* data, uint64_t length)
+{
+    for (; length >= 3 * CRC32C_LONG;
+         data += 3 * CRC32C_LONG, length -= 3 * CRC32C_LONG)
+    {
+        uint64_t crc0 = crc;
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const uint8_t* next = data + CRC32C_LONG;
+        const uint8_t* last = next + CRC32C_LONG;
+        for (uint32_t i = 0; i < CRC32C_LONG; i += 8)
+        {
+            crc0 = _mm_crc32_u64(crc0, crc32c_load(data + i));
+            crc1 = _mm_crc32_u64(crc1, crc32c_load(next + i));
+            crc2 = _mm_crc32_u64(crc2, crc32c_load(last + i));
+        }
+        crc = crc32c_clmul_shift((uint32_t)crc0, (uint32_t)crc1,
+                                 crc32c_clmul_long) ^
+              (uint32_t)crc2;
+    }
+    for (; length >= 3 * CRC32C_SHORT;
+         data += 3 * CRC32C_SHORT, length -= 3 * CRC32C_SHORT)
+    {
+        uint64_t crc0 = crc;
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const uint8_t* next = data + CRC32C_SHORT;
+        const uint8_t* last = next + CRC32C_SHORT;
+        for (uint32_t i = 0; i < CRC32C_SHORT; i += 8)
+        {
+            crc0 = _mm_crc32_u64(crc0, crc32c_load(data + i));
+            crc1 = _mm_crc32_u64(crc1, crc32c_load(next + i));
+            crc2 = _mm_crc32_u64(crc2, crc32c_load(last + i));
+        }
+        crc = crc32c_clmul_shift((uint32_t)crc0, (uint32_t)crc1,
+                                 crc32c_clmul_short) ^
+              (uint32_t)crc2;
+    }
+    return crc32c_sse42(crc, data, length);
+}
+#endif
+
+#ifdef CHECKSUM_ARM
+/* streams are joined in software, once per few kilobytes */
+__attribute__((target("+crc"))) static uint32_t
+crc32c_armv8(uint32_t crc, const uint8_t* data, uint64_t length)
+{
+    for (; length >= 3 * CRC32C_LONG;
+         data += 3 * CRC32C_LONG, length -= 3 * CRC32C_LONG)
+    {
+        uint32_t crc0 = crc;
+        uint32_t crc1 = 0;
+        uint32_t crc2 = 0;
+        const uint8_t* next = data + CRC32C_LONG;
+        const uint8_t* last = next + CRC32C_LONG;
+        for (uint32_t i = 0; i < CRC32C_LONG; i += 8)
+        {
+            crc0 = __crc32cd(crc0, crc32c_load(data + i));
+            crc1 = __crc32cd(crc1, crc32c_load(next + i));
+            crc2 = __crc32cd(crc2, crc32c_load(last + i));
+        }
+        crc = crc32c_multiply(crc32c_shift_long[1], crc0) ^
+              crc32c_multiply(crc32c_shift_long[0], crc1) ^ crc2;
+    }
+    for (; length >= 3 * CRC32C_SHORT;
+         data += 3 * CRC32C_SHORT, length -= 3 * CRC32C_SHORT)
+    {
+        uint32_t crc0 = crc;
+        uint32_t crc1 = 0;
+        uint32_t crc2 = 0;
+        const uint8_t* next = data + CRC32C_SHORT;
+        const uint8_t* last = next + CRC32C_SHORT;
+        for (uint32_t i = 0; i < CRC32C_SHORT; i += 8)
+        {
+            crc0 = __crc32cd(crc0, crc32c_load(data + i));
+            crc1 = __crc32cd(crc1, crc32c_load(next + i));
+            crc2 = __crc32cd(crc2, crc32c_load(last + i));
+        }
+        crc = crc32c_multiply(crc32c_shift_short[1], crc0) ^
+              crc32c_multiply(crc32c_shift_short[0], crc1) ^ crc2;
+    }
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        crc = __crc32cd(crc, crc32c_load(data));
+    }
+    for (; length > 0; data++, length--)
+    {
+        crc = __crc32cb(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+static uint32_t xxh32_load(const uint8_t* data)
+{
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap32(word);
+#endif
+    return word;
+}
+
+static uint32_t xxh32_rotl(uint32_t x, uint32_t r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxh32_round(uint32_t acc, uint32_t input)
+{
+    acc += input * XXH32_PRIME2;
+    return xxh32_rotl(acc, 13) * XXH32_PRIME1;
+}
+
+void xxh32_init(xxh32_state_t state[static 1], uint32_t seed)
+{
+    *state = (xxh32_state_t){
+        .lanes = {seed + XXH32_PRIME1 + XXH32_PRIME2, seed + XXH32_PRIME2,
+                  seed, seed - XXH32_PRIME1},
+        .seed = seed,
+    };
+}
+
+void xxh32_update(xxh32_state_t state[static 1], const void* data,
+                  uint64_t length)
+{
+    const uint8_t* in = data;
+    state->total += length;
+    if (state->buffered + length < 16)
+    {
+        memcpy(state->buffer + state->buffered, in, length);
+        state->buffered += (uint32_t)length;
+        return;
+    }
+    if (state->buffered > 0)
+    {
+        uint32_t fill = 16 - state->buffered;
+        memcpy(state->buffer + state->buffered, in, fill);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            state->lanes[i] =
+                xxh32_round(state->lanes[i], xxh32_load(state->buffer + 4 * i));
+        }
+        in += fill;
+        length -= fill;
+        state->buffered = 0;
+    }
+    uint32_t lanes[4] = {state->lanes[0], state->lanes[1], state->lanes[2],
+                         state->lanes[3]};
+    for (; length >= 16; in += 16, length -= 16)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            lanes[i] = xxh32_round(lanes[i], xxh32_load(in + 4 * i));
+        }
+    }
+    memcpy(state->lanes, lanes, sizeof(lanes));
+    memcpy(state->buffer, in, length);
+    state->buffered = (uint32_t)length;
+}
+
+uint32_t xxh32_digest(const xxh32_state_t state[static 1])
+{
+    uint32_t h;
+    if (state->total >= 16)
+    {
+        h = xxh32_rotl(state->lanes[0], 1) + xxh32_rotl(state->lanes[1], 7) +
+            xxh32_rotl(state->lanes[2], 12) + xxh32_rotl(state->lanes[3], 18);
+    }
+    else
+    {
+        h = state->seed + XXH32_PRIME5;
+    }
+    h += (uint32_t)state->total;
+    uint32_t i = 0;
+    for (; i + 4 <= state->buffered; i += 4)
+    {
+        h += xxh32_load(state->buffer + i) * XXH32_PRIME3;
+        h = xxh32_rotl(h, 17) * XXH32_PRIME4;
+    }
+    for (; i < state->buffered; i++)
+    {
+        h += state->buffer[i] * XXH32_PRIME5;
+        h = xxh32_rotl(h, 11) * XXH32_PRIME1;
+    }
+    h ^= h >> 15;
+    h *= XXH32_PRIME2;
+    h ^= h >> 13;
+    h *= XXH32_PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t xxh32(const void* data, uint64_t length, uint32_t seed)
+{
+    xxh32_state_t state;
+    xxh32_init(&state, seed);
+    xxh32_update(&state, data, length);
+    return xxh32_digest(&state);
+}
+
+void checksum_init(checksum_t sum[static 1], uint32_t kind)
+{
+    sum->kind = kind;
+    sum->crc = 0;
+    if (kind == CHECKSUM_XXH32)
+    {
+        xxh32_init(&sum->xxh, 0);
+    }
+}
+
+void checksum_update(checksum_t sum[static 1], const void* data,
+                     uint64_t length)
+{
+    if (sum->kind == CHECKSUM_XXH32)
+    {
+        xxh32_update(&sum->xxh, data, length);
+        return;
+    }
+    sum->crc = crc32c(sum->crc, data, length);
+}
+
+uint32_t checksum_final(const checksum_t sum[static 1])
+{
+    return sum->kind == CHECKSUM_XXH32 ? xxh32_digest(&sum->xxh) : sum->crc;
+}
@@ -0,0 +1,588 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "chunk_cache.h"
+#include "buf_pool.h"
+#include "connection.h"
+#include "hash_ring.h"
+#include "logger.h"
+#include "sha256.h"
+#include "wire.h"
+#include <stdlib.h>
+
+#define CHUNK_CACHE_INITIAL_BUCKETS 64
+
+/* context of chunk request sent to peer */
+typedef struct chunk_cache_request_t
+{
+    chunk_cache_t* cache;
+    chunk_hash_t hash;
+} chunk_cache_request_t;
+
+static chunk_cache_shard_t*
+chunk_cache_shard(chunk_cache_t cache[static 1],
+                  const chunk_hash_t hash[static 1]);
+static uint32_t chunk_cache_bucket(const chunk_cache_shard_t shard[static 1],
+                                   const chunk_hash_t hash[static 1]);
+static chunk_cache_entry_t*
+chunk_cache_find(chunk_cache_shard_t shard[static 1],
+                 const chunk_hash_t hash[static 1]);
+static err_t chunk_cache_grow(chunk_cache_shard_t shard[static 1]);
+static void chunk_cache_unlink(chunk_cache_shard_t shard[static 1],
+                               chunk_cache_entry_t entry[static 1]);
+static void chunk_cache_push(chunk_cache_shard_t shard[static 1],
+                             chunk_cache_entry_t entry[static 1],
+                             uint32_t list);
+static void chunk_cache_pop(chunk_cache_shard_t shard[static 1],
+                            chunk_cache_entry_t entry[static 1]);
+static void chunk_cache_forget(chunk_cache_shard_t shard[static 1],
+                               chunk_cache_entry_t* entry);
+static void chunk_cache_adapt(chunk_cache_shard_t shard[static 1],
+                              const chunk_cache_entry_t ghost[static 1]);
+static void chunk_cache_replace(chunk_cache_shard_t shard[static 1],
+                                uint64_t size, uint8_t in_b2);
+static void chunk_cache_insert(chunk_cache_shard_t shard[static 1],
+                               chunk_cache_miss_t miss[static 1]);
+static chunk_cache_miss_t*
+chunk_cache_find_miss(chunk_cache_shard_t shard[static 1],
+                      const chunk_hash_t hash[static 1]);
+static err_t chunk_cache_copy(struct buf_t* data, uint32_t length,
+                              void* buffer, uint32_t buffer_len,
+                              uint32_t out[static 1]);
+static void chunk_cache_fetched(void* ctx, client_t* client, err_t status,
+                                const proto_frame_t* reply);
+
+static chunk_cache_shard_t*
+chunk_cache_shard(chunk_cache_t cache[static 1],
+                  const chunk_hash_t hash[static 1])
+{
+    /* bucket is picked by leading bytes, shard by following ones */
+    return &cache->shards[hash->bytes[8] & (CHUNK_CACHE_SHARDS - 1)];
+}
+
+static uint32_t chunk_cache_bucket(const chunk_cache_shard_t shard[static 1],
+                                   const chunk_hash_t hash[static 1])
+{
+    return (uint32_t)hash_ring_key(hash->bytes) & (shard->bucket_count - 1);
+}
+
+static chunk_cache_entry_t*
+chunk_cache_find(chunk_cache_shard_t shard[static 1],
+                 const chunk_hash_t hash[static 1])
+{
+    chunk_cache_entry_t* entry =
+        shard->buckets[chunk_cache_bucket(shard, hash)];
+    while (entry && memcmp(entry->hash.bytes, hash->bytes, CHUNK_HASH_SIZE))
+    {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+static err_t chunk_cache_grow(chunk_cache_shard_t shard[static 1])
+{
+    uint32_t old_count = shard->bucket_count;
+    chunk_cache_entry_t** old = shard->buckets;
+    uint32_t count = old_count ? old_count * 2 : CHUNK_CACHE_INITIAL_BUCKETS;
+    chunk_cache_entry_t** buckets = calloc(count, sizeof(*buckets));
+    if (buckets == NULL)
+    {
+        LOG_ERROR("Cannot grow chunk cache index to %u buckets\n", count);
+        return DISFS_ERR_ALLOC;
+    }
+    shard->buckets = buckets;
+    shard->bucket_count = count;
+    for (uint32_t i = 0; i < old_count; i++)
+    {
+        while (old[i])
+        {
+            chunk_cache_entry_t* entry = old[i];
+            old[i] = entry->hash_next;
+            uint32_t bucket = chunk_cache_bucket(shard, &entry->hash);
+            entry->hash_next = buckets[bucket];
+            buckets[bucket] = entry;
+        }
+    }
+    free(old);
+    return DISFS_SUCCESS;
+}
+
+static void chunk_cache_unlink(chunk_cache_shard_t shard[static 1],
+                               chunk_cache_entry_t entry[static 1])
+{
+    chunk_cache_entry_t** link =
+        &shard->buckets[chunk_cache_bucket(shard, &entry->hash)];
+    while (*link != entry)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    shard->count--;
+}
+
+/* entry becomes most recently used of list */
+static void chunk_cache_push(chunk_cache_shard_t shard[static 1],
+                             chunk_cache_entry_t entry[static 1],
+                             uint32_t list)
+{
+    chunk_cache_queue_t* queue = &shard->lists[list];
+    if (queue->head == NULL)
+    {
+        entry->prev = entry;
+        entry->next = entry;
+        queue->head = entry;
+    }
+    else
+    {
+        entry->next = queue->head;
+        entry->prev = queue->head->prev;
+        entry->prev->next = entry;
+        queue->head->prev = entry;
+    }
+    queue->bytes += entry->size;
+    entry->list = list;
+}
+
+static void chunk_cache_pop(chunk_cache_shard_t shard[static 1],
+                            chunk_cache_entry_t entry[static 1])
+{
+    chunk_cache_queue_t* queue = &shard->lists[entry->list];
+    if (entry->next == entry)
+    {
+        queue->head = NULL;
+    }
+    else
+    {
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+        if (queue->head == entry)
+        {
+            queue->head = entry->next;
+        }
+    }
+    queue->bytes -= entry->size;
+}
+
+static void chunk_cache_forget(chunk_cache_shard_t shard[static 1],
+                               chunk_cache_entry_t* entry)
+{
+    chunk_cache_pop(shard, entry);
+    chunk_cache_unlink(shard, entry);
+    buf_unref(entry->data);
+    free(entry);
+}
+
+/*
+ * Hit of ghost means its list would have kept it with more memory, so target
+ * size of T1 moves towards that list, faster when other ghost list is larger.
+ */
+static void chunk_cache_adapt(chunk_cache_shard_t shard[static 1],
+                              const chunk_cache_entry_t ghost[static 1])
+{
+    uint64_t b1 = shard->lists[CHUNK_CACHE_RECENT_GHOST].bytes;
+    uint64_t b2 = shard->lists[CHUNK_CACHE_FREQUENT_GHOST].bytes;
+    if (ghost->list == CHUNK_CACHE_RECENT_GHOST)
+    {
+        uint64_t delta = b1 >= b2 ? ghost->size : ghost->size * b2 / b1;
+        shard->target = shard->target + delta < shard->capacity
+                            ? shard->target + delta
+                            : shard->capacity;
+    }
+    else
+    {
+        uint64_t delta = b2 >= b1 ? ghost->size : ghost->size * b1 / b2;
+        shard->target = shard->target > delta ? shard->target - delta : 0;
+    }
+}
+
+/*
+ * Evict until size more bytes fit budget, then trim ghost lists. With T1 at
+ * its target, chunk coming back from B2 takes space of T1, as in ARC.
+ */
+static void chunk_cache_replace(chunk_cache_shard_t shard[static 1],
+                                uint64_t size, uint8_t in_b2)
+{
+    chunk_cache_queue_t* lists = shard->lists;
+    while (lists[CHUNK_CACHE_RECENT].bytes + lists[CHUNK_CACHE_FREQUENT].bytes +
+               size >
+           shard->capacity)
+    {
+        uint64_t t1 = lists[CHUNK_CACHE_RECENT].bytes;
+        uint32_t from = CHUNK_CACHE_RECENT;
+        if (lists[CHUNK_CACHE_FREQUENT].head &&
+            (t1 == 0 || t1 < shard->target ||
+             (t1 == shard->target && !in_b2)))
+        {
+            from = CHUNK_CACHE_FREQUENT;
+        }
+        chunk_cache_entry_t* victim = lists[from].head;
+        chunk_cache_pop(shard, victim);
+        buf_unref(victim->data);
+        victim->data = NULL;
+        chunk_cache_push(shard, victim, from + CHUNK_CACHE_RECENT_GHOST);
+        shard->stats.evictions++;
+        shard->stats.resident_bytes -= victim->size;
+        shard->stats.resident_chunks--;
+    }
+    while (lists[CHUNK_CACHE_RECENT_GHOST].head &&
+           lists[CHUNK_CACHE_RECENT].bytes +
+                   lists[CHUNK_CACHE_RECENT_GHOST].bytes >
+               shard->capacity)
+    {
+        chunk_cache_forget(shard, lists[CHUNK_CACHE_RECENT_GHOST].head);
+    }
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < CHUNK_CACHE_LISTS; i++)
+    {
+        total += lists[i].bytes;
+    }
+    while (lists[CHUNK_CACHE_FREQUENT_GHOST].head &&
+           total > 2 * shard->capacity)
+    {
+        chunk_cache_entry_t* ghost = lists[CHUNK_CACHE_FREQUENT_GHOST].head;
+        total -= ghost->size;
+        chunk_cache_forget(shard, ghost);
+    }
+}
+
+static void chunk_cache_insert(chunk_cache_shard_t shard[static 1],
+                               chunk_cache_miss_t miss[static 1])
+{
+    uint64_t size = miss->data->capacity;
+    if (size > shard->capacity)
+    {
+        return;
+    }
+    if (shard->count >= shard->bucket_count &&
+        chunk_cache_grow(shard) != DISFS_SUCCESS)
+    {
+        return;
+    }
+    chunk_cache_entry_t* entry = malloc(sizeof(*entry));
+    if (entry == NULL)
+    {
+        LOG_ERROR("Cannot allocate chunk cache entry\n");
+        return;
+    }
+    chunk_cache_replace(shard, size, miss->in_b2);
+    *entry = (chunk_cache_entry_t){
+        .hash = miss->hash,
+        .data = miss->data,
+        .length = miss->length,
+        .size = (uint32_t)size,
+    };
+    buf_ref(miss->data);
+    uint32_t bucket = chunk_cache_bucket(shard, &entry->hash);
+    entry->hash_next = shard->buckets[bucket];
+    shard->buckets[bucket] = entry;
+    shard->count++;
+    chunk_cache_push(shard, entry,
+                     miss->frequent ? CHUNK_CACHE_FREQUENT
+                                    : CHUNK_CACHE_RECENT);
+    shard->stats.resident_bytes += size;
+    shard->stats.resident_chunks++;
+}
+
+static chunk_cache_miss_t*
+chunk_cache_find_miss(chunk_cache_shard_t shard[static 1],
+                      const chunk_hash_t hash[static 1])
+{
+    chunk_cache_miss_t* miss = shard->misses;
+    while (miss && memcmp(miss->hash.bytes, hash->bytes, CHUNK_HASH_SIZE))
+    {
+        miss = miss->next;
+    }
+    return miss;
+}
+
+static err_t chunk_cache_copy(struct buf_t* data, uint32_t length,
+                              void* buffer, uint32_t buffer_len,
+                              uint32_t out[static 1])
+{
+    if (length > buffer_len)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    memcpy(buffer, data->data, length);
+    *out = length;
+    return DISFS_SUCCESS;
+}
+
+err_t chunk_cache_init(chunk_cache_t cache[static 1], uint64_t capacity,
+                       chunk_cache_fetch_fn fetch, void* fetch_ctx)
+{
+    *cache = (chunk_cache_t){.fetch = fetch, .fetch_ctx = fetch_ctx};
+    for (uint32_t i = 0; i < CHUNK_CACHE_SHARDS; i++)
+    {
+        chunk_cache_shard_t* shard = &cache->shards[i];
+        shard->capacity = capacity / CHUNK_CACHE_SHARDS;
+        pthread_mutex_init(&shard->lock, NULL);
+        pthread_cond_init(&shard->fetched, NULL);
+        err_t ret = chunk_cache_grow(shard);
+        if (ret != DISFS_SUCCESS)
+        {
+            chunk_cache_destroy(cache);
+            return ret;
+        }
+    }
+    return DISFS_SUCCESS;
+}
+
+void chunk_cache_destroy(chunk_cache_t cache[static 1])
+{
+    for (uint32_t i = 0; i < CHUNK_CACHE_SHARDS; i++)
+    {
+        chunk_cache_shard_t* shard = &cache->shards[i];
+        for (uint32_t j = 0; j < CHUNK_CACHE_LISTS; j++)
+        {
+            while (shard->lists[j].head)
+            {
+                chunk_cache_forget(shard, shard->lists[j].head);
+            }
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+        pthread_cond_destroy(&shard->fetched);
+    }
+    *cache = (chunk_cache_t){};
+}
+
+err_t chunk_cache_get(chunk_cache_t cache[static 1],
+                      const chunk_hash_t hash[static 1], void* buffer,
+                      uint32_t buffer_len, uint32_t length[static 1])
+{
+    chunk_cache_shard_t* shard = chunk_cache_shard(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    chunk_cache_entry_t* entry = chunk_cache_find(shard, hash);
+    if (entry && entry->data)
+    {
+        /* hit is promoted to frequent list, data is copied without lock */
+        chunk_cache_pop(shard, entry);
+        chunk_cache_push(shard, entry, CHUNK_CACHE_FREQUENT);
+        struct buf_t* data = entry->data;
+        uint32_t chunk_length = entry->length;
+        buf_ref(data);
+        shard->stats.hits++;
+        shard->stats.bytes_saved += chunk_length;
+        pthread_mutex_unlock(&shard->lock);
+        err_t ret =
+            chunk_cache_copy(data, chunk_length, buffer, buffer_len, length);
+        buf_unref(data);
+        return ret;
+    }
+
+    chunk_cache_miss_t* miss = chunk_cache_find_miss(shard, hash);
+    if (miss)
+    {
+        miss->waiters++;
+        shard->stats.coalesced++;
+    }
+    else
+    {
+        miss = calloc(1, sizeof(*miss));
+        if (miss == NULL)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            LOG_ERROR("Cannot allocate fetch of chunk\n");
+            return DISFS_ERR_ALLOC;
+        }
+        miss->hash = *hash;
+        miss->waiters = 1;
+        if (entry)
+        {
+            /* ghost hit, chunk returns as frequent and ghost is dropped */
+            chunk_cache_adapt(shard, entry);
+            miss->frequent = 1;
+            miss->in_b2 = entry->list == CHUNK_CACHE_FREQUENT_GHOST;
+            chunk_cache_forget(shard, entry);
+            shard->stats.ghost_hits++;
+        }
+        miss->next = shard->misses;
+        shard->misses = miss;
+        shard->stats.misses++;
+        pthread_mutex_unlock(&shard->lock);
+        cache->fetch(cache->fetch_ctx, cache, hash);
+        pthread_mutex_lock(&shard->lock);
+    }
+    while (!miss->done)
+    {
+        pthread_cond_wait(&shard->fetched, &shard->lock);
+    }
+    err_t ret = miss->status;
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = chunk_cache_copy(miss->data, miss->length, buffer, buffer_len,
+                               length);
+        if (miss->waiters > 1)
+        {
+            shard->stats.bytes_saved += miss->length;
+        }
+    }
+    if (--miss->waiters == 0)
+    {
+        buf_unref(miss->data);
+        free(miss);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return ret;
+}
+
+void chunk_cache_fill(chunk_cache_t cache[static 1],
+                      const chunk_hash_t hash[static 1], err_t status,
+                      const void* data, uint32_t length)
+{
+    struct buf_t* buf = NULL;
+    if (status == DISFS_SUCCESS)
+    {
+        /* hash is verified before lock, peer cannot poison the cache */
+        uint8_t digest[CHUNK_HASH_SIZE];
+        sha256(data, length, digest);
+        if (length > CHUNK_MAX_SIZE ||
+            memcmp(digest, hash->bytes, CHUNK_HASH_SIZE) != 0)
+        {
+            LOG_WARNING("Fetched chunk of %u bytes does not match its hash\n",
+                        length);
+            status = DISFS_ERR_CORRUPT;
+        }
+        else if ((buf = buf_alloc(length)) == NULL)
+        {
+            status = DISFS_ERR_ALLOC;
+        }
+        else
+        {
+            memcpy(buf->data, data, length);
+        }
+    }
+
+    chunk_cache_shard_t* shard = chunk_cache_shard(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    chunk_cache_miss_t** link = &shard->misses;
+    while (*link && memcmp((*link)->hash.bytes, hash->bytes, CHUNK_HASH_SIZE))
+    {
+        link = &(*link)->next;
+    }
+    chunk_cache_miss_t* miss = *link;
+    if (miss == NULL)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        buf_unref(buf);
+        LOG_DEBUG("Fill of chunk which is not fetched, ignored\n");
+        return;
+    }
+    /* later reads of chunk hit cache or start new fetch */
+    *link = miss->next;
+    miss->status = status;
+    miss->data = buf;
+    miss->length = length;
+    miss->done = 1;
+    if (status == DISFS_SUCCESS)
+    {
+        shard->stats.bytes_fetched += length;
+        chunk_cache_insert(shard, miss);
+    }
+    else
+    {
+        shard->stats.fetch_errors++;
+    }
+    pthread_cond_broadcast(&shard->fetched);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void chunk_cache_stats(chunk_cache_t cache[static 1],
+                       chunk_cache_stats_t stats[static 1])
+{
+    *stats = (chunk_cache_stats_t){};
+    for (uint32_t i = 0; i < CHUNK_CACHE_SHARDS; i++)
+    {
+        chunk_cache_shard_t* shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        const chunk_cache_stats_t* s = &shard->stats;
+        stats->hits += s->hits;
+        stats->misses += s->misses;
+        stats->coalesced += s->coalesced;
+        stats->ghost_hits += s->ghost_hits;
+        stats->evictions += s->evictions;
+        stats->fetch_errors += s->fetch_errors;
+        stats->bytes_saved += s->bytes_saved;
+        stats->bytes_fetched += s->bytes_fetched;
+        stats->resident_bytes += s->resident_bytes;
+        stats->resident_chunks += s->resident_chunks;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+void chunk_cache_report(chunk_cache_t cache[static 1],
+                        metrics_writer_t writer[static 1])
+{
+    chunk_cache_stats_t stats;
+    chunk_cache_stats(cache, &stats);
+    uint64_t reads = stats.hits + stats.misses + stats.coalesced;
+    metrics_printf(writer,
+                   "chunk_cache hits=%lu misses=%lu coalesced=%lu "
+                   "ghost_hits=%lu hit_ratio=%.3f evictions=%lu "
+                   "fetch_errors=%lu bytes_saved=%lu bytes_fetched=%lu "
+                   "resident_bytes=%lu resident_chunks=%lu\n",
+                   stats.hits, stats.misses, stats.coalesced, stats.ghost_hits,
+                   reads ? (double)stats.hits / (double)reads : 0.0,
+                   stats.evictions, stats.fetch_errors, stats.bytes_saved,
+                   stats.bytes_fetched, stats.resident_bytes,
+                   stats.resident_chunks);
+}
+
+/*
+ * First remote owner on placement ring is asked, local node is skipped as its
+ * chunks are read from local store. Peer may be dropped after lookup, then
+ * request fails and so does the fetch.
+ */
+void chunk_cache_fetch_peer(void* ctx, chunk_cache_t* cache,
+                            const chunk_hash_t hash[static 1])
+{
+    connection_t* conn = ctx;
+    hash_ring_node_t owners[HASH_RING_MAX_REPLICAS];
+    uint32_t count = hash_ring_lookup(&conn->ring, hash_ring_key(hash->bytes),
+                                      owners, HASH_RING_MAX_REPLICAS);
+    const hash_ring_node_t* owner = NULL;
+    for (uint32_t i = 0; i < count && owner == NULL; i++)
+    {
+        owner = owners[i].local ? NULL : &owners[i];
+    }
+    chunk_cache_request_t* request = malloc(sizeof(*request));
+    if (owner == NULL || request == NULL)
+    {
+        free(request);
+        chunk_cache_fill(cache, hash,
+                         owner ? DISFS_ERR_ALLOC : DISFS_ERR_NOT_FOUND, NULL,
+                         0);
+        return;
+    }
+    *request = (chunk_cache_request_t){.cache = cache, .hash = *hash};
+    struct sockaddr_in addr = owner->addr;
+    err_t ret =
+        connection_call(conn, &addr, PROTO_MSG_CHUNK_GET, hash->bytes,
+                        CHUNK_HASH_SIZE, 0, chunk_cache_fetched, request);
+    if (ret != DISFS_SUCCESS)
+    {
+        free(request);
+        chunk_cache_fill(cache, hash, ret, NULL, 0);
+    }
+}
+
+static void chunk_cache_fetched(void* ctx, client_t* client, err_t status,
+                                const proto_frame_t* reply)
+{
+    (void)client;
+    chunk_cache_request_t* request = ctx;
+    wire_chunk_data_t data = {};
+    if (status == DISFS_SUCCESS &&
+        (reply->header.type != PROTO_MSG_CHUNK_DATA ||
+         wire_chunk_data_decode(&data, reply->payload,
+                                reply->header.length) != DISFS_SUCCESS))
+    {
+        status = DISFS_ERR_PROTO;
+    }
+    chunk_cache_fill(request->cache, &request->hash, status, data.data.data,
+                     (uint32_t)data.data.length);
+    free(request);
+}
@@ -0,0 +1,766 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "chunk_store.h"
+#include "buf_pool.h"
+#include "cdc.h"
+#include "checksum.h"
+#include "compress.h"
+#include "connection.h"
+#include "err_codes.h"
+#include "logger.h"
+#include "protocol.h"
+#include "sha256.h"
+#include "wire.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define CHUNK_INDEX_MAGIC 0x5849435346534944ULL /* "DISFSCIX" */
+/* version 2 added checksum of chunk data to slots */
+#define CHUNK_INDEX_VERSION 2
+#define CHUNK_INDEX_INITIAL_CAPACITY 1024
+#define CHUNK_SLOT_USED 0x1
+/* data did not compress when stored, peers get it straight from page cache */
+#define CHUNK_SLOT_INCOMPRESSIBLE 0x2
+/* file is read for chunking in pieces of two largest chunks */
+#define CHUNK_FILE_BUFFER (2 * CDC_MAX_SIZE)
+#define CHUNK_PACK_NAME "chunks.pack"
+#define CHUNK_INDEX_NAME "chunks.idx"
+/* directory, separator and longest file name always fit */
+#define CHUNK_FILE_PATH_MAX (CHUNK_STORE_PATH_MAX + 32)
+
+_Static_assert(CDC_MAX_SIZE <= CHUNK_MAX_SIZE,
+               "Content defined chunk does not fit chunk of store");
+
+static uint64_t chunk_index_file_size(uint64_t capacity);
+static err_t chunk_index_map(int32_t fd, uint64_t size,
+                             chunk_index_header_t* header[static 1]);
+static err_t chunk_index_create(const char* path, uint64_t capacity,
+                                int32_t fd[static 1],
+                                chunk_index_header_t* header[static 1]);
+static chunk_index_slot_t* chunk_index_probe(chunk_index_slot_t* slots,
+                                             uint64_t capacity,
+                                             const chunk_hash_t hash[static 1]);
+static err_t chunk_index_grow(chunk_store_t store[static 1]);
+static err_t chunk_index_trim(chunk_store_t store[static 1],
+                              uint64_t pack_size);
+static int32_t chunk_store_path(const chunk_store_t store[static 1],
+                                const char* name, char* out, size_t out_len);
+static err_t chunk_store_read(chunk_store_t store[static 1],
+                              const chunk_location_t location[static 1],
+                              void* buffer);
+static err_t chunk_store_reply_data(chunk_store_t store[static 1],
+                                    client_t client[static 1],
+                                    const proto_frame_t frame[static 1],
+                                    const chunk_hash_t hash[static 1],
+                                    const chunk_location_t location[static 1]);
+static err_t chunk_store_reply_error(client_t client[static 1],
+                                     const proto_frame_t frame[static 1],
+                                     err_t error);
+static err_t chunk_store_handle_get(void* ctx, client_t client[static 1],
+                                    const proto_frame_t frame[static 1]);
+static err_t chunk_store_handle_put(void* ctx, client_t client[static 1],
+                                    const proto_frame_t frame[static 1]);
+static err_t chunk_store_handle_manifest(void* ctx, client_t client[static 1],
+                                         const proto_frame_t frame[static 1]);
+
+static uint64_t chunk_index_file_size(uint64_t capacity)
+{
+    return sizeof(chunk_index_header_t) + capacity * sizeof(chunk_index_slot_t);
+}
+
+static int32_t chunk_store_path(const chunk_store_t store[static 1],
+                                const char* name, char* out, size_t out_len)
+{
+    int32_t n = snprintf(out, out_len, "%s/%s", store->dir, name);
+    return n > 0 && (size_t)n < out_len;
+}
+
+static err_t chunk_index_map(int32_t fd, uint64_t size,
+                             chunk_index_header_t* header[static 1])
+{
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        LOG_ERROR("Cannot map chunk index: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_IO;
+    }
+    *header = map;
+    return DISFS_SUCCESS;
+}
+
+static err_t chunk_index_create(const char* path, uint64_t capacity,
+                                int32_t fd[static 1],
+                                chunk_index_header_t* header[static 1])
+{
+    *fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (*fd < 0)
+    {
+        LOG_ERROR("Cannot create chunk index %s: errno=%d : %s\n", path, errno,
+                  strerror(errno));
+        return DISFS_ERR_IO;
+    }
+    uint64_t size = chunk_index_file_size(capacity);
+    if (ftruncate(*fd, (off_t)size) < 0)
+    {
+        LOG_ERROR("Cannot resize chunk index %s: errno=%d : %s\n", path, errno,
+                  strerror(errno));
+        close(*fd);
+        *fd = -1;
+        return DISFS_ERR_IO;
+    }
+    err_t ret = chunk_index_map(*fd, size, header);
+    if (ret != DISFS_SUCCESS)
+    {
+        close(*fd);
+        *fd = -1;
+        return ret;
+    }
+    (*header)->magic = CHUNK_INDEX_MAGIC;
+    (*header)->version = CHUNK_INDEX_VERSION;
+    (*header)->capacity = capacity;
+    return DISFS_SUCCESS;
+}
+
+err_t chunk_store_open(chunk_store_t store[static 1], const char* dir)
+{
+    *store = (chunk_store_t){.pack_fd = -1, .index_fd = -1};
+    pthread_rwlock_init(&store->lock, NULL);
+    err_t ret = DISFS_SUCCESS;
+    size_t dir_len = strlen(dir);
+    if (dir_len >= CHUNK_STORE_PATH_MAX)
+    {
+        LOG_ERROR("Chunk store path is too long: %s\n", dir);
+        ret = DISFS_ERR_INVALID_ARG;
+        goto fail;
+    }
+    memcpy(store->dir, dir, dir_len + 1);
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+    {
+        LOG_ERROR("Cannot create chunk store directory %s: errno=%d : %s\n",
+                  dir, errno, strerror(errno));
+        ret = DISFS_ERR_IO;
+        goto fail;
+    }
+
+    char path[CHUNK_FILE_PATH_MAX];
+    chunk_store_path(store, CHUNK_INDEX_NAME, path, sizeof(path));
+    store->index_fd = open(path, O_RDWR | O_CLOEXEC);
+    if (store->index_fd < 0 && errno == ENOENT)
+    {
+        ret = chunk_index_create(path, CHUNK_INDEX_INITIAL_CAPACITY,
+                                 &store->index_fd, &store->index);
+        if (ret != DISFS_SUCCESS)
+        {
+            goto fail;
+        }
+        store->index_map_size =
+            chunk_index_file_size(CHUNK_INDEX_INITIAL_CAPACITY);
+    }
+    else if (store->index_fd < 0)
+    {
+        LOG_ERROR("Cannot open chunk index %s: errno=%d : %s\n", path, errno,
+                  strerror(errno));
+        ret = DISFS_ERR_IO;
+        goto fail;
+    }
+    else
+    {
+        struct stat st;
+        if (fstat(store->index_fd, &st) < 0 ||
+            (uint64_t)st.st_size < sizeof(chunk_index_header_t))
+        {
+            LOG_ERROR("Chunk index %s is truncated\n", path);
+            ret = DISFS_ERR_CORRUPT;
+            goto fail;
+        }
+        ret = chunk_index_map(store->index_fd, (uint64_t)st.st_size,
+                              &store->index);
+        if (ret != DISFS_SUCCESS)
+        {
+            goto fail;
+        }
+        store->index_map_size = (uint64_t)st.st_size;
+        if (store->index->magic != CHUNK_INDEX_MAGIC ||
+            store->index->version != CHUNK_INDEX_VERSION ||
+            chunk_index_file_size(store->index->capacity) !=
+                store->index_map_size)
+        {
+            LOG_ERROR("Chunk index %s is corrupted\n", path);
+            ret = DISFS_ERR_CORRUPT;
+            goto fail;
+        }
+    }
+    store->slots = (chunk_index_slot_t*)(store->index + 1);
+
+    chunk_store_path(store, CHUNK_PACK_NAME, path, sizeof(path));
+    store->pack_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if (store->pack_fd < 0 || fstat(store->pack_fd, &st) < 0)
+    {
+        LOG_ERROR("Cannot open chunk pack %s: errno=%d : %s\n", path, errno,
+                  strerror(errno));
+        ret = DISFS_ERR_IO;
+        goto fail;
+    }
+    /* shared index mapping reaches disk on its own, so after crash it may
+     * point at pack data which never did */
+    if ((uint64_t)st.st_size < store->index->pack_size)
+    {
+        LOG_WARNING("Chunk pack %s is shorter than its index, dropping "
+                    "chunks past its end\n",
+                    path);
+        ret = chunk_index_trim(store, (uint64_t)st.st_size);
+        if (ret != DISFS_SUCCESS)
+        {
+            goto fail;
+        }
+    }
+    /* drop data appended after last indexed chunk, e.g. by crash */
+    if ((uint64_t)st.st_size > store->index->pack_size)
+    {
+        if (ftruncate(store->pack_fd, (off_t)store->index->pack_size) < 0)
+        {
+            LOG_WARNING("Cannot trim chunk pack %s\n", path);
+        }
+    }
+    LOG_DEBUG("Opened chunk store %s with %lu chunks\n", dir,
+              store->index->count);
+    return DISFS_SUCCESS;
+
+fail:
+    chunk_store_close(store);
+    return ret;
+}
+
+void chunk_store_close(chunk_store_t store[static 1])
+{
+    if (store->index)
+    {
+        msync(store->index, store->index_map_size, MS_SYNC);
+        munmap(store->index, store->index_map_size);
+    }
+    if (store->index_fd >= 0)
+    {
+        close(store->index_fd);
+    }
+    if (store->pack_fd >= 0)
+    {
+        close(store->pack_fd);
+    }
+    pthread_rwlock_destroy(&store->lock);
+    store->index = NULL;
+    store->slots = NULL;
+    store->index_fd = -1;
+    store->pack_fd = -1;
+}
+
+err_t chunk_store_sync(chunk_store_t store[static 1])
+{
+    pthread_rwlock_rdlock(&store->lock);
+    /* pack first, index must never point at data which is not on disk */
+    int32_t ret = fdatasync(store->pack_fd);
+    if (ret == 0)
+    {
+        ret = msync(store->index, store->index_map_size, MS_SYNC);
+    }
+    pthread_rwlock_unlock(&store->lock);
+    if (ret < 0)
+    {
+        LOG_ERROR("Cannot sync chunk store: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_IO;
+    }
+    return DISFS_SUCCESS;
+}
+
+static chunk_index_slot_t* chunk_index_probe(chunk_index_slot_t* slots,
+                                             uint64_t capacity,
+                                             const chunk_hash_t hash[static 1])
+{
+    uint64_t start;
+    memcpy(&start, hash->bytes, sizeof(start));
+    uint64_t mask = capacity - 1;
+    for (uint64_t i = start & mask;; i = (i + 1) & mask)
+    {
+        chunk_index_slot_t* slot = &slots[i];
+        if (!(slot->location.flags & CHUNK_SLOT_USED) ||
+            memcmp(slot->hash.bytes, hash->bytes, CHUNK_HASH_SIZE) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+/* keeps chunks which end within pack_size, slots are placed again so no
+ * probe sequence is broken by dropped ones */
+static err_t chunk_index_trim(chunk_store_t store[static 1],
+                              uint64_t pack_size)
+{
+    uint64_t capacity = store->index->capacity;
+    chunk_index_slot_t* kept = malloc(capacity * sizeof(*kept));
+    if (kept == NULL)
+    {
+        return DISFS_ERR_ALLOC;
+    }
+    uint64_t count = 0;
+    uint64_t end = 0;
+    for (uint64_t i = 0; i < capacity; i++)
+    {
+        const chunk_location_t* location = &store->slots[i].location;
+        uint64_t chunk_end = location->offset + location->length;
+        if ((location->flags & CHUNK_SLOT_USED) && chunk_end <= pack_size)
+        {
+            kept[count++] = store->slots[i];
+            end = chunk_end > end ? chunk_end : end;
+        }
+    }
+    memset(store->slots, 0, capacity * sizeof(*kept));
+    for (uint64_t i = 0; i < count; i++)
+    {
+        *chunk_index_probe(store->slots, capacity, &kept[i].hash) = kept[i];
+    }
+    free(kept);
+    LOG_WARNING("Dropped %lu chunks missing from pack\n",
+                store->index->count - count);
+    store->index->count = count;
+    store->index->pack_size = end;
+    if (msync(store->index, store->index_map_size, MS_SYNC) < 0)
+    {
+        LOG_ERROR("Cannot sync chunk index: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_IO;
+    }
+    return DISFS_SUCCESS;
+}
+
+static err_t chunk_index_grow(chunk_store_t store[static 1])
+{
+    char path[CHUNK_FILE_PATH_MAX];
+    char tmp[CHUNK_FILE_PATH_MAX];
+    chunk_store_path(store, CHUNK_INDEX_NAME, path, sizeof(path));
+    chunk_store_path(store, CHUNK_INDEX_NAME ".tmp", tmp, sizeof(tmp));
+
+    uint64_t capacity = store->index->capacity * 2;
+    int32_t fd = -1;
+    chunk_index_header_t* header = NULL;
+    err_t ret = chunk_index_create(tmp, capacity, &fd, &header);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    chunk_index_slot_t* slots = (chunk_index_slot_t*)(header + 1);
+    for (uint64_t i = 0; i < store->index->capacity; i++)
+    {
+        chunk_index_slot_t* old = &store->slots[i];
+        if (old->location.flags & CHUNK_SLOT_USED)
+        {
+            *chunk_index_probe(slots, capacity, &old->hash) = *old;
+        }
+    }
+    header->count = store->index->count;
+    header->pack_size = store->index->pack_size;
+
+    uint64_t size = chunk_index_file_size(capacity);
+    if (msync(header, size, MS_SYNC) < 0 || rename(tmp, path) < 0)
+    {
+        LOG_ERROR("Cannot replace chunk index: errno=%d : %s\n", errno,
+                  strerror(errno));
+        munmap(header, size);
+        close(fd);
+        unlink(tmp);
+        return DISFS_ERR_IO;
+    }
+    munmap(store->index, store->index_map_size);
+    close(store->index_fd);
+    store->index = header;
+    store->slots = slots;
+    store->index_fd = fd;
+    store->index_map_size = size;
+    LOG_DEBUG("Chunk index grown to %lu slots\n", capacity);
+    return DISFS_SUCCESS;
+}
+
+err_t chunk_store_put(chunk_store_t store[static 1], const void* data,
+                      uint32_t length, chunk_hash_t hash[static 1])
+{
+    if (length > CHUNK_MAX_SIZE)
+    {
+        LOG_ERROR("Chunk of %u bytes exceeds maximum chunk size\n", length);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    sha256(data, length, hash->bytes);
+
+    pthread_rwlock_wrlock(&store->lock);
+    err_t ret = DISFS_SUCCESS;
+    chunk_index_slot_t* slot =
+        chunk_index_probe(store->slots, store->index->capacity, hash);
+    if (slot->location.flags & CHUNK_SLOT_USED)
+    {
+        goto out;
+    }
+    /* keep index load factor under 70% */
+    if ((store->index->count + 1) * 10 > store->index->capacity * 7)
+    {
+        ret = chunk_index_grow(store);
+        if (ret != DISFS_SUCCESS)
+        {
+            goto out;
+        }
+        slot = chunk_index_probe(store->slots, store->index->capacity, hash);
+    }
+
+    uint64_t offset = store->index->pack_size;
+    ssize_t written = pwrite(store->pack_fd, data, length, (off_t)offset);
+    if (written != (ssize_t)length)
+    {
+        LOG_ERROR("Cannot append chunk to pack: errno=%d : %s\n", errno,
+                  strerror(errno));
+        ret = DISFS_ERR_IO;
+        goto out;
+    }
+    slot->hash = *hash;
+    slot->location.offset = offset;
+    slot->location.length = length;
+    slot->location.flags = CHUNK_SLOT_USED;
+    if (!compress_worthwhile(data, length))
+    {
+        slot->location.flags |= CHUNK_SLOT_INCOMPRESSIBLE;
+    }
+    slot->location.crc = crc32c(0, data, length);
+    store->index->count++;
+    store->index->pack_size = offset + length;
+out:
+    pthread_rwlock_unlock(&store->lock);
+    return ret;
+}
+
+err_t chunk_store_lookup(chunk_store_t store[static 1],
+                         const chunk_hash_t hash[static 1],
+                         chunk_location_t location[static 1])
+{
+    err_t ret = DISFS_SUCCESS;
+    pthread_rwlock_rdlock(&store->lock);
+    chunk_index_slot_t* slot =
+        chunk_index_probe(store->slots, store->index->capacity, hash);
+    if (slot->location.flags & CHUNK_SLOT_USED)
+    {
+        *location = slot->location;
+    }
+    else
+    {
+        ret = DISFS_ERR_NOT_FOUND;
+    }
+    pthread_rwlock_unlock(&store->lock);
+    return ret;
+}
+
+err_t chunk_store_get(chunk_store_t store[static 1],
+                      const chunk_hash_t hash[static 1], void* buffer,
+                      uint32_t buffer_len, uint32_t length[static 1])
+{
+    chunk_location_t location;
+    err_t ret = chunk_store_lookup(store, hash, &location);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    if (location.length > buffer_len)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    ret = chunk_store_read(store, &location, buffer);
+    if (ret == DISFS_SUCCESS)
+    {
+        *length = location.length;
+    }
+    return ret;
+}
+
+static err_t chunk_store_read(chunk_store_t store[static 1],
+                              const chunk_location_t location[static 1],
+                              void* buffer)
+{
+    ssize_t readed = pread(store->pack_fd, buffer, location->length,
+                           (off_t)location->offset);
+    if (readed != (ssize_t)location->length)
+    {
+        LOG_ERROR("Cannot read chunk from pack: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_IO;
+    }
+    if (crc32c(0, buffer, location->length) != location->crc)
+    {
+        LOG_ERROR("Chunk at offset %lu of pack is corrupted\n",
+                  location->offset);
+        return DISFS_ERR_CORRUPT;
+    }
+    return DISFS_SUCCESS;
+}
+
+err_t chunk_store_put_file(chunk_store_t store[static 1], int32_t fd,
+                           chunk_hash_t* hashes, uint64_t max_hashes,
+                           uint64_t count[static 1])
+{
+    buf_t* buf = buf_alloc(CHUNK_FILE_BUFFER);
+    if (buf == NULL)
+    {
+        return DISFS_ERR_ALLOC;
+    }
+    uint8_t* buffer = buf->data;
+    err_t ret = DISFS_SUCCESS;
+    uint32_t start = 0;
+    uint32_t filled = 0;
+    int32_t eof = 0;
+    *count = 0;
+    while (1)
+    {
+        /* cut depends on CDC_MAX_SIZE bytes ahead, unless file ends first */
+        if (!eof && filled - start < CDC_MAX_SIZE)
+        {
+            memmove(buffer, buffer + start, filled - start);
+            filled -= start;
+            start = 0;
+            while (filled < CHUNK_FILE_BUFFER)
+            {
+                ssize_t readed =
+                    read(fd, buffer + filled, CHUNK_FILE_BUFFER - filled);
+                if (readed < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (readed < 0)
+                {
+                    LOG_ERROR("Cannot read file for chunking: errno=%d : %s\n",
+                              errno, strerror(errno));
+                    ret = DISFS_ERR_IO;
+                    goto out;
+                }
+                if (readed == 0)
+                {
+                    eof = 1;
+                    break;
+                }
+                filled += (uint32_t)readed;
+            }
+        }
+        if (start == filled)
+        {
+            break;
+        }
+        if (*count == max_hashes)
+        {
+            ret = DISFS_ERR_INVALID_ARG;
+            goto out;
+        }
+        uint32_t length = cdc_cut(buffer + start, filled - start);
+        ret = chunk_store_put(store, buffer + start, length, &hashes[*count]);
+        if (ret != DISFS_SUCCESS)
+        {
+            goto out;
+        }
+        (*count)++;
+        start += length;
+    }
+out:
+    buf_unref(buf);
+    return ret;
+}
+
+static err_t chunk_store_reply_error(client_t client[static 1],
+                                     const proto_frame_t frame[static 1],
+                                     err_t error)
+{
+    wire_error_t reply = {.code = (uint64_t)error};
+    uint8_t scratch[WIRE_FIXED_SIZE(error)];
+    struct iovec iov[1];
+    uint32_t iov_count;
+    err_t ret = wire_encode_iov(&wire_error_schema, &reply, scratch,
+                                sizeof(scratch), iov, 1, &iov_count);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    return connection_reply(client, frame, PROTO_MSG_ERROR, iov, iov_count);
+}
+
+static err_t chunk_store_handle_get(void* ctx, client_t client[static 1],
+                                    const proto_frame_t frame[static 1])
+{
+    chunk_store_t* store = ctx;
+    wire_chunk_get_t request;
+    if (wire_chunk_get_decode(&request, frame->payload,
+                              frame->header.length) != DISFS_SUCCESS)
+    {
+        return chunk_store_reply_error(client, frame, DISFS_ERR_INVALID_ARG);
+    }
+    chunk_hash_t hash;
+    memcpy(hash.bytes, request.hash.data, CHUNK_HASH_SIZE);
+
+    /* chunk data is immutable once indexed, kernel sends it from page cache */
+    chunk_location_t location;
+    err_t ret = chunk_store_lookup(store, &hash, &location);
+    if (ret != DISFS_SUCCESS)
+    {
+        return chunk_store_reply_error(client, frame, ret);
+    }
+    if (connection_compressing(client) &&
+        !(location.flags & CHUNK_SLOT_INCOMPRESSIBLE))
+    {
+        return chunk_store_reply_data(store, client, frame, &hash, &location);
+    }
+    /* data field is left empty, file range follows encoded hash */
+    wire_chunk_data_t reply = {
+        .hash = {.data = hash.bytes, .length = CHUNK_HASH_SIZE}};
+    uint8_t scratch[WIRE_FIXED_SIZE(chunk_data)];
+    struct iovec iov[1];
+    uint32_t iov_count;
+    ret = wire_encode_iov(&wire_chunk_data_schema, &reply, scratch,
+                          sizeof(scratch), iov, 1, &iov_count);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    return connection_reply_file(client, frame, PROTO_MSG_CHUNK_DATA, iov,
+                                 iov_count, store->pack_fd, location.offset,
+                                 location.length, location.crc);
+}
+
+/* chunk read to memory, so link can compress it */
+static err_t chunk_store_reply_data(chunk_store_t store[static 1],
+                                    client_t client[static 1],
+                                    const proto_frame_t frame[static 1],
+                                    const chunk_hash_t hash[static 1],
+                                    const chunk_location_t location[static 1])
+{
+    buf_t* buf = buf_alloc(location->length);
+    if (buf == NULL)
+    {
+        return chunk_store_reply_error(client, frame, DISFS_ERR_ALLOC);
+    }
+    err_t ret = chunk_store_read(store, location, buf->data);
+    if (ret != DISFS_SUCCESS)
+    {
+        buf_unref(buf);
+        return chunk_store_reply_error(client, frame, ret);
+    }
+    wire_chunk_data_t reply = {
+        .hash = {.data = hash->bytes, .length = CHUNK_HASH_SIZE},
+        .data = {.data = buf->data, .length = location->length}};
+    uint8_t scratch[WIRE_FIXED_SIZE(chunk_data)];
+    struct iovec iov[2];
+    uint32_t iov_count;
+    ret = wire_encode_iov(&wire_chunk_data_schema, &reply, scratch,
+                          sizeof(scratch), iov, 2, &iov_count);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_reply(client, frame, PROTO_MSG_CHUNK_DATA, iov,
+                               iov_count);
+    }
+    buf_unref(buf);
+    return ret;
+}
+
+static err_t chunk_store_handle_put(void* ctx, client_t client[static 1],
+                                    const proto_frame_t frame[static 1])
+{
+    chunk_store_t* store = ctx;
+    wire_chunk_put_t request;
+    chunk_hash_t hash;
+    err_t ret = wire_chunk_put_decode(&request, frame->payload,
+                                      frame->header.length);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = chunk_store_put(store, request.data.data,
+                              (uint32_t)request.data.length, &hash);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        return chunk_store_reply_error(client, frame, ret);
+    }
+    wire_chunk_put_ack_t reply = {
+        .hash = {.data = hash.bytes, .length = CHUNK_HASH_SIZE}};
+    uint8_t scratch[WIRE_FIXED_SIZE(chunk_put_ack)];
+    struct iovec iov[1];
+    uint32_t iov_count;
+    ret = wire_encode_iov(&wire_chunk_put_ack_schema, &reply, scratch,
+                          sizeof(scratch), iov, 1, &iov_count);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    return connection_reply(client, frame, PROTO_MSG_CHUNK_PUT_ACK, iov,
+                            iov_count);
+}
+
+/* index is in memory, so whole manifest is answered from reactor */
+static err_t chunk_store_handle_manifest(void* ctx, client_t client[static 1],
+                                         const proto_frame_t frame[static 1])
+{
+    chunk_store_t* store = ctx;
+    wire_manifest_t request;
+    if (wire_manifest_decode(&request, frame->payload,
+                             frame->header.length) != DISFS_SUCCESS ||
+        request.hashes.length != request.count * CHUNK_HASH_SIZE)
+    {
+        return chunk_store_reply_error(client, frame, DISFS_ERR_INVALID_ARG);
+    }
+    uint32_t bytes = (uint32_t)(request.count + 7) / 8;
+    buf_t* buf = buf_alloc(bytes ? bytes : 1);
+    if (buf == NULL)
+    {
+        return chunk_store_reply_error(client, frame, DISFS_ERR_ALLOC);
+    }
+    memset(buf->data, 0, bytes);
+    for (uint32_t i = 0; i < request.count; i++)
+    {
+        chunk_hash_t hash;
+        chunk_location_t location;
+        memcpy(hash.bytes, request.hashes.data + i * CHUNK_HASH_SIZE,
+               CHUNK_HASH_SIZE);
+        if (chunk_store_lookup(store, &hash, &location) != DISFS_SUCCESS)
+        {
+            buf->data[i / 8] |= (uint8_t)(1u << (i % 8));
+        }
+    }
+    wire_manifest_missing_t reply = {
+        .count = request.count, .bitmap = {.data = buf->data, .length = bytes}};
+    uint8_t scratch[WIRE_FIXED_SIZE(manifest_missing)];
+    struct iovec iov[2];
+    uint32_t iov_count;
+    err_t ret = wire_encode_iov(&wire_manifest_missing_schema, &reply, scratch,
+                                sizeof(scratch), iov, 2, &iov_count);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_reply(client, frame, PROTO_MSG_MANIFEST_MISSING, iov,
+                               iov_count);
+    }
+    buf_unref(buf);
+    return ret;
+}
+
+err_t chunk_store_attach(chunk_store_t store[static 1],
+                         struct connection_t* conn)
+{
+    err_t ret = connection_register_handler(conn, PROTO_MSG_CHUNK_GET,
+                                            chunk_store_handle_get, store);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_register_handler(conn, PROTO_MSG_CHUNK_PUT,
+                                          chunk_store_handle_put, store);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_register_handler(conn, PROTO_MSG_MANIFEST,
+                                          chunk_store_handle_manifest, store);
+    }
+    return ret;
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "chunk_sync.h"
+#include "buf_pool.h"
+#include "connection.h"
+#include "logger.h"
+#include "protocol.h"
+#include "wire.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(WIRE_FIXED_SIZE(manifest) + CHUNK_SYNC_BATCH * CHUNK_HASH_SIZE <=
+                   PROTO_MAX_PAYLOAD,
+               "Manifest batch does not fit frame");
+
+struct chunk_sync_op_t;
+
+/* chunk put waiting for acknowledgement */
+typedef struct chunk_sync_put_t
+{
+    struct chunk_sync_op_t* op;
+    chunk_hash_t hash;
+    uint8_t busy;
+    char _padded[7];
+} chunk_sync_put_t;
+
+/* state of one chunk_sync_push, guarded by its lock */
+typedef struct chunk_sync_op_t
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t* missing; /* bitmap of last manifest reply */
+    uint32_t missing_count;
+    uint32_t pending; /* requests waiting for reply */
+    err_t status;     /* first failure */
+    chunk_sync_put_t puts[CHUNK_SYNC_WINDOW];
+} chunk_sync_op_t;
+
+static int chunk_sync_compare(const void* a, const void* b);
+static err_t chunk_sync_manifest(chunk_sync_op_t op[static 1],
+                                 struct connection_t* conn,
+                                 const struct sockaddr_in addr[static 1],
+                                 const chunk_hash_t* hashes, uint32_t count,
+                                 chunk_sync_stats_t stats[static 1]);
+static void chunk_sync_answered(void* ctx, client_t* client, err_t status,
+                                const proto_frame_t* reply);
+static err_t chunk_sync_put(chunk_sync_op_t op[static 1],
+                            struct connection_t* conn,
+                            const struct sockaddr_in addr[static 1],
+                            chunk_store_t store[static 1],
+                            const chunk_hash_t hash[static 1], uint8_t* buffer,
+                            chunk_sync_stats_t stats[static 1]);
+static void chunk_sync_acked(void* ctx, client_t* client, err_t status,
+                             const proto_frame_t* reply);
+static void chunk_sync_fail(chunk_sync_op_t op[static 1], err_t status);
+static void chunk_sync_wait(chunk_sync_op_t op[static 1], uint32_t pending);
+
+err_t chunk_sync_push(struct connection_t* conn,
+                      const struct sockaddr_in addr[static 1],
+                      chunk_store_t store[static 1], const chunk_hash_t* hashes,
+                      uint64_t count, chunk_sync_stats_t stats[static 1])
+{
+    *stats = (chunk_sync_stats_t){};
+    /* sorted, so chunk repeated in file is asked for and sent once */
+    chunk_hash_t* unique = malloc((count ? count : 1) * sizeof(*unique));
+    uint8_t* buffer = malloc(CHUNK_MAX_SIZE);
+    uint8_t* missing = malloc(CHUNK_SYNC_BATCH / 8);
+    if (unique == NULL || buffer == NULL || missing == NULL)
+    {
+        LOG_ERROR("Cannot allocate sync of %lu chunks\n", count);
+        free(unique);
+        free(buffer);
+        free(missing);
+        return DISFS_ERR_ALLOC;
+    }
+    memcpy(unique, hashes, count * sizeof(*unique));
+    qsort(unique, count, sizeof(*unique), chunk_sync_compare);
+    uint64_t distinct = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (distinct == 0 || memcmp(&unique[distinct - 1], &unique[i],
+                                    sizeof(*unique)) != 0)
+        {
+            unique[distinct++] = unique[i];
+        }
+    }
+    stats->chunks = distinct;
+
+    chunk_sync_op_t op = {.missing = missing};
+    pthread_mutex_init(&op.lock, NULL);
+    pthread_cond_init(&op.changed, NULL);
+    err_t ret = DISFS_SUCCESS;
+    for (uint64_t first = 0; first < distinct && ret == DISFS_SUCCESS;
+         first += CHUNK_SYNC_BATCH)
+    {
+        uint32_t batch = distinct - first < CHUNK_SYNC_BATCH
+                             ? (uint32_t)(distinct - first)
+                             : CHUNK_SYNC_BATCH;
+        ret = chunk_sync_manifest(&op, conn, addr, &unique[first], batch,
+                                  stats);
+        for (uint32_t i = 0; i < batch && ret == DISFS_SUCCESS; i++)
+        {
+            if (op.missing[i / 8] & (1u << (i % 8)))
+            {
+                ret = chunk_sync_put(&op, conn, addr, store, &unique[first + i],
+                                     buffer, stats);
+                continue;
+            }
+            chunk_location_t location;
+            if (chunk_store_lookup(store, &unique[first + i], &location) ==
+                DISFS_SUCCESS)
+            {
+                stats->present_bytes += location.length;
+            }
+        }
+    }
+    /* completions refer to op, so every request has to finish first */
+    pthread_mutex_lock(&op.lock);
+    chunk_sync_wait(&op, 0);
+    ret = ret != DISFS_SUCCESS ? ret : op.status;
+    pthread_mutex_unlock(&op.lock);
+    if (ret != DISFS_SUCCESS)
+    {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+        LOG_ERROR("Sync of %lu chunks to %s:%u failed after %lu sent : %lld\n",
+                  distinct, ip, ntohs(addr->sin_port), stats->sent, ret);
+    }
+    pthread_cond_destroy(&op.changed);
+    pthread_mutex_destroy(&op.lock);
+    free(unique);
+    free(buffer);
+    free(missing);
+    return ret;
+}
+
+static int chunk_sync_compare(const void* a, const void* b)
+{
+    return memcmp(a, b, sizeof(chunk_hash_t));
+}
+
+/* ask which chunks of batch peer lacks, answer is left in op->missing */
+static err_t chunk_sync_manifest(chunk_sync_op_t op[static 1],
+                                 struct connection_t* conn,
+                                 const struct sockaddr_in addr[static 1],
+                                 const chunk_hash_t* hashes, uint32_t count,
+                                 chunk_sync_stats_t stats[static 1])
+{
+    wire_manifest_t manifest = {
+        .count = count,
+        .hashes = {.data = hashes->bytes,
+                   .length = (uint64_t)count * CHUNK_HASH_SIZE}};
+    uint64_t size = wire_size(&wire_manifest_schema, &manifest);
+    buf_t* buf = buf_alloc((uint32_t)size);
+    if (buf == NULL)
+    {
+        return DISFS_ERR_ALLOC;
+    }
+    uint64_t length = 0;
+    err_t ret = wire_manifest_encode(&manifest, buf->data, size, &length);
+    pthread_mutex_lock(&op->lock);
+    op->missing_count = count;
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_call(conn, addr, PROTO_MSG_MANIFEST, buf->data,
+                              (uint32_t)length, 0, chunk_sync_answered, op);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        op->pending++;
+        stats->manifest_bytes += length;
+        chunk_sync_wait(op, 0);
+        ret = op->status;
+    }
+    pthread_mutex_unlock(&op->lock);
+    buf_unref(buf);
+    return ret;
+}
+
+static void chunk_sync_answered(void* ctx, client_t* client, err_t status,
+                                const proto_frame_t* reply)
+{
+    (void)client;
+    chunk_sync_op_t* op = ctx;
+    pthread_mutex_lock(&op->lock);
+    wire_manifest_missing_t missing;
+    if (status == DISFS_SUCCESS &&
+        (reply->header.type != PROTO_MSG_MANIFEST_MISSING ||
+         wire_manifest_missing_decode(&missing, reply->payload,
+                                      reply->header.length) != DISFS_SUCCESS ||
+         missing.count != op->missing_count ||
+         missing.bitmap.length != (op->missing_count + 7) / 8))
+    {
+        status = DISFS_ERR_PROTO;
+    }
+    if (status == DISFS_SUCCESS)
+    {
+        memcpy(op->missing, missing.bitmap.data, missing.bitmap.length);
+    }
+    chunk_sync_fail(op, status);
+    op->pending--;
+    pthread_cond_signal(&op->changed);
+    pthread_mutex_unlock(&op->lock);
+}
+
+/* chunk is read to buffer, payload of call is copied so it is reused */
+static err_t chunk_sync_put(chunk_sync_op_t op[static 1],
+                            struct connection_t* conn,
+                            const struct sockaddr_in addr[static 1],
+                            chunk_store_t store[static 1],
+                            const chunk_hash_t hash[static 1], uint8_t* buffer,
+                            chunk_sync_stats_t stats[static 1])
+{
+    uint32_t length = 0;
+    err_t ret = chunk_store_get(store, hash, buffer, CHUNK_MAX_SIZE, &length);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    pthread_mutex_lock(&op->lock);
+    chunk_sync_wait(op, CHUNK_SYNC_WINDOW - 1);
+    ret = op->status;
+    chunk_sync_put_t* put = NULL;
+    for (uint32_t i = 0; i < CHUNK_SYNC_WINDOW && put == NULL; i++)
+    {
+        put = op->puts[i].busy ? NULL : &op->puts[i];
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        *put = (chunk_sync_put_t){.op = op, .hash = *hash, .busy = 1};
+        ret = connection_call(conn, addr, PROTO_MSG_CHUNK_PUT, buffer, length,
+                              0, chunk_sync_acked, put);
+        put->busy = ret == DISFS_SUCCESS;
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        op->pending++;
+        stats->sent++;
+        stats->sent_bytes += length;
+    }
+    pthread_mutex_unlock(&op->lock);
+    return ret;
+}
+
+/* peer acknowledges with hash of data it stored */
+static void chunk_sync_acked(void* ctx, client_t* client, err_t status,
+                             const proto_frame_t* reply)
+{
+    chunk_sync_put_t* put = ctx;
+    chunk_sync_op_t* op = put->op;
+    wire_chunk_put_ack_t ack;
+    if (status == DISFS_SUCCESS &&
+        (reply->header.type != PROTO_MSG_CHUNK_PUT_ACK ||
+         wire_chunk_put_ack_decode(&ack, reply->payload,
+                                   reply->header.length) != DISFS_SUCCESS))
+    {
+        status = DISFS_ERR_PROTO;
+    }
+    else if (status == DISFS_SUCCESS &&
+             memcmp(ack.hash.data, put->hash.bytes, CHUNK_HASH_SIZE) != 0)
+    {
+        LOG_WARNING("Peer %s stored synced chunk under other hash\n",
+                    client->ip);
+        status = DISFS_ERR_CORRUPT;
+    }
+    pthread_mutex_lock(&op->lock);
+    chunk_sync_fail(op, status);
+    put->busy = 0;
+    op->pending--;
+    pthread_cond_signal(&op->changed);
+    pthread_mutex_unlock(&op->lock);
+}
+
+static void chunk_sync_fail(chunk_sync_op_t op[static 1], err_t status)
+{
+    if (op->status == DISFS_SUCCESS)
+    {
+        op->status = status;
+    }
+}
+
+static void chunk_sync_wait(chunk_sync_op_t op[static 1], uint32_t pending)
+{
+    while (op->pending > pending)
+    {
+        pthread_cond_wait(&op->changed, &op->lock);
+    }
+}
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "compress.h"
+#include <string.h>
+
+/*
+ * LZ4 block: sequences of token, literals and match. High nibble of token is
+ * literal count and low nibble match length minus LZ_MIN_MATCH, nibble 15 is
+ * continued by bytes added to it while they are 255. Match is u16 offset back
+ * into output. Last sequence has literals only and covers at least
+ * LZ_LAST_LITERALS bytes, no match starts within LZ_MF_LIMIT bytes of end.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MF_LIMIT 12
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_LOG 12
+#define LZ_MIN_HASH_LOG 8
+/* every 2^LZ_SKIP_TRIGGER failed lookups step between lookups grows by one,
+ * so incompressible data is crossed at nearly memcpy speed */
+#define LZ_SKIP_TRIGGER 6
+#define LZ_RUN_MASK 15
+#define LZ_WILD_COPY 16
+
+/* bytes compressed to guess whether whole data compresses */
+#define COMPRESS_SAMPLE_SIZE 4096
+/* new sample weighs 1/4 in moving averages */
+#define COMPRESS_AVERAGE_SHIFT 2
+/* stop when average block exceeds 7/8 of its input */
+#define COMPRESS_RATIO_LIMIT 896
+/* stop when every saved byte costs more ns of compressor time */
+#define COMPRESS_COST_LIMIT_NS 16
+#define COMPRESS_PROBE_MIN 8
+#define COMPRESS_PROBE_MAX 1024
+/* no average, next sample is taken as it is */
+#define COMPRESS_UNKNOWN UINT32_MAX
+
+typedef struct compress_signature_t
+{
+    uint8_t length;
+    uint8_t bytes[7];
+} compress_signature_t;
+
+/* leading bytes of formats which are compressed already */
+static const compress_signature_t compress_signatures[] = {
+    {2, {0x1F, 0x8B}},                         /* gzip */
+    {4, {0x28, 0xB5, 0x2F, 0xFD}},             /* zstd */
+    {4, {0x04, 0x22, 0x4D, 0x18}},             /* lz4 frame */
+    {6, {0xFD, '7', 'z', 'X', 'Z', 0x00}},     /* xz */
+    {3, {'B', 'Z', 'h'}},                      /* bzip2 */
+    {6, {'7', 'z', 0xBC, 0xAF, 0x27, 0x1C}},   /* 7z */
+    {4, {'P', 'K', 0x03, 0x04}},               /* zip, jar, office */
+    {3, {0xFF, 0xD8, 0xFF}},                   /* jpeg */
+    {4, {0x89, 'P', 'N', 'G'}},                /* png */
+    {4, {'G', 'I', 'F', '8'}},                 /* gif */
+    {4, {'O', 'g', 'g', 'S'}},                 /* ogg */
+    {3, {'I', 'D', '3'}},                      /* mp3 */
+};
+
+static uint32_t lz_load32(const uint8_t* p);
+static uint64_t lz_load64(const uint8_t* p);
+static uint32_t lz_hash(uint32_t sequence, uint32_t hash_log);
+static uint8_t* lz_put_length(uint8_t* out, uint64_t length);
+static err_t lz_get_length(const uint8_t* in[static 1], const uint8_t* end,
+                           uint64_t length[static 1]);
+static const uint8_t* lz_match_end(const uint8_t* ip, const uint8_t* match,
+                                   const uint8_t* limit);
+static uint32_t compress_average(uint32_t average, uint32_t sample);
+
+static uint32_t lz_load32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t lz_load64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t sequence, uint32_t hash_log)
+{
+    return (sequence * 2654435761u) >> (32 - hash_log);
+}
+
+/* continuation bytes of length whose nibble is LZ_RUN_MASK */
+static uint8_t* lz_put_length(uint8_t* out, uint64_t length)
+{
+    for (length -= LZ_RUN_MASK; length >= 255; length -= 255)
+    {
+        *out++ = 255;
+    }
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+static err_t lz_get_length(const uint8_t* in[static 1], const uint8_t* end,
+                           uint64_t length[static 1])
+{
+    uint8_t byte;
+    do
+    {
+        if (*in >= end)
+        {
+            return DISFS_ERR_PROTO;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return DISFS_SUCCESS;
+}
+
+static const uint8_t* lz_match_end(const uint8_t* ip, const uint8_t* match,
+                                   const uint8_t* limit)
+{
+    while (ip + sizeof(uint64_t) <= limit)
+    {
+        uint64_t diff = lz_load64(ip) ^ lz_load64(match);
+        if (diff)
+        {
+            return ip + (__builtin_ctzll(diff) >> 3);
+        }
+        ip += sizeof(uint64_t);
+        match += sizeof(uint64_t);
+    }
+    while (ip < limit && *ip == *match)
+    {
+        ip++;
+        match++;
+    }
+    return ip;
+}
+
+uint64_t compress_lz(const void* src, uint64_t length, uint8_t* dst,
+                     uint64_t capacity)
+{
+    const uint8_t* in = src;
+    const uint8_t* end = in + length;
+    const uint8_t* anchor = in;
+    uint8_t* out = dst;
+    uint8_t* out_end = dst + capacity;
+
+    /* input offsets fit table entries, payloads are far below 4 GiB */
+    if (length > LZ_MF_LIMIT && length <= UINT32_MAX)
+    {
+        /* small inputs clear smaller table */
+        uint32_t hash_log = LZ_HASH_LOG;
+        while (hash_log > LZ_MIN_HASH_LOG && (1ull << hash_log) > length)
+        {
+            hash_log--;
+        }
+        uint32_t table[1 << LZ_HASH_LOG];
+        memset(table, 0, sizeof(table[0]) << hash_log);
+
+        const uint8_t* mf_limit = end - LZ_MF_LIMIT;
+        const uint8_t* match_limit = end - LZ_LAST_LITERALS;
+        const uint8_t* ip = in + 1;
+        for (;;)
+        {
+            const uint8_t* match;
+            const uint8_t* next = ip;
+            uint32_t attempts = 1u << LZ_SKIP_TRIGGER;
+            do
+            {
+                ip = next;
+                next = ip + (attempts++ >> LZ_SKIP_TRIGGER);
+                if (next > mf_limit)
+                {
+                    goto last_literals;
+                }
+                uint32_t h = lz_hash(lz_load32(ip), hash_log);
+                match = in + table[h];
+                table[h] = (uint32_t)(ip - in);
+            } while (ip - match > LZ_MAX_OFFSET ||
+                     lz_load32(match) != lz_load32(ip));
+
+            while (ip > anchor && match > in && ip[-1] == match[-1])
+            {
+                ip--;
+                match--;
+            }
+            const uint8_t* match_end = lz_match_end(
+                ip + LZ_MIN_MATCH, match + LZ_MIN_MATCH, match_limit);
+            uint64_t literals = (uint64_t)(ip - anchor);
+            uint64_t match_length = (uint64_t)(match_end - ip) - LZ_MIN_MATCH;
+            /* token, literals, offset and both length continuations */
+            if ((uint64_t)(out_end - out) <
+                1 + literals + literals / 255 + 1 + 2 + match_length / 255 + 1)
+            {
+                return 0;
+            }
+            uint8_t* token = out++;
+            *token = (uint8_t)((literals < LZ_RUN_MASK ? literals : LZ_RUN_MASK)
+                               << 4);
+            if (literals >= LZ_RUN_MASK)
+            {
+                out = lz_put_length(out, literals);
+            }
+            memcpy(out, anchor, literals);
+            out += literals;
+            uint16_t offset = (uint16_t)(ip - match);
+            *out++ = (uint8_t)offset;
+            *out++ = (uint8_t)(offset >> 8);
+            *token |= (uint8_t)(match_length < LZ_RUN_MASK ? match_length
+                                                           : LZ_RUN_MASK);
+            if (match_length >= LZ_RUN_MASK)
+            {
+                out = lz_put_length(out, match_length);
+            }
+
+            ip = match_end;
+            anchor = ip;
+            if (ip > mf_limit)
+            {
+                break;
+            }
+            /* position inside match would never be looked up otherwise */
+            table[lz_hash(lz_load32(ip - 2), hash_log)] =
+                (uint32_t)(ip - 2 - in);
+        }
+    }
+
+last_literals:;
+    uint64_t literals = (uint64_t)(end - anchor);
+    if ((uint64_t)(out_end - out) < 1 + literals / 255 + 1 + literals)
+    {
+        return 0;
+    }
+    *out++ = (uint8_t)((literals < LZ_RUN_MASK ? literals : LZ_RUN_MASK) << 4);
+    if (literals >= LZ_RUN_MASK)
+    {
+        out = lz_put_length(out, literals);
+    }
+    memcpy(out, anchor, literals);
+    out += literals;
+    return (uint64_t)(out - dst);
+}
+
+err_t decompress_lz(const uint8_t* src, uint64_t src_length, uint8_t* dst,
+                    uint64_t length)
+{
+    const uint8_t* ip = src;
+    const uint8_t* ip_end = src + src_length;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + length;
+    while (ip < ip_end)
+    {
+        uint8_t token = *ip++;
+        uint64_t literals = token >> 4;
+        if (literals == LZ_RUN_MASK &&
+            lz_get_length(&ip, ip_end, &literals) != DISFS_SUCCESS)
+        {
+            return DISFS_ERR_PROTO;
+        }
+        if (literals > (uint64_t)(ip_end - ip) ||
+            literals > (uint64_t)(op_end - op))
+        {
+            return DISFS_ERR_PROTO;
+        }
+        /* short runs are copied by fixed size, ends are rewritten later */
+        if (literals <= LZ_WILD_COPY && op_end - op >= LZ_WILD_COPY &&
+            ip_end - ip >= LZ_WILD_COPY)
+        {
+            memcpy(op, ip, LZ_WILD_COPY);
+        }
+        else
+        {
+            memcpy(op, ip, literals);
+        }
+        op += literals;
+        ip += literals;
+        /* last sequence has no match */
+        if (ip == ip_end)
+        {
+            break;
+        }
+
+        if (ip_end - ip < 2)
+        {
+            return DISFS_ERR_PROTO;
+        }
+        uint64_t offset = (uint64_t)ip[0] | ((uint64_t)ip[1] << 8);
+        ip += 2;
+        uint64_t match_length = token & LZ_RUN_MASK;
+        if (match_length == LZ_RUN_MASK &&
+            lz_get_length(&ip, ip_end, &match_length) != DISFS_SUCCESS)
+        {
+            return DISFS_ERR_PROTO;
+        }
+        match_length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (uint64_t)(op - dst) ||
+            match_length > (uint64_t)(op_end - op))
+        {
+            return DISFS_ERR_PROTO;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= sizeof(uint64_t) &&
+            (uint64_t)(op_end - op) >= match_length + sizeof(uint64_t))
+        {
+            /* words never overlap their source, tail past match is
+             * overwritten by next sequence */
+            for (uint64_t i = 0; i < match_length; i += sizeof(uint64_t))
+            {
+                memcpy(op + i, match + i, sizeof(uint64_t));
+            }
+            op += match_length;
+            continue;
+        }
+        /* overlapping match repeats last offset bytes */
+        for (uint64_t i = 0; i < match_length; i++)
+        {
+            op[i] = match[i];
+        }
+        op += match_length;
+    }
+    return op == op_end ? DISFS_SUCCESS : DISFS_ERR_PROTO;
+}
+
+int32_t compress_worthwhile(const void* data, uint64_t length)
+{
+    if (length < COMPRESS_MIN_LENGTH)
+    {
+        return 0;
+    }
+    const uint8_t* bytes = data;
+    for (uint32_t i = 0;
+         i < sizeof(compress_signatures) / sizeof(compress_signatures[0]); i++)
+    {
+        const compress_signature_t* signature = &compress_signatures[i];
+        if (memcmp(bytes, signature->bytes, signature->length) == 0)
+        {
+            return 0;
+        }
+    }
+    /* middle of data, headers of media files often compress well */
+    uint64_t sample = length < COMPRESS_SAMPLE_SIZE ? length
+                                                    : COMPRESS_SAMPLE_SIZE;
+    uint8_t out[COMPRESS_SAMPLE_SIZE];
+    return compress_lz(bytes + (length - sample) / 2, sample, out,
+                       sample - (sample >> COMPRESS_MIN_SAVING_SHIFT)) != 0;
+}
+
+void compress_adapt_init(compress_adapt_t adapt[static 1])
+{
+    *adapt = (compress_adapt_t){.ratio = COMPRESS_UNKNOWN,
+                                .cost = COMPRESS_UNKNOWN,
+                                .backoff = COMPRESS_PROBE_MIN};
+}
+
+void compress_adapt_skip(compress_adapt_t adapt[static 1])
+{
+    if (adapt->skip)
+    {
+        adapt->skip--;
+    }
+}
+
+static uint32_t compress_average(uint32_t average, uint32_t sample)
+{
+    if (average == COMPRESS_UNKNOWN)
+    {
+        return sample;
+    }
+    int64_t delta = (int64_t)sample - (int64_t)average;
+    return (uint32_t)((int64_t)average + delta / (1 << COMPRESS_AVERAGE_SHIFT));
+}
+
+void compress_adapt_record(compress_adapt_t adapt[static 1], uint64_t raw,
+                           uint64_t packed, uint64_t ns)
+{
+    if (raw == 0)
+    {
+        return;
+    }
+    uint64_t ratio = packed ? packed * 1024 / raw : 1024;
+    uint64_t cost = ns * 1024 / raw;
+    adapt->ratio = compress_average(adapt->ratio,
+                                    (uint32_t)(ratio < 1024 ? ratio : 1024));
+    adapt->cost = compress_average(
+        adapt->cost, (uint32_t)(cost < UINT32_MAX - 1 ? cost : UINT32_MAX - 1));
+
+    uint64_t saved = 1024 - adapt->ratio;
+    if (adapt->ratio <= COMPRESS_RATIO_LIMIT &&
+        adapt->cost <= COMPRESS_COST_LIMIT_NS * saved)
+    {
+        adapt->backoff = COMPRESS_PROBE_MIN;
+        return;
+    }
+    /* averages restart with probe, stale ones would outvote it */
+    adapt->skip = adapt->backoff;
+    adapt->backoff = adapt->backoff * 2 < COMPRESS_PROBE_MAX
+                         ? adapt->backoff * 2
+                         : COMPRESS_PROBE_MAX;
+    adapt->ratio = COMPRESS_UNKNOWN;
+    adapt->cost = COMPRESS_UNKNOWN;
+}
@@ -4,38 +4,181 @@
  */
 
 #include "connection.h"
+#include "buf_pool.h"
+#include "checksum.h"
+#include "compress.h"
 #include "err_codes.h"
+#include "io_backend.h"
 #include "logger.h"
+#include "membership.h"
+#include "metrics.h"
+#include "peer.h"
+#include "protocol.h"
+#include "ring_buffer.h"
 #include "udp_discovery.h"
+#include "wire.h"
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
-#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/fcntl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
-#define EPOLL_MAX_FD 100
+#define REACTOR_WAIT_MS 1000
+#define CONNECT_TIMEOUT_MS 3000
+#define CONNECT_BACKOFF_BASE_MS 250
+#define CONNECT_BACKOFF_MAX_MS 30000
+/* after this many failed attempts peer is forgotten until rediscovered */
+#define CONNECT_MAX_FAILURES 16
+/* peers are sampled for round trip time and evicted this often */
+#define PEER_CHECK_MS 1000
+#define DISCOVERY_PORT 8081
+#define DISCOVERY_IP "172.17.255.255"
+#define DISCOVERY_INTERVAL_MS 1000
+/* longest sleep of discovery thread, bounds delay of close_connection */
+#define DISCOVERY_NAP_MS 100
+#define TX_HIGH_WATERMARK (4 * 1024 * 1024)
+/* most queued segments written by single syscall */
+#define TX_IOV_BATCH 64
+#define REQUEST_TIMEOUT_MS 5000
 
-static int32_t is_first_connection = 0;
+/*
+   request posted to reactor by connection_call, or cancel of one posted by
+   connection_cancel, lives in pool buffer
+ */
+typedef struct connection_call_t
+{
+    struct sockaddr_in addr;
+    inflight_fn fn;
+    void* ctx;
+    uint32_t timeout_ms;
+    uint32_t length;
+    uint16_t type;
+    uint8_t cancel;
+    char _padded[5];
+    uint8_t payload[];
+} connection_call_t;
+
+_Static_assert(sizeof(tx_segment_t) + PROTO_MAX_FRAME_SIZE <=
+                   BUF_POOL_MAX_SIZE + BUF_POOL_HEADROOM,
+               "Largest frame does not fit buffer pool");
 
 static void* connection_thread(void* arg);
+static err_t connection_reactor_init(reactor_t reactor[static 1]);
 static void* connection_udp_thread(void* arg);
+static void connection_rejoin(connection_t connection[static 1]);
 static err_t connection_set_noblock(int32_t fd);
-static err_t connection_add_event(int32_t epoll, int32_t fd, uint32_t state);
-static err_t connection_accept_client(int32_t epoll,
-                                      connection_t connection[static 1]);
-static err_t connection_handle_events(int32_t epoll, struct epoll_event* events,
-                                      int32_t events_count,
-                                      connection_t connection[static 1]);
-static err_t connection_to_new_server(UDP_packet packet[static 1],
-                                      struct sockaddr_in* addr,
-                                      const char ip[INET_ADDRSTRLEN]);
+static err_t connection_attach_client(reactor_t reactor[static 1],
+                                      client_t client[static 1]);
+static err_t connection_accept_client(reactor_t reactor[static 1]);
+static err_t connection_add_accepted(reactor_t reactor[static 1], int32_t fd,
+                                     const struct sockaddr_in addr[static 1]);
+static err_t connection_handle_events(reactor_t reactor[static 1],
+                                      const io_event_t* events,
+                                      int32_t events_count);
+static void connection_handle_udp(connection_t connection[static 1]);
+static err_t
+connection_to_new_server(connection_t connection[static 1],
+                         const struct sockaddr_in peer_addr[static 1]);
+static void connection_member_event(void* ctx,
+                                    const member_t member[static 1]);
 
 static void connection_get_local_ip(connection_t connection[static 1]);
+static err_t connection_read(client_t client[static 1]);
+static err_t connection_receive(client_t client[static 1],
+                                const uint8_t* data, uint32_t length);
+static err_t connection_ingest(client_t client[static 1], const uint8_t* data,
+                               uint32_t length, uint32_t used[static 1]);
+static err_t connection_stash(client_t client[static 1], const uint8_t* data,
+                              uint32_t length);
+static err_t connection_resume(client_t client[static 1]);
+static err_t connection_process(client_t client[static 1]);
+static err_t connection_dispatch(void* arg,
+                                 const proto_frame_t frame[static 1]);
+static err_t connection_dispatch_packed(client_t client[static 1],
+                                        const proto_frame_t frame[static 1]);
+static err_t connection_send_hello(client_t client[static 1]);
+static err_t connection_handle_hello(client_t client[static 1],
+                                     const proto_frame_t frame[static 1]);
+static err_t connection_adopt_peer(client_t client[static 1],
+                                   uint16_t tcp_port);
+static void connection_retire_peer(connection_t connection[static 1],
+                                   client_t peer[static 1]);
+static void connection_ring_add(connection_t connection[static 1],
+                                client_t client[static 1]);
+static void connection_drop_client(client_t client[static 1]);
+static void connection_release_dropped(reactor_t reactor[static 1]);
+static void connection_free_tx(client_t client[static 1]);
+static uint8_t connection_wants(const client_t client[static 1]);
+static err_t connection_set_wants(client_t client[static 1], uint8_t wants);
+static err_t connection_flush(client_t client[static 1]);
+static ssize_t connection_write_batch(client_t client[static 1],
+                                      size_t requested[static 1]);
+static err_t connection_frame_segment(client_t client[static 1],
+                                      uint16_t type, uint8_t flags,
+                                      uint64_t request_id,
+                                      const struct iovec* iov,
+                                      uint32_t iov_count, uint64_t extra_length,
+                                      uint32_t extra_crc,
+                                      tx_segment_t* out[static 1]);
+static uint64_t connection_compress(client_t client[static 1],
+                                    const struct iovec* iov,
+                                    uint32_t iov_count, uint64_t length,
+                                    uint8_t* payload);
+static err_t connection_queue(client_t client[static 1],
+                              tx_segment_t* first, tx_segment_t* last);
+static err_t connection_send_frame(client_t client[static 1], uint16_t type,
+                                   uint8_t flags, uint64_t request_id,
+                                   const struct iovec* iov,
+                                   uint32_t iov_count);
+static err_t connection_send_file_frame(client_t client[static 1],
+                                        uint16_t type, uint8_t flags,
+                                        uint64_t request_id,
+                                        const struct iovec* iov,
+                                        uint32_t iov_count, int32_t file_fd,
+                                        uint64_t file_offset,
+                                        uint32_t file_length,
+                                        uint32_t file_crc);
+static err_t connection_complete(client_t client[static 1],
+                                 const proto_frame_t frame[static 1]);
+static void connection_track(client_t client[static 1]);
+static void connection_fail_requests(client_t client[static 1]);
+static void connection_post_call(reactor_t reactor[static 1],
+                                 buf_t buf[static 1]);
+static void connection_run_calls(reactor_t reactor[static 1]);
+static void connection_start_call(reactor_t reactor[static 1],
+                                  buf_t buf[static 1]);
+static void connection_fail_calls(reactor_t reactor[static 1]);
+static void connection_cancel_call(client_t* client, inflight_fn fn,
+                                   void* ctx);
+static uint64_t connection_now_ms(void);
+static err_t connection_start_connect(reactor_t reactor[static 1],
+                                      client_t client[static 1]);
+static void connection_finish_connect(reactor_t reactor[static 1],
+                                      client_t client[static 1]);
+static void connection_connect_failed(reactor_t reactor[static 1],
+                                      client_t client[static 1]);
+static void connection_unlink_connecting(reactor_t reactor[static 1],
+                                         client_t client[static 1]);
+static void connection_check_deadlines(reactor_t reactor[static 1]);
+static void connection_expire_requests(reactor_t reactor[static 1],
+                                       uint64_t now);
+static int32_t connection_next_timeout(reactor_t reactor[static 1]);
+static void connection_check_peers(reactor_t reactor[static 1]);
+static void connection_teardown(connection_t conn[static 1],
+                                uint32_t reactors);
+static void connection_report(void* arg, metrics_writer_t writer[static 1]);
+static err_t connection_handle_ping(void* ctx, client_t client[static 1],
+                                    const proto_frame_t frame[static 1]);
 
 static void connection_get_local_ip(connection_t connection[static 1])
 {
@@ -62,54 +205,291 @@ err_t _internal_create_connection(connection_t connection[static 1],
                                   connection_params_opt params)
 {
     connection_get_local_ip(connection);
+    /* everything fail path releases is set up before first failure */
+    uint32_t ready = 0;
+    connection->udp.fd = -1;
+    connection->udp_rx = NULL;
+    connection->peer_cache = NULL;
+    connection->reactors = NULL;
+    connection->membership = (membership_t){};
+    metrics_init(&connection->metrics);
+    hash_ring_init(&connection->ring, 0);
+    err_t err = peer_table_init(&connection->peers);
+    if (err != DISFS_SUCCESS)
+    {
+        goto fail;
+    }
     int32_t tcp_port = params.port_tcp ? params.port_tcp : 8080;
-    int32_t udp_port = params.port_udp ? params.port_udp : 8080;
+    int32_t udp_port = params.port_udp ? params.port_udp : DISCOVERY_PORT;
 
     /* create udp socket */
-    connection->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (connection->udp_fd <= 0)
+    connection->udp.kind = EVENT_KIND_UDP;
+    connection->udp.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (connection->udp.fd <= 0)
     {
         LOG_ERROR("Cannot create socket for udp connection: errno=%d : %s\n",
                   errno, strerror(errno));
-        return DISFS_ERR_SOCK;
+        err = DISFS_ERR_SOCK;
+        goto fail;
     }
 
     int32_t udp_opt = -1;
-    int32_t ret = setsockopt(connection->udp_fd, SOL_SOCKET, SO_REUSEADDR,
+    int32_t ret = setsockopt(connection->udp.fd, SOL_SOCKET, SO_REUSEADDR,
                              &udp_opt, sizeof(udp_opt));
 
     if (ret < 0)
     {
         LOG_ERROR(
             "Cannot set options to socket: socket = %d, errno = %d : %s!\n",
-            connection->udp_fd, errno, strerror(errno));
-        return DISFS_ERR_SOCK;
+            connection->udp.fd, errno, strerror(errno));
+        err = DISFS_ERR_SOCK;
+        goto fail;
+    }
+    /* bootstrap announcements leave from the same socket */
+    udp_opt = 1;
+    ret = setsockopt(connection->udp.fd, SOL_SOCKET, SO_BROADCAST, &udp_opt,
+                     sizeof(udp_opt));
+    if (ret < 0)
+    {
+        LOG_ERROR("Cannot enable broadcast on socket %d: errno = %d : %s!\n",
+                  connection->udp.fd, errno, strerror(errno));
+        err = DISFS_ERR_SOCK;
+        goto fail;
     }
 
     connection->udp_addr.sin_family = AF_INET;
     connection->udp_addr.sin_addr.s_addr = INADDR_ANY;
-    connection->udp_addr.sin_port = htons(8081);
+    connection->udp_addr.sin_port = htons((uint16_t)udp_port);
 
-    if (bind(connection->udp_fd, (struct sockaddr*)&connection->udp_addr,
+    if (bind(connection->udp.fd, (struct sockaddr*)&connection->udp_addr,
              sizeof(connection->udp_addr)) < 0)
     {
         LOG_ERROR("Cannot bind socket to port: port %d errno: %d : %s!\n",
                   udp_port, errno, strerror(errno));
-        return DISFS_ERR_SOCK;
+        err = DISFS_ERR_SOCK;
+        goto fail;
+    }
+
+    connection->addr.sin_addr.s_addr = INADDR_ANY;
+    connection->addr.sin_family = AF_INET;
+    connection->addr.sin_port = htons((uint16_t)tcp_port);
+    connection->addr_len = sizeof(connection->addr);
+
+    connection->discovery_addr.sin_family = AF_INET;
+    connection->discovery_addr.sin_port = htons((uint16_t)(
+        params.discovery_port ? params.discovery_port : udp_port));
+    const char* discovery_ip =
+        params.discovery_ip ? params.discovery_ip : DISCOVERY_IP;
+    if (inet_pton(AF_INET, discovery_ip,
+                  &connection->discovery_addr.sin_addr) != 1)
+    {
+        LOG_ERROR("Invalid discovery address %s\n", discovery_ip);
+        err = DISFS_ERR_INVALID_ARG;
+        goto fail;
+    }
+    connection->discovery_ports =
+        params.discovery_ports ? params.discovery_ports : 1;
+    connection->discovery_interval_ms = params.discovery_interval_ms
+                                            ? params.discovery_interval_ms
+                                            : DISCOVERY_INTERVAL_MS;
+    connection->udp_rx = udp_batch_create();
+    if (connection->udp_rx == NULL)
+    {
+        err = DISFS_ERR_ALLOC;
+        goto fail;
+    }
+    struct in_addr local_ip = {};
+    inet_pton(AF_INET, connection->local_ip, &local_ip);
+    err = membership_init(&connection->membership, connection->udp.fd,
+                                local_ip, (uint16_t)udp_port,
+                                (uint16_t)tcp_port, params.probe_interval_ms,
+                                connection_member_event, connection);
+    if (err != DISFS_SUCCESS)
+    {
+        goto fail;
+    }
+    if (connection->handlers[PROTO_MSG_PING].fn == NULL)
+    {
+        connection_register_handler(connection, PROTO_MSG_PING,
+                                    connection_handle_ping, NULL);
+    }
+
+    connection->connect_timeout_ms = params.connect_timeout_ms
+                                         ? params.connect_timeout_ms
+                                         : CONNECT_TIMEOUT_MS;
+    connection->tx_high_watermark = params.tx_high_watermark
+                                        ? params.tx_high_watermark
+                                        : TX_HIGH_WATERMARK;
+    connection->tx_low_watermark = params.tx_low_watermark
+                                       ? params.tx_low_watermark
+                                       : connection->tx_high_watermark / 4;
+    if (connection->tx_low_watermark > connection->tx_high_watermark)
+    {
+        LOG_ERROR("Low watermark %lu is above high watermark %lu\n",
+                  connection->tx_low_watermark,
+                  connection->tx_high_watermark);
+        err = DISFS_ERR_INVALID_ARG;
+        goto fail;
+    }
+    if (params.frame_checksum < 0 || params.frame_checksum >= CHECKSUM_KIND_MAX)
+    {
+        LOG_ERROR("Unknown frame checksum %d\n", params.frame_checksum);
+        err = DISFS_ERR_INVALID_ARG;
+        goto fail;
+    }
+    connection->frame_checksum = (uint32_t)params.frame_checksum;
+    /* cache is opened only once parameters are known to be valid */
+    if (params.peer_cache_path)
+    {
+        connection->peer_cache = malloc(sizeof(*connection->peer_cache));
+        if (connection->peer_cache == NULL)
+        {
+            err = DISFS_ERR_ALLOC;
+            goto fail;
+        }
+        err = peer_cache_open(connection->peer_cache, params.peer_cache_path,
+                              (uint64_t)time(NULL));
+        if (err != DISFS_SUCCESS)
+        {
+            free(connection->peer_cache);
+            connection->peer_cache = NULL;
+            goto fail;
+        }
+    }
+    connection->codecs = params.disable_compression ? 0 : COMPRESS_SUPPORTED;
+    connection->reactor_count =
+        params.reactor_threads ? params.reactor_threads : 1;
+    connection->reactors =
+        calloc(connection->reactor_count, sizeof(*connection->reactors));
+    if (connection->reactors == NULL)
+    {
+        LOG_ERROR("Cannot allocate %u reactors\n", connection->reactor_count);
+        err = DISFS_ERR_ALLOC;
+        goto fail;
+    }
+
+    /*
+       Ring is keyed by listening address, so only established member
+       peers, indexed by address their node listens on, and this node itself
+       take part.
+       Local node is the entry without address.
+     */
+    struct sockaddr_in local = connection->addr;
+    inet_pton(AF_INET, connection->local_ip, &local.sin_addr);
+    err = hash_ring_add(&connection->ring, connection_node_id(&local), NULL);
+    if (err != DISFS_SUCCESS)
+    {
+        goto fail;
+    }
+
+    int32_t cpus = (int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    for (uint32_t i = 0; i < connection->reactor_count; i++)
+    {
+        reactor_t* reactor = &connection->reactors[i];
+        reactor->connection = connection;
+        reactor->id = i;
+        reactor->cpu = params.pin_reactors ? (int32_t)i % cpus : -1;
+        reactor->rng = (uint64_t)time(NULL) ^ ((uint64_t)(i + 1) << 32);
+        reactor->listener.fd = -1;
+        reactor->wakeup.fd = -1;
+        reactor->backend = (io_backend_t){.fd = -1};
+        pthread_mutex_init(&reactor->calls_lock, NULL);
+        ready = i + 1;
+        reactor->metrics = metrics_shard(&connection->metrics);
+        if (reactor->metrics == NULL)
+        {
+            err = DISFS_ERR_ALLOC;
+            goto fail;
+        }
+        err = io_backend_init(&reactor->backend, params.io_backend);
+        if (err != DISFS_SUCCESS)
+        {
+            goto fail;
+        }
+        err = connection_reactor_init(reactor);
+        if (err != DISFS_SUCCESS)
+        {
+            goto fail;
+        }
+    }
+    /*
+       membership traffic is served by first reactor only, it also owns every
+       outbound peer until its connect completes
+     */
+    err = io_backend_add(&connection->reactors[0].backend, &connection->udp,
+                         IO_WANT_READ);
+    if (err != DISFS_SUCCESS)
+    {
+        goto fail;
+    }
+
+    LOG_DEBUG("Successfully created %u reactors on port %d\n",
+              connection->reactor_count, tcp_port);
+
+    if (params.stats_path)
+    {
+        err = metrics_serve(&connection->metrics, params.stats_path,
+                            connection_report, connection);
+        if (err != DISFS_SUCCESS)
+        {
+            goto fail;
+        }
+    }
+
+    connection->closing = 0;
+    connection->tcp_th_run = 1;
+    connection->udp_th_run = 1;
+
+    uint32_t started = 0;
+    while (started < connection->reactor_count &&
+           pthread_create(&connection->reactors[started].th, NULL,
+                          connection_thread,
+                          &connection->reactors[started]) == 0)
+    {
+        started++;
+    }
+    if (started == connection->reactor_count &&
+        pthread_create(&connection->udp_th, NULL, connection_udp_thread,
+                       connection) == 0)
+    {
+        return DISFS_SUCCESS;
+    }
+    LOG_ERROR("Cannot start threads of connection\n");
+    err = DISFS_ERR_GENERIC;
+    connection->closing = 1;
+    connection->tcp_th_run = 0;
+    connection->udp_th_run = 0;
+    for (uint32_t i = 0; i < started; i++)
+    {
+        pthread_join(connection->reactors[i].th, NULL);
     }
+fail:
+    connection_teardown(connection, ready);
+    return err;
+}
 
-    connection->fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (connection->fd <= 0)
+static err_t connection_reactor_init(reactor_t reactor[static 1])
+{
+    connection_t* connection = reactor->connection;
+    reactor->listener.kind = EVENT_KIND_LISTENER;
+    reactor->listener.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (reactor->listener.fd <= 0)
     {
         LOG_ERROR("Cannot create socket for connection errno: %d : %s!\n",
                   errno, strerror(errno));
         return DISFS_ERR_SOCK;
     }
 
+    /* every reactor binds own listener, kernel spreads incoming connections */
     int32_t opt = -1;
-    ret =
-        setsockopt(connection->fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
+    int32_t ret = setsockopt(reactor->listener.fd, SOL_SOCKET, SO_REUSEADDR,
+                             &opt, sizeof(opt));
+    if (ret == 0)
+    {
+        opt = 1;
+        ret = setsockopt(reactor->listener.fd, SOL_SOCKET, SO_REUSEPORT, &opt,
+                         sizeof(opt));
+    }
     if (ret < 0)
     {
         LOG_ERROR("Cannot set options to socket: errno: %d : %s!\n", errno,
@@ -117,52 +497,83 @@ err_t _internal_create_connection(connection_t connection[static 1],
         return DISFS_ERR_SOCK;
     }
 
-    connection->addr.sin_addr.s_addr = INADDR_ANY;
-    connection->addr.sin_family = AF_INET;
-    connection->addr.sin_port = htons((uint16_t)tcp_port);
-    connection->addr_len = sizeof(connection->addr);
-
-    ret = bind(connection->fd, (struct sockaddr*)&connection->addr,
+    ret = bind(reactor->listener.fd, (struct sockaddr*)&connection->addr,
                connection->addr_len);
     if (ret < 0)
     {
         LOG_ERROR("Cannot bind socket to port: port %d errno: %d : %s!\n",
-                  tcp_port, errno, strerror(errno));
+                  ntohs(connection->addr.sin_port), errno, strerror(errno));
         return DISFS_ERR_SOCK;
     }
 
-    ret = listen(connection->fd, 3);
+    ret = listen(reactor->listener.fd, SOMAXCONN);
     if (ret < 0)
     {
         LOG_ERROR("Cannot listen for socket errno: %d : %s!\n", errno,
                   strerror(errno));
         return DISFS_ERR_SOCK;
     }
+    connection_set_noblock(reactor->listener.fd);
+    err_t err = io_backend_add(&reactor->backend, &reactor->listener,
+                               IO_WANT_ACCEPT);
+    if (err != DISFS_SUCCESS)
+    {
+        return err;
+    }
 
-    LOG_DEBUG("Successfully created connection socket: %d\n", connection->fd);
-
-    connection->tcp_th_run = 1;
-    connection->udp_th_run = 1;
-
-    pthread_create(&connection->tcp_th, NULL, connection_thread, connection);
-    pthread_create(&connection->udp_th, NULL, connection_udp_thread,
-                   connection);
-    return 0;
+    reactor->wakeup.kind = EVENT_KIND_WAKEUP;
+    reactor->wakeup.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wakeup.fd < 0)
+    {
+        LOG_ERROR("Cannot create eventfd of reactor errno: %d : %s!\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_SOCK;
+    }
+    return io_backend_add(&reactor->backend, &reactor->wakeup, IO_WANT_READ);
 }
 
 static void* connection_thread(void* arg)
 {
     ASSERT(arg, "Argument for thread function cannot be nullptr");
-    int32_t epoll = epoll_create(EPOLL_MAX_FD);
-    struct epoll_event events[EPOLL_MAX_FD * 10]; // TODO: remove magic number
-    connection_t* conn = arg;
-    connection_set_noblock(conn->fd);
-    connection_add_event(epoll, conn->fd, EPOLLIN);
-    connection_add_event(epoll, conn->udp_fd, EPOLLIN);
+    io_event_t events[IO_BACKEND_MAX_EVENTS];
+    reactor_t* reactor = arg;
+    connection_t* conn = reactor->connection;
+    if (reactor->cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((size_t)reactor->cpu, &set);
+        int32_t ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0)
+        {
+            LOG_WARNING("Cannot pin reactor %u to cpu %d: %s\n", reactor->id,
+                        reactor->cpu, strerror(ret));
+        }
+    }
+    if (reactor->id == 0)
+    {
+        connection_rejoin(conn);
+    }
     while (conn->tcp_th_run)
     {
-        int32_t no_events = epoll_wait(epoll, events, EPOLL_MAX_FD * 10, 1000);
-        connection_handle_events(epoll, events, no_events, conn);
+        int32_t timeout = connection_next_timeout(reactor);
+        int32_t no_events = io_backend_wait(&reactor->backend, events,
+                                            IO_BACKEND_MAX_EVENTS, timeout);
+        uint64_t start_ns = metrics_now_ns();
+        connection_handle_events(reactor, events, no_events);
+        connection_check_deadlines(reactor);
+        connection_release_dropped(reactor);
+        connection_check_peers(reactor);
+        if (reactor->id == 0 && connection_now_ms() >= reactor->membership_ms)
+        {
+            reactor->membership_ms =
+                membership_tick(&conn->membership, connection_now_ms());
+        }
+        if (no_events > 0)
+        {
+            metrics_record(reactor->metrics, METRIC_LOOP_NS,
+                           metrics_now_ns() - start_ns);
+        }
     }
     return NULL;
 }
@@ -187,246 +598,2044 @@ static err_t connection_set_noblock(int32_t fd)
     return DISFS_SUCCESS;
 }
 
-static err_t connection_add_event(int32_t epoll, int32_t fd, uint32_t state)
+static err_t connection_attach_client(reactor_t reactor[static 1],
+                                      client_t client[static 1])
 {
-    struct epoll_event ev = {0};
-    ev.data.fd = fd;
-    ev.events = state;
-    int32_t res = epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &ev);
-    if (res < 0)
+    client->rx_verify = (proto_verify_t){};
+    if (ring_buffer_create(&client->rx, PROTO_MAX_FRAME_SIZE) != DISFS_SUCCESS)
     {
-        LOG_ERROR("Cannot add event to epoll\n");
-        return DISFS_ERR_EPOLL;
+        return DISFS_ERR_ALLOC;
     }
-    return DISFS_SUCCESS;
+    connection_set_noblock(client->source.fd);
+    inet_ntop(AF_INET, &client->addr.sin_addr, client->ip, INET_ADDRSTRLEN);
+    client->source.kind = EVENT_KIND_PEER;
+    client->reactor = reactor;
+    client->state = PEER_STATE_ESTABLISHED;
+    /* other threads see peer once active, and then everything set above */
+    __atomic_store_n(&client->active, 1, __ATOMIC_RELEASE);
+    err_t ret =
+        io_backend_add(&reactor->backend, &client->source, IO_WANT_RECV);
+    if (ret != DISFS_SUCCESS)
+    {
+        __atomic_store_n(&client->active, 0, __ATOMIC_RELEASE);
+        ring_buffer_destroy(&client->rx);
+    }
+    return ret;
 }
 
-static err_t connection_accept_client(int32_t epoll,
-                                      connection_t connection[static 1])
+static err_t connection_accept_client(reactor_t reactor[static 1])
 {
-    client_t client = {.active = 1};
-    client.fd =
-        accept(connection->fd, (struct sockaddr*)&client.addr, &client.len);
-    if (client.fd <= 0)
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int32_t fd = accept(reactor->listener.fd, (struct sockaddr*)&addr, &len);
+    if (fd <= 0)
     {
+        /* another reactor may win the race for the same connection */
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return DISFS_SUCCESS;
+        }
         LOG_ERROR("Cannot accept client: fd=%d, server_fd=%d errno=%d : %s!\n",
-                  client.fd, connection->fd, errno, strerror(errno));
+                  fd, reactor->listener.fd, errno, strerror(errno));
         return DISFS_ERR_SOCK;
     }
-    LOG_TRACE("Accepted new client: fd=%d\n", client.fd);
-    if (is_first_connection == 0)
+    return connection_add_accepted(reactor, fd, &addr);
+}
+
+static err_t connection_add_accepted(reactor_t reactor[static 1], int32_t fd,
+                                     const struct sockaddr_in addr[static 1])
+{
+    connection_t* connection = reactor->connection;
+    LOG_TRACE("Accepted new client: fd=%d\n", fd);
+
+    client_t* client = NULL;
+    err_t ret = peer_table_add(&connection->peers, addr, &client);
+    if (ret != DISFS_SUCCESS)
     {
-        is_first_connection = 1;
+        LOG_ERROR("Cannot add accepted client fd=%d to peer table\n", fd);
+        close(fd);
+        return ret;
     }
-    client_t* clients = connection->clients;
-    for (int32_t i = 0; i < MAX_NEIGHBOURS; i++)
+    client->source.fd = fd;
+    ret = connection_attach_client(reactor, client);
+    if (ret != DISFS_SUCCESS)
     {
-        if (!clients[i].active)
-        {
-            clients[i] = client;
-            connection_add_event(epoll, client.fd, EPOLLIN);
-            return DISFS_SUCCESS;
-        }
+        close(fd);
+        peer_table_remove(&connection->peers, client);
+        return ret;
     }
-    LOG_ERROR("Threshhold of active neighbours is reached!\n");
-    /* TODO: In this context of reaching max neighbours, server should send info
-       to client informing that should find another peer connection */
-
-    return DISFS_ERR_MAX_PEER;
+    metrics_add(reactor->metrics, METRIC_ACCEPTS, 1);
+    return DISFS_SUCCESS;
 }
 
 static err_t connection_read(client_t client[static 1])
 {
-    char buffer[1024] = {};
-    ssize_t readed = read(client->fd, buffer, sizeof(buffer) - 1);
-    LOG_INFO("Readed from %d, size %ld, buffer = %s\n", client->fd, readed,
-             buffer);
+    ring_buffer_t* rx = &client->rx;
+    /* readable event may be left from batch in which client was throttled */
+    if (client->throttled)
+    {
+        return DISFS_SUCCESS;
+    }
+    /* frame never exceeds ring capacity, so full ring was already parsed */
+    ASSERT(ring_buffer_free(rx) > 0, "Receive ring is full");
+    ssize_t readed = read(client->source.fd, ring_buffer_write_ptr(rx),
+                          ring_buffer_free(rx));
+    if (readed < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return DISFS_SUCCESS;
+    }
     if (readed <= 0)
     {
         LOG_WARNING("Readed 0 or less bytes from client %d, client will be "
                     "disconnected\n",
-                    client->fd);
+                    client->source.fd);
         return DISFS_ERR_READED;
     }
+    ring_buffer_produce(rx, (uint64_t)readed);
+    metrics_inc(&client->bytes_in, (uint64_t)readed);
+    metrics_add(client->reactor->metrics, METRIC_BYTES_IN, (uint64_t)readed);
+    LOG_TRACE("Readed from %d, size %ld, pending = %lu\n", client->source.fd,
+              readed, ring_buffer_used(rx));
+    return connection_process(client);
+}
+
+/* take data received by backend, bytes after older backlog wait behind it */
+static err_t connection_receive(client_t client[static 1],
+                                const uint8_t* data, uint32_t length)
+{
+    metrics_inc(&client->bytes_in, length);
+    metrics_add(client->reactor->metrics, METRIC_BYTES_IN, length);
+    uint32_t used = 0;
+    if (client->rx_backlog == NULL)
+    {
+        err_t ret = connection_ingest(client, data, length, &used);
+        if (ret != DISFS_SUCCESS)
+        {
+            return ret;
+        }
+    }
+    if (used < length)
+    {
+        return connection_stash(client, data + used, length - used);
+    }
     return DISFS_SUCCESS;
 }
 
-static err_t connection_handle_events(int32_t epoll, struct epoll_event* events,
-                                      int32_t events_count,
-                                      connection_t connection[static 1])
+/* copy data to receive ring, parsing frames as it fills unless throttled */
+static err_t connection_ingest(client_t client[static 1], const uint8_t* data,
+                               uint32_t length, uint32_t used[static 1])
 {
-    for (int32_t i = 0; i < events_count; i++)
+    ring_buffer_t* rx = &client->rx;
+    *used = 0;
+    while (*used < length)
     {
-        int32_t fd = events[i].data.fd;
-        if (fd == connection->fd)
+        uint64_t chunk = ring_buffer_free(rx);
+        if (chunk == 0)
         {
-            connection_accept_client(epoll, connection);
+            /* only frames left unparsed by throttled client fill ring */
+            ASSERT(client->throttled, "Receive ring is full");
+            break;
         }
-        else if (fd == connection->udp_fd)
+        if (chunk > length - *used)
         {
-            /*
-               Handle broadcasted UDP packet to get new client, after receiving
-               this packet, we should initiate connection with following client.
-
-             */
-            char buffer[1024] = {};
-            struct sockaddr_in src_addr;
-            socklen_t addrlen = sizeof(src_addr);
-
-            ssize_t n = recvfrom(fd, buffer, sizeof(buffer) - 1, 0,
-                                 (struct sockaddr*)&src_addr, &addrlen);
-            char ip[INET_ADDRSTRLEN] = {};
-            inet_ntop(AF_INET, &(src_addr.sin_addr), ip, sizeof(ip));
-            LOG_TRACE("Received udp packet: fd=%d, ip=%s, port=%d, buffor=%s\n",
-                      fd, ip, ntohs(src_addr.sin_port), buffer);
-
-            /* resend udp packet, to inform where start connection */
-            UDP_packet packet = {};
-            udp_discovery_packet_deserialize(&packet, buffer, n);
-            // after that try to connect to this server
-            if (packet.magic_number != UDP_DISCOVERY_PACKET_MAGIC_NUMBER ||
-                packet.protocol_version != UDP_DISCOVERY_PROTOCOL_VERSION)
-            {
-                LOG_ERROR("Udp packet with incorrect information!\n");
-                break;
-            }
-            if (strcmp(ip, "127.0.0.1") == 0)
-            {
-                LOG_TRACE("Internal sended message!, ignoring\n");
-                continue;
-            }
-            if (strcmp(ip, connection->local_ip) == 0)
-            {
-                LOG_TRACE("Internal sended message!, ignoring\n");
-                continue;
-            }
-            connection_to_new_server(&packet, &src_addr, ip);
+            chunk = length - *used;
         }
-        else
+        memcpy(ring_buffer_write_ptr(rx), data + *used, chunk);
+        ring_buffer_produce(rx, chunk);
+        *used += (uint32_t)chunk;
+        if (!client->throttled)
         {
-            client_t* client = NULL;
-            for (int32_t j = 0; j < MAX_NEIGHBOURS; j++)
-            {
-                if (connection->clients[j].fd == fd &&
-                    connection->clients[j].active)
-                {
-                    client = &connection->clients[j];
-                }
-            }
-            if (events[i].events & EPOLLIN)
+            err_t ret = connection_process(client);
+            if (ret != DISFS_SUCCESS)
             {
-                if (connection_read(client) != DISFS_SUCCESS)
-                {
-                    client->active = 0;
-                    close(client->fd);
-                }
+                return ret;
             }
         }
     }
     return DISFS_SUCCESS;
 }
 
-// TODO: remove global
-static client_t clients[MAX_NEIGHBOURS];
+/*
+ * io_uring may complete receives of throttled client before they are
+ * cancelled, bytes which do not fit its ring are kept in order until release.
+ * Backlog is bounded by receive buffers of backend.
+ */
+static err_t connection_stash(client_t client[static 1], const uint8_t* data,
+                              uint32_t length)
+{
+    buf_t* buf = buf_alloc(length);
+    if (buf == NULL)
+    {
+        return DISFS_ERR_ALLOC;
+    }
+    memcpy(buf->data, data, length);
+    buf->length = length;
+    buf_t** link = &client->rx_backlog;
+    while (*link)
+    {
+        link = &(*link)->next;
+    }
+    *link = buf;
+    return DISFS_SUCCESS;
+}
 
-static err_t connection_to_new_server(UDP_packet packet[static 1],
-                                      struct sockaddr_in* addr,
-                                      const char ip[INET_ADDRSTRLEN])
+/* release throttled client once its queue drained, parse what it sent since */
+static err_t connection_resume(client_t client[static 1])
 {
-    /* check if connection from this IP is already satisfied */
-    client_t* client = NULL;
-    for (int32_t i = 0; i < MAX_NEIGHBOURS; i++)
+    if (!client->throttled ||
+        client->tx_pending > client->reactor->connection->tx_low_watermark)
     {
-        if (clients[i].active)
-        {
-            if (strcmp(clients[i].ip, ip) == 0)
-            {
-                LOG_DEBUG("Connected before this IP: %s\n", ip);
-                return DISFS_SUCCESS;
-            }
-        }
-        else
+        return DISFS_SUCCESS;
+    }
+    client->throttled = 0;
+    err_t ret = connection_process(client);
+    while (ret == DISFS_SUCCESS && client->rx_backlog && !client->throttled)
+    {
+        buf_t* buf = client->rx_backlog;
+        uint32_t used = 0;
+        ret = connection_ingest(client, buf->data, buf->length, &used);
+        if (used < buf->length)
         {
-            client = &clients[i];
-            break;
+            memmove(buf->data, buf->data + used, buf->length - used);
+            buf->length -= used;
+            continue;
         }
+        client->rx_backlog = buf->next;
+        buf_unref(buf);
     }
-    client->fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (client->fd < 0)
+    if (ret != DISFS_SUCCESS)
     {
-        LOG_ERROR("Cannot create socket for connection\n");
-        return DISFS_ERR_SOCK;
+        return ret;
     }
-    client->addr.sin_family = AF_INET;
-    client->addr.sin_port = htons((uint16_t)packet->tcp_port);
-    client->addr.sin_addr = addr->sin_addr;
+    return connection_set_wants(client, connection_wants(client));
+}
 
-    if (connect(client->fd, (struct sockaddr*)&client->addr,
-                sizeof(client->addr)) < 0)
+static err_t connection_process(client_t client[static 1])
+{
+    err_t ret = proto_process(&client->rx, &client->rx_verify,
+                              connection_dispatch, client);
+    if (ret == DISFS_ERR_CORRUPT)
     {
-        LOG_ERROR("Cannot connect to server!\n");
-        return DISFS_ERR_SOCK;
+        metrics_add(client->reactor->metrics, METRIC_CHECKSUM_ERRORS, 1);
     }
-    LOG_DEBUG("Connected to client!\n");
+    if (ret != DISFS_SUCCESS)
+    {
+        LOG_WARNING("Protocol error from client %d, client will be "
+                    "disconnected\n",
+                    client->source.fd);
+    }
+    return ret;
+}
 
-    if (is_first_connection == 0)
+static err_t connection_dispatch(void* arg, const proto_frame_t frame[static 1])
+{
+    client_t* client = arg;
+    connection_t* connection = client->reactor->connection;
+    uint16_t type = frame->header.type;
+    if (frame->header.flags & PROTO_FLAG_COMPRESSED)
     {
-        is_first_connection = 1;
+        return connection_dispatch_packed(client, frame);
     }
-    client->active = 1;
-    memcpy(client->ip, ip, INET_ADDRSTRLEN);
-    return DISFS_SUCCESS;
+    metrics_inc(&client->frames_in, 1);
+    metrics_add(client->reactor->metrics, METRIC_FRAMES_IN, 1);
+    err_t ret = DISFS_SUCCESS;
+    if (type == PROTO_MSG_HELLO)
+    {
+        ret = connection_handle_hello(client, frame);
+    }
+    else if (frame->header.flags & PROTO_FLAG_REPLY)
+    {
+        ret = connection_complete(client, frame);
+    }
+    else if (type >= PROTO_MSG_MAX || connection->handlers[type].fn == NULL)
+    {
+        LOG_WARNING("No handler for frame type %u from client %d, dropped\n",
+                    type, client->source.fd);
+        return DISFS_SUCCESS;
+    }
+    else
+    {
+        connection_handler_t* handler = &connection->handlers[type];
+        ret = handler->fn(handler->ctx, client, frame);
+    }
+    /* reply pushed queue over high watermark, next frames wait for release */
+    if (ret == DISFS_SUCCESS && client->throttled)
+    {
+        return PROTO_STOP;
+    }
+    return ret;
 }
 
-static void* connection_udp_thread(void* arg)
+/* restore original payload of compressed frame and dispatch it instead */
+static err_t connection_dispatch_packed(client_t client[static 1],
+                                        const proto_frame_t frame[static 1])
 {
-    connection_t* conn = arg;
-    int32_t fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (fd <= 0)
+    uint32_t packed = frame->header.length;
+    uint32_t length = packed >= sizeof(uint32_t)
+                          ? proto_get_u32(frame->payload)
+                          : UINT32_MAX;
+    if (length > PROTO_MAX_PAYLOAD)
     {
-        LOG_ERROR("Cannot create socket for udp connection: errno=%d : %s\n",
-                  errno, strerror(errno));
-        return NULL;
+        LOG_ERROR("Compressed frame %lu from client %d is malformed\n",
+                  frame->header.request_id, client->source.fd);
+        return DISFS_ERR_PROTO;
+    }
+    buf_t* buf = buf_alloc(length);
+    if (buf == NULL)
+    {
+        LOG_ERROR("Cannot allocate %u bytes of decompressed frame\n", length);
+        return DISFS_ERR_ALLOC;
     }
+    if (decompress_lz(frame->payload + sizeof(uint32_t),
+                      packed - sizeof(uint32_t), buf->data,
+                      length) != DISFS_SUCCESS)
+    {
+        LOG_ERROR("Compressed frame %lu from client %d is malformed\n",
+                  frame->header.request_id, client->source.fd);
+        buf_unref(buf);
+        return DISFS_ERR_PROTO;
+    }
+    proto_frame_t plain = {.header = frame->header, .payload = buf->data};
+    plain.header.flags &= (uint8_t)~PROTO_FLAG_COMPRESSED;
+    plain.header.length = length;
+    err_t ret = connection_dispatch(client, &plain);
+    buf_unref(buf);
+    return ret;
+}
 
-    int32_t udp_opt = 1;
-    int32_t ret = setsockopt(fd, SOL_SOCKET, SO_BROADCAST | SO_REUSEADDR,
-                             &udp_opt, sizeof(udp_opt));
+/*
+ * First frame of connecting side, offers codecs it can decode and names port
+ * node listens on, so accepting side knows which node connected.
+ */
+static err_t connection_send_hello(client_t client[static 1])
+{
+    connection_t* connection = client->reactor->connection;
+    wire_hello_t hello = {.codecs = connection->codecs,
+                          .tcp_port = ntohs(connection->addr.sin_port)};
+    uint8_t payload[WIRE_FIXED_SIZE(hello)];
+    uint64_t length;
+    err_t ret = wire_hello_encode(&hello, payload, sizeof(payload), &length);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    struct iovec iov = {.iov_base = payload, .iov_len = length};
+    return connection_send_frame(client, PROTO_MSG_HELLO, 0, 0, &iov, 1);
+}
 
-    if (ret < 0)
+/*
+ * Accepting side picks best codec both sides know and replies with it, so
+ * both directions of link use the same codec, or none when either side has
+ * compression disabled.
+ */
+static err_t connection_handle_hello(client_t client[static 1],
+                                     const proto_frame_t frame[static 1])
+{
+    wire_hello_t hello;
+    uint64_t consumed;
+    if (wire_decode(&wire_hello_schema, &hello, frame->payload,
+                    frame->header.length, &consumed) != DISFS_SUCCESS)
     {
-        LOG_ERROR(
-            "Cannot set options to socket: socket = %d, errno = %d : %s!\n", fd,
-            errno, strerror(errno));
-        return NULL;
+        LOG_WARNING("Malformed hello from client %d\n", client->source.fd);
+        return DISFS_ERR_PROTO;
+    }
+    /* older nodes do not name their port, their peers stay as they are */
+    if (!(frame->header.flags & PROTO_FLAG_REPLY) && hello.tcp_port != 0)
+    {
+        err_t ret = connection_adopt_peer(client, (uint16_t)hello.tcp_port);
+        if (ret == DISFS_ERR_PEER_EXISTS)
+        {
+            /* link is dropped, so hello is left unanswered */
+            return DISFS_SUCCESS;
+        }
+        if (ret != DISFS_SUCCESS)
+        {
+            return ret;
+        }
+    }
+    uint32_t common =
+        (uint32_t)hello.codecs & client->reactor->connection->codecs;
+    client->codec = common ? 31 - (uint32_t)__builtin_clz(common)
+                           : COMPRESS_NONE;
+    compress_adapt_init(&client->compress);
+    LOG_DEBUG("Frames of client %s use codec %u\n", client->ip,
+              client->codec);
+    if (frame->header.flags & PROTO_FLAG_REPLY)
+    {
+        return DISFS_SUCCESS;
+    }
+    wire_hello_t reply = {
+        .codecs = common ? 1u << client->codec : 0,
+        .tcp_port = ntohs(client->reactor->connection->addr.sin_port)};
+    uint8_t payload[WIRE_FIXED_SIZE(hello)];
+    uint64_t length;
+    err_t ret = wire_hello_encode(&reply, payload, sizeof(payload), &length);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
     }
+    struct iovec iov = {.iov_base = payload, .iov_len = length};
+    return connection_reply(client, frame, PROTO_MSG_HELLO, &iov, 1);
+}
 
-    struct sockaddr_in addr = {};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = inet_addr("172.17.255.255");
-    addr.sin_port = htons(8081);
+/*
+ * Inbound peer is indexed by its source address until hello names port its
+ * node listens on. When both nodes connected to each other, link opened by
+ * node with lower id is kept, and both nodes decide the same. Node this one
+ * did not connect to may be dead to membership, so its peer is put in ring
+ * by first reactor, which owns membership.
+ */
+static err_t connection_adopt_peer(client_t client[static 1],
+                                   uint16_t tcp_port)
+{
+    connection_t* connection = client->reactor->connection;
+    struct sockaddr_in node = {.sin_family = AF_INET,
+                               .sin_port = htons(tcp_port),
+                               .sin_addr = client->addr.sin_addr};
+    /* remote node knows this one by address it connected to */
+    struct sockaddr_in local;
+    socklen_t len = sizeof(local);
+    if (getsockname(client->source.fd, (struct sockaddr*)&local, &len) < 0)
+    {
+        LOG_ERROR("Cannot get address of client %d: %s\n", client->source.fd,
+                  strerror(errno));
+        return DISFS_ERR_SOCK;
+    }
+    local.sin_port = connection->addr.sin_port;
 
-    while (conn->udp_th_run)
+    peer_table_lock(&connection->peers);
+    client_t* other = peer_table_find_locked(&connection->peers, &node);
+    if (other == client)
+    {
+        peer_table_unlock(&connection->peers);
+        return DISFS_SUCCESS;
+    }
+    /*
+       this node connects to live members only and dropped peer is no longer
+       member, open link of this node competes with inbound one
+     */
+    int32_t known = other != NULL && other->member;
+    err_t ret = DISFS_SUCCESS;
+    if (known && __atomic_load_n(&other->active, __ATOMIC_ACQUIRE) &&
+        connection_node_id(&local) < connection_node_id(&node))
+    {
+        client->evict = 1;
+        ret = DISFS_ERR_PEER_EXISTS;
+    }
+    else
     {
-        if (is_first_connection)
+        if (other != NULL)
         {
-            sleep(20);
+            connection_retire_peer(connection, other);
         }
-        else
-            sleep(1);
-        UDP_packet packet = {};
-        udp_discovery_packet_create(&packet, 8080, "Test", 4);
-        char udp_buffer[50] = {0};
-        udp_discovery_packet_serialize(&packet, udp_buffer, 50);
-        sendto(fd, udp_buffer, 50, 0, (struct sockaddr*)&addr, sizeof(addr));
+        ret = peer_table_rekey_locked(&connection->peers, client, &node);
     }
-    return NULL;
+    if (ret == DISFS_SUCCESS)
+    {
+        client->member = 1;
+        if (known)
+        {
+            connection_ring_add(connection, client);
+        }
+    }
+    peer_table_unlock(&connection->peers);
+    if (ret == DISFS_ERR_PEER_EXISTS)
+    {
+        LOG_DEBUG("Dropping duplicate link of node %s:%u\n", client->ip,
+                  tcp_port);
+    }
+    return ret;
 }
 
-void close_connection(connection_t conn[static 1])
+/*
+ * Peer lost address of its node to inbound one, caller holds peer table lock.
+ * Connecting peer is dropped once connect ends, established one by its owner
+ * and backing off one, which no reactor holds, is handed to first reactor.
+ */
+static void connection_retire_peer(connection_t connection[static 1],
+                                   client_t peer[static 1])
 {
-    conn->tcp_th_run = 0;
-    conn->udp_th_run = 0;
-    pthread_join(conn->tcp_th, NULL);
-    pthread_join(conn->udp_th, NULL);
+    peer_table_detach_locked(&connection->peers, peer);
+    if (peer->ringed)
+    {
+        hash_ring_remove(&connection->ring, connection_node_id(&peer->addr));
+        peer->ringed = 0;
+    }
+    peer->member = 0;
+    peer->evict = 1;
+    if (peer->state == PEER_STATE_BACKOFF)
+    {
+        peer->next = connection->retired;
+        connection->retired = peer;
+    }
+}
+
+/* caller holds peer table lock */
+static void connection_ring_add(connection_t connection[static 1],
+                                client_t client[static 1])
+{
+    if (!client->ringed &&
+        hash_ring_add(&connection->ring, connection_node_id(&client->addr),
+                      &client->addr) == DISFS_SUCCESS)
+    {
+        client->ringed = 1;
+    }
+}
+
+/*
+ * Events for dropped client may still be pending in current batch and
+ * io_uring may still hold operations on it, so client is only parked here and
+ * returned to peer table once backend releases it.
+ */
+static void connection_drop_client(client_t client[static 1])
+{
+    reactor_t* reactor = client->reactor;
+    peer_table_lock(&reactor->connection->peers);
+    if (client->ringed)
+    {
+        hash_ring_remove(&reactor->connection->ring,
+                         connection_node_id(&client->addr));
+        client->ringed = 0;
+    }
+    client->member = 0;
+    peer_table_unlock(&reactor->connection->peers);
+    __atomic_store_n(&client->active, 0, __ATOMIC_RELEASE);
+    connection_fail_requests(client);
+    io_backend_remove(&reactor->backend, &client->source);
+    close(client->source.fd);
+    ring_buffer_destroy(&client->rx);
+    connection_free_tx(client);
+    while (client->rx_backlog)
+    {
+        buf_t* buf = client->rx_backlog;
+        client->rx_backlog = buf->next;
+        buf_unref(buf);
+    }
+    client->next = reactor->graveyard;
+    reactor->graveyard = client;
+}
+
+static void connection_release_dropped(reactor_t reactor[static 1])
+{
+    client_t** link = &reactor->graveyard;
+    while (*link)
+    {
+        client_t* client = *link;
+        if (client->source.inflight > 0)
+        {
+            link = &client->next;
+            continue;
+        }
+        *link = client->next;
+        peer_table_remove(&reactor->connection->peers, client);
+    }
+}
+
+static void connection_free_tx(client_t client[static 1])
+{
+    while (client->tx_head)
+    {
+        tx_segment_t* segment = client->tx_head;
+        client->tx_head = segment->next;
+        buf_unref(buf_of(segment));
+    }
+    client->tx_tail = NULL;
+    __atomic_store_n(&client->tx_pending, 0, __ATOMIC_RELAXED);
+}
+
+/* throttled client waits for writable even with empty queue to be released */
+static uint8_t connection_wants(const client_t client[static 1])
+{
+    uint8_t wants = client->throttled ? 0 : IO_WANT_RECV;
+    if (client->tx_head || client->throttled)
+    {
+        wants |= IO_WANT_WRITE;
+    }
+    return wants;
+}
+
+static err_t connection_set_wants(client_t client[static 1], uint8_t wants)
+{
+    return io_backend_modify(&client->reactor->backend, &client->source,
+                             wants);
+}
+
+/*
+ * Write run of in-memory segments at head of tx queue with single call, or
+ * range of file segment at head. requested is set to bytes offered to kernel.
+ */
+static ssize_t connection_write_batch(client_t client[static 1],
+                                      size_t requested[static 1])
+{
+    tx_segment_t* segment = client->tx_head;
+    if (segment->file_fd >= 0)
+    {
+        *requested = segment->length - segment->offset;
+        off_t offset = (off_t)(segment->file_offset + segment->offset);
+        ssize_t written = sendfile(client->source.fd, segment->file_fd,
+                                   &offset, *requested);
+        if (written == 0)
+        {
+            /* file is shorter than queued range, frame can never complete */
+            errno = EIO;
+            return -1;
+        }
+        return written;
+    }
+    struct iovec iov[TX_IOV_BATCH];
+    uint32_t count = 0;
+    *requested = 0;
+    for (; segment && segment->file_fd < 0 && count < TX_IOV_BATCH;
+         segment = segment->next)
+    {
+        iov[count] = (struct iovec){
+            .iov_base = segment->data + segment->offset,
+            .iov_len = segment->length - segment->offset};
+        *requested += iov[count].iov_len;
+        count++;
+    }
+    /* header of file frame is held back until file data follows it */
+    int32_t flags = MSG_NOSIGNAL;
+    if (segment && segment->file_fd >= 0)
+    {
+        flags |= MSG_MORE;
+    }
+    /* writev of socket, which does not raise SIGPIPE */
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+    return sendmsg(client->source.fd, &msg, flags);
+}
+
+/* write as much of tx queue as socket accepts, want writable only if needed */
+static err_t connection_flush(client_t client[static 1])
+{
+    while (client->tx_head)
+    {
+        size_t requested = 0;
+        ssize_t written = connection_write_batch(client, &requested);
+        if (written < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_WARNING("Cannot write to client %d: errno=%d : %s\n",
+                        client->source.fd, errno, strerror(errno));
+            return DISFS_ERR_SOCK;
+        }
+        __atomic_store_n(&client->tx_pending,
+                         client->tx_pending - (uint64_t)written,
+                         __ATOMIC_RELAXED);
+        metrics_inc(&client->bytes_out, (uint64_t)written);
+        metrics_add(client->reactor->metrics, METRIC_BYTES_OUT,
+                    (uint64_t)written);
+        metrics_add(client->reactor->metrics, METRIC_TX_WRITES, 1);
+        /* release segments written whole, keep offset of partial one */
+        uint64_t left = (uint64_t)written;
+        while (left > 0)
+        {
+            tx_segment_t* segment = client->tx_head;
+            uint64_t remaining = segment->length - segment->offset;
+            if (left < remaining)
+            {
+                segment->offset += (uint32_t)left;
+                break;
+            }
+            left -= remaining;
+            client->tx_head = segment->next;
+            if (client->tx_head == NULL)
+            {
+                client->tx_tail = NULL;
+            }
+            buf_unref(buf_of(segment));
+        }
+        if ((size_t)written < requested)
+        {
+            /* socket buffer is full */
+            break;
+        }
+    }
+    return connection_set_wants(client, connection_wants(client));
+}
+
+/*
+ * In-memory segment with frame header, iov and checksum trailer. Payload may
+ * be extended by extra bytes with CRC32C extra_crc, then trailer is computed
+ * without reading them and waits in buffer past end of segment. Payload
+ * without extra bytes is compressed when link agreed on codec and it pays
+ * off.
+ */
+static err_t connection_frame_segment(client_t client[static 1],
+                                      uint16_t type, uint8_t flags,
+                                      uint64_t request_id,
+                                      const struct iovec* iov,
+                                      uint32_t iov_count, uint64_t extra_length,
+                                      uint32_t extra_crc,
+                                      tx_segment_t* out[static 1])
+{
+    uint64_t length = 0;
+    for (uint32_t i = 0; i < iov_count; i++)
+    {
+        length += iov[i].iov_len;
+    }
+    if (length + extra_length > PROTO_MAX_PAYLOAD)
+    {
+        LOG_ERROR("Frame payload of %lu bytes is too big\n",
+                  length + extra_length);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    uint64_t head_length = PROTO_HEADER_SIZE + length;
+    buf_t* buf =
+        buf_alloc(sizeof(tx_segment_t) + head_length + PROTO_TRAILER_SIZE);
+    if (buf == NULL)
+    {
+        LOG_ERROR("Cannot allocate tx segment of %lu bytes\n", length);
+        return DISFS_ERR_ALLOC;
+    }
+    uint32_t kind = client->reactor->connection->frame_checksum;
+    if (extra_length == 0 && kind == CHECKSUM_XXH32)
+    {
+        flags |= PROTO_FLAG_XXH32;
+    }
+    tx_segment_t* segment = (tx_segment_t*)(void*)buf->data;
+    uint8_t* payload = segment->data + PROTO_HEADER_SIZE;
+    uint64_t packed = 0;
+    if (extra_length == 0 && client->codec != COMPRESS_NONE &&
+        length >= COMPRESS_MIN_LENGTH)
+    {
+        packed = connection_compress(client, iov, iov_count, length, payload);
+    }
+    if (packed)
+    {
+        flags |= PROTO_FLAG_COMPRESSED;
+        length = packed;
+        head_length = PROTO_HEADER_SIZE + length;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < iov_count; i++)
+        {
+            memcpy(payload, iov[i].iov_base, iov[i].iov_len);
+            payload += iov[i].iov_len;
+        }
+    }
+    *segment = (tx_segment_t){
+        .length = (uint32_t)(head_length +
+                             (extra_length ? 0 : PROTO_TRAILER_SIZE)),
+        .file_fd = -1};
+    proto_header_t header = {.version = PROTO_VERSION,
+                             .flags = flags,
+                             .type = type,
+                             .length = (uint32_t)(length + extra_length),
+                             .request_id = request_id};
+    proto_header_encode(&header, segment->data);
+    checksum_t sum;
+    checksum_init(&sum, proto_checksum_kind(flags));
+    checksum_update(&sum, segment->data, head_length);
+    uint32_t trailer = checksum_final(&sum);
+    if (extra_length)
+    {
+        trailer = crc32c_combine(trailer, extra_crc, extra_length);
+    }
+    proto_put_u32(segment->data + head_length, trailer);
+    *out = segment;
+    return DISFS_SUCCESS;
+}
+
+/*
+ * Compress payload gathered from iov into payload of segment, 0 when frame
+ * should go uncompressed. Outcome of every attempt feeds adaptive switch of
+ * client, which stops compressing once data or cpu cost makes it pointless.
+ */
+static uint64_t connection_compress(client_t client[static 1],
+                                    const struct iovec* iov,
+                                    uint32_t iov_count, uint64_t length,
+                                    uint8_t* payload)
+{
+    compress_adapt_t* adapt = &client->compress;
+    if (!compress_adapt_wants(adapt))
+    {
+        compress_adapt_skip(adapt);
+        return 0;
+    }
+    const uint8_t* src = iov[0].iov_base;
+    buf_t* gathered = NULL;
+    if (iov_count > 1)
+    {
+        gathered = buf_alloc(length);
+        if (gathered == NULL)
+        {
+            return 0;
+        }
+        uint8_t* out = gathered->data;
+        for (uint32_t i = 0; i < iov_count; i++)
+        {
+            memcpy(out, iov[i].iov_base, iov[i].iov_len);
+            out += iov[i].iov_len;
+        }
+        src = gathered->data;
+    }
+    /* block together with length prefix has to save 1/16 of payload */
+    uint64_t start = metrics_now_ns();
+    uint64_t block = compress_lz(
+        src, length, payload + sizeof(uint32_t),
+        length - (length >> COMPRESS_MIN_SAVING_SHIFT) - sizeof(uint32_t));
+    compress_adapt_record(adapt, length, block, metrics_now_ns() - start);
+    buf_unref(gathered);
+    if (block == 0)
+    {
+        return 0;
+    }
+    proto_put_u32(payload, (uint32_t)length);
+    metrics_add(client->reactor->metrics, METRIC_COMPRESS_RAW_BYTES, length);
+    metrics_add(client->reactor->metrics, METRIC_COMPRESS_WIRE_BYTES,
+                block + sizeof(uint32_t));
+    return block + sizeof(uint32_t);
+}
+
+/* append linked segments first..last to tx queue and start writing them */
+static err_t connection_queue(client_t client[static 1],
+                              tx_segment_t* first, tx_segment_t* last)
+{
+    if (client->tx_tail)
+    {
+        client->tx_tail->next = first;
+    }
+    else
+    {
+        client->tx_head = first;
+    }
+    client->tx_tail = last;
+    for (tx_segment_t* segment = first; segment; segment = segment->next)
+    {
+        metrics_inc(&client->tx_pending, segment->length);
+    }
+    metrics_inc(&client->frames_out, 1);
+    metrics_add(client->reactor->metrics, METRIC_FRAMES_OUT, 1);
+    if (!client->throttled &&
+        client->tx_pending >= client->reactor->connection->tx_high_watermark)
+    {
+        LOG_DEBUG("Client %s throttled with %lu bytes queued\n", client->ip,
+                  client->tx_pending);
+        client->throttled = 1;
+        metrics_add(client->reactor->metrics, METRIC_TX_THROTTLED, 1);
+    }
+
+    /* queue of connecting peer is flushed when connect completes */
+    if (client->state != PEER_STATE_ESTABLISHED)
+    {
+        return DISFS_SUCCESS;
+    }
+    return connection_flush(client);
+}
+
+static err_t connection_send_frame(client_t client[static 1], uint16_t type,
+                                   uint8_t flags, uint64_t request_id,
+                                   const struct iovec* iov, uint32_t iov_count)
+{
+    tx_segment_t* segment = NULL;
+    err_t ret = connection_frame_segment(client, type, flags, request_id, iov,
+                                         iov_count, 0, 0, &segment);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    return connection_queue(client, segment, segment);
+}
+
+static err_t connection_send_file_frame(client_t client[static 1],
+                                        uint16_t type, uint8_t flags,
+                                        uint64_t request_id,
+                                        const struct iovec* iov,
+                                        uint32_t iov_count, int32_t file_fd,
+                                        uint64_t file_offset,
+                                        uint32_t file_length, uint32_t file_crc)
+{
+    if (file_fd < 0)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    /* file range is never compressed, frame counts as skipped one */
+    if (client->codec != COMPRESS_NONE)
+    {
+        compress_adapt_skip(&client->compress);
+    }
+    tx_segment_t* header = NULL;
+    err_t ret =
+        connection_frame_segment(client, type, flags, request_id, iov,
+                                 iov_count, file_length, file_crc, &header);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    if (file_length == 0)
+    {
+        return connection_queue(client, header, header);
+    }
+    buf_t* buf = buf_alloc(sizeof(tx_segment_t));
+    buf_t* trailer_buf = buf_alloc(sizeof(tx_segment_t) + PROTO_TRAILER_SIZE);
+    if (buf == NULL || trailer_buf == NULL)
+    {
+        buf_unref(buf);
+        buf_unref(trailer_buf);
+        buf_unref(buf_of(header));
+        return DISFS_ERR_ALLOC;
+    }
+    tx_segment_t* range = (tx_segment_t*)(void*)buf->data;
+    *range = (tx_segment_t){.length = file_length,
+                            .file_fd = file_fd,
+                            .file_offset = file_offset};
+    tx_segment_t* trailer = (tx_segment_t*)(void*)trailer_buf->data;
+    *trailer = (tx_segment_t){.length = PROTO_TRAILER_SIZE, .file_fd = -1};
+    memcpy(trailer->data, header->data + header->length, PROTO_TRAILER_SIZE);
+    header->next = range;
+    range->next = trailer;
+    return connection_queue(client, header, trailer);
+}
+
+err_t connection_send(client_t client[static 1], uint16_t type,
+                      uint64_t request_id, const struct iovec* iov,
+                      uint32_t iov_count)
+{
+    return connection_send_frame(client, type, 0, request_id, iov,
+                                 iov_count);
+}
+
+err_t connection_send_file(client_t client[static 1], uint16_t type,
+                           uint64_t request_id, const struct iovec* iov,
+                           uint32_t iov_count, int32_t file_fd,
+                           uint64_t file_offset, uint32_t file_length,
+                           uint32_t file_crc)
+{
+    return connection_send_file_frame(client, type, 0, request_id, iov,
+                                      iov_count, file_fd, file_offset,
+                                      file_length, file_crc);
+}
+
+err_t connection_reply(client_t client[static 1],
+                       const proto_frame_t request[static 1], uint16_t type,
+                       const struct iovec* iov, uint32_t iov_count)
+{
+    return connection_send_frame(client, type, PROTO_FLAG_REPLY,
+                                 request->header.request_id, iov, iov_count);
+}
+
+err_t connection_reply_file(client_t client[static 1],
+                            const proto_frame_t request[static 1],
+                            uint16_t type, const struct iovec* iov,
+                            uint32_t iov_count, int32_t file_fd,
+                            uint64_t file_offset, uint32_t file_length,
+                            uint32_t file_crc)
+{
+    return connection_send_file_frame(
+        client, type, PROTO_FLAG_REPLY, request->header.request_id, iov,
+        iov_count, file_fd, file_offset, file_length, file_crc);
+}
+
+err_t connection_request(client_t client[static 1], uint16_t type,
+                         const struct iovec* iov, uint32_t iov_count,
+                         uint32_t timeout_ms, inflight_fn fn, void* ctx)
+{
+    if (!client->active || client->state != PEER_STATE_ESTABLISHED)
+    {
+        return DISFS_ERR_PEER_CLOSED;
+    }
+    uint64_t deadline =
+        connection_now_ms() + (timeout_ms ? timeout_ms : REQUEST_TIMEOUT_MS);
+    uint64_t id = 0;
+    err_t ret = inflight_add(&client->inflight, deadline, fn, ctx, &id);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    ret = connection_send_frame(client, type, 0, id, iov, iov_count);
+    if (ret != DISFS_SUCCESS)
+    {
+        /* caller learns about failure from return value only */
+        inflight_entry_t entry;
+        inflight_take(&client->inflight, id, &entry);
+        return ret;
+    }
+    connection_track(client);
+    return DISFS_SUCCESS;
+}
+
+/* reply completes its request, late reply to expired request is dropped */
+static err_t connection_complete(client_t client[static 1],
+                                 const proto_frame_t frame[static 1])
+{
+    inflight_entry_t entry;
+    if (inflight_take(&client->inflight, frame->header.request_id, &entry) !=
+        DISFS_SUCCESS)
+    {
+        LOG_DEBUG("Reply %lu from client %d matches no request, dropped\n",
+                  frame->header.request_id, client->source.fd);
+        return DISFS_SUCCESS;
+    }
+    err_t status = DISFS_SUCCESS;
+    wire_error_t error;
+    if (frame->header.type == PROTO_MSG_ERROR &&
+        wire_error_decode(&error, frame->payload, frame->header.length) ==
+            DISFS_SUCCESS)
+    {
+        status = (err_t)error.code;
+    }
+    entry.fn(entry.ctx, client, status, frame);
+    return DISFS_SUCCESS;
+}
+
+/* peer with requests in flight has its deadlines watched by its reactor */
+static void connection_track(client_t client[static 1])
+{
+    if (client->requesting || client->inflight.count == 0)
+    {
+        return;
+    }
+    reactor_t* reactor = client->reactor;
+    client->requesting = 1;
+    client->requesting_next = reactor->requesting;
+    reactor->requesting = client;
+}
+
+/*
+ * Called for inactive client, so completions cannot add new requests to it.
+ * Completions may call connection_call, so peer table must not be locked.
+ */
+static void connection_fail_requests(client_t client[static 1])
+{
+    if (client->requesting)
+    {
+        client_t** link = &client->reactor->requesting;
+        while (*link != client)
+        {
+            link = &(*link)->requesting_next;
+        }
+        *link = client->requesting_next;
+        client->requesting = 0;
+    }
+    inflight_entry_t entry;
+    while (inflight_expire(&client->inflight, UINT64_MAX, &entry))
+    {
+        entry.fn(entry.ctx, client, DISFS_ERR_PEER_CLOSED, NULL);
+    }
+    inflight_destroy(&client->inflight);
+}
+
+err_t connection_call(connection_t conn[static 1],
+                      const struct sockaddr_in addr[static 1], uint16_t type,
+                      const void* payload, uint32_t length,
+                      uint32_t timeout_ms, inflight_fn fn, void* ctx)
+{
+    if (length > PROTO_MAX_PAYLOAD)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    /* reactors may be gone, their calls lock and wakeup with them */
+    if (conn->closing)
+    {
+        return DISFS_ERR_PEER_CLOSED;
+    }
+    peer_table_lock(&conn->peers);
+    client_t* client = peer_table_find_locked(&conn->peers, addr);
+    reactor_t* reactor =
+        client ? __atomic_load_n(&client->reactor, __ATOMIC_ACQUIRE) : NULL;
+    peer_table_unlock(&conn->peers);
+    if (reactor == NULL)
+    {
+        return DISFS_ERR_PEER_CLOSED;
+    }
+    buf_t* buf = buf_alloc(sizeof(connection_call_t) + length);
+    if (buf == NULL)
+    {
+        LOG_ERROR("Cannot allocate request of %u bytes\n", length);
+        return DISFS_ERR_ALLOC;
+    }
+    connection_call_t* call = (connection_call_t*)(void*)buf->data;
+    *call = (connection_call_t){
+        .addr = *addr,
+        .fn = fn,
+        .ctx = ctx,
+        .timeout_ms = timeout_ms,
+        .length = length,
+        .type = type,
+    };
+    memcpy(call->payload, payload, length);
+    connection_post_call(reactor, buf);
+    return DISFS_SUCCESS;
+}
+
+static void connection_post_call(reactor_t reactor[static 1],
+                                 buf_t buf[static 1])
+{
+    pthread_mutex_lock(&reactor->calls_lock);
+    int32_t idle = reactor->calls == NULL;
+    buf->next = reactor->calls;
+    reactor->calls = buf;
+    pthread_mutex_unlock(&reactor->calls_lock);
+    /* reactor drains whole list on wakeup, so only first post signals */
+    if (idle && eventfd_write(reactor->wakeup.fd, 1) < 0)
+    {
+        LOG_ERROR("Cannot wake reactor %u errno: %d : %s\n", reactor->id,
+                  errno, strerror(errno));
+    }
+}
+
+static void connection_run_calls(reactor_t reactor[static 1])
+{
+    eventfd_t value;
+    eventfd_read(reactor->wakeup.fd, &value);
+    pthread_mutex_lock(&reactor->calls_lock);
+    buf_t* list = reactor->calls;
+    reactor->calls = NULL;
+    pthread_mutex_unlock(&reactor->calls_lock);
+    /* list is newest first, requests are started in order of posting */
+    buf_t* ordered = NULL;
+    while (list)
+    {
+        buf_t* next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+    while (ordered)
+    {
+        buf_t* next = ordered->next;
+        connection_start_call(reactor, ordered);
+        ordered = next;
+    }
+}
+
+/*
+ * Peer may have been handed over to other reactor since call was posted, then
+ * call follows it. Peer is only released by its owner, so peer found here
+ * under table lock and owned by this reactor stays valid.
+ */
+static void connection_start_call(reactor_t reactor[static 1],
+                                  buf_t buf[static 1])
+{
+    connection_t* conn = reactor->connection;
+    connection_call_t* call = (connection_call_t*)(void*)buf->data;
+    struct sockaddr_in addr = call->addr;
+    peer_table_lock(&conn->peers);
+    client_t* client = peer_table_find_locked(&conn->peers, &addr);
+    reactor_t* owner =
+        client ? __atomic_load_n(&client->reactor, __ATOMIC_ACQUIRE) : NULL;
+    peer_table_unlock(&conn->peers);
+    if (owner != NULL && owner != reactor)
+    {
+        connection_post_call(owner, buf);
+        return;
+    }
+    if (call->cancel)
+    {
+        connection_cancel_call(owner ? client : NULL, call->fn, call->ctx);
+        buf_unref(buf);
+        return;
+    }
+    err_t ret = DISFS_ERR_PEER_CLOSED;
+    if (owner != NULL)
+    {
+        struct iovec iov = {.iov_base = call->payload,
+                            .iov_len = call->length};
+        ret = connection_request(client, call->type, &iov, 1, call->timeout_ms,
+                                 call->fn, call->ctx);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        call->fn(call->ctx, owner ? client : NULL, ret, NULL);
+    }
+    buf_unref(buf);
+}
+
+/* reactor is stopped, posted requests complete as if peer was dropped */
+static void connection_fail_calls(reactor_t reactor[static 1])
+{
+    buf_t* list = reactor->calls;
+    reactor->calls = NULL;
+    while (list)
+    {
+        buf_t* next = list->next;
+        connection_call_t* call = (connection_call_t*)(void*)list->data;
+        if (!call->cancel)
+        {
+            call->fn(call->ctx, NULL, DISFS_ERR_PEER_CLOSED, NULL);
+        }
+        buf_unref(list);
+        list = next;
+    }
+}
+
+err_t connection_cancel(connection_t conn[static 1],
+                        const struct sockaddr_in addr[static 1],
+                        inflight_fn fn, void* ctx)
+{
+    /* requests of closing connection are failed by close_connection */
+    if (conn->closing)
+    {
+        return DISFS_SUCCESS;
+    }
+    peer_table_lock(&conn->peers);
+    client_t* client = peer_table_find_locked(&conn->peers, addr);
+    reactor_t* reactor =
+        client ? __atomic_load_n(&client->reactor, __ATOMIC_ACQUIRE) : NULL;
+    peer_table_unlock(&conn->peers);
+    if (reactor == NULL)
+    {
+        /* dropped peer has already completed all its requests */
+        return DISFS_SUCCESS;
+    }
+    buf_t* buf = buf_alloc(sizeof(connection_call_t));
+    if (buf == NULL)
+    {
+        LOG_ERROR("Cannot allocate cancel of request\n");
+        return DISFS_ERR_ALLOC;
+    }
+    connection_call_t* call = (connection_call_t*)(void*)buf->data;
+    *call = (connection_call_t){
+        .addr = *addr,
+        .fn = fn,
+        .ctx = ctx,
+        .cancel = 1,
+    };
+    connection_post_call(reactor, buf);
+    return DISFS_SUCCESS;
+}
+
+/*
+ * Reply which arrives later matches no request and is dropped. Peer is not
+ * told, it has usually sent reply already and stopping it would cost more.
+ */
+static void connection_cancel_call(client_t* client, inflight_fn fn,
+                                   void* ctx)
+{
+    inflight_entry_t entry;
+    if (client == NULL ||
+        inflight_take_ctx(&client->inflight, fn, ctx, &entry) != DISFS_SUCCESS)
+    {
+        return;
+    }
+    entry.fn(entry.ctx, client, DISFS_ERR_CANCELLED, NULL);
+}
+
+err_t connection_register_handler(connection_t conn[static 1], uint16_t type,
+                                  connection_handler_fn fn, void* ctx)
+{
+    if (type == PROTO_MSG_INVALID || type >= PROTO_MSG_MAX)
+    {
+        LOG_ERROR("Cannot register handler for invalid frame type %u\n", type);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    conn->handlers[type].fn = fn;
+    conn->handlers[type].ctx = ctx;
+    return DISFS_SUCCESS;
+}
+
+/*
+ * Socket carries membership protocol and bootstrap announcements, node which
+ * announces itself is handed to membership and connected once it is member.
+ * Socket is drained in batches and replies leave together after each batch.
+ */
+static void connection_handle_udp(connection_t connection[static 1])
+{
+    udp_batch_t* batch = connection->udp_rx;
+    UDP_packet packets[UDP_BATCH_SIZE];
+    uint32_t count;
+    do
+    {
+        count = udp_batch_recv(batch, connection->udp.fd);
+        uint64_t now = connection_now_ms();
+        udp_discovery_packet_deserialize_batch(batch, packets);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t length = batch->msgs[i].msg_len;
+            if (membership_is_packet(batch->data[i], length))
+            {
+                membership_receive(&connection->membership, batch->data[i],
+                                   length, &batch->addrs[i], now);
+            }
+            else if (packets[i].magic_number ==
+                     UDP_DISCOVERY_PACKET_MAGIC_NUMBER)
+            {
+                membership_join(&connection->membership, &batch->addrs[i],
+                                (uint16_t)packets[i].tcp_port, now);
+            }
+            else
+            {
+                LOG_ERROR("Udp packet with incorrect information!\n");
+            }
+        }
+        membership_flush(&connection->membership);
+    } while (count == UDP_BATCH_SIZE);
+}
+
+static err_t connection_handle_events(reactor_t reactor[static 1],
+                                      const io_event_t* events,
+                                      int32_t events_count)
+{
+    for (int32_t i = 0; i < events_count; i++)
+    {
+        const io_event_t* event = &events[i];
+        event_source_t* source = event->source;
+        switch ((event_kind)source->kind)
+        {
+        case EVENT_KIND_LISTENER:
+            if (event->type == IO_EVENT_ACCEPTED)
+            {
+                struct sockaddr_in addr = {};
+                socklen_t len = sizeof(addr);
+                getpeername(event->result, (struct sockaddr*)&addr, &len);
+                connection_add_accepted(reactor, event->result, &addr);
+            }
+            else
+            {
+                connection_accept_client(reactor);
+            }
+            break;
+        case EVENT_KIND_UDP:
+            connection_handle_udp(reactor->connection);
+            break;
+        case EVENT_KIND_WAKEUP:
+            connection_run_calls(reactor);
+            break;
+        case EVENT_KIND_PEER:
+        {
+            client_t* client = (client_t*)source;
+            if (!client->active)
+            {
+                break;
+            }
+            if (client->state == PEER_STATE_CONNECTING)
+            {
+                connection_finish_connect(reactor, client);
+                break;
+            }
+            err_t ret = DISFS_SUCCESS;
+            switch ((io_event_type)event->type)
+            {
+            case IO_EVENT_RECEIVED:
+                ret = connection_receive(client, event->data,
+                                         (uint32_t)event->result);
+                break;
+            case IO_EVENT_CLOSED:
+                LOG_WARNING("Client %d closed connection: %s\n",
+                            client->source.fd,
+                            event->result ? strerror(-event->result) : "eof");
+                ret = DISFS_ERR_READED;
+                break;
+            case IO_EVENT_READY:
+                if (event->result & IO_WANT_READ)
+                {
+                    ret = connection_read(client);
+                }
+                if (ret == DISFS_SUCCESS && event->result & IO_WANT_WRITE)
+                {
+                    ret = connection_flush(client);
+                    if (ret == DISFS_SUCCESS)
+                    {
+                        ret = connection_resume(client);
+                    }
+                }
+                break;
+            case IO_EVENT_ACCEPTED:
+                break;
+            }
+            if (ret != DISFS_SUCCESS)
+            {
+                connection_drop_client(client);
+            }
+            break;
+        }
+        }
+    }
+    return DISFS_SUCCESS;
+}
+
+static err_t
+connection_to_new_server(connection_t connection[static 1],
+                         const struct sockaddr_in peer_addr[static 1])
+{
+    /* check if connection to this server is already satisfied */
+    client_t* client = NULL;
+    peer_table_lock(&connection->peers);
+    client = peer_table_find_locked(&connection->peers, peer_addr);
+    if (client == NULL)
+    {
+        err_t ret =
+            peer_table_add_locked(&connection->peers, peer_addr, &client);
+        if (ret != DISFS_SUCCESS)
+        {
+            peer_table_unlock(&connection->peers);
+            return ret;
+        }
+        client->member = 1;
+    }
+    else
+    {
+        /* member lives again, so its peer is kept */
+        client->evict = 0;
+        if (__atomic_load_n(&client->active, __ATOMIC_ACQUIRE) &&
+            client->state == PEER_STATE_ESTABLISHED)
+        {
+            connection_ring_add(connection, client);
+        }
+        if (client->state != PEER_STATE_BACKOFF ||
+            connection_now_ms() < client->retry_at_ms ||
+            client->source.inflight > 0)
+        {
+            peer_table_unlock(&connection->peers);
+            LOG_DEBUG("Connected before or backing off this IP: %s\n",
+                      client->ip);
+            return DISFS_SUCCESS;
+        }
+    }
+    client->state = PEER_STATE_CONNECTING;
+    peer_table_unlock(&connection->peers);
+
+    return connection_start_connect(&connection->reactors[0], client);
+}
+
+uint64_t connection_node_id(const struct sockaddr_in addr[static 1])
+{
+    uint64_t key = ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+    /* zero is reserved by hash ring */
+    return hash_ring_mix(key) | 1;
+}
+
+static uint64_t connection_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/*
+ * Outbound connect never blocks reactor, socket is non-blocking and
+ * completion is reported as writable. Peer stays on connecting list of
+ * discovery reactor until it completes, fails or its deadline passes.
+ */
+static err_t connection_start_connect(reactor_t reactor[static 1],
+                                      client_t client[static 1])
+{
+    inet_ntop(AF_INET, &client->addr.sin_addr, client->ip, INET_ADDRSTRLEN);
+    client->reactor = reactor;
+    client->source.kind = EVENT_KIND_PEER;
+    client->source.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (client->source.fd < 0)
+    {
+        LOG_ERROR("Cannot create socket for connection\n");
+        connection_connect_failed(reactor, client);
+        return DISFS_ERR_SOCK;
+    }
+    __atomic_store_n(&client->active, 1, __ATOMIC_RELEASE);
+    client->deadline_ms =
+        connection_now_ms() + reactor->connection->connect_timeout_ms;
+
+    int32_t ret = connect(client->source.fd, (struct sockaddr*)&client->addr,
+                          sizeof(client->addr));
+    if (ret < 0 && errno != EINPROGRESS)
+    {
+        LOG_ERROR("Cannot connect to server %s: errno=%d : %s!\n", client->ip,
+                  errno, strerror(errno));
+        connection_connect_failed(reactor, client);
+        return DISFS_ERR_SOCK;
+    }
+    if (io_backend_add(&reactor->backend, &client->source, IO_WANT_WRITE) !=
+        DISFS_SUCCESS)
+    {
+        connection_connect_failed(reactor, client);
+        return DISFS_ERR_EPOLL;
+    }
+    /* completion is handled from backend even when connect finished at once */
+    client->next = reactor->connecting;
+    reactor->connecting = client;
+    return DISFS_SUCCESS;
+}
+
+static void connection_finish_connect(reactor_t reactor[static 1],
+                                      client_t client[static 1])
+{
+    connection_t* connection = reactor->connection;
+    connection_unlink_connecting(reactor, client);
+
+    int32_t error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(client->source.fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+    {
+        error = errno;
+    }
+    if (error != 0)
+    {
+        LOG_WARNING("Cannot connect to server %s: %s\n", client->ip,
+                    strerror(error));
+        connection_connect_failed(reactor, client);
+        return;
+    }
+    client->rx_verify = (proto_verify_t){};
+    if (ring_buffer_create(&client->rx, PROTO_MAX_FRAME_SIZE) != DISFS_SUCCESS)
+    {
+        connection_connect_failed(reactor, client);
+        return;
+    }
+    LOG_DEBUG("Connected to client %s!\n", client->ip);
+    /* nothing is compressed until peer answers hello */
+    client->codec = COMPRESS_NONE;
+    if (connection_send_hello(client) != DISFS_SUCCESS)
+    {
+        connection_connect_failed(reactor, client);
+        return;
+    }
+    /* inbound link of the same node may have taken its place meanwhile */
+    peer_table_lock(&connection->peers);
+    int32_t member = client->member;
+    if (member)
+    {
+        client->state = PEER_STATE_ESTABLISHED;
+        connection_ring_add(connection, client);
+    }
+    peer_table_unlock(&connection->peers);
+    if (!member)
+    {
+        connection_drop_client(client);
+        return;
+    }
+    client->connect_failures = 0;
+    connection->rejoining = 0;
+    if (connection->peer_cache)
+    {
+        peer_cache_result(connection->peer_cache, &client->addr, 1,
+                          (uint64_t)time(NULL));
+    }
+
+    /* hand peer over to its reactor, outbound peers are spread round robin */
+    reactor_t* owner = &connection->reactors[connection->next_reactor++ %
+                                             connection->reactor_count];
+    /* connection_call of other threads routes requests by owner */
+    __atomic_store_n(&client->reactor, owner, __ATOMIC_RELEASE);
+    /* frames queued while connecting are flushed once writable */
+    if (io_backend_handoff(&reactor->backend, &owner->backend, &client->source,
+                           connection_wants(client)) != DISFS_SUCCESS)
+    {
+        client->reactor = reactor;
+        connection_drop_client(client);
+    }
+}
+
+static void connection_connect_failed(reactor_t reactor[static 1],
+                                      client_t client[static 1])
+{
+    connection_t* connection = reactor->connection;
+    if (client->active)
+    {
+        io_backend_remove(&reactor->backend, &client->source);
+        close(client->source.fd);
+        __atomic_store_n(&client->active, 0, __ATOMIC_RELEASE);
+    }
+    ring_buffer_destroy(&client->rx);
+    connection_free_tx(client);
+    metrics_add(reactor->metrics, METRIC_CONNECT_FAILURES, 1);
+    client->connect_failures++;
+    if (connection->peer_cache)
+    {
+        peer_cache_result(connection->peer_cache, &client->addr, 0,
+                          (uint64_t)time(NULL));
+    }
+    if (client->connect_failures >= CONNECT_MAX_FAILURES)
+    {
+        LOG_WARNING("Giving up on server %s after %u attempts\n", client->ip,
+                    client->connect_failures);
+    }
+
+    /* exponential backoff with jitter, retried when server is rediscovered */
+    uint64_t delay = CONNECT_BACKOFF_BASE_MS;
+    for (uint32_t i = 1;
+         i < client->connect_failures && delay < CONNECT_BACKOFF_MAX_MS; i++)
+    {
+        delay *= 2;
+    }
+    if (delay > CONNECT_BACKOFF_MAX_MS)
+    {
+        delay = CONNECT_BACKOFF_MAX_MS;
+    }
+    reactor->rng ^= reactor->rng << 13;
+    reactor->rng ^= reactor->rng >> 7;
+    reactor->rng ^= reactor->rng << 17;
+    delay = delay / 2 + reactor->rng % (delay / 2 + 1);
+
+    /* peer retired by inbound link of its node is not retried */
+    peer_table_lock(&connection->peers);
+    int32_t retry =
+        client->member && client->connect_failures < CONNECT_MAX_FAILURES;
+    if (retry)
+    {
+        client->retry_at_ms = connection_now_ms() + delay;
+        client->state = PEER_STATE_BACKOFF;
+    }
+    peer_table_unlock(&connection->peers);
+    if (!retry)
+    {
+        client->next = reactor->graveyard;
+        reactor->graveyard = client;
+        return;
+    }
+    LOG_DEBUG("Server %s backoff %lu ms after %u failures\n", client->ip,
+              delay, client->connect_failures);
+}
+
+static void connection_unlink_connecting(reactor_t reactor[static 1],
+                                         client_t client[static 1])
+{
+    client_t** link = &reactor->connecting;
+    while (*link != NULL && *link != client)
+    {
+        link = &(*link)->next;
+    }
+    if (*link == client)
+    {
+        *link = client->next;
+    }
+    client->next = NULL;
+}
+
+static void connection_check_deadlines(reactor_t reactor[static 1])
+{
+    uint64_t now = connection_now_ms();
+    connection_expire_requests(reactor, now);
+    client_t** link = &reactor->connecting;
+    while (*link != NULL)
+    {
+        client_t* client = *link;
+        if (client->deadline_ms > now)
+        {
+            link = &client->next;
+            continue;
+        }
+        *link = client->next;
+        client->next = NULL;
+        LOG_WARNING("Connect to server %s timed out\n", client->ip);
+        connection_connect_failed(reactor, client);
+    }
+}
+
+/*
+ * Completions may send new requests to any peer, so list is detached first and
+ * peers which still wait for replies are put back after their turn.
+ */
+static void connection_expire_requests(reactor_t reactor[static 1],
+                                       uint64_t now)
+{
+    client_t* client = reactor->requesting;
+    reactor->requesting = NULL;
+    while (client)
+    {
+        client_t* next = client->requesting_next;
+        inflight_entry_t entry;
+        while (inflight_expire(&client->inflight, now, &entry))
+        {
+            LOG_DEBUG("Request %lu to client %s timed out\n", entry.id,
+                      client->ip);
+            entry.fn(entry.ctx, client, DISFS_ERR_TIMEOUT, NULL);
+        }
+        client->requesting = 0;
+        connection_track(client);
+        client = next;
+    }
+}
+
+static int32_t connection_next_timeout(reactor_t reactor[static 1])
+{
+    uint64_t now = connection_now_ms();
+    uint64_t timeout = REACTOR_WAIT_MS;
+    for (client_t* client = reactor->connecting; client; client = client->next)
+    {
+        uint64_t left =
+            client->deadline_ms > now ? client->deadline_ms - now : 0;
+        if (left < timeout)
+        {
+            timeout = left;
+        }
+    }
+    for (client_t* client = reactor->requesting; client;
+         client = client->requesting_next)
+    {
+        uint64_t deadline = inflight_next_deadline(&client->inflight);
+        uint64_t left = deadline > now ? deadline - now : 0;
+        timeout = left < timeout ? left : timeout;
+    }
+    if (reactor->id == 0)
+    {
+        uint64_t left =
+            reactor->membership_ms > now ? reactor->membership_ms - now : 0;
+        timeout = left < timeout ? left : timeout;
+    }
+    return (int32_t)timeout;
+}
+
+/*
+ * Kernel keeps smoothed round trip time of every tcp socket. Peers of members
+ * declared dead and duplicate links are dropped here by their owning reactor
+ * and first reactor retries connections to live members which lost their
+ * peer.
+ */
+static void connection_check_peers(reactor_t reactor[static 1])
+{
+    uint64_t now = connection_now_ms();
+    if (now < reactor->peer_check_ms)
+    {
+        return;
+    }
+    reactor->peer_check_ms = now + PEER_CHECK_MS;
+    connection_t* connection = reactor->connection;
+    peer_table_t* peers = &connection->peers;
+    /*
+       established peer is on no list, so it is linked through next until it
+       is dropped, which fails its requests and must run without table lock
+     */
+    client_t* evicted = NULL;
+    peer_table_lock(peers);
+    /* retired peers in backoff belong to no reactor, first one releases them */
+    while (reactor->id == 0 && connection->retired)
+    {
+        client_t* client = connection->retired;
+        connection->retired = client->next;
+        client->next = reactor->graveyard;
+        reactor->graveyard = client;
+    }
+    for (uint32_t i = 0; i < peers->slab_count; i++)
+    {
+        for (uint32_t j = 0; j < PEER_SLAB_SIZE; j++)
+        {
+            client_t* client = &peers->slabs[i][j];
+            /* peers of other reactors are only looked at */
+            if (!__atomic_load_n(&client->active, __ATOMIC_ACQUIRE) ||
+                __atomic_load_n(&client->reactor, __ATOMIC_RELAXED) !=
+                    reactor ||
+                client->state != PEER_STATE_ESTABLISHED)
+            {
+                continue;
+            }
+            if (client->evict)
+            {
+                client->next = evicted;
+                evicted = client;
+                continue;
+            }
+            struct tcp_info info;
+            socklen_t len = sizeof(info);
+            if (getsockopt(client->source.fd, IPPROTO_TCP, TCP_INFO, &info,
+                           &len) < 0)
+            {
+                continue;
+            }
+            uint64_t rtt_ns = (uint64_t)info.tcpi_rtt * 1000;
+            __atomic_store_n(&client->rtt_ns, rtt_ns, __ATOMIC_RELAXED);
+            metrics_record(reactor->metrics, METRIC_PEER_RTT_NS, rtt_ns);
+        }
+    }
+    peer_table_unlock(peers);
+    /* only owning reactor releases peer, so collected ones stay valid */
+    while (evicted)
+    {
+        client_t* client = evicted;
+        evicted = client->next;
+        client->next = NULL;
+        LOG_INFO("Dropping peer %s of dead or linked member\n", client->ip);
+        connection_drop_client(client);
+    }
+
+    if (reactor->id != 0)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < connection->membership.count; i++)
+    {
+        const member_t* member = &connection->membership.members[i];
+        if (member->state != MEMBER_DEAD)
+        {
+            struct sockaddr_in addr = {.sin_family = AF_INET,
+                                       .sin_port = htons(member->tcp_port),
+                                       .sin_addr = member->addr.sin_addr};
+            connection_to_new_server(connection, &addr);
+        }
+    }
+}
+
+/* called from first reactor, which owns membership */
+static void connection_member_event(void* ctx,
+                                    const member_t member[static 1])
+{
+    connection_t* connection = ctx;
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(member->tcp_port),
+                               .sin_addr = member->addr.sin_addr};
+    if (member->state != MEMBER_DEAD)
+    {
+        if (connection->peer_cache)
+        {
+            peer_cache_learn(connection->peer_cache, &member->addr,
+                             member->tcp_port, (uint64_t)time(NULL));
+        }
+        connection_to_new_server(connection, &addr);
+        return;
+    }
+    /* peer may belong to other reactor, which drops it on next check */
+    peer_table_lock(&connection->peers);
+    client_t* client = peer_table_find_locked(&connection->peers, &addr);
+    if (client && client->member)
+    {
+        client->evict = 1;
+    }
+    peer_table_unlock(&connection->peers);
+}
+
+/* per-peer lines of stats report, called from stats thread */
+static void connection_report(void* arg, metrics_writer_t writer[static 1])
+{
+    connection_t* connection = arg;
+    peer_table_t* peers = &connection->peers;
+    metrics_printf(writer, "peers %u\n", peer_table_count(peers));
+    peer_table_lock(peers);
+    for (uint32_t i = 0; i < peers->slab_count; i++)
+    {
+        for (uint32_t j = 0; j < PEER_SLAB_SIZE; j++)
+        {
+            client_t* client = &peers->slabs[i][j];
+            /* counters of peer belong to its reactor, they are only loaded */
+            if (!__atomic_load_n(&client->active, __ATOMIC_ACQUIRE))
+            {
+                continue;
+            }
+            metrics_printf(
+                writer,
+                "peer %s:%u state=%d member=%d tx_pending=%lu bytes_in=%lu "
+                "bytes_out=%lu frames_in=%lu frames_out=%lu rtt_ns=%lu\n",
+                client->ip, ntohs(client->addr.sin_port), client->state,
+                client->member,
+                __atomic_load_n(&client->tx_pending, __ATOMIC_RELAXED),
+                __atomic_load_n(&client->bytes_in, __ATOMIC_RELAXED),
+                __atomic_load_n(&client->bytes_out, __ATOMIC_RELAXED),
+                __atomic_load_n(&client->frames_in, __ATOMIC_RELAXED),
+                __atomic_load_n(&client->frames_out, __ATOMIC_RELAXED),
+                __atomic_load_n(&client->rtt_ns, __ATOMIC_RELAXED));
+        }
+    }
+    peer_table_unlock(peers);
+}
+
+/*
+ * Bootstrap, node announces itself until it learns about first member, or
+ * after restart until first of its cached peers gets connected. Changes of
+ * peer cache are saved from here, away from reactors.
+ */
+static void* connection_udp_thread(void* arg)
+{
+    connection_t* conn = arg;
+    udp_batch_t* batch = udp_batch_create();
+    if (batch == NULL)
+    {
+        return NULL;
+    }
+    uint64_t next_ms = connection_now_ms() + conn->discovery_interval_ms;
+    while (conn->udp_th_run)
+    {
+        uint64_t now = connection_now_ms();
+        if (now < next_ms)
+        {
+            uint64_t nap = next_ms - now;
+            nap = nap < DISCOVERY_NAP_MS ? nap : DISCOVERY_NAP_MS;
+            struct timespec ts = {.tv_nsec = (long)(nap * 1000000)};
+            nanosleep(&ts, NULL);
+            continue;
+        }
+        next_ms = now + conn->discovery_interval_ms;
+        if (conn->peer_cache)
+        {
+            peer_cache_save(conn->peer_cache);
+        }
+        if (membership_live_count(&conn->membership) > 0 && !conn->rejoining)
+        {
+            continue;
+        }
+        UDP_packet packet = {};
+        udp_discovery_packet_create(&packet, ntohs(conn->addr.sin_port),
+                                    "Test", 4);
+        struct sockaddr_in addr = conn->discovery_addr;
+        for (uint32_t i = 0; i < conn->discovery_ports; i++)
+        {
+            addr.sin_port =
+                htons((uint16_t)(ntohs(conn->discovery_addr.sin_port) + i));
+            uint8_t* buffer = udp_batch_prepare(batch, &addr);
+            if (buffer == NULL)
+            {
+                udp_batch_send(batch, conn->udp.fd);
+                buffer = udp_batch_prepare(batch, &addr);
+            }
+            udp_discovery_packet_serialize(&packet, (char*)buffer,
+                                           UDP_BATCH_PACKET_SIZE);
+            udp_batch_commit(batch, UDP_DISCOVERY_PACKET_SIZE);
+        }
+        /* sent from bound socket, so receivers learn our udp port */
+        udp_batch_send(batch, conn->udp.fd);
+    }
+    udp_batch_free(batch);
+    return NULL;
+}
+
+/*
+ * Cached peers become members at once, so membership pings them and member
+ * events connect to all of them in parallel, before any announcement is sent
+ * or received. Peers which are gone are declared dead by membership.
+ */
+static void connection_rejoin(connection_t connection[static 1])
+{
+    if (connection->peer_cache == NULL)
+    {
+        return;
+    }
+    peer_cache_entry_t entries[PEER_CACHE_MAX];
+    uint32_t count =
+        peer_cache_list(connection->peer_cache, entries, PEER_CACHE_MAX);
+    if (count == 0)
+    {
+        return;
+    }
+    connection->rejoining = 1;
+    uint64_t now = connection_now_ms();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        struct sockaddr_in addr = {.sin_family = AF_INET,
+                                   .sin_port = htons(entries[i].udp_port),
+                                   .sin_addr.s_addr = entries[i].ip};
+        membership_join(&connection->membership, &addr, entries[i].tcp_port,
+                        now);
+    }
+    membership_flush(&connection->membership);
+    LOG_INFO("Rejoining %u cached peers\n", count);
+}
+
+int32_t connection_compressing(const client_t client[static 1])
+{
+    return client->codec != COMPRESS_NONE &&
+           compress_adapt_wants(&client->compress);
+}
+
+int32_t connection_writable(const client_t client[static 1])
+{
+    return !client->throttled;
+}
+
+uint32_t connection_established_count(connection_t conn[static 1])
+{
+    uint32_t count = 0;
+    peer_table_lock(&conn->peers);
+    for (uint32_t i = 0; i < conn->peers.slab_count; i++)
+    {
+        for (uint32_t j = 0; j < PEER_SLAB_SIZE; j++)
+        {
+            client_t* client = &conn->peers.slabs[i][j];
+            if (__atomic_load_n(&client->active, __ATOMIC_ACQUIRE) &&
+                client->member && client->state == PEER_STATE_ESTABLISHED)
+            {
+                count++;
+            }
+        }
+    }
+    peer_table_unlock(&conn->peers);
+    return count;
+}
+
+/* liveness probe, payload is echoed back */
+static err_t connection_handle_ping(void* ctx, client_t client[static 1],
+                                    const proto_frame_t frame[static 1])
+{
+    (void)ctx;
+    struct iovec iov = {.iov_base = (void*)(uintptr_t)frame->payload,
+                        .iov_len = frame->header.length};
+    return connection_reply(client, frame, PROTO_MSG_PONG, &iov, 1);
+}
+
+/*
+ * Completions run from here may retry or cancel, which fails at once while
+ * closing, so every request is completed before any reactor is torn down.
+ */
+void close_connection(connection_t conn[static 1])
+{
+    conn->closing = 1;
+    conn->tcp_th_run = 0;
+    conn->udp_th_run = 0;
+    for (uint32_t i = 0; i < conn->reactor_count; i++)
+    {
+        pthread_join(conn->reactors[i].th, NULL);
+    }
+    pthread_join(conn->udp_th, NULL);
+    connection_teardown(conn, conn->reactor_count);
+}
+
+/* threads are stopped, first reactors of connection were initialized */
+static void connection_teardown(connection_t conn[static 1], uint32_t reactors)
+{
+    metrics_destroy(&conn->metrics);
+    for (uint32_t i = 0; i < reactors; i++)
+    {
+        connection_fail_calls(&conn->reactors[i]);
+    }
+    /* reactors are stopped, remaining peers can be closed from here */
+    for (uint32_t i = 0; i < conn->peers.slab_count; i++)
+    {
+        for (uint32_t j = 0; j < PEER_SLAB_SIZE; j++)
+        {
+            client_t* client = &conn->peers.slabs[i][j];
+            if (client->active)
+            {
+                client->active = 0;
+                connection_fail_requests(client);
+                close(client->source.fd);
+                ring_buffer_destroy(&client->rx);
+                connection_free_tx(client);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < reactors; i++)
+    {
+        reactor_t* reactor = &conn->reactors[i];
+        /*
+           io_uring drops its accept of listener only some time after ring is
+           closed, shutdown takes listener out of port at once, so node
+           started on the same port gets every connection
+         */
+        if (reactor->listener.fd >= 0)
+        {
+            shutdown(reactor->listener.fd, SHUT_RDWR);
+        }
+        io_backend_destroy(&reactor->backend);
+        if (reactor->listener.fd >= 0)
+        {
+            close(reactor->listener.fd);
+        }
+        if (reactor->wakeup.fd >= 0)
+        {
+            close(reactor->wakeup.fd);
+        }
+        pthread_mutex_destroy(&reactor->calls_lock);
+    }
+    if (conn->udp.fd >= 0)
+    {
+        close(conn->udp.fd);
+    }
+    membership_destroy(&conn->membership);
+    if (conn->peer_cache)
+    {
+        peer_cache_close(conn->peer_cache);
+        free(conn->peer_cache);
+        conn->peer_cache = NULL;
+    }
+    udp_batch_free(conn->udp_rx);
+    conn->udp_rx = NULL;
+    free(conn->reactors);
+    conn->reactors = NULL;
+    conn->reactor_count = 0;
+    peer_table_destroy(&conn->peers);
+    hash_ring_destroy(&conn->ring);
 }
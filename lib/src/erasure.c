@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "erasure.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ERASURE_X86 1
+#endif
+
+/* x^8 + x^4 + x^3 + x^2 + 1, generator 2 */
+#define ERASURE_GF_POLY 0x11d
+/* stripe is processed in blocks, so every pass over data hits cache */
+#define ERASURE_BLOCK_SIZE (8 * 1024)
+
+/**
+ * @brief dst = sum of src[i][offset..] multiplied by coefficient of
+ *        tables[i], with accumulate dst is added to instead
+ */
+typedef void (*erasure_dot_fn)(uint32_t count, const uint8_t* tables,
+                               const uint8_t* const* src, uint64_t offset,
+                               uint8_t* dst, uint64_t length,
+                               int32_t accumulate);
+
+static uint8_t erasure_exp[512];
+static uint8_t erasure_log[256];
+static pthread_once_t erasure_once = PTHREAD_ONCE_INIT;
+static erasure_dot_fn erasure_dot;
+static int32_t erasure_kernel_in_use;
+
+static void erasure_setup(void);
+static int32_t erasure_supported(int32_t kernel);
+static erasure_dot_fn erasure_kernel_fn(int32_t kernel);
+static uint8_t erasure_mul(uint8_t a, uint8_t b);
+static uint8_t erasure_inv(uint8_t a);
+static void erasure_table(uint8_t coef, uint8_t table[ERASURE_TABLE_SIZE]);
+static err_t erasure_invert(uint8_t* matrix, uint32_t n);
+static void erasure_dot_scalar(uint32_t count, const uint8_t* tables,
+                               const uint8_t* const* src, uint64_t offset,
+                               uint8_t* dst, uint64_t length,
+                               int32_t accumulate);
+#ifdef ERASURE_X86
+static void erasure_dot_ssse3(uint32_t count, const uint8_t* tables,
+                              const uint8_t* const* src, uint64_t offset,
+                              uint8_t* dst, uint64_t length,
+                              int32_t accumulate);
+static void erasure_dot_avx2(uint32_t count, const uint8_t* tables,
+                             const uint8_t* const* src, uint64_t offset,
+                             uint8_t* dst, uint64_t length,
+                             int32_t accumulate);
+static void erasure_dot_avx512(uint32_t count, const uint8_t* tables,
+                               const uint8_t* const* src, uint64_t offset,
+                               uint8_t* dst, uint64_t length,
+                               int32_t accumulate);
+#endif
+
+static void erasure_setup(void)
+{
+    uint32_t x = 1;
+    for (uint32_t i = 0; i < 255; i++)
+    {
+        erasure_exp[i] = (uint8_t)x;
+        erasure_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100)
+        {
+            x ^= ERASURE_GF_POLY;
+        }
+    }
+    /* doubled, so product needs no modulo */
+    for (uint32_t i = 255; i < 512; i++)
+    {
+        erasure_exp[i] = erasure_exp[i - 255];
+    }
+    int32_t best = ERASURE_KERNEL_SCALAR;
+    for (int32_t kernel = ERASURE_KERNEL_SSSE3; kernel < ERASURE_KERNEL_MAX;
+         kernel++)
+    {
+        best = erasure_supported(kernel) ? kernel : best;
+    }
+    erasure_kernel_in_use = best;
+    __atomic_store_n(&erasure_dot, erasure_kernel_fn(best), __ATOMIC_RELEASE);
+}
+
+static int32_t erasure_supported(int32_t kernel)
+{
+    switch (kernel)
+    {
+    case ERASURE_KERNEL_SCALAR:
+        return 1;
+#ifdef ERASURE_X86
+    case ERASURE_KERNEL_SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case ERASURE_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case ERASURE_KERNEL_AVX512:
+        return __builtin_cpu_supports("avx512bw");
+#endif
+    default:
+        return 0;
+    }
+}
+
+static erasure_dot_fn erasure_kernel_fn(int32_t kernel)
+{
+    switch (kernel)
+    {
+#ifdef ERASURE_X86
+    case ERASURE_KERNEL_SSSE3:
+        return erasure_dot_ssse3;
+    case ERASURE_KERNEL_AVX2:
+        return erasure_dot_avx2;
+    case ERASURE_KERNEL_AVX512:
+        return erasure_dot_avx512;
+#endif
+    default:
+        return erasure_dot_scalar;
+    }
+}
+
+err_t erasure_select_kernel(int32_t kernel)
+{
+    pthread_once(&erasure_once, erasure_setup);
+    if (kernel == ERASURE_KERNEL_AUTO)
+    {
+        for (kernel = ERASURE_KERNEL_MAX - 1; !erasure_supported(kernel);
+             kernel--)
+        {
+        }
+    }
+    if (!erasure_supported(kernel))
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    erasure_kernel_in_use = kernel;
+    __atomic_store_n(&erasure_dot, erasure_kernel_fn(kernel),
+                     __ATOMIC_RELEASE);
+    return DISFS_SUCCESS;
+}
+
+int32_t erasure_active_kernel(void)
+{
+    pthread_once(&erasure_once, erasure_setup);
+    return erasure_kernel_in_use;
+}
+
+const char* erasure_kernel_name(int32_t kernel)
+{
+    static const char* names[ERASURE_KERNEL_MAX] = {"auto", "scalar", "ssse3",
+                                                    "avx2", "avx512"};
+    return kernel >= 0 && kernel < ERASURE_KERNEL_MAX ? names[kernel] : "?";
+}
+
+static uint8_t erasure_mul(uint8_t a, uint8_t b)
+{
+    if (a == 0 || b == 0)
+    {
+        return 0;
+    }
+    return erasure_exp[erasure_log[a] + erasure_log[b]];
+}
+
+static uint8_t erasure_inv(uint8_t a)
+{
+    return erasure_exp[255 - erasure_log[a]];
+}
+
+static void erasure_table(uint8_t coef, uint8_t table[ERASURE_TABLE_SIZE])
+{
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        table[i] = erasure_mul(coef, (uint8_t)i);
+        table[16 + i] = erasure_mul(coef, (uint8_t)(i << 4));
+    }
+}
+
+/* Gauss-Jordan elimination of n x n matrix in place */
+static err_t erasure_invert(uint8_t* matrix, uint32_t n)
+{
+    uint8_t inverse[ERASURE_MAX_SHARDS * ERASURE_MAX_SHARDS] = {};
+    for (uint32_t i = 0; i < n; i++)
+    {
+        inverse[i * n + i] = 1;
+    }
+    for (uint32_t col = 0; col < n; col++)
+    {
+        uint32_t pivot = col;
+        while (pivot < n && matrix[pivot * n + col] == 0)
+        {
+            pivot++;
+        }
+        if (pivot == n)
+        {
+            return DISFS_ERR_INVALID_ARG;
+        }
+        for (uint32_t j = 0; j < n; j++)
+        {
+            uint8_t t = matrix[col * n + j];
+            matrix[col * n + j] = matrix[pivot * n + j];
+            matrix[pivot * n + j] = t;
+            t = inverse[col * n + j];
+            inverse[col * n + j] = inverse[pivot * n + j];
+            inverse[pivot * n + j] = t;
+        }
+        uint8_t scale = erasure_inv(matrix[col * n + col]);
+        for (uint32_t j = 0; j < n; j++)
+        {
+            matrix[col * n + j] = erasure_mul(matrix[col * n + j], scale);
+            inverse[col * n + j] = erasure_mul(inverse[col * n + j], scale);
+        }
+        for (uint32_t row = 0; row < n; row++)
+        {
+            uint8_t factor = matrix[row * n + col];
+            if (row == col || factor == 0)
+            {
+                continue;
+            }
+            for (uint32_t j = 0; j < n; j++)
+            {
+                matrix[row * n + j] ^= erasure_mul(factor, matrix[col * n + j]);
+                inverse[row * n + j] ^=
+                    erasure_mul(factor, inverse[col * n + j]);
+            }
+        }
+    }
+    memcpy(matrix, inverse, n * n);
+    return DISFS_SUCCESS;
+}
+
+err_t erasure_init(erasure_t code[static 1], uint32_t data_shards,
+                   uint32_t parity_shards)
+{
+    if (data_shards == 0 || parity_shards == 0 ||
+        data_shards + parity_shards > ERASURE_MAX_SHARDS)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    pthread_once(&erasure_once, erasure_setup);
+    *code = (erasure_t){.data_shards = data_shards,
+                        .parity_shards = parity_shards};
+    /* Cauchy rows 1 / (x_i + y_j) with x_i = k + i and y_j = j are disjoint,
+     * so every square submatrix of identity stacked on them is invertible */
+    for (uint32_t i = 0; i < parity_shards; i++)
+    {
+        for (uint32_t j = 0; j < data_shards; j++)
+        {
+            uint8_t coef = erasure_inv((uint8_t)((data_shards + i) ^ j));
+            code->matrix[i][j] = coef;
+            erasure_table(coef, code->tables[i][j]);
+        }
+    }
+    return DISFS_SUCCESS;
+}
+
+void erasure_encode(const erasure_t code[static 1], const uint8_t* const* data,
+                    uint8_t* const* parity, uint64_t length)
+{
+    erasure_dot_fn dot = __atomic_load_n(&erasure_dot, __ATOMIC_ACQUIRE);
+    for (uint64_t offset = 0; offset < length; offset += ERASURE_BLOCK_SIZE)
+    {
+        uint64_t n = length - offset < ERASURE_BLOCK_SIZE ? length - offset
+                                                           : ERASURE_BLOCK_SIZE;
+        for (uint32_t i = 0; i < code->parity_shards; i++)
+        {
+            dot(code->data_shards, code->tables[i][0], data, offset,
+                parity[i] + offset, n, 0);
+        }
+    }
+}
+
+/*
+ * Rows of surviving fragments form invertible matrix, its inverse maps them
+ * back to data fragments. Lost parity is then encoded again from data.
+ */
+err_t erasure_decode(const erasure_t code[static 1], uint8_t* const* shards,
+                     uint32_t erased, uint64_t length)
+{
+    uint32_t k = code->data_shards;
+    uint32_t total = k + code->parity_shards;
+    erased &= (uint32_t)((1ULL << total) - 1);
+    if (erased == 0)
+    {
+        return DISFS_SUCCESS;
+    }
+    if ((uint32_t)__builtin_popcount(erased) > code->parity_shards)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    const uint8_t* sources[ERASURE_MAX_SHARDS];
+    uint8_t matrix[ERASURE_MAX_SHARDS * ERASURE_MAX_SHARDS] = {};
+    uint32_t rows = 0;
+    for (uint32_t i = 0; i < total && rows < k; i++)
+    {
+        if (erased & (1u << i))
+        {
+            continue;
+        }
+        sources[rows] = shards[i];
+        for (uint32_t j = 0; j < k; j++)
+        {
+            matrix[rows * k + j] =
+                i < k ? (uint8_t)(i == j) : code->matrix[i - k][j];
+        }
+        rows++;
+    }
+    err_t ret = erasure_invert(matrix, k);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+
+    /* tables of every lost data fragment, then of every lost parity */
+    uint8_t tables[ERASURE_MAX_SHARDS][ERASURE_MAX_SHARDS][ERASURE_TABLE_SIZE];
+    uint32_t lost_data[ERASURE_MAX_SHARDS];
+    uint32_t lost_data_count = 0;
+    for (uint32_t j = 0; j < k; j++)
+    {
+        if (erased & (1u << j))
+        {
+            for (uint32_t i = 0; i < k; i++)
+            {
+                erasure_table(matrix[j * k + i], tables[lost_data_count][i]);
+            }
+            lost_data[lost_data_count++] = j;
+        }
+    }
+    const uint8_t* data[ERASURE_MAX_SHARDS];
+    for (uint32_t j = 0; j < k; j++)
+    {
+        data[j] = shards[j];
+    }
+
+    erasure_dot_fn dot = __atomic_load_n(&erasure_dot, __ATOMIC_ACQUIRE);
+    for (uint64_t offset = 0; offset < length; offset += ERASURE_BLOCK_SIZE)
+    {
+        uint64_t n = length - offset < ERASURE_BLOCK_SIZE ? length - offset
+                                                           : ERASURE_BLOCK_SIZE;
+        for (uint32_t i = 0; i < lost_data_count; i++)
+        {
+            dot(k, tables[i][0], sources, offset,
+                shards[lost_data[i]] + offset, n, 0);
+        }
+        for (uint32_t i = 0; i < code->parity_shards; i++)
+        {
+            if (erased & (1u << (k + i)))
+            {
+                dot(k, code->tables[i][0], data, offset,
+                    shards[k + i] + offset, n, 0);
+            }
+        }
+    }
+    return DISFS_SUCCESS;
+}
+
+/* parity is linear, so it changes by coefficient times difference of data */
+void erasure_update(const erasure_t code[static 1], uint32_t index,
+                    const uint8_t* old_data, const uint8_t* new_data,
+                    uint8_t* const* parity, uint64_t length)
+{
+    erasure_dot_fn dot = __atomic_load_n(&erasure_dot, __ATOMIC_ACQUIRE);
+    uint8_t delta[ERASURE_BLOCK_SIZE];
+    const uint8_t* sources[1] = {delta};
+    for (uint64_t offset = 0; offset < length; offset += ERASURE_BLOCK_SIZE)
+    {
+        uint64_t n = length - offset < ERASURE_BLOCK_SIZE ? length - offset
+                                                           : ERASURE_BLOCK_SIZE;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            delta[i] = old_data[offset + i] ^ new_data[offset + i];
+        }
+        for (uint32_t i = 0; i < code->parity_shards; i++)
+        {
+            dot(1, code->tables[i][index], sources, 0, parity[i] + offset, n,
+                1);
+        }
+    }
+}
+
+static void erasure_dot_scalar(uint32_t count, const uint8_t* tables,
+                               const uint8_t* const* src, uint64_t offset,
+                               uint8_t* dst, uint64_t length,
+                               int32_t accumulate)
+{
+    for (uint64_t pos = 0; pos < length; pos++)
+    {
+        uint8_t acc = accumulate ? dst[pos] : 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint8_t* table = tables + i * ERASURE_TABLE_SIZE;
+            uint8_t x = src[i][offset + pos];
+            acc ^= table[x & 0x0f] ^ table[16 + (x >> 4)];
+        }
+        dst[pos] = acc;
+    }
+}
+
+#ifdef ERASURE_X86
+/*
+ * Product of byte and coefficient is sum of products of its nibbles, both
+ * are looked up 16 (32, 64) bytes at once by byte shuffle of nibble tables.
+ */
+__attribute__((target("ssse3"))) static void
+erasure_dot_ssse3(uint32_t count, const uint8_t* tables,
+                  const uint8_t* const* src, uint64_t offset, uint8_t* dst,
+                  uint64_t length, int32_t accumulate)
+{
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    uint64_t pos = 0;
+    for (; pos + 16 <= length; pos += 16)
+    {
+        __m128i acc = accumulate ? _mm_loadu_si128((const __m128i*)(dst + pos))
+                                 : _mm_setzero_si128();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint8_t* table = tables + i * ERASURE_TABLE_SIZE;
+            __m128i lo = _mm_loadu_si128((const __m128i*)table);
+            __m128i hi = _mm_loadu_si128((const __m128i*)(table + 16));
+            __m128i x =
+                _mm_loadu_si128((const __m128i*)(src[i] + offset + pos));
+            __m128i l = _mm_and_si128(x, mask);
+            __m128i h = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+            acc = _mm_xor_si128(acc, _mm_shuffle_epi8(lo, l));
+            acc = _mm_xor_si128(acc, _mm_shuffle_epi8(hi, h));
+        }
+        _mm_storeu_si128((__m128i*)(dst + pos), acc);
+    }
+    if (pos < length)
+    {
+        erasure_dot_scalar(count, tables, src, offset + pos, dst + pos,
+                           length - pos, accumulate);
+    }
+}
+
+__attribute__((target("avx2"))) static void
+erasure_dot_avx2(uint32_t count, const uint8_t* tables,
+                 const uint8_t* const* src, uint64_t offset, uint8_t* dst,
+                 uint64_t length, int32_t accumulate)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    uint64_t pos = 0;
+    for (; pos + 32 <= length; pos += 32)
+    {
+        __m256i acc = accumulate
+                          ? _mm256_loadu_si256((const __m256i*)(dst + pos))
+                          : _mm256_setzero_si256();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint8_t* table = tables + i * ERASURE_TABLE_SIZE;
+            __m256i lo = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i*)table));
+            __m256i hi = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i*)(table + 16)));
+            __m256i x =
+                _mm256_loadu_si256((const __m256i*)(src[i] + offset + pos));
+            __m256i l = _mm256_and_si256(x, mask);
+            __m256i h = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+            acc = _mm256_xor_si256(acc, _mm256_shuffle_epi8(lo, l));
+            acc = _mm256_xor_si256(acc, _mm256_shuffle_epi8(hi, h));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + pos), acc);
+    }
+    if (pos < length)
+    {
+        erasure_dot_ssse3(count, tables, src, offset + pos, dst + pos,
+                          length - pos, accumulate);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+erasure_dot_avx512(uint32_t count, const uint8_t* tables,
+                   const uint8_t* const* src, uint64_t offset, uint8_t* dst,
+                   uint64_t length, int32_t accumulate)
+{
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    uint64_t pos = 0;
+    for (; pos + 64 <= length; pos += 64)
+    {
+        __m512i acc = accumulate ? _mm512_loadu_si512(dst + pos)
+                                 : _mm512_setzero_si512();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint8_t* table = tables + i * ERASURE_TABLE_SIZE;
+            __m512i lo = _mm512_broadcast_i32x4(
+                _mm_loadu_si128((const __m128i*)table));
+            __m512i hi = _mm512_broadcast_i32x4(
+                _mm_loadu_si128((const __m128i*)(table + 16)));
+            __m512i x = _mm512_loadu_si512(src[i] + offset + pos);
+            __m512i l = _mm512_and_si512(x, mask);
+            __m512i h = _mm512_and_si512(_mm512_srli_epi64(x, 4), mask);
+            acc = _mm512_xor_si512(acc, _mm512_shuffle_epi8(lo, l));
+            acc = _mm512_xor_si512(acc, _mm512_shuffle_epi8(hi, h));
+        }
+        _mm512_storeu_si512(dst + pos, acc);
+    }
+    if (pos < length)
+    {
+        erasure_dot_avx2(count, tables, src, offset + pos, dst + pos,
+                         length - pos, accumulate);
+    }
+}
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "hash_ring.h"
+#include "err_codes.h"
+#include "logger.h"
+#include <stdlib.h>
+
+static int hash_ring_point_cmp(const void* a, const void* b);
+static uint32_t hash_ring_search(const hash_ring_t ring[static 1],
+                                 uint64_t key);
+
+static int hash_ring_point_cmp(const void* a, const void* b)
+{
+    const hash_ring_point_t* pa = a;
+    const hash_ring_point_t* pb = b;
+    return (pa->hash > pb->hash) - (pa->hash < pb->hash);
+}
+
+err_t hash_ring_init(hash_ring_t ring[static 1], uint32_t vnodes)
+{
+    *ring = (hash_ring_t){.vnodes = vnodes ? vnodes : HASH_RING_DEFAULT_VNODES};
+    pthread_rwlock_init(&ring->lock, NULL);
+    return DISFS_SUCCESS;
+}
+
+void hash_ring_destroy(hash_ring_t ring[static 1])
+{
+    free(ring->points);
+    free(ring->nodes);
+    pthread_rwlock_destroy(&ring->lock);
+    *ring = (hash_ring_t){};
+}
+
+err_t hash_ring_add(hash_ring_t ring[static 1], uint64_t id,
+                    const struct sockaddr_in* addr)
+{
+    if (id == 0)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    hash_ring_point_t* added = malloc(ring->vnodes * sizeof(*added));
+    if (added == NULL)
+    {
+        return DISFS_ERR_ALLOC;
+    }
+
+    err_t ret = DISFS_SUCCESS;
+    pthread_rwlock_wrlock(&ring->lock);
+    uint32_t node = ring->node_count;
+    for (uint32_t i = 0; i < ring->node_count; i++)
+    {
+        if (ring->nodes[i].id == id)
+        {
+            ret = DISFS_ERR_PEER_EXISTS;
+            goto out;
+        }
+        if (ring->nodes[i].id == 0 && node == ring->node_count)
+        {
+            node = i;
+        }
+    }
+    if (node == ring->node_capacity)
+    {
+        uint32_t capacity = ring->node_capacity ? ring->node_capacity * 2 : 16;
+        hash_ring_node_t* nodes =
+            realloc(ring->nodes, capacity * sizeof(*nodes));
+        if (nodes == NULL)
+        {
+            ret = DISFS_ERR_ALLOC;
+            goto out;
+        }
+        ring->nodes = nodes;
+        ring->node_capacity = capacity;
+    }
+    if (ring->point_count + ring->vnodes > ring->point_capacity)
+    {
+        uint32_t capacity = (ring->point_count + ring->vnodes) * 2;
+        hash_ring_point_t* points =
+            realloc(ring->points, capacity * sizeof(*points));
+        if (points == NULL)
+        {
+            ret = DISFS_ERR_ALLOC;
+            goto out;
+        }
+        ring->points = points;
+        ring->point_capacity = capacity;
+    }
+
+    for (uint32_t i = 0; i < ring->vnodes; i++)
+    {
+        added[i].hash = hash_ring_mix(hash_ring_mix(id) + i);
+        added[i].node = node;
+        added[i]._padded = 0;
+    }
+    qsort(added, ring->vnodes, sizeof(*added), hash_ring_point_cmp);
+
+    /* merge new points into sorted ring from the back */
+    uint32_t old = ring->point_count;
+    uint32_t out = old + ring->vnodes;
+    uint32_t j = ring->vnodes;
+    while (j > 0)
+    {
+        if (old > 0 && ring->points[old - 1].hash > added[j - 1].hash)
+        {
+            ring->points[--out] = ring->points[--old];
+        }
+        else
+        {
+            ring->points[--out] = added[--j];
+        }
+    }
+    ring->point_count += ring->vnodes;
+    ring->nodes[node] = (hash_ring_node_t){.id = id, .local = addr == NULL};
+    if (addr)
+    {
+        ring->nodes[node].addr = *addr;
+    }
+    if (node == ring->node_count)
+    {
+        ring->node_count++;
+    }
+    ring->live_nodes++;
+out:
+    pthread_rwlock_unlock(&ring->lock);
+    free(added);
+    return ret;
+}
+
+err_t hash_ring_remove(hash_ring_t ring[static 1], uint64_t id)
+{
+    err_t ret = DISFS_ERR_NOT_FOUND;
+    pthread_rwlock_wrlock(&ring->lock);
+    for (uint32_t node = 0; node < ring->node_count; node++)
+    {
+        if (ring->nodes[node].id != id || id == 0)
+        {
+            continue;
+        }
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < ring->point_count; i++)
+        {
+            if (ring->points[i].node != node)
+            {
+                ring->points[kept++] = ring->points[i];
+            }
+        }
+        ring->point_count = kept;
+        ring->nodes[node] = (hash_ring_node_t){};
+        ring->live_nodes--;
+        ret = DISFS_SUCCESS;
+        break;
+    }
+    pthread_rwlock_unlock(&ring->lock);
+    return ret;
+}
+
+/* index of first point with hash >= key, wraps to 0 */
+static uint32_t hash_ring_search(const hash_ring_t ring[static 1],
+                                 uint64_t key)
+{
+    uint32_t lo = 0;
+    uint32_t hi = ring->point_count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ring->points[mid].hash < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo == ring->point_count ? 0 : lo;
+}
+
+uint32_t hash_ring_lookup(hash_ring_t ring[static 1], uint64_t key,
+                          hash_ring_node_t* owners, uint32_t count)
+{
+    uint32_t seen[HASH_RING_MAX_REPLICAS];
+    uint32_t found = 0;
+    if (count > HASH_RING_MAX_REPLICAS)
+    {
+        count = HASH_RING_MAX_REPLICAS;
+    }
+    pthread_rwlock_rdlock(&ring->lock);
+    if (ring->point_count == 0)
+    {
+        goto out;
+    }
+    if (count > ring->live_nodes)
+    {
+        count = ring->live_nodes;
+    }
+    uint32_t pos = hash_ring_search(ring, key);
+    for (uint32_t step = 0; step < ring->point_count && found < count; step++)
+    {
+        uint32_t node = ring->points[pos].node;
+        uint32_t duplicate = 0;
+        for (uint32_t i = 0; i < found; i++)
+        {
+            duplicate |= seen[i] == node;
+        }
+        if (!duplicate)
+        {
+            seen[found] = node;
+            owners[found++] = ring->nodes[node];
+        }
+        pos = pos + 1 == ring->point_count ? 0 : pos + 1;
+    }
+out:
+    pthread_rwlock_unlock(&ring->lock);
+    return found;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "inflight.h"
+#include "logger.h"
+#include <stdlib.h>
+
+#define INFLIGHT_INITIAL_CAPACITY 16
+#define INFLIGHT_NONE UINT32_MAX
+
+static err_t inflight_grow(inflight_t table[static 1]);
+static void inflight_heap_set(inflight_t table[static 1], uint32_t index,
+                              uint32_t slot);
+static void inflight_sift_up(inflight_t table[static 1], uint32_t index);
+static void inflight_sift_down(inflight_t table[static 1], uint32_t index);
+static void inflight_remove(inflight_t table[static 1], uint32_t slot,
+                            inflight_entry_t entry[static 1]);
+
+static err_t inflight_grow(inflight_t table[static 1])
+{
+    uint32_t capacity =
+        table->capacity ? table->capacity * 2 : INFLIGHT_INITIAL_CAPACITY;
+    inflight_entry_t* entries =
+        realloc(table->entries, capacity * sizeof(*entries));
+    if (entries == NULL)
+    {
+        LOG_ERROR("Cannot grow in-flight table to %u requests\n", capacity);
+        return DISFS_ERR_ALLOC;
+    }
+    table->entries = entries;
+    uint32_t* heap = realloc(table->heap, capacity * sizeof(*heap));
+    if (heap == NULL)
+    {
+        LOG_ERROR("Cannot grow in-flight table to %u requests\n", capacity);
+        return DISFS_ERR_ALLOC;
+    }
+    table->heap = heap;
+    /* new slots are free, lowest slot is handed out first */
+    for (uint32_t i = capacity; i-- > table->capacity;)
+    {
+        entries[i] = (inflight_entry_t){.next_free = table->free_head};
+        table->free_head = i;
+    }
+    table->capacity = capacity;
+    return DISFS_SUCCESS;
+}
+
+static void inflight_heap_set(inflight_t table[static 1], uint32_t index,
+                              uint32_t slot)
+{
+    table->heap[index] = slot;
+    table->entries[slot].heap_index = index;
+}
+
+static void inflight_sift_up(inflight_t table[static 1], uint32_t index)
+{
+    uint32_t slot = table->heap[index];
+    uint64_t deadline = table->entries[slot].deadline_ms;
+    while (index > 0)
+    {
+        uint32_t parent = (index - 1) / 2;
+        if (table->entries[table->heap[parent]].deadline_ms <= deadline)
+        {
+            break;
+        }
+        inflight_heap_set(table, index, table->heap[parent]);
+        index = parent;
+    }
+    inflight_heap_set(table, index, slot);
+}
+
+static void inflight_sift_down(inflight_t table[static 1], uint32_t index)
+{
+    uint32_t slot = table->heap[index];
+    uint64_t deadline = table->entries[slot].deadline_ms;
+    for (;;)
+    {
+        uint32_t child = index * 2 + 1;
+        if (child >= table->count)
+        {
+            break;
+        }
+        if (child + 1 < table->count &&
+            table->entries[table->heap[child + 1]].deadline_ms <
+                table->entries[table->heap[child]].deadline_ms)
+        {
+            child++;
+        }
+        if (deadline <= table->entries[table->heap[child]].deadline_ms)
+        {
+            break;
+        }
+        inflight_heap_set(table, index, table->heap[child]);
+        index = child;
+    }
+    inflight_heap_set(table, index, slot);
+}
+
+static void inflight_remove(inflight_t table[static 1], uint32_t slot,
+                            inflight_entry_t entry[static 1])
+{
+    *entry = table->entries[slot];
+    uint32_t index = entry->heap_index;
+    table->count--;
+    if (index < table->count)
+    {
+        /* last heap element fills the hole and moves whichever way it fits */
+        uint32_t moved = table->heap[table->count];
+        inflight_heap_set(table, index, moved);
+        inflight_sift_up(table, index);
+        inflight_sift_down(table, table->entries[moved].heap_index);
+    }
+    table->entries[slot] = (inflight_entry_t){.next_free = table->free_head};
+    table->free_head = slot;
+}
+
+void inflight_destroy(inflight_t table[static 1])
+{
+    free(table->entries);
+    free(table->heap);
+    *table = (inflight_t){};
+}
+
+err_t inflight_add(inflight_t table[static 1], uint64_t deadline_ms,
+                   inflight_fn fn, void* ctx, uint64_t id[static 1])
+{
+    if (table->count == table->capacity)
+    {
+        err_t ret = inflight_grow(table);
+        if (ret != DISFS_SUCCESS)
+        {
+            return ret;
+        }
+    }
+    uint32_t slot = table->free_head;
+    inflight_entry_t* entry = &table->entries[slot];
+    table->free_head = entry->next_free;
+    /* sequence never wraps to 0, so id of slot 0 is never 0 either */
+    if (++table->sequence == 0)
+    {
+        table->sequence = 1;
+    }
+    *entry = (inflight_entry_t){
+        .id = ((uint64_t)table->sequence << 32) | slot,
+        .deadline_ms = deadline_ms,
+        .fn = fn,
+        .ctx = ctx,
+        .next_free = INFLIGHT_NONE,
+    };
+    inflight_heap_set(table, table->count++, slot);
+    inflight_sift_up(table, table->count - 1);
+    *id = entry->id;
+    return DISFS_SUCCESS;
+}
+
+err_t inflight_take(inflight_t table[static 1], uint64_t id,
+                    inflight_entry_t entry[static 1])
+{
+    uint32_t slot = (uint32_t)id;
+    if (id == 0 || slot >= table->capacity || table->entries[slot].id != id)
+    {
+        return DISFS_ERR_NOT_FOUND;
+    }
+    inflight_remove(table, slot, entry);
+    return DISFS_SUCCESS;
+}
+
+/* linear, cancelling is rare and tables of peers are short */
+err_t inflight_take_ctx(inflight_t table[static 1], inflight_fn fn, void* ctx,
+                        inflight_entry_t entry[static 1])
+{
+    for (uint32_t i = 0; i < table->count; i++)
+    {
+        uint32_t slot = table->heap[i];
+        if (table->entries[slot].fn == fn && table->entries[slot].ctx == ctx)
+        {
+            inflight_remove(table, slot, entry);
+            return DISFS_SUCCESS;
+        }
+    }
+    return DISFS_ERR_NOT_FOUND;
+}
+
+int32_t inflight_expire(inflight_t table[static 1], uint64_t now_ms,
+                        inflight_entry_t entry[static 1])
+{
+    if (table->count == 0 ||
+        table->entries[table->heap[0]].deadline_ms > now_ms)
+    {
+        return 0;
+    }
+    inflight_remove(table, table->heap[0], entry);
+    return 1;
+}
+
+uint64_t inflight_next_deadline(const inflight_t table[static 1])
+{
+    if (table->count == 0)
+    {
+        return UINT64_MAX;
+    }
+    return table->entries[table->heap[0]].deadline_ms;
+}
@@ -0,0 +1,695 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "io_backend.h"
+#include "err_codes.h"
+#include "logger.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#define IO_URING_ENTRIES 256
+#define IO_URING_CQ_ENTRIES (4 * IO_URING_ENTRIES)
+#define IO_URING_BUFFER_GROUP 0
+/* multishot receive into provided buffer ring needs 6.0 */
+#define IO_URING_MIN_MAJOR 6
+#define IO_URING_MIN_MINOR 0
+
+/*
+   io_uring user_data is pointer to event source with operation tag in low
+   bits, event_source_t is at least 4 byte aligned
+ */
+#define IO_TAG_READ 0UL     /* accept, receive or readable poll */
+#define IO_TAG_WRITE 1UL    /* writable poll */
+#define IO_TAG_POSTED 2UL   /* source handed over from other reactor */
+#define IO_TAG_INTERNAL 3UL /* cancel and message completions, ignored */
+#define IO_TAG_MASK 3UL
+
+#define IO_WANT_READ_ANY (IO_WANT_READ | IO_WANT_RECV | IO_WANT_ACCEPT)
+
+static err_t io_epoll_init(io_backend_t backend[static 1]);
+static uint32_t io_epoll_events(uint8_t wants);
+static int32_t io_epoll_wait(io_backend_t backend[static 1], io_event_t* events,
+                             int32_t max_events, int32_t timeout_ms);
+
+static int32_t io_uring_supported(void);
+static err_t io_uring_init(io_backend_t backend[static 1]);
+static void io_uring_destroy(io_backend_t backend[static 1]);
+static err_t io_uring_setup_buffers(io_backend_t backend[static 1]);
+static int32_t io_uring_enter(io_backend_t backend[static 1],
+                              uint32_t min_complete, int32_t timeout_ms);
+static struct io_uring_sqe* io_uring_get_sqe(io_backend_t backend[static 1]);
+static err_t io_uring_arm(io_backend_t backend[static 1],
+                          event_source_t source[static 1]);
+static err_t io_uring_cancel(io_backend_t backend[static 1],
+                             event_source_t source[static 1], uint64_t tag);
+static void io_uring_return_buffers(io_backend_t backend[static 1]);
+static int32_t io_uring_complete(io_backend_t backend[static 1],
+                                 const struct io_uring_cqe cqe[static 1],
+                                 io_event_t event[static 1]);
+static int32_t io_uring_wait(io_backend_t backend[static 1], io_event_t* events,
+                             int32_t max_events, int32_t timeout_ms);
+
+err_t io_backend_init(io_backend_t backend[static 1], int32_t kind)
+{
+    *backend = (io_backend_t){.fd = -1};
+    if (kind != IO_BACKEND_EPOLL)
+    {
+        err_t ret = io_uring_supported() ? io_uring_init(backend)
+                                         : DISFS_ERR_GENERIC;
+        if (ret == DISFS_SUCCESS || kind == IO_BACKEND_URING)
+        {
+            if (ret != DISFS_SUCCESS)
+            {
+                LOG_ERROR("io_uring backend is not available\n");
+            }
+            return ret;
+        }
+        LOG_DEBUG("io_uring backend is not available, using epoll\n");
+    }
+    return io_epoll_init(backend);
+}
+
+void io_backend_destroy(io_backend_t backend[static 1])
+{
+    if (backend->kind == IO_BACKEND_URING)
+    {
+        io_uring_destroy(backend);
+    }
+    else if (backend->fd >= 0)
+    {
+        close(backend->fd);
+    }
+    free(backend->epoll_events);
+    *backend = (io_backend_t){.fd = -1};
+}
+
+err_t io_backend_add(io_backend_t backend[static 1],
+                     event_source_t source[static 1], uint8_t wants)
+{
+    source->wants = wants;
+    if (backend->kind == IO_BACKEND_URING)
+    {
+        return io_uring_arm(backend, source);
+    }
+    struct epoll_event ev = {.events = io_epoll_events(wants),
+                             .data.ptr = source};
+    if (epoll_ctl(backend->fd, EPOLL_CTL_ADD, source->fd, &ev) < 0)
+    {
+        LOG_ERROR("Cannot add fd %d to epoll: errno=%d : %s\n", source->fd,
+                  errno, strerror(errno));
+        return DISFS_ERR_EPOLL;
+    }
+    source->armed = wants;
+    return DISFS_SUCCESS;
+}
+
+err_t io_backend_modify(io_backend_t backend[static 1],
+                        event_source_t source[static 1], uint8_t wants)
+{
+    if (backend->kind == IO_BACKEND_URING)
+    {
+        /* multishot read is stopped when its kind is no longer wanted */
+        uint8_t reading = source->armed & IO_WANT_READ_ANY;
+        source->wants = wants;
+        if (reading && !(wants & reading))
+        {
+            err_t ret = io_uring_cancel(backend, source, IO_TAG_READ);
+            if (ret != DISFS_SUCCESS)
+            {
+                return ret;
+            }
+        }
+        return io_uring_arm(backend, source);
+    }
+    if (source->wants == wants)
+    {
+        return DISFS_SUCCESS;
+    }
+    struct epoll_event ev = {.events = io_epoll_events(wants),
+                             .data.ptr = source};
+    if (epoll_ctl(backend->fd, EPOLL_CTL_MOD, source->fd, &ev) < 0)
+    {
+        LOG_ERROR("Cannot modify epoll events of fd %d: errno=%d : %s\n",
+                  source->fd, errno, strerror(errno));
+        return DISFS_ERR_EPOLL;
+    }
+    source->wants = wants;
+    source->armed = wants;
+    return DISFS_SUCCESS;
+}
+
+void io_backend_remove(io_backend_t backend[static 1],
+                       event_source_t source[static 1])
+{
+    source->wants = 0;
+    if (backend->kind != IO_BACKEND_URING)
+    {
+        epoll_ctl(backend->fd, EPOLL_CTL_DEL, source->fd, NULL);
+        source->armed = 0;
+        return;
+    }
+    /* completions of cancelled operations are ignored as nothing is wanted */
+    if (source->armed & IO_WANT_READ_ANY)
+    {
+        io_uring_cancel(backend, source, IO_TAG_READ);
+    }
+    if (source->armed & IO_WANT_WRITE)
+    {
+        io_uring_cancel(backend, source, IO_TAG_WRITE);
+    }
+}
+
+err_t io_backend_handoff(io_backend_t from[static 1], io_backend_t to[static 1],
+                         event_source_t source[static 1], uint8_t wants)
+{
+    if (from == to)
+    {
+        return io_backend_modify(from, source, wants);
+    }
+    if (from->kind != IO_BACKEND_URING)
+    {
+        epoll_ctl(from->fd, EPOLL_CTL_DEL, source->fd, NULL);
+        return io_backend_add(to, source, wants);
+    }
+    /* ring is only submitted to from its own thread, so ask owner to arm */
+    ASSERT(source->armed == 0, "Source handed over with pending operations");
+    source->wants = wants;
+    struct io_uring_sqe* sqe = io_uring_get_sqe(from);
+    if (sqe == NULL)
+    {
+        return DISFS_ERR_GENERIC;
+    }
+    sqe->opcode = IORING_OP_MSG_RING;
+    sqe->fd = to->fd;
+    sqe->addr = IORING_MSG_DATA;
+    sqe->off = (uint64_t)(uintptr_t)source | IO_TAG_POSTED;
+    sqe->user_data = IO_TAG_INTERNAL;
+    return DISFS_SUCCESS;
+}
+
+int32_t io_backend_wait(io_backend_t backend[static 1], io_event_t* events,
+                        int32_t max_events, int32_t timeout_ms)
+{
+    if (backend->kind == IO_BACKEND_URING)
+    {
+        return io_uring_wait(backend, events, max_events, timeout_ms);
+    }
+    return io_epoll_wait(backend, events, max_events, timeout_ms);
+}
+
+static err_t io_epoll_init(io_backend_t backend[static 1])
+{
+    backend->kind = IO_BACKEND_EPOLL;
+    backend->epoll_events =
+        calloc(IO_BACKEND_MAX_EVENTS, sizeof(*backend->epoll_events));
+    if (backend->epoll_events == NULL)
+    {
+        LOG_ERROR("Cannot allocate epoll event array\n");
+        return DISFS_ERR_ALLOC;
+    }
+    backend->fd = epoll_create1(EPOLL_CLOEXEC);
+    if (backend->fd < 0)
+    {
+        LOG_ERROR("Cannot create epoll errno: %d : %s!\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_EPOLL;
+    }
+    return DISFS_SUCCESS;
+}
+
+static uint32_t io_epoll_events(uint8_t wants)
+{
+    uint32_t events = 0;
+    if (wants & IO_WANT_READ_ANY)
+    {
+        events |= EPOLLIN;
+    }
+    if (wants & IO_WANT_WRITE)
+    {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+
+static int32_t io_epoll_wait(io_backend_t backend[static 1], io_event_t* events,
+                             int32_t max_events, int32_t timeout_ms)
+{
+    if (max_events > IO_BACKEND_MAX_EVENTS)
+    {
+        max_events = IO_BACKEND_MAX_EVENTS;
+    }
+    int32_t count =
+        epoll_wait(backend->fd, backend->epoll_events, max_events, timeout_ms);
+    for (int32_t i = 0; i < count; i++)
+    {
+        uint32_t revents = backend->epoll_events[i].events;
+        int32_t ready = 0;
+        /* errors and hangups surface from the next read or write */
+        if (revents & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            ready |= IO_WANT_READ;
+        }
+        if (revents & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+        {
+            ready |= IO_WANT_WRITE;
+        }
+        events[i] = (io_event_t){.source = backend->epoll_events[i].data.ptr,
+                                 .type = IO_EVENT_READY,
+                                 .result = ready};
+    }
+    return count < 0 ? 0 : count;
+}
+
+static int32_t io_uring_supported(void)
+{
+    struct utsname name;
+    int32_t major = 0;
+    int32_t minor = 0;
+    if (uname(&name) < 0 ||
+        sscanf(name.release, "%d.%d", &major, &minor) != 2)
+    {
+        return 0;
+    }
+    return major > IO_URING_MIN_MAJOR ||
+           (major == IO_URING_MIN_MAJOR && minor >= IO_URING_MIN_MINOR);
+}
+
+static err_t io_uring_init(io_backend_t backend[static 1])
+{
+    struct io_uring_params params = {.flags = IORING_SETUP_CQSIZE |
+                                              IORING_SETUP_SUBMIT_ALL |
+                                              IORING_SETUP_COOP_TASKRUN,
+                                     .cq_entries = IO_URING_CQ_ENTRIES};
+    backend->fd =
+        (int32_t)syscall(__NR_io_uring_setup, IO_URING_ENTRIES, &params);
+    if (backend->fd < 0)
+    {
+        LOG_DEBUG("Cannot create io_uring errno: %d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_GENERIC;
+    }
+    backend->kind = IO_BACKEND_URING;
+    uint32_t required =
+        IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required)
+    {
+        io_uring_destroy(backend);
+        return DISFS_ERR_GENERIC;
+    }
+
+    /* submission and completion rings share single mapping */
+    uint64_t sq_size = params.sq_off.array + params.sq_entries * sizeof(__u32);
+    uint64_t cq_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    backend->ring_map_size = sq_size > cq_size ? sq_size : cq_size;
+    backend->ring_map =
+        mmap(NULL, backend->ring_map_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, backend->fd, IORING_OFF_SQ_RING);
+    backend->sqes_map_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    backend->sqes = mmap(NULL, backend->sqes_map_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, backend->fd,
+                         IORING_OFF_SQES);
+    if (backend->ring_map == MAP_FAILED || backend->sqes == MAP_FAILED)
+    {
+        LOG_ERROR("Cannot map io_uring errno: %d : %s\n", errno,
+                  strerror(errno));
+        io_uring_destroy(backend);
+        return DISFS_ERR_GENERIC;
+    }
+    uint8_t* ring = backend->ring_map;
+    backend->sq_head = (uint32_t*)(ring + params.sq_off.head);
+    backend->sq_tail = (uint32_t*)(ring + params.sq_off.tail);
+    backend->sq_mask = *(uint32_t*)(ring + params.sq_off.ring_mask);
+    backend->sq_entries = params.sq_entries;
+    backend->sq_local_tail = *backend->sq_tail;
+    backend->sq_submitted = backend->sq_local_tail;
+    backend->cq_head = (uint32_t*)(ring + params.cq_off.head);
+    backend->cq_tail = (uint32_t*)(ring + params.cq_off.tail);
+    backend->cqes = (struct io_uring_cqe*)(ring + params.cq_off.cqes);
+    backend->cq_mask = *(uint32_t*)(ring + params.cq_off.ring_mask);
+    /* sqe slots are used in ring order, so indirection array is identity */
+    uint32_t* array = (uint32_t*)(ring + params.sq_off.array);
+    for (uint32_t i = 0; i < params.sq_entries; i++)
+    {
+        array[i] = i;
+    }
+
+    err_t ret = io_uring_setup_buffers(backend);
+    if (ret != DISFS_SUCCESS)
+    {
+        io_uring_destroy(backend);
+    }
+    return ret;
+}
+
+static err_t io_uring_setup_buffers(io_backend_t backend[static 1])
+{
+    uint64_t ring_size = IO_URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    backend->buf_ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    backend->buffers = mmap(NULL,
+                            (uint64_t)IO_URING_BUFFER_COUNT *
+                                IO_URING_BUFFER_SIZE,
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (backend->buf_ring == MAP_FAILED || backend->buffers == MAP_FAILED)
+    {
+        LOG_ERROR("Cannot allocate io_uring receive buffers\n");
+        return DISFS_ERR_ALLOC;
+    }
+    struct io_uring_buf_reg reg = {.ring_addr = (uint64_t)(uintptr_t)
+                                       backend->buf_ring,
+                                   .ring_entries = IO_URING_BUFFER_COUNT,
+                                   .bgid = IO_URING_BUFFER_GROUP};
+    if (syscall(__NR_io_uring_register, backend->fd,
+                IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        LOG_DEBUG("Cannot register provided buffer ring errno: %d : %s\n",
+                  errno, strerror(errno));
+        return DISFS_ERR_GENERIC;
+    }
+    for (uint16_t i = 0; i < IO_URING_BUFFER_COUNT; i++)
+    {
+        backend->returned[i] = i;
+    }
+    backend->returned_count = IO_URING_BUFFER_COUNT;
+    io_uring_return_buffers(backend);
+    return DISFS_SUCCESS;
+}
+
+static void io_uring_destroy(io_backend_t backend[static 1])
+{
+    /* closing ring cancels every operation still in flight */
+    if (backend->fd >= 0)
+    {
+        close(backend->fd);
+    }
+    if (backend->ring_map && backend->ring_map != MAP_FAILED)
+    {
+        munmap(backend->ring_map, backend->ring_map_size);
+    }
+    if (backend->sqes && backend->sqes != MAP_FAILED)
+    {
+        munmap(backend->sqes, backend->sqes_map_size);
+    }
+    if (backend->buf_ring && backend->buf_ring != MAP_FAILED)
+    {
+        munmap(backend->buf_ring,
+               IO_URING_BUFFER_COUNT * sizeof(struct io_uring_buf));
+    }
+    if (backend->buffers && backend->buffers != MAP_FAILED)
+    {
+        munmap(backend->buffers,
+               (uint64_t)IO_URING_BUFFER_COUNT * IO_URING_BUFFER_SIZE);
+    }
+    *backend = (io_backend_t){.fd = -1};
+}
+
+/* submit queued entries and wait for min_complete completions */
+static int32_t io_uring_enter(io_backend_t backend[static 1],
+                              uint32_t min_complete, int32_t timeout_ms)
+{
+    uint32_t to_submit = backend->sq_local_tail - backend->sq_submitted;
+    if (to_submit == 0 && min_complete == 0)
+    {
+        return 0;
+    }
+    __atomic_store_n(backend->sq_tail, backend->sq_local_tail,
+                     __ATOMIC_RELEASE);
+    struct __kernel_timespec ts = {.tv_sec = timeout_ms / 1000,
+                                   .tv_nsec = (timeout_ms % 1000) * 1000000};
+    /* negative timeout waits without limit */
+    struct io_uring_getevents_arg arg = {
+        .sigmask_sz = _NSIG / 8,
+        .ts = timeout_ms < 0 ? 0 : (uint64_t)(uintptr_t)&ts};
+    uint32_t flags = IORING_ENTER_EXT_ARG;
+    if (min_complete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    int32_t ret = (int32_t)syscall(__NR_io_uring_enter, backend->fd, to_submit,
+                                   min_complete, flags, &arg, sizeof(arg));
+    if (ret < 0)
+    {
+        if (errno != ETIME && errno != EINTR && errno != EBUSY)
+        {
+            LOG_ERROR("Cannot enter io_uring errno: %d : %s\n", errno,
+                      strerror(errno));
+        }
+        return ret;
+    }
+    backend->sq_submitted += (uint32_t)ret;
+    return ret;
+}
+
+static struct io_uring_sqe* io_uring_get_sqe(io_backend_t backend[static 1])
+{
+    uint32_t head = __atomic_load_n(backend->sq_head, __ATOMIC_ACQUIRE);
+    if (backend->sq_local_tail - head >= backend->sq_entries)
+    {
+        /* submission queue is full, submit it early */
+        io_uring_enter(backend, 0, 0);
+        head = __atomic_load_n(backend->sq_head, __ATOMIC_ACQUIRE);
+        if (backend->sq_local_tail - head >= backend->sq_entries)
+        {
+            LOG_ERROR("io_uring submission queue is full\n");
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe =
+        &backend->sqes[backend->sq_local_tail & backend->sq_mask];
+    *sqe = (struct io_uring_sqe){};
+    backend->sq_local_tail++;
+    return sqe;
+}
+
+/* queue operations for wanted flags which have none queued yet */
+static err_t io_uring_arm(io_backend_t backend[static 1],
+                          event_source_t source[static 1])
+{
+    uint8_t missing = source->wants & (uint8_t)~source->armed;
+    if (missing & IO_WANT_READ_ANY && !(source->armed & IO_WANT_READ_ANY))
+    {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(backend);
+        if (sqe == NULL)
+        {
+            return DISFS_ERR_GENERIC;
+        }
+        sqe->fd = source->fd;
+        sqe->user_data = (uint64_t)(uintptr_t)source | IO_TAG_READ;
+        if (missing & IO_WANT_ACCEPT)
+        {
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        }
+        else if (missing & IO_WANT_RECV)
+        {
+            sqe->opcode = IORING_OP_RECV;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = IO_URING_BUFFER_GROUP;
+        }
+        else
+        {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = POLLIN;
+            sqe->len = IORING_POLL_ADD_MULTI;
+        }
+        source->armed |= missing & IO_WANT_READ_ANY;
+        source->inflight++;
+    }
+    /* writable poll is one shot, it is rearmed while owner wants it */
+    if (missing & IO_WANT_WRITE)
+    {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(backend);
+        if (sqe == NULL)
+        {
+            return DISFS_ERR_GENERIC;
+        }
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = source->fd;
+        sqe->poll32_events = POLLOUT;
+        sqe->user_data = (uint64_t)(uintptr_t)source | IO_TAG_WRITE;
+        source->armed |= IO_WANT_WRITE;
+        source->inflight++;
+    }
+    return DISFS_SUCCESS;
+}
+
+static err_t io_uring_cancel(io_backend_t backend[static 1],
+                             event_source_t source[static 1], uint64_t tag)
+{
+    /* matched by user_data, so fd reused after close is never cancelled */
+    struct io_uring_sqe* sqe = io_uring_get_sqe(backend);
+    if (sqe == NULL)
+    {
+        return DISFS_ERR_GENERIC;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uint64_t)(uintptr_t)source | tag;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = IO_TAG_INTERNAL;
+    return DISFS_SUCCESS;
+}
+
+static void io_uring_return_buffers(io_backend_t backend[static 1])
+{
+    struct io_uring_buf_ring* ring = backend->buf_ring;
+    uint16_t tail = ring->tail;
+    for (uint32_t i = 0; i < backend->returned_count; i++)
+    {
+        uint16_t bid = backend->returned[i];
+        struct io_uring_buf* buf =
+            &ring->bufs[(uint16_t)(tail + i) & (IO_URING_BUFFER_COUNT - 1)];
+        buf->addr = (uint64_t)(uintptr_t)(backend->buffers +
+                                          (uint64_t)bid * IO_URING_BUFFER_SIZE);
+        buf->len = IO_URING_BUFFER_SIZE;
+        buf->bid = bid;
+    }
+    __atomic_store_n(&ring->tail, (uint16_t)(tail + backend->returned_count),
+                     __ATOMIC_RELEASE);
+    backend->returned_count = 0;
+}
+
+/* translate completion to event, returns 1 when event was produced */
+static int32_t io_uring_complete(io_backend_t backend[static 1],
+                                 const struct io_uring_cqe cqe[static 1],
+                                 io_event_t event[static 1])
+{
+    uint64_t tag = cqe->user_data & IO_TAG_MASK;
+    event_source_t* source =
+        (event_source_t*)(uintptr_t)(cqe->user_data & ~IO_TAG_MASK);
+    if (tag == IO_TAG_INTERNAL)
+    {
+        if (cqe->res < 0 && cqe->res != -ENOENT && cqe->res != -EALREADY)
+        {
+            LOG_WARNING("io_uring internal operation failed: %s\n",
+                        strerror(-cqe->res));
+        }
+        return 0;
+    }
+    if (tag == IO_TAG_POSTED)
+    {
+        io_uring_arm(backend, source);
+        return 0;
+    }
+    int32_t more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    if (!more)
+    {
+        source->inflight--;
+        source->armed &= (uint8_t)~(tag == IO_TAG_WRITE ? IO_WANT_WRITE
+                                                        : IO_WANT_READ_ANY);
+    }
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        /* buffer goes back to kernel once owner processed this batch */
+        backend->returned[backend->returned_count++] =
+            (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+    if (tag == IO_TAG_WRITE)
+    {
+        if (!(source->wants & IO_WANT_WRITE))
+        {
+            return 0;
+        }
+        *event = (io_event_t){.source = source,
+                              .type = IO_EVENT_READY,
+                              .result = IO_WANT_WRITE};
+        return 1;
+    }
+    if (cqe->flags & IORING_CQE_F_BUFFER && cqe->res > 0 && source->wants)
+    {
+        /* bytes left socket already, so they are reported to watched source
+           even when its receive was stopped meanwhile */
+        uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        *event = (io_event_t){.source = source,
+                              .data = backend->buffers +
+                                      (uint64_t)bid * IO_URING_BUFFER_SIZE,
+                              .type = IO_EVENT_RECEIVED,
+                              .result = cqe->res};
+    }
+    else if (!(source->wants & IO_WANT_READ_ANY))
+    {
+        return 0;
+    }
+    else if (source->wants & IO_WANT_RECV)
+    {
+        if (cqe->res == -ENOBUFS || cqe->res == -ECANCELED)
+        {
+            /* all buffers are in use, retry after they are returned, or
+               receive was stopped and wanted again before it completed */
+            io_uring_arm(backend, source);
+            return 0;
+        }
+        *event = (io_event_t){
+            .source = source, .type = IO_EVENT_CLOSED, .result = cqe->res};
+        return 1;
+    }
+    else if (source->wants & IO_WANT_ACCEPT)
+    {
+        if (cqe->res < 0)
+        {
+            if (cqe->res != -ECANCELED)
+            {
+                LOG_WARNING("Multishot accept failed: %s\n",
+                            strerror(-cqe->res));
+            }
+            io_uring_arm(backend, source);
+            return 0;
+        }
+        *event = (io_event_t){
+            .source = source, .type = IO_EVENT_ACCEPTED, .result = cqe->res};
+    }
+    else
+    {
+        *event = (io_event_t){
+            .source = source, .type = IO_EVENT_READY, .result = IO_WANT_READ};
+    }
+    if (!more)
+    {
+        io_uring_arm(backend, source);
+    }
+    return 1;
+}
+
+static int32_t io_uring_wait(io_backend_t backend[static 1], io_event_t* events,
+                             int32_t max_events, int32_t timeout_ms)
+{
+    /* data of previous batch was consumed by owner */
+    io_uring_return_buffers(backend);
+    if (max_events > IO_BACKEND_MAX_EVENTS)
+    {
+        max_events = IO_BACKEND_MAX_EVENTS;
+    }
+
+    uint32_t head = *backend->cq_head;
+    uint32_t tail = __atomic_load_n(backend->cq_tail, __ATOMIC_ACQUIRE);
+    io_uring_enter(backend, head == tail && timeout_ms != 0, timeout_ms);
+
+    int32_t count = 0;
+    tail = __atomic_load_n(backend->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && count < max_events)
+    {
+        const struct io_uring_cqe* cqe =
+            &backend->cqes[head & backend->cq_mask];
+        count += io_uring_complete(backend, cqe, &events[count]);
+        head++;
+    }
+    __atomic_store_n(backend->cq_head, head, __ATOMIC_RELEASE);
+    return count;
+}
@@ -0,0 +1,639 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "logger.h"
+#include "err_codes.h"
+#include "ring_buffer.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RED "\x1B[31m"
+#define GREEN "\x1B[32m"
+#define PURPLE "\x1B[35m"
+#define BLUE "\x1B[36m"
+#define YELLOW "\x1B[90m"
+#define RESET "\x1B[0m"
+
+#define LOGGER_RING_SIZE (128 * 1024)
+/* longer string arguments are truncated to fit */
+#define LOGGER_RECORD_MAX 2048
+#define LOGGER_LINE_MAX 4096
+#define LOGGER_OUTPUT_SIZE (64 * 1024)
+#define LOGGER_IDLE_NS (2 * 1000 * 1000)
+
+/*
+ * Record in ring of producer thread, followed by arg_count log_arg_t. String
+ * arguments keep their length in u and their bytes follow the arguments in
+ * order. Size is multiple of 8, so every record is aligned.
+ */
+typedef struct logger_record_t
+{
+    uint64_t timestamp_ns;
+    const char* file;
+    const char* fmt;
+    uint32_t line;
+    uint16_t level;
+    uint16_t arg_count;
+    uint32_t size;
+    uint32_t _padded;
+} logger_record_t;
+
+/**
+ * @brief single producer single consumer ring, tail is advanced only by
+ *        producer thread and head only by thread holding logger lock
+ */
+typedef struct logger_ring_t
+{
+    ring_buffer_t rb;
+    struct logger_ring_t* next;
+    uint64_t dropped;  /* records lost on full ring */
+    uint64_t reported; /* dropped records already reported */
+    int32_t closed;    /* producer thread exited */
+    uint32_t _padded;
+} logger_ring_t;
+
+typedef struct logger_t
+{
+    pthread_mutex_t lock; /* list of rings, consuming and output */
+    pthread_t th;
+    logger_ring_t* rings;
+    pthread_key_t key;
+    volatile int th_run;
+    uint32_t out_used;
+    uint32_t _padded;
+    char out[LOGGER_OUTPUT_SIZE];
+} logger_t;
+
+static logger_t logger = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static pthread_once_t logger_once = PTHREAD_ONCE_INIT;
+static _Thread_local logger_ring_t* logger_local;
+static _Thread_local int32_t logger_registering;
+
+static const char* const logger_levels[] = {
+    [LOG_LEVEL_TRACE] = BLUE "[TRACE] " RESET,
+    [LOG_LEVEL_DEBUG] = PURPLE "[DEBUG] " RESET,
+    [LOG_LEVEL_INFO] = GREEN "[INFO] " RESET,
+    [LOG_LEVEL_WARNING] = YELLOW "[WARNING] " RESET,
+    [LOG_LEVEL_ERROR] = RED "[ERROR] " RESET,
+};
+
+static void logger_init(void);
+static void logger_shutdown(void);
+static void logger_release_ring(void* arg);
+static logger_ring_t* logger_register(void);
+static void* logger_thread(void* arg);
+static uint32_t logger_drain(void);
+static void logger_output_flush(void);
+static void logger_put(char* out, uint32_t cap, uint32_t used[static 1],
+                       const char* text, uint32_t length);
+static void logger_pad(char* out, uint32_t cap, uint32_t used[static 1],
+                       char c, uint32_t count);
+static uint32_t logger_digits(char* end, uint64_t value, uint32_t base,
+                              int32_t upper);
+static uint32_t logger_format(char* out, uint32_t cap, const char* fmt,
+                              const log_arg_t* args, const uint32_t* lengths,
+                              uint32_t arg_count);
+static uint32_t logger_format_line(char* out, uint32_t cap, uint32_t level,
+                                   const char* file, uint32_t line,
+                                   const char* fmt, const log_arg_t* args,
+                                   const uint32_t* lengths,
+                                   uint32_t arg_count);
+static void logger_write_direct(uint32_t level, const char* file,
+                                uint32_t line, const char* fmt,
+                                const log_arg_t* args, uint32_t arg_count);
+static void logger_emit(const logger_record_t record[static 1]);
+
+static void logger_init(void)
+{
+    pthread_key_create(&logger.key, logger_release_ring);
+    logger.th_run = 1;
+    if (pthread_create(&logger.th, NULL, logger_thread, NULL) != 0)
+    {
+        logger.th_run = 0;
+        return;
+    }
+    atexit(logger_shutdown);
+}
+
+/* records logged after shutdown are written directly */
+static void logger_shutdown(void)
+{
+    logger.th_run = 0;
+    pthread_join(logger.th, NULL);
+    logger_flush();
+}
+
+static void logger_release_ring(void* arg)
+{
+    logger_ring_t* ring = arg;
+    logger_local = NULL;
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+static logger_ring_t* logger_register(void)
+{
+    pthread_once(&logger_once, logger_init);
+    if (!logger.th_run)
+    {
+        return NULL;
+    }
+    /* errors of ring creation are logged directly */
+    logger_registering = 1;
+    logger_ring_t* ring = calloc(1, sizeof(*ring));
+    if (ring &&
+        ring_buffer_create(&ring->rb, LOGGER_RING_SIZE) != DISFS_SUCCESS)
+    {
+        free(ring);
+        ring = NULL;
+    }
+    logger_registering = 0;
+    if (ring == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&logger.lock);
+    ring->next = logger.rings;
+    logger.rings = ring;
+    pthread_mutex_unlock(&logger.lock);
+    pthread_setspecific(logger.key, ring);
+    logger_local = ring;
+    return ring;
+}
+
+void logger_write(uint32_t level, const char* file, uint32_t line,
+                  const char* fmt, const log_arg_t* args, uint32_t arg_count)
+{
+    int saved_errno = errno;
+    logger_ring_t* ring = logger_local;
+    if (ring == NULL && !logger_registering)
+    {
+        ring = logger_register();
+    }
+    if (ring == NULL || !logger.th_run)
+    {
+        logger_write_direct(level, file, line, fmt, args, arg_count);
+        errno = saved_errno;
+        return;
+    }
+
+    arg_count = arg_count < LOG_MAX_ARGS ? arg_count : LOG_MAX_ARGS;
+    uint32_t lengths[LOG_MAX_ARGS];
+    uint64_t size = sizeof(logger_record_t) + arg_count * sizeof(log_arg_t);
+    for (uint32_t i = 0; i < arg_count; i++)
+    {
+        lengths[i] = 0;
+        if (args[i].kind == LOG_ARG_STR && args[i].s != NULL)
+        {
+            lengths[i] = (uint32_t)strnlen(args[i].s, LOGGER_RECORD_MAX - size);
+            size += lengths[i];
+        }
+    }
+    size = (size + 7) & ~7ULL;
+
+    uint64_t head = __atomic_load_n(&ring->rb.head, __ATOMIC_ACQUIRE);
+    if (size > ring->rb.capacity - (ring->rb.tail - head) &&
+        level >= LOG_LEVEL_ERROR)
+    {
+        logger_flush();
+        head = __atomic_load_n(&ring->rb.head, __ATOMIC_ACQUIRE);
+    }
+    if (size > ring->rb.capacity - (ring->rb.tail - head))
+    {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        errno = saved_errno;
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    /* mirrored mapping keeps record contiguous across end of ring */
+    uint8_t* out = ring_buffer_write_ptr(&ring->rb);
+    *(logger_record_t*)out = (logger_record_t){
+        .timestamp_ns =
+            (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec,
+        .file = file,
+        .fmt = fmt,
+        .line = line,
+        .level = (uint16_t)level,
+        .arg_count = (uint16_t)arg_count,
+        .size = (uint32_t)size,
+    };
+    log_arg_t* stored = (log_arg_t*)(out + sizeof(logger_record_t));
+    uint8_t* strings = (uint8_t*)(stored + arg_count);
+    for (uint32_t i = 0; i < arg_count; i++)
+    {
+        stored[i] = args[i];
+        if (args[i].kind == LOG_ARG_STR && args[i].s == NULL)
+        {
+            stored[i] = log_arg_ptr(NULL);
+        }
+        else if (args[i].kind == LOG_ARG_STR)
+        {
+            stored[i].u = lengths[i];
+            memcpy(strings, args[i].s, lengths[i]);
+            strings += lengths[i];
+        }
+    }
+    __atomic_store_n(&ring->rb.tail, ring->rb.tail + size, __ATOMIC_RELEASE);
+    /* error is often last record before abort, it must not wait for thread */
+    if (level >= LOG_LEVEL_ERROR)
+    {
+        logger_flush();
+    }
+    errno = saved_errno;
+}
+
+static void* logger_thread(void* arg)
+{
+    (void)arg;
+    struct timespec idle = {.tv_nsec = LOGGER_IDLE_NS};
+    while (logger.th_run)
+    {
+        pthread_mutex_lock(&logger.lock);
+        uint32_t count = logger_drain();
+        pthread_mutex_unlock(&logger.lock);
+        if (count == 0)
+        {
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+void logger_flush(void)
+{
+    pthread_mutex_lock(&logger.lock);
+    logger_drain();
+    pthread_mutex_unlock(&logger.lock);
+}
+
+/* caller holds logger lock, records of all threads are merged by time */
+static uint32_t logger_drain(void)
+{
+    uint32_t count = 0;
+    while (1)
+    {
+        logger_ring_t* oldest = NULL;
+        const logger_record_t* record = NULL;
+        for (logger_ring_t* ring = logger.rings; ring; ring = ring->next)
+        {
+            uint64_t tail = __atomic_load_n(&ring->rb.tail, __ATOMIC_ACQUIRE);
+            if (tail == ring->rb.head)
+            {
+                continue;
+            }
+            const logger_record_t* next =
+                (const logger_record_t*)ring_buffer_read_ptr(&ring->rb);
+            if (record == NULL || next->timestamp_ns < record->timestamp_ns)
+            {
+                oldest = ring;
+                record = next;
+            }
+        }
+        if (oldest == NULL)
+        {
+            break;
+        }
+        logger_emit(record);
+        __atomic_store_n(&oldest->rb.head, oldest->rb.head + record->size,
+                         __ATOMIC_RELEASE);
+        count++;
+    }
+
+    logger_ring_t** link = &logger.rings;
+    while (*link)
+    {
+        logger_ring_t* ring = *link;
+        uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != ring->reported)
+        {
+            char line[128];
+            int32_t length =
+                snprintf(line, sizeof(line),
+                         "%slogger  --  dropped %lu records of full ring\n",
+                         logger_levels[LOG_LEVEL_WARNING],
+                         dropped - ring->reported);
+            logger_put(logger.out, LOGGER_OUTPUT_SIZE, &logger.out_used, line,
+                       (uint32_t)length);
+            ring->reported = dropped;
+        }
+        /* ring is freed once its exited thread cannot add to it */
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&ring->rb.tail, __ATOMIC_ACQUIRE) ==
+                ring->rb.head)
+        {
+            *link = ring->next;
+            ring_buffer_destroy(&ring->rb);
+            free(ring);
+            continue;
+        }
+        link = &ring->next;
+    }
+    logger_output_flush();
+    return count;
+}
+
+static void logger_output_flush(void)
+{
+    uint32_t done = 0;
+    while (done < logger.out_used)
+    {
+        ssize_t n = write(STDERR_FILENO, logger.out + done,
+                          logger.out_used - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        done += (uint32_t)n;
+    }
+    logger.out_used = 0;
+}
+
+static void logger_emit(const logger_record_t record[static 1])
+{
+    log_arg_t args[LOG_MAX_ARGS];
+    uint32_t lengths[LOG_MAX_ARGS];
+    const log_arg_t* stored = (const log_arg_t*)(record + 1);
+    const char* strings = (const char*)(stored + record->arg_count);
+    for (uint32_t i = 0; i < record->arg_count; i++)
+    {
+        args[i] = stored[i];
+        lengths[i] = 0;
+        if (args[i].kind == LOG_ARG_STR)
+        {
+            lengths[i] = (uint32_t)stored[i].u;
+            args[i].s = strings;
+            strings += lengths[i];
+        }
+    }
+    if (logger.out_used + LOGGER_LINE_MAX > LOGGER_OUTPUT_SIZE)
+    {
+        logger_output_flush();
+    }
+    logger.out_used += logger_format_line(
+        logger.out + logger.out_used, LOGGER_LINE_MAX, record->level,
+        record->file, record->line, record->fmt, args, lengths,
+        record->arg_count);
+}
+
+static void logger_write_direct(uint32_t level, const char* file,
+                                uint32_t line, const char* fmt,
+                                const log_arg_t* args, uint32_t arg_count)
+{
+    uint32_t lengths[LOG_MAX_ARGS];
+    arg_count = arg_count < LOG_MAX_ARGS ? arg_count : LOG_MAX_ARGS;
+    for (uint32_t i = 0; i < arg_count; i++)
+    {
+        lengths[i] = args[i].kind == LOG_ARG_STR && args[i].s != NULL
+                         ? (uint32_t)strnlen(args[i].s, LOGGER_LINE_MAX)
+                         : 0;
+    }
+    char out[LOGGER_LINE_MAX];
+    uint32_t length = logger_format_line(out, sizeof(out), level, file, line,
+                                         fmt, args, lengths, arg_count);
+    if (write(STDERR_FILENO, out, length) < 0)
+    {
+        /* nowhere to report it */
+    }
+}
+
+static uint32_t logger_format_line(char* out, uint32_t cap, uint32_t level,
+                                   const char* file, uint32_t line,
+                                   const char* fmt, const log_arg_t* args,
+                                   const uint32_t* lengths, uint32_t arg_count)
+{
+    const log_arg_t prefix_args[] = {
+        log_arg_str(logger_levels[level <= LOG_LEVEL_ERROR ? level
+                                                           : LOG_LEVEL_ERROR]),
+        log_arg_str(file),
+        log_arg_u64(line),
+    };
+    const uint32_t prefix_lengths[] = {
+        (uint32_t)strlen(prefix_args[0].s),
+        (uint32_t)strlen(file),
+        0,
+    };
+    uint32_t used = logger_format(out, cap, "%s %s:%u  --  ", prefix_args,
+                                  prefix_lengths, 3);
+    return used + logger_format(out + used, cap - used, fmt, args, lengths,
+                                arg_count);
+}
+
+static void logger_put(char* out, uint32_t cap, uint32_t used[static 1],
+                       const char* text, uint32_t length)
+{
+    length = length < cap - *used ? length : cap - *used;
+    memcpy(out + *used, text, length);
+    *used += length;
+}
+
+static void logger_pad(char* out, uint32_t cap, uint32_t used[static 1],
+                       char c, uint32_t count)
+{
+    count = count < cap - *used ? count : cap - *used;
+    memset(out + *used, c, count);
+    *used += count;
+}
+
+/* writes digits backwards ending before end, returns their count */
+static uint32_t logger_digits(char* end, uint64_t value, uint32_t base,
+                              int32_t upper)
+{
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    uint32_t count = 0;
+    do
+    {
+        *--end = digits[value % base];
+        value /= base;
+        count++;
+    } while (value != 0);
+    return count;
+}
+
+/*
+ * Subset of printf used by log calls: flags '-', '0' and '#', width, precision,
+ * '*' for both, any length modifier and conversions d i u x X o c s p f e g.
+ * Length modifiers are ignored, every argument carries its own type.
+ */
+static uint32_t logger_format(char* out, uint32_t cap, const char* fmt,
+                              const log_arg_t* args, const uint32_t* lengths,
+                              uint32_t arg_count)
+{
+    uint32_t used = 0;
+    uint32_t next = 0;
+    for (const char* p = fmt; *p != '\0' && used < cap; p++)
+    {
+        if (*p != '%' || p[1] == '%')
+        {
+            p += *p == '%';
+            out[used++] = *p;
+            continue;
+        }
+        int32_t left = 0;
+        int32_t zero = 0;
+        int32_t alternate = 0;
+        uint32_t width = 0;
+        int32_t precision = -1;
+        for (p++; *p == '-' || *p == '0' || *p == '+' || *p == ' ' || *p == '#';
+             p++)
+        {
+            left |= *p == '-';
+            zero |= *p == '0';
+            alternate |= *p == '#';
+        }
+        if (*p == '*')
+        {
+            width = next < arg_count ? (uint32_t)args[next++].i : 0;
+            p++;
+        }
+        for (; *p >= '0' && *p <= '9'; p++)
+        {
+            width = width * 10 + (uint32_t)(*p - '0');
+        }
+        if (*p == '.')
+        {
+            precision = 0;
+            if (*++p == '*')
+            {
+                precision = next < arg_count ? (int32_t)args[next++].i : 0;
+                p++;
+            }
+            for (; *p >= '0' && *p <= '9'; p++)
+            {
+                precision = precision * 10 + (*p - '0');
+            }
+        }
+        while (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'q' || *p == 'j' ||
+               *p == 'z' || *p == 't')
+        {
+            p++;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+
+        char buffer[72];
+        char* end = buffer + sizeof(buffer);
+        const char* text = end;
+        uint32_t length = 0;
+        const char* sign = "";
+        const log_arg_t* arg = next < arg_count ? &args[next] : NULL;
+        uint32_t arg_length = next < arg_count ? lengths[next] : 0;
+        next++;
+        int32_t numeric = 1;
+        if (arg == NULL)
+        {
+            text = "(missing)";
+            length = 9;
+            numeric = 0;
+        }
+        else if (*p == 'd' || *p == 'i')
+        {
+            int64_t value = arg->kind == LOG_ARG_F64 ? (int64_t)arg->d : arg->i;
+            uint64_t magnitude =
+                value < 0 ? (uint64_t)(-(value + 1)) + 1 : (uint64_t)value;
+            sign = value < 0 ? "-" : "";
+            length = logger_digits(end, magnitude, 10, 0);
+            text = end - length;
+        }
+        else if (*p == 'u' || *p == 'x' || *p == 'X' || *p == 'o')
+        {
+            uint64_t value =
+                arg->kind == LOG_ARG_F64 ? (uint64_t)arg->d : arg->u;
+            uint32_t base = *p == 'u' ? 10 : *p == 'o' ? 8 : 16;
+            length = logger_digits(end, value, base, *p == 'X');
+            text = end - length;
+            if (alternate && value != 0)
+            {
+                sign = *p == 'o' ? "0" : *p == 'x' ? "0x" : "0X";
+            }
+        }
+        else if (*p == 'p')
+        {
+            length = logger_digits(end, arg->u, 16, 0);
+            text = end - length;
+            sign = "0x";
+        }
+        else if (*p == 'c')
+        {
+            buffer[0] = (char)arg->i;
+            text = buffer;
+            length = 1;
+            numeric = 0;
+        }
+        else if (*p == 's')
+        {
+            text = arg->kind == LOG_ARG_STR ? arg->s : "(null)";
+            length = arg->kind == LOG_ARG_STR ? arg_length : 6;
+            if (precision >= 0 && (uint32_t)precision < length)
+            {
+                length = (uint32_t)precision;
+            }
+            numeric = 0;
+        }
+        else if (*p == 'f' || *p == 'F' || *p == 'e' || *p == 'E' ||
+                 *p == 'g' || *p == 'G')
+        {
+            double value = arg->kind == LOG_ARG_F64   ? arg->d
+                           : arg->kind == LOG_ARG_I64 ? (double)arg->i
+                                                      : (double)arg->u;
+            int32_t digits = precision >= 0 ? precision : 6;
+            int32_t n = *p == 'f' || *p == 'F'
+                            ? snprintf(buffer, sizeof(buffer), "%.*f", digits,
+                                       value)
+                        : *p == 'e' || *p == 'E'
+                            ? snprintf(buffer, sizeof(buffer), "%.*e", digits,
+                                       value)
+                            : snprintf(buffer, sizeof(buffer), "%.*g", digits,
+                                       value);
+            text = buffer;
+            length = n < (int32_t)sizeof(buffer) ? (uint32_t)n
+                                                 : sizeof(buffer) - 1;
+            numeric = 0;
+        }
+        else
+        {
+            text = p - 1;
+            length = 2;
+            numeric = 0;
+        }
+
+        /* precision of integer is minimal number of digits */
+        uint32_t zeros = 0;
+        if (numeric && precision >= 0 && (uint32_t)precision > length)
+        {
+            zeros = (uint32_t)precision - length;
+        }
+        uint32_t total = (uint32_t)strlen(sign) + zeros + length;
+        uint32_t fill = width > total ? width - total : 0;
+        if (numeric && zero && !left && precision < 0)
+        {
+            zeros += fill;
+            fill = 0;
+        }
+        if (!left)
+        {
+            logger_pad(out, cap, &used, ' ', fill);
+        }
+        logger_put(out, cap, &used, sign, (uint32_t)strlen(sign));
+        logger_pad(out, cap, &used, '0', zeros);
+        logger_put(out, cap, &used, text, length);
+        if (left)
+        {
+            logger_pad(out, cap, &used, ' ', fill);
+        }
+        used = used < cap ? used : cap;
+    }
+    return used;
+}
@@ -0,0 +1,684 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "membership.h"
+#include "checksum.h"
+#include "err_codes.h"
+#include "logger.h"
+#include "protocol.h"
+#include "wire.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+
+/* suspect is declared dead after this many periods times log2(n) */
+#define MEMBERSHIP_SUSPECT_PERIODS 3
+/* every state change is piggybacked this many times log2(n) */
+#define MEMBERSHIP_GOSSIP_FACTOR 3
+/* dead member is remembered this many suspicion timeouts */
+#define MEMBERSHIP_DEAD_RETENTION 4
+#define MEMBERSHIP_INITIAL_CAPACITY 16
+/* checksum is last field of header */
+#define MEMBERSHIP_CHECKSUM_OFFSET (MEMBERSHIP_HEADER_SIZE - CHECKSUM_SIZE)
+
+_Static_assert(MEMBERSHIP_MAX_PACKET <= UDP_BATCH_PACKET_SIZE,
+               "membership packet does not fit udp batch");
+_Static_assert(MEMBERSHIP_HEADER_SIZE == WIRE_FIXED_SIZE(membership) &&
+                   MEMBERSHIP_UPDATE_SIZE == WIRE_FIXED_SIZE(member_update),
+               "membership sizes do not match wire schema");
+
+static uint32_t membership_log2(uint32_t n);
+static uint32_t membership_checksum(const uint8_t* packet, uint32_t length);
+static uint64_t membership_random(membership_t membership[static 1]);
+static uint32_t membership_next_seq(membership_t membership[static 1]);
+static uint64_t membership_suspect_timeout(membership_t membership[static 1]);
+static int32_t membership_is_self(membership_t membership[static 1],
+                                  struct in_addr ip, uint16_t udp_port);
+static member_t* membership_find(membership_t membership[static 1],
+                                 const struct sockaddr_in addr[static 1]);
+static member_t* membership_add(membership_t membership[static 1],
+                                const struct sockaddr_in addr[static 1],
+                                uint16_t tcp_port);
+static void membership_set_state(membership_t membership[static 1],
+                                 member_t member[static 1], uint8_t state,
+                                 uint32_t incarnation, uint64_t now_ms);
+static int32_t membership_apply(membership_t membership[static 1],
+                                uint8_t state,
+                                const struct sockaddr_in addr[static 1],
+                                uint16_t tcp_port, uint32_t incarnation,
+                                uint64_t now_ms);
+static void membership_put_update(uint8_t* out,
+                                  const member_t member[static 1]);
+static void membership_send(membership_t membership[static 1], uint8_t type,
+                            uint32_t seq,
+                            const struct sockaddr_in to[static 1],
+                            const member_t* target);
+static void membership_relay(membership_t membership[static 1],
+                             const struct sockaddr_in requester[static 1],
+                             uint32_t requester_seq,
+                             const struct sockaddr_in target[static 1],
+                             uint64_t now_ms);
+static void membership_ack(membership_t membership[static 1], uint32_t seq);
+static void membership_probe(membership_t membership[static 1],
+                             uint64_t now_ms);
+static void membership_probe_indirect(membership_t membership[static 1]);
+static void membership_expire(membership_t membership[static 1],
+                              uint64_t now_ms);
+
+/* ceil(log2(n)), at least 1 */
+static uint32_t membership_log2(uint32_t n)
+{
+    uint32_t log = 1;
+    while (log < 32 && (1U << log) < n)
+    {
+        log++;
+    }
+    return log;
+}
+
+static uint32_t membership_checksum(const uint8_t* packet, uint32_t length)
+{
+    uint32_t crc = crc32c(0, packet, MEMBERSHIP_CHECKSUM_OFFSET);
+    return crc32c(crc, packet + MEMBERSHIP_HEADER_SIZE,
+                  length - MEMBERSHIP_HEADER_SIZE);
+}
+
+static uint64_t membership_random(membership_t membership[static 1])
+{
+    membership->rng ^= membership->rng << 13;
+    membership->rng ^= membership->rng >> 7;
+    membership->rng ^= membership->rng << 17;
+    return membership->rng;
+}
+
+/* zero marks missing probe and free relay slot */
+static uint32_t membership_next_seq(membership_t membership[static 1])
+{
+    if (++membership->seq == 0)
+    {
+        membership->seq = 1;
+    }
+    return membership->seq;
+}
+
+static uint64_t membership_suspect_timeout(membership_t membership[static 1])
+{
+    return (uint64_t)MEMBERSHIP_SUSPECT_PERIODS * membership->period_ms *
+           membership_log2(membership->live_count + 1);
+}
+
+/* other nodes of the same host differ by port */
+static int32_t membership_is_self(membership_t membership[static 1],
+                                  struct in_addr ip, uint16_t udp_port)
+{
+    return udp_port == membership->udp_port &&
+           (ip.s_addr == htonl(INADDR_LOOPBACK) ||
+            ip.s_addr == membership->local_ip.s_addr);
+}
+
+err_t membership_init(membership_t membership[static 1], int32_t fd,
+                      struct in_addr local_ip, uint16_t udp_port,
+                      uint16_t tcp_port, uint32_t period_ms,
+                      membership_event_fn on_event, void* ctx)
+{
+    *membership = (membership_t){
+        .members =
+            calloc(MEMBERSHIP_INITIAL_CAPACITY, sizeof(*membership->members)),
+        .capacity = MEMBERSHIP_INITIAL_CAPACITY,
+        .period_ms = period_ms ? period_ms : MEMBERSHIP_DEFAULT_PERIOD_MS,
+        .local_ip = local_ip,
+        .fd = fd,
+        .udp_port = udp_port,
+        .tcp_port = tcp_port,
+        .on_event = on_event,
+        .ctx = ctx,
+        .tx = udp_batch_create(),
+    };
+    if (membership->members == NULL || membership->tx == NULL)
+    {
+        membership_destroy(membership);
+        return DISFS_ERR_ALLOC;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    membership->rng = ((uint64_t)ts.tv_nsec << 16) ^ udp_port ^
+                      ((uint64_t)tcp_port << 48) ^ (uint64_t)ts.tv_sec;
+    membership->rng |= 1;
+    return DISFS_SUCCESS;
+}
+
+void membership_destroy(membership_t membership[static 1])
+{
+    free(membership->members);
+    udp_batch_free(membership->tx);
+    *membership = (membership_t){};
+}
+
+static member_t* membership_find(membership_t membership[static 1],
+                                 const struct sockaddr_in addr[static 1])
+{
+    for (uint32_t i = 0; i < membership->count; i++)
+    {
+        member_t* member = &membership->members[i];
+        if (member->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            member->addr.sin_port == addr->sin_port)
+        {
+            return member;
+        }
+    }
+    return NULL;
+}
+
+/* new member is dead until membership_set_state brings it to life */
+static member_t* membership_add(membership_t membership[static 1],
+                                const struct sockaddr_in addr[static 1],
+                                uint16_t tcp_port)
+{
+    if (membership->count == membership->capacity)
+    {
+        uint32_t capacity = membership->capacity * 2;
+        member_t* members =
+            realloc(membership->members, capacity * sizeof(*members));
+        if (members == NULL)
+        {
+            LOG_ERROR("Cannot grow membership to %u members\n", capacity);
+            return NULL;
+        }
+        membership->members = members;
+        membership->capacity = capacity;
+    }
+    member_t* member = &membership->members[membership->count++];
+    *member = (member_t){.addr = *addr,
+                         .tcp_port = tcp_port,
+                         .state = MEMBER_DEAD};
+    member->addr.sin_family = AF_INET;
+    return member;
+}
+
+static void membership_set_state(membership_t membership[static 1],
+                                 member_t member[static 1], uint8_t state,
+                                 uint32_t incarnation, uint64_t now_ms)
+{
+    uint8_t previous = member->state;
+    member->state = state;
+    member->incarnation = incarnation;
+    if (previous == MEMBER_DEAD && state != MEMBER_DEAD)
+    {
+        __atomic_store_n(&membership->live_count, membership->live_count + 1,
+                         __ATOMIC_RELAXED);
+    }
+    else if (previous != MEMBER_DEAD && state == MEMBER_DEAD)
+    {
+        __atomic_store_n(&membership->live_count, membership->live_count - 1,
+                         __ATOMIC_RELAXED);
+    }
+    member->state_ms = state == MEMBER_SUSPECT
+                           ? now_ms + membership_suspect_timeout(membership)
+                           : now_ms;
+    uint32_t live = membership->live_count;
+    member->gossip_left =
+        (uint8_t)(MEMBERSHIP_GOSSIP_FACTOR * membership_log2(live + 1));
+
+    char ip[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &member->addr.sin_addr, ip, sizeof(ip));
+    LOG_DEBUG("Member %s:%u is %s, incarnation %u\n", ip,
+              ntohs(member->addr.sin_port),
+              state == MEMBER_ALIVE     ? "alive"
+              : state == MEMBER_SUSPECT ? "suspect"
+                                        : "dead",
+              incarnation);
+    if (membership->on_event &&
+        (previous == MEMBER_DEAD) != (state == MEMBER_DEAD))
+    {
+        membership->on_event(membership->ctx, member);
+    }
+}
+
+/*
+ * Higher incarnation always wins. With equal incarnation suspect overrides
+ * alive and dead overrides both, so only member itself can clear suspicion.
+ * Returns 1 when update refuted suspicion of this node.
+ */
+static int32_t membership_apply(membership_t membership[static 1],
+                                uint8_t state,
+                                const struct sockaddr_in addr[static 1],
+                                uint16_t tcp_port, uint32_t incarnation,
+                                uint64_t now_ms)
+{
+    if (membership_is_self(membership, addr->sin_addr,
+                           ntohs(addr->sin_port)))
+    {
+        if (state == MEMBER_ALIVE || incarnation < membership->incarnation)
+        {
+            return 0;
+        }
+        membership->incarnation = incarnation + 1;
+        LOG_INFO("Refuting suspicion with incarnation %u\n",
+                 membership->incarnation);
+        return 1;
+    }
+    member_t* member = membership_find(membership, addr);
+    if (member == NULL)
+    {
+        /* unknown node is learned only from news that it lives */
+        if (state == MEMBER_DEAD)
+        {
+            return 0;
+        }
+        member = membership_add(membership, addr, tcp_port);
+        if (member == NULL)
+        {
+            return 0;
+        }
+        membership_set_state(membership, member, state, incarnation, now_ms);
+        return 0;
+    }
+    int32_t newer = incarnation > member->incarnation;
+    int32_t same = incarnation == member->incarnation;
+    int32_t accepted =
+        (state == MEMBER_ALIVE && newer) ||
+        (state == MEMBER_SUSPECT &&
+         (newer || (same && member->state == MEMBER_ALIVE))) ||
+        (state == MEMBER_DEAD && member->state != MEMBER_DEAD &&
+         (newer || same));
+    if (!accepted)
+    {
+        return 0;
+    }
+    member->tcp_port = tcp_port;
+    membership_set_state(membership, member, state, incarnation, now_ms);
+    return 0;
+}
+
+static void membership_put_update(uint8_t* out,
+                                  const member_t member[static 1])
+{
+    wire_member_update_t update = {
+        .state = member->state,
+        .udp_port = ntohs(member->addr.sin_port),
+        .ip = {.data = (const uint8_t*)&member->addr.sin_addr.s_addr,
+               .length = 4},
+        .tcp_port = member->tcp_port,
+        .incarnation = member->incarnation,
+    };
+    uint64_t length;
+    wire_member_update_encode(&update, out, MEMBERSHIP_UPDATE_SIZE, &length);
+}
+
+/*
+ * Packet is WIRE_MEMBERSHIP header followed by WIRE_MEMBER_UPDATE entries,
+ * sequence matches ack with its ping, target is set for ping-req only.
+ *
+ * Update about receiver itself goes first whenever receiver is not alive to
+ * us, so it learns about suspicion from the first packet and can refute it.
+ */
+static void membership_send(membership_t membership[static 1], uint8_t type,
+                            uint32_t seq,
+                            const struct sockaddr_in to[static 1],
+                            const member_t* target)
+{
+    uint8_t* packet = udp_batch_prepare(membership->tx, to);
+    if (packet == NULL)
+    {
+        membership_flush(membership);
+        packet = udp_batch_prepare(membership->tx, to);
+    }
+
+    /* updates are encoded in place, header follows once their count is known */
+    uint32_t updates = 0;
+    uint8_t* out = packet + MEMBERSHIP_HEADER_SIZE;
+    const member_t* receiver = membership_find(membership, to);
+    if (receiver && receiver->state != MEMBER_ALIVE)
+    {
+        membership_put_update(out, receiver);
+        updates++;
+    }
+    /* fresh changes are spread round robin over members with gossip left */
+    for (uint32_t i = 0;
+         i < membership->count && updates < MEMBERSHIP_MAX_UPDATES; i++)
+    {
+        uint32_t index = (membership->gossip_cursor + i) % membership->count;
+        member_t* member = &membership->members[index];
+        if (member->gossip_left == 0 || member == receiver)
+        {
+            continue;
+        }
+        member->gossip_left--;
+        membership_put_update(out + updates * MEMBERSHIP_UPDATE_SIZE, member);
+        updates++;
+        membership->gossip_cursor = index + 1;
+    }
+
+    wire_membership_t header = {
+        .tcp_port = membership->tcp_port,
+        .magic = MEMBERSHIP_MAGIC,
+        .type = type,
+        .update_count = updates,
+        .seq = seq,
+        .incarnation = membership->incarnation,
+    };
+    if (target)
+    {
+        header.target_ip = (wire_blob_t){
+            .data = (const uint8_t*)&target->addr.sin_addr.s_addr,
+            .length = 4};
+        header.target_udp_port = ntohs(target->addr.sin_port);
+        header.target_tcp_port = target->tcp_port;
+    }
+    uint64_t length;
+    wire_membership_encode(&header, packet, MEMBERSHIP_HEADER_SIZE, &length);
+    length = MEMBERSHIP_HEADER_SIZE + updates * MEMBERSHIP_UPDATE_SIZE;
+    proto_put_u32(packet + MEMBERSHIP_CHECKSUM_OFFSET,
+                  membership_checksum(packet, (uint32_t)length));
+
+    udp_batch_commit(membership->tx, (uint32_t)length);
+}
+
+void membership_flush(membership_t membership[static 1])
+{
+    if (membership->tx->count > 0)
+    {
+        udp_batch_send(membership->tx, membership->fd);
+    }
+}
+
+int32_t membership_is_packet(const uint8_t* data, uint32_t length)
+{
+    return length >= MEMBERSHIP_HEADER_SIZE &&
+           proto_get_u32(data + 4) == MEMBERSHIP_MAGIC;
+}
+
+void membership_join(membership_t membership[static 1],
+                     const struct sockaddr_in addr[static 1], uint16_t tcp_port,
+                     uint64_t now_ms)
+{
+    if (membership_is_self(membership, addr->sin_addr, ntohs(addr->sin_port)))
+    {
+        return;
+    }
+    member_t* member = membership_find(membership, addr);
+    if (member == NULL)
+    {
+        member = membership_add(membership, addr, tcp_port);
+        if (member == NULL)
+        {
+            return;
+        }
+        membership_set_state(membership, member, MEMBER_ALIVE, 0, now_ms);
+    }
+    else if (member->state != MEMBER_DEAD)
+    {
+        return;
+    }
+    /*
+       introduce ourselves at once, restarted member which we believe dead is
+       told so by this ping and comes back by refuting it
+     */
+    membership_send(membership, MEMBERSHIP_MSG_PING, 0, addr, NULL);
+}
+
+void membership_receive(membership_t membership[static 1], const uint8_t* data,
+                        uint32_t length,
+                        const struct sockaddr_in from[static 1],
+                        uint64_t now_ms)
+{
+    if (!membership_is_packet(data, length))
+    {
+        return;
+    }
+    wire_membership_t header;
+    if (wire_membership_decode(&header, data, length) != DISFS_SUCCESS ||
+        header.updates.length < header.update_count * MEMBERSHIP_UPDATE_SIZE)
+    {
+        LOG_WARNING("Truncated membership packet of %u bytes\n", length);
+        return;
+    }
+    if (membership_checksum(data, length) != header.checksum)
+    {
+        LOG_WARNING("Membership packet with wrong checksum\n");
+        return;
+    }
+    uint32_t seq = (uint32_t)header.seq;
+
+    /* packet itself is proof that sender lives */
+    membership_apply(membership, MEMBER_ALIVE, from,
+                     (uint16_t)header.tcp_port, (uint32_t)header.incarnation,
+                     now_ms);
+    int32_t refuted = 0;
+    const uint8_t* next = header.updates.data;
+    for (uint32_t i = 0; i < header.update_count; i++)
+    {
+        wire_member_update_t update;
+        uint64_t consumed;
+        wire_decode(&wire_member_update_schema, &update, next,
+                    MEMBERSHIP_UPDATE_SIZE, &consumed);
+        next += consumed;
+        if (update.state > MEMBER_DEAD)
+        {
+            continue;
+        }
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons((uint16_t)update.udp_port),
+        };
+        memcpy(&addr.sin_addr.s_addr, update.ip.data, 4);
+        refuted |= membership_apply(membership, (uint8_t)update.state, &addr,
+                                    (uint16_t)update.tcp_port,
+                                    (uint32_t)update.incarnation, now_ms);
+    }
+
+    if (header.type == MEMBERSHIP_MSG_PING)
+    {
+        membership_send(membership, MEMBERSHIP_MSG_ACK, seq, from, NULL);
+        return;
+    }
+    if (header.type == MEMBERSHIP_MSG_PING_REQ)
+    {
+        struct sockaddr_in target = {
+            .sin_family = AF_INET,
+            .sin_port = htons((uint16_t)header.target_udp_port)};
+        memcpy(&target.sin_addr.s_addr, header.target_ip.data, 4);
+        membership_relay(membership, from, seq, &target, now_ms);
+    }
+    else if (header.type == MEMBERSHIP_MSG_ACK)
+    {
+        membership_ack(membership, seq);
+    }
+    /* sender did not get answer carrying our new incarnation */
+    if (refuted)
+    {
+        membership_send(membership, MEMBERSHIP_MSG_PING, 0, from, NULL);
+    }
+}
+
+static void membership_relay(membership_t membership[static 1],
+                             const struct sockaddr_in requester[static 1],
+                             uint32_t requester_seq,
+                             const struct sockaddr_in target[static 1],
+                             uint64_t now_ms)
+{
+    membership_relay_t* slot = NULL;
+    for (uint32_t i = 0; i < MEMBERSHIP_RELAY_SLOTS && slot == NULL; i++)
+    {
+        membership_relay_t* relay = &membership->relays[i];
+        if (relay->seq == 0 || relay->expire_ms <= now_ms)
+        {
+            slot = relay;
+        }
+    }
+    if (slot == NULL)
+    {
+        LOG_DEBUG("All membership relay slots are busy\n");
+        return;
+    }
+    *slot = (membership_relay_t){.requester = *requester,
+                                 .expire_ms = now_ms + membership->period_ms,
+                                 .requester_seq = requester_seq,
+                                 .seq = membership_next_seq(membership)};
+    membership_send(membership, MEMBERSHIP_MSG_PING, slot->seq, target, NULL);
+}
+
+static void membership_ack(membership_t membership[static 1], uint32_t seq)
+{
+    if (seq == 0)
+    {
+        return;
+    }
+    if (seq == membership->probe_seq)
+    {
+        membership->probe_seq = 0;
+        return;
+    }
+    for (uint32_t i = 0; i < MEMBERSHIP_RELAY_SLOTS; i++)
+    {
+        membership_relay_t* relay = &membership->relays[i];
+        if (relay->seq == seq)
+        {
+            relay->seq = 0;
+            membership_send(membership, MEMBERSHIP_MSG_ACK,
+                            relay->requester_seq, &relay->requester, NULL);
+            return;
+        }
+    }
+}
+
+/*
+ * Members are probed in round robin over list shuffled before every pass, so
+ * failed member is probed within two passes whatever random choices are.
+ */
+static void membership_probe(membership_t membership[static 1],
+                             uint64_t now_ms)
+{
+    for (uint32_t tries = 0; tries < membership->count; tries++)
+    {
+        if (membership->probe_index >= membership->count)
+        {
+            membership->probe_index = 0;
+            for (uint32_t i = membership->count - 1; i > 0; i--)
+            {
+                uint32_t j =
+                    (uint32_t)(membership_random(membership) % (i + 1));
+                member_t tmp = membership->members[i];
+                membership->members[i] = membership->members[j];
+                membership->members[j] = tmp;
+            }
+        }
+        member_t* member = &membership->members[membership->probe_index++];
+        if (member->state == MEMBER_DEAD)
+        {
+            continue;
+        }
+        membership->probe_addr = member->addr;
+        membership->probe_ms = now_ms;
+        membership->probe_seq = membership_next_seq(membership);
+        membership->probe_indirect = 0;
+        membership_send(membership, MEMBERSHIP_MSG_PING, membership->probe_seq,
+                        &member->addr, NULL);
+        return;
+    }
+}
+
+static void membership_probe_indirect(membership_t membership[static 1])
+{
+    membership->probe_indirect = 1;
+    member_t* target = membership_find(membership, &membership->probe_addr);
+    if (target == NULL || membership->count < 2)
+    {
+        return;
+    }
+    uint32_t start = (uint32_t)(membership_random(membership) %
+                                membership->count);
+    uint32_t sent = 0;
+    for (uint32_t i = 0;
+         i < membership->count && sent < MEMBERSHIP_INDIRECT_PROBES; i++)
+    {
+        member_t* member =
+            &membership->members[(start + i) % membership->count];
+        if (member == target || member->state != MEMBER_ALIVE)
+        {
+            continue;
+        }
+        membership_send(membership, MEMBERSHIP_MSG_PING_REQ,
+                        membership->probe_seq, &member->addr, target);
+        sent++;
+    }
+}
+
+static void membership_expire(membership_t membership[static 1],
+                              uint64_t now_ms)
+{
+    uint64_t retention =
+        MEMBERSHIP_DEAD_RETENTION * membership_suspect_timeout(membership);
+    for (uint32_t i = 0; i < membership->count;)
+    {
+        member_t* member = &membership->members[i];
+        if (member->state == MEMBER_SUSPECT && member->state_ms <= now_ms)
+        {
+            membership_set_state(membership, member, MEMBER_DEAD,
+                                 member->incarnation, now_ms);
+        }
+        else if (member->state == MEMBER_DEAD &&
+                 member->state_ms + retention <= now_ms)
+        {
+            *member = membership->members[--membership->count];
+            continue;
+        }
+        i++;
+    }
+}
+
+uint64_t membership_tick(membership_t membership[static 1], uint64_t now_ms)
+{
+    if (membership->probe_seq != 0)
+    {
+        uint64_t direct_timeout = membership->period_ms * 2 / 5;
+        if (!membership->probe_indirect &&
+            now_ms >= membership->probe_ms + direct_timeout)
+        {
+            membership_probe_indirect(membership);
+        }
+        if (now_ms >= membership->probe_ms + membership->period_ms)
+        {
+            membership->probe_seq = 0;
+            member_t* target =
+                membership_find(membership, &membership->probe_addr);
+            if (target && target->state == MEMBER_ALIVE)
+            {
+                membership_set_state(membership, target, MEMBER_SUSPECT,
+                                     target->incarnation, now_ms);
+            }
+        }
+    }
+    membership_expire(membership, now_ms);
+    if (now_ms >= membership->next_probe_ms)
+    {
+        membership->next_probe_ms = now_ms + membership->period_ms;
+        membership_probe(membership, now_ms);
+    }
+
+    uint64_t next = membership->next_probe_ms;
+    if (membership->probe_seq != 0 && !membership->probe_indirect)
+    {
+        uint64_t indirect =
+            membership->probe_ms + membership->period_ms * 2 / 5;
+        next = indirect < next ? indirect : next;
+    }
+    for (uint32_t i = 0; i < membership->count; i++)
+    {
+        const member_t* member = &membership->members[i];
+        if (member->state == MEMBER_SUSPECT && member->state_ms < next)
+        {
+            next = member->state_ms;
+        }
+    }
+    membership_flush(membership);
+    return next;
+}
+
+uint32_t membership_live_count(membership_t membership[static 1])
+{
+    return __atomic_load_n(&membership->live_count, __ATOMIC_RELAXED);
+}
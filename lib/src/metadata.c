@@ -0,0 +1,2156 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "metadata.h"
+#include "buf_pool.h"
+#include "connection.h"
+#include "erasure.h"
+#include "err_codes.h"
+#include "hash_ring.h"
+#include "logger.h"
+#include "protocol.h"
+#include "wire.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define META_WAL_NAME "meta.wal"
+/* log started by snapshot, replaces META_WAL_NAME once snapshot is durable */
+#define META_WAL_NEXT_NAME "meta.wal.next"
+#define META_SNAPSHOT_NAME "meta.snap"
+#define META_FILE_PATH_MAX (META_DIR_MAX + 32)
+#define META_SNAPSHOT_MAGIC 0x4E534D5346534944ULL /* "DISFSMSN" */
+#define META_SNAPSHOT_VERSION 1
+#define META_SECTIONS 4
+/* snapshot sections are mapped separately, so they start at multiple of
+ * largest page size in use */
+#define META_SECTION_ALIGN (64 * 1024)
+#define META_TABLE_MIN_RESERVE (64ULL * 1024 * 1024)
+#define META_INDEX_INITIAL_CAPACITY 1024
+#define META_INDEX_TOMBSTONE UINT32_MAX
+#define META_CHUNKS_MAX (1U << 20)
+#define META_WRITER_BUFFER_SIZE (256 * 1024)
+#define META_LIST_REPLY_MAX (64 * 1024)
+#define META_FNV_OFFSET 0xcbf29ce484222325ULL
+#define META_FNV_PRIME 0x100000001b3ULL
+
+typedef enum meta_wal_type
+{
+    META_WAL_CREATE = 1,
+    META_WAL_REMOVE = 2,
+    META_WAL_RENAME = 3,
+    META_WAL_CHUNKS = 4,
+    META_WAL_POLICY = 5,
+} meta_wal_type;
+
+/* log record header, followed by length bytes of payload */
+typedef struct meta_wal_header_t
+{
+    uint64_t lsn;
+    uint64_t checksum; /* FNV-1a of header with zero checksum and payload */
+    uint32_t length;
+    uint16_t type;
+    uint16_t _reserved;
+} meta_wal_header_t;
+
+/* followed by name */
+typedef struct meta_wal_create_t
+{
+    uint64_t mtime_ns;
+    uint32_t ino;
+    uint32_t parent;
+    uint16_t name_len;
+    uint8_t type;
+    char _padded[5];
+} meta_wal_create_t;
+
+typedef struct meta_wal_remove_t
+{
+    uint32_t ino;
+} meta_wal_remove_t;
+
+/* followed by new name */
+typedef struct meta_wal_rename_t
+{
+    uint32_t ino;
+    uint32_t parent;
+    uint16_t name_len;
+    char _padded[6];
+} meta_wal_rename_t;
+
+/* followed by count chunk hashes */
+typedef struct meta_wal_chunks_t
+{
+    uint64_t size;
+    uint64_t mtime_ns;
+    uint32_t ino;
+    uint32_t count;
+} meta_wal_chunks_t;
+
+typedef struct meta_wal_policy_t
+{
+    uint32_t ino;
+    uint8_t data_shards;
+    uint8_t parity_shards;
+    char _padded[2];
+} meta_wal_policy_t;
+
+typedef union meta_wal_record_t
+{
+    meta_wal_create_t create;
+    meta_wal_remove_t remove;
+    meta_wal_rename_t rename;
+    meta_wal_chunks_t chunks;
+    meta_wal_policy_t policy;
+} meta_wal_record_t;
+
+/* inodes, index, names and chunks sections follow at META_SECTION_ALIGN */
+typedef struct meta_snapshot_header_t
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t free_inodes;
+    uint64_t lsn;
+    uint64_t inode_count; /* records including free ones */
+    uint64_t index_capacity;
+    uint64_t index_used;
+    uint64_t names_size;
+    uint64_t chunk_count;
+    uint32_t live_inodes;
+    uint32_t _padded;
+    uint64_t _reserved[7];
+} meta_snapshot_header_t;
+
+typedef struct meta_writer_t
+{
+    uint8_t* buffer;
+    uint64_t offset; /* file offset after buffered bytes */
+    err_t error;
+    int32_t fd;
+    uint32_t used;
+} meta_writer_t;
+
+typedef struct meta_list_reply_t
+{
+    uint8_t* buffer;
+    uint32_t used;
+    uint32_t count;
+} meta_list_reply_t;
+
+static uint64_t meta_align(uint64_t value, uint64_t align);
+static uint64_t meta_fnv1a(uint64_t hash, const void* data, uint64_t length);
+static uint64_t meta_now_ns(void);
+static int32_t meta_path(const meta_t meta[static 1], const char* name,
+                         char* out, size_t size);
+static err_t meta_table_map(meta_table_t table[static 1], uint64_t reserve,
+                            int32_t fd, uint64_t offset, uint64_t length);
+static err_t meta_table_ensure(meta_table_t table[static 1], uint64_t size);
+static uint64_t meta_table_push(meta_table_t table[static 1], const void* data,
+                                uint64_t length);
+static void meta_table_release(meta_table_t table[static 1]);
+static err_t meta_table_copy(meta_table_t copy[static 1],
+                             const meta_table_t table[static 1]);
+static meta_inode_t* meta_inode(const meta_t meta[static 1], uint32_t ino);
+static uint32_t meta_inode_count(const meta_t meta[static 1]);
+static int32_t meta_is_live(const meta_t meta[static 1], uint32_t ino);
+static const char* meta_name(const meta_t meta[static 1],
+                             const meta_inode_t inode[static 1]);
+static uint32_t meta_next_ino(const meta_t meta[static 1]);
+static int32_t meta_valid_name(const char* name, uint32_t name_len);
+static uint64_t meta_entry_hash(uint32_t parent, const char* name,
+                                uint16_t name_len);
+static uint32_t meta_index_find(const meta_t meta[static 1], uint32_t parent,
+                                const char* name, uint16_t name_len);
+static int32_t meta_index_place(uint32_t* slots, uint64_t capacity,
+                                uint64_t hash, uint32_t ino);
+static void meta_index_insert(meta_t meta[static 1], uint32_t ino);
+static void meta_index_erase(meta_t meta[static 1], uint32_t ino);
+static uint64_t meta_index_fill(const meta_t meta[static 1], uint32_t* slots,
+                                uint64_t capacity);
+static err_t meta_index_reserve(meta_t meta[static 1]);
+static err_t meta_reserve(meta_t meta[static 1], uint64_t name_len,
+                          uint64_t chunk_count);
+static void meta_link(meta_t meta[static 1], uint32_t ino, uint32_t parent);
+static void meta_unlink(meta_t meta[static 1], uint32_t ino);
+static err_t meta_apply_create(meta_t meta[static 1],
+                               const meta_wal_create_t record[static 1],
+                               const uint8_t* name, uint32_t name_len,
+                               int32_t commit);
+static err_t meta_apply_remove(meta_t meta[static 1],
+                               const meta_wal_remove_t record[static 1],
+                               uint32_t tail_len, int32_t commit);
+static err_t meta_apply_rename(meta_t meta[static 1],
+                               const meta_wal_rename_t record[static 1],
+                               const uint8_t* name, uint32_t name_len,
+                               int32_t commit);
+static err_t meta_apply_chunks(meta_t meta[static 1],
+                               const meta_wal_chunks_t record[static 1],
+                               const uint8_t* hashes, uint32_t hashes_len,
+                               int32_t commit);
+static err_t meta_apply_policy(meta_t meta[static 1],
+                               const meta_wal_policy_t record[static 1],
+                               uint32_t tail_len, int32_t commit);
+static uint32_t meta_wal_head_size(uint16_t type);
+static err_t meta_execute(meta_t meta[static 1], uint16_t type,
+                          const meta_wal_record_t record[static 1],
+                          const uint8_t* tail, uint32_t tail_len,
+                          int32_t commit);
+static err_t meta_log(meta_t meta[static 1], uint16_t type,
+                      const meta_wal_record_t record[static 1],
+                      const uint8_t* tail, uint32_t tail_len);
+static err_t meta_mutate(meta_t meta[static 1], uint16_t type,
+                         const meta_wal_record_t record[static 1],
+                         const uint8_t* tail, uint32_t tail_len);
+static err_t meta_commit(meta_t meta[static 1], uint64_t lsn);
+static err_t meta_replay_record(meta_t meta[static 1], uint16_t type,
+                                const uint8_t* payload, uint32_t length);
+static err_t meta_replay(meta_t meta[static 1], int32_t fd,
+                         uint64_t valid[static 1]);
+static err_t meta_replay_rotated(meta_t meta[static 1]);
+static err_t meta_init_tables(meta_t meta[static 1]);
+static uint64_t
+meta_snapshot_layout(const meta_snapshot_header_t header[static 1],
+                     uint64_t offsets[static META_SECTIONS]);
+static err_t meta_load_snapshot(meta_t meta[static 1], const char* path);
+static void meta_writer_put(meta_writer_t writer[static 1], const void* data,
+                            uint64_t length);
+static void meta_writer_pad(meta_writer_t writer[static 1], uint64_t offset);
+static err_t meta_writer_flush(meta_writer_t writer[static 1]);
+static err_t meta_write_snapshot(meta_t meta[static 1], const char* path);
+static err_t meta_sync_dir(const meta_t meta[static 1]);
+static err_t meta_freeze(const meta_t meta[static 1],
+                         meta_t frozen[static 1]);
+static err_t meta_rotate(meta_t meta[static 1], int32_t old_fd[static 1]);
+static void* meta_snapshot_thread(void* arg);
+static err_t meta_walk(const meta_t meta[static 1], const char* path,
+                       uint32_t parent[static 1], const char* name[static 1],
+                       uint16_t name_len[static 1]);
+static err_t meta_resolve(const meta_t meta[static 1], const char* path,
+                          uint32_t ino[static 1]);
+static void meta_fill_attr(const meta_t meta[static 1], uint32_t ino,
+                           meta_attr_t attr[static 1]);
+static wire_meta_attr_t meta_wire_attr(const meta_attr_t attr[static 1]);
+static err_t meta_payload_path(const wire_blob_t field[static 1],
+                               char path[static META_PATH_MAX + 1]);
+static int32_t meta_list_encode(void* ctx, const char* name, uint16_t name_len,
+                                const meta_attr_t attr[static 1]);
+static err_t meta_reply_error(client_t client[static 1],
+                              const proto_frame_t frame[static 1],
+                              err_t error);
+static err_t meta_reply_attr(client_t client[static 1],
+                             const proto_frame_t frame[static 1],
+                             const meta_attr_t attr[static 1]);
+static err_t meta_handle_lookup(void* ctx, client_t client[static 1],
+                                const proto_frame_t frame[static 1]);
+static err_t meta_handle_create(void* ctx, client_t client[static 1],
+                                const proto_frame_t frame[static 1]);
+static err_t meta_handle_remove(void* ctx, client_t client[static 1],
+                                const proto_frame_t frame[static 1]);
+static err_t meta_handle_rename(void* ctx, client_t client[static 1],
+                                const proto_frame_t frame[static 1]);
+static err_t meta_handle_list(void* ctx, client_t client[static 1],
+                              const proto_frame_t frame[static 1]);
+
+static uint64_t meta_align(uint64_t value, uint64_t align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+static uint64_t meta_fnv1a(uint64_t hash, const void* data, uint64_t length)
+{
+    const uint8_t* bytes = data;
+    for (uint64_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ bytes[i]) * META_FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t meta_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int32_t meta_path(const meta_t meta[static 1], const char* name,
+                         char* out, size_t size)
+{
+    return snprintf(out, size, "%s/%s", meta->dir, name);
+}
+
+static err_t meta_table_map(meta_table_t table[static 1], uint64_t reserve,
+                            int32_t fd, uint64_t offset, uint64_t length)
+{
+    /* untouched part of reservation costs neither memory nor swap */
+    reserve = meta_align(reserve > length ? reserve : length,
+                         META_SECTION_ALIGN);
+    uint8_t* base = mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR("Cannot reserve metadata table: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_ALLOC;
+    }
+    /* pages past end of file fault, so only pages holding section are
+     * mapped from it, reservation stays anonymous behind them */
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    if (length > 0 &&
+        mmap(base, meta_align(length, page), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fd, (off_t)offset) == MAP_FAILED)
+    {
+        LOG_ERROR("Cannot map metadata snapshot: errno=%d : %s\n", errno,
+                  strerror(errno));
+        munmap(base, reserve);
+        return DISFS_ERR_IO;
+    }
+    *table = (meta_table_t){.base = base, .size = length, .reserved = reserve};
+    return DISFS_SUCCESS;
+}
+
+static err_t meta_table_ensure(meta_table_t table[static 1], uint64_t size)
+{
+    if (size <= table->reserved)
+    {
+        return DISFS_SUCCESS;
+    }
+    meta_table_t grown;
+    err_t ret = meta_table_map(&grown, table->reserved * 2 > size
+                                           ? table->reserved * 2
+                                           : size,
+                               -1, 0, 0);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    memcpy(grown.base, table->base, table->size);
+    grown.size = table->size;
+    meta_table_release(table);
+    *table = grown;
+    return DISFS_SUCCESS;
+}
+
+/* append to table whose reservation was ensured, returns offset of data */
+static uint64_t meta_table_push(meta_table_t table[static 1], const void* data,
+                                uint64_t length)
+{
+    ASSERT(table->size + length <= table->reserved, "table is not reserved");
+    uint64_t offset = table->size;
+    memcpy(table->base + offset, data, length);
+    table->size += length;
+    return offset;
+}
+
+static void meta_table_release(meta_table_t table[static 1])
+{
+    if (table->base)
+    {
+        munmap(table->base, table->reserved);
+    }
+    *table = (meta_table_t){};
+}
+
+static err_t meta_table_copy(meta_table_t copy[static 1],
+                             const meta_table_t table[static 1])
+{
+    err_t ret = meta_table_map(
+        copy, table->size > 0 ? table->size : META_SECTION_ALIGN, -1, 0, 0);
+    if (ret == DISFS_SUCCESS)
+    {
+        memcpy(copy->base, table->base, table->size);
+        copy->size = table->size;
+    }
+    return ret;
+}
+
+static meta_inode_t* meta_inode(const meta_t meta[static 1], uint32_t ino)
+{
+    return (meta_inode_t*)meta->inodes.base + ino;
+}
+
+static uint32_t meta_inode_count(const meta_t meta[static 1])
+{
+    return (uint32_t)(meta->inodes.size / sizeof(meta_inode_t));
+}
+
+static int32_t meta_is_live(const meta_t meta[static 1], uint32_t ino)
+{
+    return ino != 0 && ino < meta_inode_count(meta) &&
+           meta_inode(meta, ino)->type != META_TYPE_FREE;
+}
+
+static const char* meta_name(const meta_t meta[static 1],
+                             const meta_inode_t inode[static 1])
+{
+    return (const char*)meta->names.base + inode->name;
+}
+
+static uint32_t meta_next_ino(const meta_t meta[static 1])
+{
+    return meta->free_inodes != 0 ? meta->free_inodes
+                                  : meta_inode_count(meta);
+}
+
+static int32_t meta_valid_name(const char* name, uint32_t name_len)
+{
+    if (name_len == 0 || name_len > META_NAME_MAX ||
+        memchr(name, '/', name_len) != NULL ||
+        memchr(name, '\0', name_len) != NULL)
+    {
+        return 0;
+    }
+    return !(name[0] == '.' &&
+             (name_len == 1 || (name_len == 2 && name[1] == '.')));
+}
+
+static uint64_t meta_entry_hash(uint32_t parent, const char* name,
+                                uint16_t name_len)
+{
+    uint64_t hash = meta_fnv1a(META_FNV_OFFSET, &parent, sizeof(parent));
+    return hash_ring_mix(meta_fnv1a(hash, name, name_len));
+}
+
+static uint32_t meta_index_find(const meta_t meta[static 1], uint32_t parent,
+                                const char* name, uint16_t name_len)
+{
+    const uint32_t* slots = (const uint32_t*)meta->index.base;
+    uint64_t mask = meta->index.size / sizeof(uint32_t) - 1;
+    /* load factor is kept below 3/4, so probing always reaches empty slot */
+    for (uint64_t i = meta_entry_hash(parent, name, name_len) & mask;;
+         i = (i + 1) & mask)
+    {
+        uint32_t ino = slots[i];
+        if (ino == 0)
+        {
+            return 0;
+        }
+        if (ino == META_INDEX_TOMBSTONE)
+        {
+            continue;
+        }
+        const meta_inode_t* inode = meta_inode(meta, ino);
+        if (inode->parent == parent && inode->name_len == name_len &&
+            memcmp(meta_name(meta, inode), name, name_len) == 0)
+        {
+            return ino;
+        }
+    }
+}
+
+/* returns 1 when empty slot was taken, 0 when tombstone was reused */
+static int32_t meta_index_place(uint32_t* slots, uint64_t capacity,
+                                uint64_t hash, uint32_t ino)
+{
+    uint64_t mask = capacity - 1;
+    uint64_t i = hash & mask;
+    while (slots[i] != 0 && slots[i] != META_INDEX_TOMBSTONE)
+    {
+        i = (i + 1) & mask;
+    }
+    int32_t fresh = slots[i] == 0;
+    slots[i] = ino;
+    return fresh;
+}
+
+static void meta_index_insert(meta_t meta[static 1], uint32_t ino)
+{
+    const meta_inode_t* inode = meta_inode(meta, ino);
+    uint64_t hash =
+        meta_entry_hash(inode->parent, meta_name(meta, inode), inode->name_len);
+    meta->index_used += (uint64_t)meta_index_place(
+        (uint32_t*)meta->index.base, meta->index.size / sizeof(uint32_t),
+        hash, ino);
+}
+
+static void meta_index_erase(meta_t meta[static 1], uint32_t ino)
+{
+    const meta_inode_t* inode = meta_inode(meta, ino);
+    uint32_t* slots = (uint32_t*)meta->index.base;
+    uint64_t mask = meta->index.size / sizeof(uint32_t) - 1;
+    for (uint64_t i = meta_entry_hash(inode->parent, meta_name(meta, inode),
+                                      inode->name_len) &
+                      mask;
+         slots[i] != 0; i = (i + 1) & mask)
+    {
+        if (slots[i] == ino)
+        {
+            slots[i] = META_INDEX_TOMBSTONE;
+            return;
+        }
+    }
+}
+
+/* insert every live entry into empty slots, returns number of entries */
+static uint64_t meta_index_fill(const meta_t meta[static 1], uint32_t* slots,
+                                uint64_t capacity)
+{
+    uint64_t count = 0;
+    uint32_t inodes = meta_inode_count(meta);
+    for (uint32_t ino = META_ROOT_INO + 1; ino < inodes; ino++)
+    {
+        const meta_inode_t* inode = meta_inode(meta, ino);
+        if (inode->type != META_TYPE_FREE)
+        {
+            meta_index_place(slots, capacity,
+                             meta_entry_hash(inode->parent,
+                                             meta_name(meta, inode),
+                                             inode->name_len),
+                             ino);
+            count++;
+        }
+    }
+    return count;
+}
+
+/* make room for one more entry, rebuilding drops tombstones */
+static err_t meta_index_reserve(meta_t meta[static 1])
+{
+    uint64_t capacity = meta->index.size / sizeof(uint32_t);
+    if ((meta->index_used + 1) * 4 <= capacity * 3)
+    {
+        return DISFS_SUCCESS;
+    }
+    /* entries are live inodes without root plus the one being added */
+    while ((uint64_t)meta->live_inodes * 2 > capacity)
+    {
+        capacity *= 2;
+    }
+    meta_table_t index;
+    err_t ret = meta_table_map(&index, capacity * sizeof(uint32_t), -1, 0, 0);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    index.size = capacity * sizeof(uint32_t);
+    meta->index_used = meta_index_fill(meta, (uint32_t*)index.base, capacity);
+    meta_table_release(&meta->index);
+    meta->index = index;
+    LOG_DEBUG("Metadata index rebuilt with %lu slots\n", capacity);
+    return DISFS_SUCCESS;
+}
+
+/* grow tables before mutation is logged, so applying it cannot fail */
+static err_t meta_reserve(meta_t meta[static 1], uint64_t name_len,
+                          uint64_t chunk_count)
+{
+    err_t ret = meta_table_ensure(&meta->inodes,
+                                  meta->inodes.size + sizeof(meta_inode_t));
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_ensure(&meta->names, meta->names.size + name_len);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_ensure(&meta->chunks,
+                                meta->chunks.size +
+                                    chunk_count * sizeof(chunk_hash_t));
+    }
+    if (ret == DISFS_SUCCESS && name_len > 0)
+    {
+        ret = meta_index_reserve(meta);
+    }
+    return ret;
+}
+
+static void meta_link(meta_t meta[static 1], uint32_t ino, uint32_t parent)
+{
+    meta_inode_t* inode = meta_inode(meta, ino);
+    meta_inode_t* dir = meta_inode(meta, parent);
+    inode->parent = parent;
+    inode->prev_sibling = 0;
+    inode->next_sibling = dir->first_child;
+    if (dir->first_child != 0)
+    {
+        meta_inode(meta, dir->first_child)->prev_sibling = ino;
+    }
+    dir->first_child = ino;
+    dir->child_count++;
+}
+
+static void meta_unlink(meta_t meta[static 1], uint32_t ino)
+{
+    meta_inode_t* inode = meta_inode(meta, ino);
+    meta_inode_t* dir = meta_inode(meta, inode->parent);
+    if (inode->prev_sibling != 0)
+    {
+        meta_inode(meta, inode->prev_sibling)->next_sibling =
+            inode->next_sibling;
+    }
+    else
+    {
+        dir->first_child = inode->next_sibling;
+    }
+    if (inode->next_sibling != 0)
+    {
+        meta_inode(meta, inode->next_sibling)->prev_sibling =
+            inode->prev_sibling;
+    }
+    dir->child_count--;
+}
+
+/*
+ * Apply functions validate record against current tree and either only make
+ * room for it (commit == 0) or change the tree. Live mutations and log replay
+ * both go through them, so replay rebuilds exactly the same tree.
+ */
+static err_t meta_apply_create(meta_t meta[static 1],
+                               const meta_wal_create_t record[static 1],
+                               const uint8_t* name, uint32_t name_len,
+                               int32_t commit)
+{
+    if (name_len != record->name_len ||
+        !meta_valid_name((const char*)name, name_len) ||
+        (record->type != META_TYPE_FILE && record->type != META_TYPE_DIR) ||
+        !meta_is_live(meta, record->parent) ||
+        record->ino != meta_next_ino(meta) ||
+        record->ino == META_INDEX_TOMBSTONE)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    if (meta_inode(meta, record->parent)->type != META_TYPE_DIR)
+    {
+        return DISFS_ERR_NOT_DIR;
+    }
+    if (meta_index_find(meta, record->parent, (const char*)name,
+                        record->name_len) != 0)
+    {
+        return DISFS_ERR_EXISTS;
+    }
+    if (!commit)
+    {
+        return meta_reserve(meta, name_len, 0);
+    }
+
+    uint32_t ino = record->ino;
+    if (ino == meta_inode_count(meta))
+    {
+        meta->inodes.size += sizeof(meta_inode_t);
+    }
+    else
+    {
+        meta->free_inodes = meta_inode(meta, ino)->next_sibling;
+    }
+    meta_inode_t* inode = meta_inode(meta, ino);
+    *inode = (meta_inode_t){
+        .mtime_ns = record->mtime_ns,
+        .chunks = meta->chunks.size / sizeof(chunk_hash_t),
+        .name = meta_table_push(&meta->names, name, name_len),
+        .name_len = record->name_len,
+        .type = record->type,
+    };
+    meta_link(meta, ino, record->parent);
+    meta_index_insert(meta, ino);
+    meta->live_inodes++;
+    return DISFS_SUCCESS;
+}
+
+static err_t meta_apply_remove(meta_t meta[static 1],
+                               const meta_wal_remove_t record[static 1],
+                               uint32_t tail_len, int32_t commit)
+{
+    uint32_t ino = record->ino;
+    if (tail_len != 0 || ino == META_ROOT_INO || !meta_is_live(meta, ino))
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    meta_inode_t* inode = meta_inode(meta, ino);
+    if (inode->child_count > 0)
+    {
+        return DISFS_ERR_NOT_EMPTY;
+    }
+    if (!commit)
+    {
+        return DISFS_SUCCESS;
+    }
+
+    meta_index_erase(meta, ino);
+    meta_unlink(meta, ino);
+    meta->garbage +=
+        inode->name_len + (uint64_t)inode->chunk_count * sizeof(chunk_hash_t);
+    *inode = (meta_inode_t){.next_sibling = meta->free_inodes};
+    meta->free_inodes = ino;
+    meta->live_inodes--;
+    return DISFS_SUCCESS;
+}
+
+static err_t meta_apply_rename(meta_t meta[static 1],
+                               const meta_wal_rename_t record[static 1],
+                               const uint8_t* name, uint32_t name_len,
+                               int32_t commit)
+{
+    uint32_t ino = record->ino;
+    if (ino == META_ROOT_INO || !meta_is_live(meta, ino) ||
+        name_len != record->name_len ||
+        !meta_valid_name((const char*)name, name_len) ||
+        !meta_is_live(meta, record->parent))
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    if (meta_inode(meta, record->parent)->type != META_TYPE_DIR)
+    {
+        return DISFS_ERR_NOT_DIR;
+    }
+    if (meta_index_find(meta, record->parent, (const char*)name,
+                        record->name_len) != 0)
+    {
+        return DISFS_ERR_EXISTS;
+    }
+    /* directory cannot be moved below itself */
+    for (uint32_t dir = record->parent; dir != 0;
+         dir = meta_inode(meta, dir)->parent)
+    {
+        if (dir == ino)
+        {
+            return DISFS_ERR_INVALID_ARG;
+        }
+    }
+    if (!commit)
+    {
+        return meta_reserve(meta, name_len, 0);
+    }
+
+    meta_inode_t* inode = meta_inode(meta, ino);
+    meta_index_erase(meta, ino);
+    meta_unlink(meta, ino);
+    meta->garbage += inode->name_len;
+    inode->name = meta_table_push(&meta->names, name, name_len);
+    inode->name_len = record->name_len;
+    meta_link(meta, ino, record->parent);
+    meta_index_insert(meta, ino);
+    return DISFS_SUCCESS;
+}
+
+static err_t meta_apply_chunks(meta_t meta[static 1],
+                               const meta_wal_chunks_t record[static 1],
+                               const uint8_t* hashes, uint32_t hashes_len,
+                               int32_t commit)
+{
+    if (!meta_is_live(meta, record->ino) ||
+        meta_inode(meta, record->ino)->type != META_TYPE_FILE ||
+        record->count > META_CHUNKS_MAX ||
+        hashes_len != record->count * sizeof(chunk_hash_t))
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    if (!commit)
+    {
+        return meta_reserve(meta, 0, record->count);
+    }
+
+    meta_inode_t* inode = meta_inode(meta, record->ino);
+    meta->garbage += (uint64_t)inode->chunk_count * sizeof(chunk_hash_t);
+    inode->chunks = meta_table_push(&meta->chunks, hashes, hashes_len) /
+                    sizeof(chunk_hash_t);
+    inode->chunk_count = record->count;
+    inode->size = record->size;
+    inode->mtime_ns = record->mtime_ns;
+    return DISFS_SUCCESS;
+}
+
+static err_t meta_apply_policy(meta_t meta[static 1],
+                               const meta_wal_policy_t record[static 1],
+                               uint32_t tail_len, int32_t commit)
+{
+    erasure_t code;
+    if (tail_len != 0 || !meta_is_live(meta, record->ino) ||
+        meta_inode(meta, record->ino)->type != META_TYPE_FILE ||
+        ((record->data_shards != 0 || record->parity_shards != 0) &&
+         erasure_init(&code, record->data_shards, record->parity_shards) !=
+             DISFS_SUCCESS))
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    if (!commit)
+    {
+        return DISFS_SUCCESS;
+    }
+
+    meta_inode_t* inode = meta_inode(meta, record->ino);
+    inode->data_shards = record->data_shards;
+    inode->parity_shards = record->parity_shards;
+    return DISFS_SUCCESS;
+}
+
+static uint32_t meta_wal_head_size(uint16_t type)
+{
+    switch (type)
+    {
+    case META_WAL_CREATE:
+        return sizeof(meta_wal_create_t);
+    case META_WAL_REMOVE:
+        return sizeof(meta_wal_remove_t);
+    case META_WAL_RENAME:
+        return sizeof(meta_wal_rename_t);
+    case META_WAL_CHUNKS:
+        return sizeof(meta_wal_chunks_t);
+    case META_WAL_POLICY:
+        return sizeof(meta_wal_policy_t);
+    default:
+        return 0;
+    }
+}
+
+static err_t meta_execute(meta_t meta[static 1], uint16_t type,
+                          const meta_wal_record_t record[static 1],
+                          const uint8_t* tail, uint32_t tail_len,
+                          int32_t commit)
+{
+    switch (type)
+    {
+    case META_WAL_CREATE:
+        return meta_apply_create(meta, &record->create, tail, tail_len,
+                                 commit);
+    case META_WAL_REMOVE:
+        return meta_apply_remove(meta, &record->remove, tail_len, commit);
+    case META_WAL_RENAME:
+        return meta_apply_rename(meta, &record->rename, tail, tail_len,
+                                 commit);
+    case META_WAL_CHUNKS:
+        return meta_apply_chunks(meta, &record->chunks, tail, tail_len,
+                                 commit);
+    case META_WAL_POLICY:
+        return meta_apply_policy(meta, &record->policy, tail_len, commit);
+    default:
+        return DISFS_ERR_INVALID_ARG;
+    }
+}
+
+static err_t meta_log(meta_t meta[static 1], uint16_t type,
+                      const meta_wal_record_t record[static 1],
+                      const uint8_t* tail, uint32_t tail_len)
+{
+    uint32_t head_len = meta_wal_head_size(type);
+    meta_wal_header_t header = {
+        .lsn = meta->lsn + 1,
+        .length = head_len + tail_len,
+        .type = type,
+    };
+    uint64_t checksum = meta_fnv1a(META_FNV_OFFSET, &header, sizeof(header));
+    checksum = meta_fnv1a(checksum, record, head_len);
+    header.checksum = meta_fnv1a(checksum, tail, tail_len);
+
+    struct iovec iov[3] = {
+        {.iov_base = &header, .iov_len = sizeof(header)},
+        {.iov_base = (void*)(uintptr_t)record, .iov_len = head_len},
+        {.iov_base = (void*)(uintptr_t)tail, .iov_len = tail_len},
+    };
+    uint64_t total = sizeof(header) + head_len + tail_len;
+    ssize_t written = writev(meta->wal_fd, iov, 3);
+    if (written < 0 || (uint64_t)written != total)
+    {
+        LOG_ERROR("Cannot append to metadata log: errno=%d : %s\n", errno,
+                  strerror(errno));
+        /* partial record must not stay in front of the next one */
+        if (ftruncate(meta->wal_fd, (off_t)meta->wal_size) < 0)
+        {
+            LOG_WARNING("Cannot trim metadata log\n");
+        }
+        return DISFS_ERR_IO;
+    }
+    /* committing threads read it without lock */
+    __atomic_store_n(&meta->lsn, meta->lsn + 1, __ATOMIC_RELEASE);
+    meta->wal_size += total;
+    return DISFS_SUCCESS;
+}
+
+static err_t meta_mutate(meta_t meta[static 1], uint16_t type,
+                         const meta_wal_record_t record[static 1],
+                         const uint8_t* tail, uint32_t tail_len)
+{
+    err_t ret = meta_execute(meta, type, record, tail, tail_len, 0);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_log(meta, type, record, tail, tail_len);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_execute(meta, type, record, tail, tail_len, 1);
+    }
+    return ret;
+}
+
+/* group commit, one sync covers every record appended before it, so
+ * mutations queued behind it mostly find their record synced already */
+static err_t meta_commit(meta_t meta[static 1], uint64_t lsn)
+{
+    err_t ret = DISFS_SUCCESS;
+    pthread_mutex_lock(&meta->wal_lock);
+    /* failed sync may drop dirty pages, later sync would succeed without
+     * them */
+    if (meta->wal_failed)
+    {
+        ret = DISFS_ERR_IO;
+    }
+    else if (meta->synced_lsn < lsn)
+    {
+        uint64_t appended = __atomic_load_n(&meta->lsn, __ATOMIC_ACQUIRE);
+        if (fdatasync(meta->wal_fd) < 0)
+        {
+            LOG_ERROR("Cannot sync metadata log: errno=%d : %s\n", errno,
+                      strerror(errno));
+            meta->wal_failed = 1;
+            ret = DISFS_ERR_IO;
+        }
+        else
+        {
+            meta->synced_lsn = appended;
+        }
+    }
+    pthread_mutex_unlock(&meta->wal_lock);
+    return ret;
+}
+
+static err_t meta_replay_record(meta_t meta[static 1], uint16_t type,
+                                const uint8_t* payload, uint32_t length)
+{
+    meta_wal_record_t record;
+    uint32_t head_len = meta_wal_head_size(type);
+    if (head_len == 0 || length < head_len)
+    {
+        return DISFS_ERR_CORRUPT;
+    }
+    /* payload in log is not aligned */
+    memcpy(&record, payload, head_len);
+    err_t ret = meta_execute(meta, type, &record, payload + head_len,
+                             length - head_len, 0);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_execute(meta, type, &record, payload + head_len,
+                           length - head_len, 1);
+    }
+    return ret;
+}
+
+/* valid is set to length of log without torn tail */
+static err_t meta_replay(meta_t meta[static 1], int32_t fd,
+                         uint64_t valid[static 1])
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        LOG_ERROR("Cannot stat metadata log: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_IO;
+    }
+    uint64_t size = (uint64_t)st.st_size;
+    uint8_t* map = NULL;
+    if (size > 0)
+    {
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            LOG_ERROR("Cannot map metadata log: errno=%d : %s\n", errno,
+                      strerror(errno));
+            return DISFS_ERR_IO;
+        }
+    }
+
+    err_t ret = DISFS_SUCCESS;
+    uint64_t offset = 0;
+    uint64_t replayed = 0;
+    while (size - offset >= sizeof(meta_wal_header_t))
+    {
+        meta_wal_header_t header;
+        memcpy(&header, map + offset, sizeof(header));
+        const uint8_t* payload = map + offset + sizeof(header);
+        if (header.length > size - offset - sizeof(header))
+        {
+            break;
+        }
+        uint64_t checksum = header.checksum;
+        header.checksum = 0;
+        if (meta_fnv1a(meta_fnv1a(META_FNV_OFFSET, &header, sizeof(header)),
+                       payload, header.length) != checksum)
+        {
+            break;
+        }
+        /* records up to snapshot are left behind when crash interrupts
+         * truncation after snapshot */
+        if (header.lsn > meta->lsn)
+        {
+            if (header.lsn != meta->lsn + 1 ||
+                meta_replay_record(meta, header.type, payload,
+                                   header.length) != DISFS_SUCCESS)
+            {
+                LOG_ERROR("Metadata log record %lu cannot be applied\n",
+                          header.lsn);
+                ret = DISFS_ERR_CORRUPT;
+                break;
+            }
+            meta->lsn = header.lsn;
+            replayed++;
+        }
+        offset += sizeof(header) + header.length;
+    }
+    if (map)
+    {
+        munmap(map, size);
+    }
+    if (ret == DISFS_SUCCESS && offset < size)
+    {
+        /* mutation returns once its record is synced, so record torn by
+         * crash was never acknowledged, drop it */
+        LOG_WARNING("Dropping %lu bytes of torn metadata log tail\n",
+                    size - offset);
+        if (ftruncate(fd, (off_t)offset) < 0)
+        {
+            LOG_ERROR("Cannot trim metadata log: errno=%d : %s\n", errno,
+                      strerror(errno));
+            ret = DISFS_ERR_IO;
+        }
+    }
+    *valid = offset;
+    LOG_DEBUG("Replayed %lu metadata log records\n", replayed);
+    return ret;
+}
+
+/* log started by snapshot which crash interrupted continues older log, it is
+ * replayed after it and appended to it, so one log is left again */
+static err_t meta_replay_rotated(meta_t meta[static 1])
+{
+    char path[META_FILE_PATH_MAX];
+    meta_path(meta, META_WAL_NEXT_NAME, path, sizeof(path));
+    int32_t fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT)
+    {
+        return DISFS_SUCCESS;
+    }
+    if (fd < 0)
+    {
+        LOG_ERROR("Cannot open metadata log %s: errno=%d : %s\n", path,
+                  errno, strerror(errno));
+        return DISFS_ERR_IO;
+    }
+
+    uint64_t size = 0;
+    err_t ret = meta_replay(meta, fd, &size);
+    uint8_t* buffer = malloc(META_WRITER_BUFFER_SIZE);
+    if (ret == DISFS_SUCCESS && buffer == NULL)
+    {
+        ret = DISFS_ERR_ALLOC;
+    }
+    /* records already appended by earlier attempt are skipped by replay */
+    for (uint64_t offset = 0; ret == DISFS_SUCCESS && offset < size;)
+    {
+        uint64_t n = size - offset < META_WRITER_BUFFER_SIZE
+                         ? size - offset
+                         : META_WRITER_BUFFER_SIZE;
+        if (pread(fd, buffer, n, (off_t)offset) != (ssize_t)n ||
+            write(meta->wal_fd, buffer, n) != (ssize_t)n)
+        {
+            LOG_ERROR("Cannot move metadata log %s: errno=%d : %s\n", path,
+                      errno, strerror(errno));
+            ret = DISFS_ERR_IO;
+        }
+        offset += n;
+    }
+    if (ret == DISFS_SUCCESS && fdatasync(meta->wal_fd) < 0)
+    {
+        LOG_ERROR("Cannot sync metadata log: errno=%d : %s\n", errno,
+                  strerror(errno));
+        ret = DISFS_ERR_IO;
+    }
+    free(buffer);
+    close(fd);
+    if (ret == DISFS_SUCCESS)
+    {
+        meta->wal_size += size;
+        unlink(path);
+    }
+    return ret;
+}
+
+static err_t meta_init_tables(meta_t meta[static 1])
+{
+    err_t ret =
+        meta_table_map(&meta->inodes, META_TABLE_MIN_RESERVE, -1, 0, 0);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_map(&meta->names, META_TABLE_MIN_RESERVE, -1, 0, 0);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_map(&meta->chunks, META_TABLE_MIN_RESERVE, -1, 0, 0);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_map(&meta->index,
+                             META_INDEX_INITIAL_CAPACITY * sizeof(uint32_t),
+                             -1, 0, 0);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    meta->index.size = META_INDEX_INITIAL_CAPACITY * sizeof(uint32_t);
+    /* inode 0 is never used, it terminates lists */
+    meta->inodes.size = (META_ROOT_INO + 1) * sizeof(meta_inode_t);
+    meta_inode(meta, META_ROOT_INO)->type = META_TYPE_DIR;
+    meta->live_inodes = 1;
+    return DISFS_SUCCESS;
+}
+
+/* fills offsets of sections, returns size of snapshot file */
+static uint64_t
+meta_snapshot_layout(const meta_snapshot_header_t header[static 1],
+                     uint64_t offsets[static META_SECTIONS])
+{
+    const uint64_t sizes[META_SECTIONS] = {
+        header->inode_count * sizeof(meta_inode_t),
+        header->index_capacity * sizeof(uint32_t),
+        header->names_size,
+        header->chunk_count * sizeof(chunk_hash_t),
+    };
+    uint64_t offset = META_SECTION_ALIGN;
+    for (uint32_t i = 0; i < META_SECTIONS; i++)
+    {
+        offsets[i] = offset;
+        offset = meta_align(offset + sizes[i], META_SECTION_ALIGN);
+    }
+    return offsets[META_SECTIONS - 1] + sizes[META_SECTIONS - 1];
+}
+
+static err_t meta_load_snapshot(meta_t meta[static 1], const char* path)
+{
+    int32_t fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT)
+    {
+        return meta_init_tables(meta);
+    }
+    if (fd < 0)
+    {
+        LOG_ERROR("Cannot open metadata snapshot %s: errno=%d : %s\n", path,
+                  errno, strerror(errno));
+        return DISFS_ERR_IO;
+    }
+
+    meta_snapshot_header_t header;
+    uint64_t offsets[META_SECTIONS];
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != META_SNAPSHOT_MAGIC ||
+        header.version != META_SNAPSHOT_VERSION ||
+        header.inode_count <= META_ROOT_INO ||
+        header.inode_count > UINT32_MAX || header.index_capacity == 0 ||
+        (header.index_capacity & (header.index_capacity - 1)) != 0 ||
+        meta_snapshot_layout(&header, offsets) > (uint64_t)st.st_size)
+    {
+        LOG_ERROR("Metadata snapshot %s is corrupted\n", path);
+        close(fd);
+        return DISFS_ERR_CORRUPT;
+    }
+
+    /* sections are used in place, pages are read on first touch */
+    uint64_t inodes_size = header.inode_count * sizeof(meta_inode_t);
+    uint64_t chunks_size = header.chunk_count * sizeof(chunk_hash_t);
+    err_t ret = meta_table_map(&meta->inodes,
+                               META_TABLE_MIN_RESERVE + inodes_size * 2, fd,
+                               offsets[0], inodes_size);
+    if (ret == DISFS_SUCCESS)
+    {
+        uint64_t index_size = header.index_capacity * sizeof(uint32_t);
+        ret = meta_table_map(&meta->index, index_size, fd, offsets[1],
+                             index_size);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_map(&meta->names,
+                             META_TABLE_MIN_RESERVE + header.names_size * 2,
+                             fd, offsets[2], header.names_size);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_map(&meta->chunks,
+                             META_TABLE_MIN_RESERVE + chunks_size * 2, fd,
+                             offsets[3], chunks_size);
+    }
+    close(fd);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    meta->free_inodes = header.free_inodes;
+    meta->live_inodes = header.live_inodes;
+    meta->index_used = header.index_used;
+    meta->lsn = header.lsn;
+    return DISFS_SUCCESS;
+}
+
+static void meta_writer_put(meta_writer_t writer[static 1], const void* data,
+                            uint64_t length)
+{
+    const uint8_t* bytes = data;
+    while (length > 0 && writer->error == DISFS_SUCCESS)
+    {
+        uint64_t n = META_WRITER_BUFFER_SIZE - writer->used;
+        n = n < length ? n : length;
+        memcpy(writer->buffer + writer->used, bytes, n);
+        writer->used += (uint32_t)n;
+        writer->offset += n;
+        bytes += n;
+        length -= n;
+        if (writer->used == META_WRITER_BUFFER_SIZE)
+        {
+            meta_writer_flush(writer);
+        }
+    }
+}
+
+static void meta_writer_pad(meta_writer_t writer[static 1], uint64_t offset)
+{
+    static const uint8_t zeros[512];
+    while (writer->offset < offset && writer->error == DISFS_SUCCESS)
+    {
+        uint64_t n = offset - writer->offset;
+        meta_writer_put(writer, zeros, n < sizeof(zeros) ? n : sizeof(zeros));
+    }
+}
+
+static err_t meta_writer_flush(meta_writer_t writer[static 1])
+{
+    uint32_t done = 0;
+    while (done < writer->used && writer->error == DISFS_SUCCESS)
+    {
+        ssize_t n =
+            write(writer->fd, writer->buffer + done, writer->used - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            LOG_ERROR("Cannot write metadata snapshot: errno=%d : %s\n", errno,
+                      strerror(errno));
+            writer->error = DISFS_ERR_IO;
+            break;
+        }
+        done += (uint32_t)n;
+    }
+    writer->used = 0;
+    return writer->error;
+}
+
+/* meta is frozen copy, so tree does not change while it is written */
+static err_t meta_write_snapshot(meta_t meta[static 1], const char* path)
+{
+    uint32_t count = meta_inode_count(meta);
+    meta_snapshot_header_t header = {
+        .magic = META_SNAPSHOT_MAGIC,
+        .version = META_SNAPSHOT_VERSION,
+        .free_inodes = meta->free_inodes,
+        .lsn = meta->lsn,
+        .inode_count = count,
+        .index_capacity = META_INDEX_INITIAL_CAPACITY,
+        .live_inodes = meta->live_inodes,
+    };
+    while (header.index_capacity < (uint64_t)meta->live_inodes * 2)
+    {
+        header.index_capacity *= 2;
+    }
+    for (uint32_t ino = META_ROOT_INO; ino < count; ino++)
+    {
+        const meta_inode_t* inode = meta_inode(meta, ino);
+        if (inode->type != META_TYPE_FREE)
+        {
+            header.names_size += inode->name_len;
+            header.chunk_count += inode->chunk_count;
+        }
+    }
+
+    /* index is rebuilt without tombstones, pools without garbage */
+    uint32_t* slots = calloc(header.index_capacity, sizeof(uint32_t));
+    meta_writer_t writer = {.buffer = malloc(META_WRITER_BUFFER_SIZE)};
+    writer.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    err_t ret = DISFS_SUCCESS;
+    if (slots == NULL || writer.buffer == NULL || writer.fd < 0)
+    {
+        LOG_ERROR("Cannot create metadata snapshot %s: errno=%d : %s\n", path,
+                  errno, strerror(errno));
+        ret = writer.fd < 0 ? DISFS_ERR_IO : DISFS_ERR_ALLOC;
+        goto out;
+    }
+    header.index_used = meta_index_fill(meta, slots, header.index_capacity);
+
+    uint64_t offsets[META_SECTIONS];
+    meta_snapshot_layout(&header, offsets);
+    meta_writer_put(&writer, &header, sizeof(header));
+    meta_writer_pad(&writer, offsets[0]);
+    uint64_t name = 0;
+    uint64_t chunks = 0;
+    for (uint32_t ino = 0; ino < count; ino++)
+    {
+        meta_inode_t inode = *meta_inode(meta, ino);
+        if (inode.type != META_TYPE_FREE)
+        {
+            inode.name = name;
+            inode.chunks = chunks;
+            name += inode.name_len;
+            chunks += inode.chunk_count;
+        }
+        meta_writer_put(&writer, &inode, sizeof(inode));
+    }
+    meta_writer_pad(&writer, offsets[1]);
+    meta_writer_put(&writer, slots, header.index_capacity * sizeof(uint32_t));
+    meta_writer_pad(&writer, offsets[2]);
+    for (uint32_t ino = META_ROOT_INO; ino < count; ino++)
+    {
+        const meta_inode_t* inode = meta_inode(meta, ino);
+        if (inode->type != META_TYPE_FREE)
+        {
+            meta_writer_put(&writer, meta_name(meta, inode), inode->name_len);
+        }
+    }
+    meta_writer_pad(&writer, offsets[3]);
+    for (uint32_t ino = META_ROOT_INO; ino < count; ino++)
+    {
+        const meta_inode_t* inode = meta_inode(meta, ino);
+        if (inode->type != META_TYPE_FREE)
+        {
+            meta_writer_put(&writer,
+                            meta->chunks.base +
+                                inode->chunks * sizeof(chunk_hash_t),
+                            (uint64_t)inode->chunk_count *
+                                sizeof(chunk_hash_t));
+        }
+    }
+    ret = meta_writer_flush(&writer);
+    if (ret == DISFS_SUCCESS && fsync(writer.fd) < 0)
+    {
+        LOG_ERROR("Cannot sync metadata snapshot: errno=%d : %s\n", errno,
+                  strerror(errno));
+        ret = DISFS_ERR_IO;
+    }
+out:
+    if (writer.fd >= 0)
+    {
+        close(writer.fd);
+    }
+    free(writer.buffer);
+    free(slots);
+    return ret;
+}
+
+static err_t meta_sync_dir(const meta_t meta[static 1])
+{
+    int32_t dir_fd = open(meta->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0 || fsync(dir_fd) < 0)
+    {
+        LOG_ERROR("Cannot sync metadata directory: errno=%d : %s\n", errno,
+                  strerror(errno));
+        if (dir_fd >= 0)
+        {
+            close(dir_fd);
+        }
+        return DISFS_ERR_IO;
+    }
+    close(dir_fd);
+    return DISFS_SUCCESS;
+}
+
+/* caller holds read lock, copy stays valid once mutations go on, index is
+ * rebuilt by snapshot so it is not copied */
+static err_t meta_freeze(const meta_t meta[static 1], meta_t frozen[static 1])
+{
+    frozen->free_inodes = meta->free_inodes;
+    frozen->live_inodes = meta->live_inodes;
+    frozen->lsn = meta->lsn;
+    err_t ret = meta_table_copy(&frozen->inodes, &meta->inodes);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_copy(&frozen->names, &meta->names);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_table_copy(&frozen->chunks, &meta->chunks);
+    }
+    return ret;
+}
+
+/* caller holds read lock, so log gets no record while it is replaced, on
+ * success log lock stays held until old log is synced */
+static err_t meta_rotate(meta_t meta[static 1], int32_t old_fd[static 1])
+{
+    char path[META_FILE_PATH_MAX];
+    meta_path(meta, META_WAL_NEXT_NAME, path, sizeof(path));
+    int32_t fd =
+        open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        LOG_ERROR("Cannot create metadata log %s: errno=%d : %s\n", path,
+                  errno, strerror(errno));
+        return DISFS_ERR_IO;
+    }
+    pthread_mutex_lock(&meta->wal_lock);
+    *old_fd = meta->wal_fd;
+    meta->wal_fd = fd;
+    meta->wal_size = 0;
+    meta->wal_rotated = 1;
+    return DISFS_SUCCESS;
+}
+
+err_t meta_snapshot(meta_t meta[static 1])
+{
+    char path[META_FILE_PATH_MAX];
+    char tmp[META_FILE_PATH_MAX];
+    char wal[META_FILE_PATH_MAX];
+    char next[META_FILE_PATH_MAX];
+    meta_path(meta, META_SNAPSHOT_NAME, path, sizeof(path));
+    meta_path(meta, META_SNAPSHOT_NAME ".tmp", tmp, sizeof(tmp));
+    meta_path(meta, META_WAL_NAME, wal, sizeof(wal));
+    meta_path(meta, META_WAL_NEXT_NAME, next, sizeof(next));
+    meta_t* frozen = calloc(1, sizeof(*frozen));
+    if (frozen == NULL)
+    {
+        return DISFS_ERR_ALLOC;
+    }
+
+    /* only copy and log switch wait for mutations, snapshot is written
+     * while they go on into new log */
+    int32_t old_fd = -1;
+    pthread_mutex_lock(&meta->snapshot_lock);
+    pthread_rwlock_rdlock(&meta->lock);
+    err_t ret = meta_freeze(meta, frozen);
+    if (ret == DISFS_SUCCESS && !meta->wal_rotated)
+    {
+        ret = meta_rotate(meta, &old_fd);
+    }
+    pthread_rwlock_unlock(&meta->lock);
+    /* records of new log are not committed before it is in directory and
+     * old log is synced */
+    if (old_fd >= 0)
+    {
+        if (fdatasync(old_fd) < 0)
+        {
+            LOG_ERROR("Cannot sync metadata log: errno=%d : %s\n", errno,
+                      strerror(errno));
+            ret = DISFS_ERR_IO;
+        }
+        if (ret != DISFS_SUCCESS || meta_sync_dir(meta) != DISFS_SUCCESS)
+        {
+            meta->wal_failed = 1;
+            ret = DISFS_ERR_IO;
+        }
+        pthread_mutex_unlock(&meta->wal_lock);
+    }
+
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_write_snapshot(frozen, tmp);
+    }
+    if (ret == DISFS_SUCCESS && rename(tmp, path) < 0)
+    {
+        LOG_ERROR("Cannot replace metadata snapshot: errno=%d : %s\n", errno,
+                  strerror(errno));
+        ret = DISFS_ERR_IO;
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        unlink(tmp);
+    }
+    /* rename must be durable before log records are dropped, records of
+     * new log are either newer than snapshot or skipped by replay */
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_sync_dir(meta);
+    }
+    if (ret == DISFS_SUCCESS && rename(next, wal) < 0)
+    {
+        LOG_ERROR("Cannot replace metadata log: errno=%d : %s\n", errno,
+                  strerror(errno));
+        ret = DISFS_ERR_IO;
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_sync_dir(meta);
+    }
+    /* after failure new log stays beside old one, next snapshot reuses it
+     * and opening appends it to old one */
+    if (ret == DISFS_SUCCESS)
+    {
+        meta->wal_rotated = 0;
+        LOG_DEBUG("Metadata snapshot at lsn %lu with %u inodes\n",
+                  frozen->lsn, frozen->live_inodes);
+    }
+    pthread_mutex_unlock(&meta->snapshot_lock);
+    if (old_fd >= 0)
+    {
+        close(old_fd);
+    }
+    meta_table_release(&frozen->inodes);
+    meta_table_release(&frozen->names);
+    meta_table_release(&frozen->chunks);
+    free(frozen);
+    return ret;
+}
+
+static void* meta_snapshot_thread(void* arg)
+{
+    meta_t* meta = arg;
+    pthread_mutex_lock(&meta->snapshot_lock);
+    while (meta->snapshot_th_run)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += META_SNAPSHOT_CHECK_MS / 1000;
+        deadline.tv_nsec += (META_SNAPSHOT_CHECK_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&meta->snapshot_cond, &meta->snapshot_lock,
+                               &deadline);
+
+        /* log is switched only under snapshot lock, appended under write
+         * lock */
+        pthread_rwlock_rdlock(&meta->lock);
+        uint64_t wal_size = meta->wal_size;
+        pthread_rwlock_unlock(&meta->lock);
+        if (meta->snapshot_th_run && wal_size >= META_SNAPSHOT_WAL_SIZE)
+        {
+            pthread_mutex_unlock(&meta->snapshot_lock);
+            meta_snapshot(meta);
+            pthread_mutex_lock(&meta->snapshot_lock);
+        }
+    }
+    pthread_mutex_unlock(&meta->snapshot_lock);
+    return NULL;
+}
+
+err_t meta_open(meta_t meta[static 1], const char* dir)
+{
+    *meta = (meta_t){.wal_fd = -1};
+    size_t dir_len = strlen(dir);
+    if (dir_len >= META_DIR_MAX)
+    {
+        LOG_ERROR("Metadata path is too long: %s\n", dir);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    memcpy(meta->dir, dir, dir_len + 1);
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+    {
+        LOG_ERROR("Cannot create metadata directory %s: errno=%d : %s\n", dir,
+                  errno, strerror(errno));
+        return DISFS_ERR_IO;
+    }
+    pthread_rwlock_init(&meta->lock, NULL);
+    pthread_mutex_init(&meta->snapshot_lock, NULL);
+    pthread_mutex_init(&meta->wal_lock, NULL);
+    pthread_cond_init(&meta->snapshot_cond, NULL);
+
+    char path[META_FILE_PATH_MAX];
+    meta_path(meta, META_SNAPSHOT_NAME, path, sizeof(path));
+    err_t ret = meta_load_snapshot(meta, path);
+    if (ret == DISFS_SUCCESS)
+    {
+        meta_path(meta, META_WAL_NAME, path, sizeof(path));
+        meta->wal_fd =
+            open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (meta->wal_fd < 0)
+        {
+            LOG_ERROR("Cannot open metadata log %s: errno=%d : %s\n", path,
+                      errno, strerror(errno));
+            ret = DISFS_ERR_IO;
+        }
+    }
+    /* log created here must stay in directory for its records to count */
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_sync_dir(meta);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_replay(meta, meta->wal_fd, &meta->wal_size);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_replay_rotated(meta);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        meta->snapshot_th_run = 1;
+        if (pthread_create(&meta->snapshot_th, NULL, meta_snapshot_thread,
+                           meta) != 0)
+        {
+            LOG_ERROR("Cannot start metadata snapshot thread\n");
+            meta->snapshot_th_run = 0;
+            ret = DISFS_ERR_GENERIC;
+        }
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        meta_close(meta);
+        return ret;
+    }
+    LOG_DEBUG("Opened metadata %s with %u inodes at lsn %lu\n", dir,
+              meta->live_inodes, meta->lsn);
+    return DISFS_SUCCESS;
+}
+
+void meta_close(meta_t meta[static 1])
+{
+    pthread_mutex_lock(&meta->snapshot_lock);
+    int running = meta->snapshot_th_run;
+    meta->snapshot_th_run = 0;
+    pthread_cond_signal(&meta->snapshot_cond);
+    pthread_mutex_unlock(&meta->snapshot_lock);
+    if (running)
+    {
+        pthread_join(meta->snapshot_th, NULL);
+    }
+    if (meta->wal_fd >= 0)
+    {
+        fdatasync(meta->wal_fd);
+        close(meta->wal_fd);
+    }
+    meta_table_release(&meta->inodes);
+    meta_table_release(&meta->index);
+    meta_table_release(&meta->names);
+    meta_table_release(&meta->chunks);
+    pthread_cond_destroy(&meta->snapshot_cond);
+    pthread_mutex_destroy(&meta->wal_lock);
+    pthread_mutex_destroy(&meta->snapshot_lock);
+    pthread_rwlock_destroy(&meta->lock);
+    meta->wal_fd = -1;
+}
+
+err_t meta_sync(meta_t meta[static 1])
+{
+    return meta_commit(meta, __atomic_load_n(&meta->lsn, __ATOMIC_ACQUIRE));
+}
+
+/* resolve all components but last, name is empty for root */
+static err_t meta_walk(const meta_t meta[static 1], const char* path,
+                       uint32_t parent[static 1], const char* name[static 1],
+                       uint16_t name_len[static 1])
+{
+    size_t path_len = strnlen(path, META_PATH_MAX + 1);
+    if (path_len > META_PATH_MAX)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    const char* end = path + path_len;
+    uint32_t dir = META_ROOT_INO;
+    *name = path;
+    *name_len = 0;
+    while (path < end)
+    {
+        while (path < end && *path == '/')
+        {
+            path++;
+        }
+        const char* component = path;
+        while (path < end && *path != '/')
+        {
+            path++;
+        }
+        uint32_t len = (uint32_t)(path - component);
+        if (len == 0)
+        {
+            break;
+        }
+        if (!meta_valid_name(component, len))
+        {
+            return DISFS_ERR_INVALID_ARG;
+        }
+        if (*name_len > 0)
+        {
+            uint32_t ino = meta_index_find(meta, dir, *name, *name_len);
+            if (ino == 0)
+            {
+                return DISFS_ERR_NOT_FOUND;
+            }
+            if (meta_inode(meta, ino)->type != META_TYPE_DIR)
+            {
+                return DISFS_ERR_NOT_DIR;
+            }
+            dir = ino;
+        }
+        *name = component;
+        *name_len = (uint16_t)len;
+    }
+    *parent = dir;
+    return DISFS_SUCCESS;
+}
+
+static err_t meta_resolve(const meta_t meta[static 1], const char* path,
+                          uint32_t ino[static 1])
+{
+    uint32_t parent = 0;
+    const char* name = NULL;
+    uint16_t name_len = 0;
+    err_t ret = meta_walk(meta, path, &parent, &name, &name_len);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    *ino = name_len == 0 ? parent
+                         : meta_index_find(meta, parent, name, name_len);
+    return *ino == 0 ? DISFS_ERR_NOT_FOUND : DISFS_SUCCESS;
+}
+
+static void meta_fill_attr(const meta_t meta[static 1], uint32_t ino,
+                           meta_attr_t attr[static 1])
+{
+    const meta_inode_t* inode = meta_inode(meta, ino);
+    *attr = (meta_attr_t){
+        .size = inode->size,
+        .mtime_ns = inode->mtime_ns,
+        .ino = ino,
+        .chunk_count = inode->chunk_count,
+        .type = inode->type,
+        .data_shards = inode->data_shards,
+        .parity_shards = inode->parity_shards,
+    };
+}
+
+err_t meta_lookup(meta_t meta[static 1], const char* path,
+                  meta_attr_t attr[static 1])
+{
+    pthread_rwlock_rdlock(&meta->lock);
+    uint32_t ino = 0;
+    err_t ret = meta_resolve(meta, path, &ino);
+    if (ret == DISFS_SUCCESS)
+    {
+        meta_fill_attr(meta, ino, attr);
+    }
+    pthread_rwlock_unlock(&meta->lock);
+    return ret;
+}
+
+err_t meta_create(meta_t meta[static 1], const char* path, uint8_t type,
+                  meta_attr_t attr[static 1])
+{
+    meta_wal_record_t record = {};
+    const char* name = NULL;
+    uint16_t name_len = 0;
+    pthread_rwlock_wrlock(&meta->lock);
+    err_t ret = meta_walk(meta, path, &record.create.parent, &name, &name_len);
+    if (ret == DISFS_SUCCESS && name_len == 0)
+    {
+        ret = DISFS_ERR_EXISTS;
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        record.create.mtime_ns = meta_now_ns();
+        record.create.ino = meta_next_ino(meta);
+        record.create.name_len = name_len;
+        record.create.type = type;
+        ret = meta_mutate(meta, META_WAL_CREATE, &record,
+                          (const uint8_t*)name, name_len);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        meta_fill_attr(meta, record.create.ino, attr);
+    }
+    uint64_t lsn = meta->lsn;
+    pthread_rwlock_unlock(&meta->lock);
+    return ret == DISFS_SUCCESS ? meta_commit(meta, lsn) : ret;
+}
+
+err_t meta_remove(meta_t meta[static 1], const char* path)
+{
+    meta_wal_record_t record = {};
+    pthread_rwlock_wrlock(&meta->lock);
+    err_t ret = meta_resolve(meta, path, &record.remove.ino);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_mutate(meta, META_WAL_REMOVE, &record, NULL, 0);
+    }
+    uint64_t lsn = meta->lsn;
+    pthread_rwlock_unlock(&meta->lock);
+    return ret == DISFS_SUCCESS ? meta_commit(meta, lsn) : ret;
+}
+
+err_t meta_rename(meta_t meta[static 1], const char* from, const char* to)
+{
+    meta_wal_record_t record = {};
+    const char* name = NULL;
+    uint16_t name_len = 0;
+    pthread_rwlock_wrlock(&meta->lock);
+    err_t ret = meta_resolve(meta, from, &record.rename.ino);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_walk(meta, to, &record.rename.parent, &name, &name_len);
+    }
+    if (ret == DISFS_SUCCESS && name_len == 0)
+    {
+        ret = DISFS_ERR_EXISTS;
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        record.rename.name_len = name_len;
+        ret = meta_mutate(meta, META_WAL_RENAME, &record,
+                          (const uint8_t*)name, name_len);
+    }
+    uint64_t lsn = meta->lsn;
+    pthread_rwlock_unlock(&meta->lock);
+    return ret == DISFS_SUCCESS ? meta_commit(meta, lsn) : ret;
+}
+
+err_t meta_list(meta_t meta[static 1], const char* path, meta_list_fn fn,
+                void* ctx, uint32_t cookie[static 1])
+{
+    pthread_rwlock_rdlock(&meta->lock);
+    uint32_t dir = 0;
+    err_t ret = meta_resolve(meta, path, &dir);
+    if (ret == DISFS_SUCCESS && meta_inode(meta, dir)->type != META_TYPE_DIR)
+    {
+        ret = DISFS_ERR_NOT_DIR;
+    }
+    /* cookie is stale when its entry was removed or moved meanwhile */
+    if (ret == DISFS_SUCCESS && *cookie != 0 &&
+        (!meta_is_live(meta, *cookie) ||
+         meta_inode(meta, *cookie)->parent != dir))
+    {
+        ret = DISFS_ERR_NOT_FOUND;
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        uint32_t ino =
+            *cookie != 0 ? *cookie : meta_inode(meta, dir)->first_child;
+        for (; ino != 0; ino = meta_inode(meta, ino)->next_sibling)
+        {
+            const meta_inode_t* inode = meta_inode(meta, ino);
+            meta_attr_t attr;
+            meta_fill_attr(meta, ino, &attr);
+            if (fn(ctx, meta_name(meta, inode), inode->name_len, &attr) != 0)
+            {
+                break;
+            }
+        }
+        *cookie = ino;
+    }
+    pthread_rwlock_unlock(&meta->lock);
+    return ret;
+}
+
+err_t meta_set_chunks(meta_t meta[static 1], const char* path, uint64_t size,
+                      const chunk_hash_t* hashes, uint32_t count)
+{
+    if (count > META_CHUNKS_MAX)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    meta_wal_record_t record = {};
+    pthread_rwlock_wrlock(&meta->lock);
+    err_t ret = meta_resolve(meta, path, &record.chunks.ino);
+    if (ret == DISFS_SUCCESS)
+    {
+        record.chunks.size = size;
+        record.chunks.mtime_ns = meta_now_ns();
+        record.chunks.count = count;
+        ret = meta_mutate(meta, META_WAL_CHUNKS, &record,
+                          (const uint8_t*)hashes,
+                          count * (uint32_t)sizeof(chunk_hash_t));
+    }
+    uint64_t lsn = meta->lsn;
+    pthread_rwlock_unlock(&meta->lock);
+    return ret == DISFS_SUCCESS ? meta_commit(meta, lsn) : ret;
+}
+
+err_t meta_set_policy(meta_t meta[static 1], const char* path,
+                      uint8_t data_shards, uint8_t parity_shards)
+{
+    meta_wal_record_t record = {};
+    pthread_rwlock_wrlock(&meta->lock);
+    err_t ret = meta_resolve(meta, path, &record.policy.ino);
+    if (ret == DISFS_SUCCESS)
+    {
+        record.policy.data_shards = data_shards;
+        record.policy.parity_shards = parity_shards;
+        ret = meta_mutate(meta, META_WAL_POLICY, &record, NULL, 0);
+    }
+    uint64_t lsn = meta->lsn;
+    pthread_rwlock_unlock(&meta->lock);
+    return ret == DISFS_SUCCESS ? meta_commit(meta, lsn) : ret;
+}
+
+err_t meta_get_chunks(meta_t meta[static 1], const char* path,
+                      chunk_hash_t* hashes, uint32_t max_hashes,
+                      uint32_t count[static 1])
+{
+    pthread_rwlock_rdlock(&meta->lock);
+    uint32_t ino = 0;
+    err_t ret = meta_resolve(meta, path, &ino);
+    if (ret == DISFS_SUCCESS)
+    {
+        const meta_inode_t* inode = meta_inode(meta, ino);
+        *count = inode->chunk_count;
+        memcpy(hashes,
+               meta->chunks.base + inode->chunks * sizeof(chunk_hash_t),
+               (inode->chunk_count < max_hashes ? inode->chunk_count
+                                                : max_hashes) *
+                   sizeof(chunk_hash_t));
+    }
+    pthread_rwlock_unlock(&meta->lock);
+    return ret;
+}
+
+static wire_meta_attr_t meta_wire_attr(const meta_attr_t attr[static 1])
+{
+    return (wire_meta_attr_t){.ino = attr->ino,
+                              .size = attr->size,
+                              .mtime_ns = attr->mtime_ns,
+                              .chunk_count = attr->chunk_count,
+                              .type = attr->type,
+                              .data_shards = attr->data_shards,
+                              .parity_shards = attr->parity_shards};
+}
+
+static err_t meta_payload_path(const wire_blob_t field[static 1],
+                               char path[static META_PATH_MAX + 1])
+{
+    if (field->length > META_PATH_MAX ||
+        memchr(field->data, '\0', field->length) != NULL)
+    {
+        return DISFS_ERR_INVALID_ARG;
+    }
+    memcpy(path, field->data, field->length);
+    path[field->length] = '\0';
+    return DISFS_SUCCESS;
+}
+
+static int32_t meta_list_encode(void* ctx, const char* name, uint16_t name_len,
+                                const meta_attr_t attr[static 1])
+{
+    meta_list_reply_t* reply = ctx;
+    if (reply->used + WIRE_FIXED_SIZE(meta_entry) + name_len >
+        META_LIST_REPLY_MAX)
+    {
+        return 1;
+    }
+    wire_meta_entry_t entry = {
+        .ino = attr->ino,
+        .size = attr->size,
+        .mtime_ns = attr->mtime_ns,
+        .chunk_count = attr->chunk_count,
+        .type = attr->type,
+        .data_shards = attr->data_shards,
+        .parity_shards = attr->parity_shards,
+        .name = {.data = (const uint8_t*)name, .length = name_len},
+    };
+    uint64_t length;
+    wire_meta_entry_encode(&entry, reply->buffer + reply->used,
+                           META_LIST_REPLY_MAX - reply->used, &length);
+    reply->used += (uint32_t)length;
+    reply->count++;
+    return 0;
+}
+
+static err_t meta_reply_error(client_t client[static 1],
+                              const proto_frame_t frame[static 1],
+                              err_t error)
+{
+    wire_error_t reply = {.code = (uint64_t)error};
+    uint8_t scratch[WIRE_FIXED_SIZE(error)];
+    struct iovec iov[1];
+    uint32_t iov_count;
+    err_t ret = wire_encode_iov(&wire_error_schema, &reply, scratch,
+                                sizeof(scratch), iov, 1, &iov_count);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    return connection_reply(client, frame, PROTO_MSG_ERROR, iov, iov_count);
+}
+
+static err_t meta_reply_attr(client_t client[static 1],
+                             const proto_frame_t frame[static 1],
+                             const meta_attr_t attr[static 1])
+{
+    wire_meta_attr_t reply = meta_wire_attr(attr);
+    uint8_t scratch[WIRE_FIXED_SIZE(meta_attr)];
+    struct iovec iov[1];
+    uint32_t iov_count;
+    err_t ret = wire_encode_iov(&wire_meta_attr_schema, &reply, scratch,
+                                sizeof(scratch), iov, 1, &iov_count);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    return connection_reply(client, frame, PROTO_MSG_META_ATTR, iov,
+                            iov_count);
+}
+
+static err_t meta_handle_lookup(void* ctx, client_t client[static 1],
+                                const proto_frame_t frame[static 1])
+{
+    wire_meta_path_t request;
+    char path[META_PATH_MAX + 1];
+    meta_attr_t attr;
+    err_t ret = wire_meta_path_decode(&request, frame->payload,
+                                      frame->header.length);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_payload_path(&request.path, path);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_lookup(ctx, path, &attr);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        return meta_reply_error(client, frame, ret);
+    }
+    return meta_reply_attr(client, frame, &attr);
+}
+
+static err_t meta_handle_create(void* ctx, client_t client[static 1],
+                                const proto_frame_t frame[static 1])
+{
+    wire_meta_create_t request;
+    char path[META_PATH_MAX + 1];
+    meta_attr_t attr;
+    err_t ret = wire_meta_create_decode(&request, frame->payload,
+                                        frame->header.length);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_payload_path(&request.path, path);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_create(ctx, path, (uint8_t)request.meta_type, &attr);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        return meta_reply_error(client, frame, ret);
+    }
+    return meta_reply_attr(client, frame, &attr);
+}
+
+static err_t meta_handle_remove(void* ctx, client_t client[static 1],
+                                const proto_frame_t frame[static 1])
+{
+    wire_meta_path_t request;
+    char path[META_PATH_MAX + 1];
+    err_t ret = wire_meta_path_decode(&request, frame->payload,
+                                      frame->header.length);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_payload_path(&request.path, path);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_remove(ctx, path);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        return meta_reply_error(client, frame, ret);
+    }
+    return connection_reply(client, frame, PROTO_MSG_META_DONE, NULL, 0);
+}
+
+static err_t meta_handle_rename(void* ctx, client_t client[static 1],
+                                const proto_frame_t frame[static 1])
+{
+    wire_meta_rename_t request;
+    char from[META_PATH_MAX + 1];
+    char to[META_PATH_MAX + 1];
+    err_t ret = wire_meta_rename_decode(&request, frame->payload,
+                                        frame->header.length);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_payload_path(&request.from, from);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_payload_path(&request.to, to);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_rename(ctx, from, to);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        return meta_reply_error(client, frame, ret);
+    }
+    return connection_reply(client, frame, PROTO_MSG_META_DONE, NULL, 0);
+}
+
+static err_t meta_handle_list(void* ctx, client_t client[static 1],
+                              const proto_frame_t frame[static 1])
+{
+    wire_meta_list_t request;
+    char path[META_PATH_MAX + 1];
+    err_t ret = wire_meta_list_decode(&request, frame->payload,
+                                      frame->header.length);
+    uint32_t cookie = 0;
+    if (ret == DISFS_SUCCESS)
+    {
+        cookie = (uint32_t)request.cookie;
+        ret = meta_payload_path(&request.path, path);
+    }
+    /* entries which do not fit are left for next request with cookie */
+    meta_list_reply_t reply = {};
+    buf_t* buf = NULL;
+    if (ret == DISFS_SUCCESS)
+    {
+        buf = buf_alloc(META_LIST_REPLY_MAX);
+        reply.buffer = buf ? buf->data : NULL;
+        ret = buf ? DISFS_SUCCESS : DISFS_ERR_ALLOC;
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = meta_list(ctx, path, meta_list_encode, &reply, &cookie);
+    }
+    if (ret != DISFS_SUCCESS)
+    {
+        buf_unref(buf);
+        return meta_reply_error(client, frame, ret);
+    }
+    /* entries are already encoded, header is gathered in front of them */
+    wire_meta_entries_t entries = {
+        .next_cookie = cookie,
+        .count = reply.count,
+        .entries = {.data = reply.buffer, .length = reply.used},
+    };
+    uint8_t scratch[WIRE_FIXED_SIZE(meta_entries)];
+    struct iovec iov[2];
+    uint32_t iov_count;
+    ret = wire_encode_iov(&wire_meta_entries_schema, &entries, scratch,
+                          sizeof(scratch), iov, 2, &iov_count);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_reply(client, frame, PROTO_MSG_META_ENTRIES, iov,
+                               iov_count);
+    }
+    buf_unref(buf);
+    return ret;
+}
+
+err_t meta_attach(meta_t meta[static 1], struct connection_t* conn)
+{
+    err_t ret = connection_register_handler(conn, PROTO_MSG_META_LOOKUP,
+                                            meta_handle_lookup, meta);
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_register_handler(conn, PROTO_MSG_META_CREATE,
+                                          meta_handle_create, meta);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_register_handler(conn, PROTO_MSG_META_REMOVE,
+                                          meta_handle_remove, meta);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_register_handler(conn, PROTO_MSG_META_RENAME,
+                                          meta_handle_rename, meta);
+    }
+    if (ret == DISFS_SUCCESS)
+    {
+        ret = connection_register_handler(conn, PROTO_MSG_META_LIST,
+                                          meta_handle_list, meta);
+    }
+    return ret;
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "metrics.h"
+#include "err_codes.h"
+#include "logger.h"
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define METRICS_POLL_MS 200
+#define METRICS_SEND_TIMEOUT_MS 1000
+#define METRICS_WRITER_INITIAL 4096
+#define METRICS_SHARD_ALIGN 64
+
+static const char* const metrics_counter_names[] = {
+    [METRIC_BYTES_IN] = "bytes_in",
+    [METRIC_BYTES_OUT] = "bytes_out",
+    [METRIC_FRAMES_IN] = "frames_in",
+    [METRIC_FRAMES_OUT] = "frames_out",
+    [METRIC_ACCEPTS] = "accepts",
+    [METRIC_CONNECT_FAILURES] = "connect_failures",
+    [METRIC_TX_WRITES] = "tx_writes",
+    [METRIC_TX_THROTTLED] = "tx_throttled",
+    [METRIC_CHECKSUM_ERRORS] = "checksum_errors",
+    [METRIC_COMPRESS_RAW_BYTES] = "compress_raw_bytes",
+    [METRIC_COMPRESS_WIRE_BYTES] = "compress_wire_bytes",
+};
+
+static const char* const metrics_histogram_names[] = {
+    [METRIC_LOOP_NS] = "loop_ns",
+    [METRIC_PEER_RTT_NS] = "peer_rtt_ns",
+};
+
+static uint64_t metrics_bucket_high(uint32_t bucket);
+static void* metrics_thread(void* arg);
+static void metrics_answer(metrics_t metrics[static 1], int32_t fd);
+
+err_t metrics_init(metrics_t metrics[static 1])
+{
+    *metrics = (metrics_t){.fd = -1, .start_ns = metrics_now_ns()};
+    pthread_mutex_init(&metrics->lock, NULL);
+    return DISFS_SUCCESS;
+}
+
+void metrics_destroy(metrics_t metrics[static 1])
+{
+    if (metrics->fd >= 0)
+    {
+        metrics->th_run = 0;
+        pthread_join(metrics->th, NULL);
+        close(metrics->fd);
+        unlink(metrics->path);
+        metrics->fd = -1;
+    }
+    while (metrics->shards)
+    {
+        metrics_shard_t* shard = metrics->shards;
+        metrics->shards = shard->next;
+        free(shard);
+    }
+    pthread_mutex_destroy(&metrics->lock);
+}
+
+metrics_shard_t* metrics_shard(metrics_t metrics[static 1])
+{
+    /* shards of different threads never share cache line */
+    size_t size = (sizeof(metrics_shard_t) + METRICS_SHARD_ALIGN - 1) &
+                  ~(size_t)(METRICS_SHARD_ALIGN - 1);
+    metrics_shard_t* shard = aligned_alloc(METRICS_SHARD_ALIGN, size);
+    if (shard == NULL)
+    {
+        LOG_ERROR("Cannot allocate metrics shard of %lu bytes\n", size);
+        return NULL;
+    }
+    memset(shard, 0, size);
+    pthread_mutex_lock(&metrics->lock);
+    shard->next = metrics->shards;
+    metrics->shards = shard;
+    pthread_mutex_unlock(&metrics->lock);
+    return shard;
+}
+
+void metrics_collect(metrics_t metrics[static 1],
+                     metrics_shard_t out[static 1])
+{
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&metrics->lock);
+    for (metrics_shard_t* shard = metrics->shards; shard; shard = shard->next)
+    {
+        for (uint32_t i = 0; i < METRIC_COUNTER_MAX; i++)
+        {
+            out->counters[i] +=
+                __atomic_load_n(&shard->counters[i], __ATOMIC_RELAXED);
+        }
+        for (uint32_t i = 0; i < METRIC_HISTOGRAM_MAX; i++)
+        {
+            metrics_histogram_t* from = &shard->histograms[i];
+            metrics_histogram_t* to = &out->histograms[i];
+            to->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+            to->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+            uint64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+            to->max = max > to->max ? max : to->max;
+            for (uint32_t j = 0; j < METRICS_BUCKETS; j++)
+            {
+                to->buckets[j] +=
+                    __atomic_load_n(&from->buckets[j], __ATOMIC_RELAXED);
+            }
+        }
+    }
+    pthread_mutex_unlock(&metrics->lock);
+}
+
+/* highest value which falls into bucket */
+static uint64_t metrics_bucket_high(uint32_t bucket)
+{
+    if (bucket < METRICS_SUB_COUNT)
+    {
+        return bucket;
+    }
+    uint32_t shift = bucket / METRICS_SUB_COUNT - 1;
+    uint64_t low = (uint64_t)(METRICS_SUB_COUNT + bucket % METRICS_SUB_COUNT)
+                   << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+uint64_t metrics_quantile(const metrics_histogram_t histogram[static 1],
+                          double q)
+{
+    /* buckets are summed again, count may be ahead of them while recording */
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < METRICS_BUCKETS; i++)
+    {
+        total += histogram->buckets[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(q * (double)total + 0.5);
+    rank = rank == 0 ? 1 : rank;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < METRICS_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t high = metrics_bucket_high(i);
+            return high < histogram->max ? high : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+void metrics_printf(metrics_writer_t writer[static 1], const char* fmt, ...)
+{
+    while (1)
+    {
+        uint32_t left = writer->capacity - writer->used;
+        va_list args;
+        va_start(args, fmt);
+        int32_t n = vsnprintf(writer->data ? writer->data + writer->used : NULL,
+                              left, fmt, args);
+        va_end(args);
+        if (n < 0)
+        {
+            return;
+        }
+        if ((uint32_t)n < left)
+        {
+            writer->used += (uint32_t)n;
+            return;
+        }
+        uint32_t capacity =
+            writer->capacity ? writer->capacity * 2 : METRICS_WRITER_INITIAL;
+        while (capacity - writer->used <= (uint32_t)n)
+        {
+            capacity *= 2;
+        }
+        char* data = realloc(writer->data, capacity);
+        if (data == NULL)
+        {
+            LOG_ERROR("Cannot grow stats report to %u bytes\n", capacity);
+            return;
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+}
+
+void metrics_report(metrics_t metrics[static 1],
+                    metrics_writer_t writer[static 1])
+{
+    metrics_shard_t* total = malloc(sizeof(*total));
+    if (total == NULL)
+    {
+        LOG_ERROR("Cannot allocate metrics of stats report\n");
+        return;
+    }
+    metrics_collect(metrics, total);
+    metrics_printf(writer, "uptime_ms %lu\n",
+                   (metrics_now_ns() - metrics->start_ns) / 1000000);
+    for (uint32_t i = 0; i < METRIC_COUNTER_MAX; i++)
+    {
+        metrics_printf(writer, "%s %lu\n", metrics_counter_names[i],
+                       total->counters[i]);
+    }
+    for (uint32_t i = 0; i < METRIC_HISTOGRAM_MAX; i++)
+    {
+        const metrics_histogram_t* h = &total->histograms[i];
+        metrics_printf(writer,
+                       "%s count=%lu mean=%lu p50=%lu p90=%lu p99=%lu "
+                       "p999=%lu max=%lu\n",
+                       metrics_histogram_names[i], h->count,
+                       h->count ? h->sum / h->count : 0,
+                       metrics_quantile(h, 0.5), metrics_quantile(h, 0.9),
+                       metrics_quantile(h, 0.99), metrics_quantile(h, 0.999),
+                       h->max);
+    }
+    free(total);
+    if (metrics->report)
+    {
+        metrics->report(metrics->report_ctx, writer);
+    }
+}
+
+err_t metrics_serve(metrics_t metrics[static 1], const char* path,
+                    metrics_report_fn report, void* ctx)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    size_t path_len = strlen(path);
+    if (path_len >= sizeof(addr.sun_path) || metrics->fd >= 0)
+    {
+        LOG_ERROR("Cannot serve stats on %s\n", path);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    memcpy(addr.sun_path, path, path_len);
+    memcpy(metrics->path, path, path_len + 1);
+
+    int32_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("Cannot create stats socket: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_SOCK;
+    }
+    /* socket left by previous run of node */
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0)
+    {
+        LOG_ERROR("Cannot listen for stats on %s: errno=%d : %s\n", path,
+                  errno, strerror(errno));
+        close(fd);
+        return DISFS_ERR_SOCK;
+    }
+    metrics->report = report;
+    metrics->report_ctx = ctx;
+    metrics->fd = fd;
+    metrics->th_run = 1;
+    if (pthread_create(&metrics->th, NULL, metrics_thread, metrics) != 0)
+    {
+        LOG_ERROR("Cannot start stats thread\n");
+        close(fd);
+        unlink(path);
+        metrics->fd = -1;
+        return DISFS_ERR_GENERIC;
+    }
+    LOG_DEBUG("Serving stats on %s\n", path);
+    return DISFS_SUCCESS;
+}
+
+static void* metrics_thread(void* arg)
+{
+    metrics_t* metrics = arg;
+    struct pollfd pfd = {.fd = metrics->fd, .events = POLLIN};
+    while (metrics->th_run)
+    {
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0)
+        {
+            continue;
+        }
+        int32_t fd = accept4(metrics->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            continue;
+        }
+        metrics_answer(metrics, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* slow reader can hold endpoint at most for send timeout */
+static void metrics_answer(metrics_t metrics[static 1], int32_t fd)
+{
+    struct timeval timeout = {
+        .tv_sec = METRICS_SEND_TIMEOUT_MS / 1000,
+        .tv_usec = (METRICS_SEND_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    metrics_writer_t writer = {};
+    metrics_report(metrics, &writer);
+    uint32_t sent = 0;
+    while (sent < writer.used)
+    {
+        ssize_t n = send(fd, writer.data + sent, writer.used - sent,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        sent += (uint32_t)n;
+    }
+    free(writer.data);
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "peer.h"
+#include "err_codes.h"
+#include "logger.h"
+#include <stdlib.h>
+
+#define PEER_INDEX_INITIAL_CAPACITY 64
+
+/* marks removed index slot, probing continues past it */
+static client_t tombstone;
+
+static uint64_t peer_addr_hash(const struct sockaddr_in addr[static 1]);
+static int32_t peer_addr_equal(const struct sockaddr_in a[static 1],
+                               const struct sockaddr_in b[static 1]);
+static client_t** peer_index_find(peer_table_t table[static 1],
+                                  const struct sockaddr_in addr[static 1]);
+static err_t peer_index_resize(peer_table_t table[static 1],
+                               uint32_t capacity);
+static err_t peer_index_reserve(peer_table_t table[static 1]);
+static err_t peer_slab_grow(peer_table_t table[static 1]);
+
+static uint64_t peer_addr_hash(const struct sockaddr_in addr[static 1])
+{
+    uint64_t x = ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static int32_t peer_addr_equal(const struct sockaddr_in a[static 1],
+                               const struct sockaddr_in b[static 1])
+{
+    return a->sin_addr.s_addr == b->sin_addr.s_addr &&
+           a->sin_port == b->sin_port;
+}
+
+err_t peer_table_init(peer_table_t table[static 1])
+{
+    *table = (peer_table_t){};
+    pthread_mutex_init(&table->lock, NULL);
+    return peer_index_resize(table, PEER_INDEX_INITIAL_CAPACITY);
+}
+
+void peer_table_destroy(peer_table_t table[static 1])
+{
+    for (uint32_t i = 0; i < table->slab_count; i++)
+    {
+        free(table->slabs[i]);
+    }
+    free(table->slabs);
+    free(table->index);
+    pthread_mutex_destroy(&table->lock);
+    *table = (peer_table_t){};
+}
+
+/* returns slot holding peer with addr or first free slot, never NULL */
+static client_t** peer_index_find(peer_table_t table[static 1],
+                                  const struct sockaddr_in addr[static 1])
+{
+    uint32_t mask = table->index_capacity - 1;
+    uint32_t pos = (uint32_t)peer_addr_hash(addr) & mask;
+    client_t** first_tombstone = NULL;
+    while (1)
+    {
+        client_t** slot = &table->index[pos];
+        if (*slot == NULL)
+        {
+            return first_tombstone ? first_tombstone : slot;
+        }
+        if (*slot == &tombstone)
+        {
+            if (first_tombstone == NULL)
+            {
+                first_tombstone = slot;
+            }
+        }
+        else if (peer_addr_equal(&(*slot)->addr, addr))
+        {
+            return slot;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+static err_t peer_index_resize(peer_table_t table[static 1], uint32_t capacity)
+{
+    client_t** old = table->index;
+    uint32_t old_capacity = table->index_capacity;
+    client_t** index = calloc(capacity, sizeof(*index));
+    if (index == NULL)
+    {
+        LOG_ERROR("Cannot allocate peer index of %u slots\n", capacity);
+        return DISFS_ERR_ALLOC;
+    }
+    table->index = index;
+    table->index_capacity = capacity;
+    table->index_used = 0;
+    for (uint32_t i = 0; i < old_capacity; i++)
+    {
+        if (old[i] != NULL && old[i] != &tombstone)
+        {
+            *peer_index_find(table, &old[i]->addr) = old[i];
+            table->index_used++;
+        }
+    }
+    free(old);
+    return DISFS_SUCCESS;
+}
+
+/* keep load factor under one half, tombstones included */
+static err_t peer_index_reserve(peer_table_t table[static 1])
+{
+    if ((table->index_used + 1) * 2 <= table->index_capacity)
+    {
+        return DISFS_SUCCESS;
+    }
+    uint32_t capacity = table->index_capacity;
+    if ((table->count + 1) * 4 > capacity)
+    {
+        capacity *= 2;
+    }
+    return peer_index_resize(table, capacity);
+}
+
+static err_t peer_slab_grow(peer_table_t table[static 1])
+{
+    if (table->slab_count == table->slab_capacity)
+    {
+        uint32_t capacity = table->slab_capacity ? table->slab_capacity * 2 : 8;
+        client_t** slabs = realloc(table->slabs, capacity * sizeof(*slabs));
+        if (slabs == NULL)
+        {
+            LOG_ERROR("Cannot grow peer slab list to %u\n", capacity);
+            return DISFS_ERR_ALLOC;
+        }
+        table->slabs = slabs;
+        table->slab_capacity = capacity;
+    }
+    client_t* slab = calloc(PEER_SLAB_SIZE, sizeof(*slab));
+    if (slab == NULL)
+    {
+        LOG_ERROR("Cannot allocate peer slab\n");
+        return DISFS_ERR_ALLOC;
+    }
+    table->slabs[table->slab_count++] = slab;
+    for (uint32_t i = PEER_SLAB_SIZE; i > 0; i--)
+    {
+        slab[i - 1].next = table->free_list;
+        table->free_list = &slab[i - 1];
+    }
+    return DISFS_SUCCESS;
+}
+
+void peer_table_lock(peer_table_t table[static 1])
+{
+    pthread_mutex_lock(&table->lock);
+}
+
+void peer_table_unlock(peer_table_t table[static 1])
+{
+    pthread_mutex_unlock(&table->lock);
+}
+
+client_t* peer_table_find_locked(peer_table_t table[static 1],
+                                 const struct sockaddr_in addr[static 1])
+{
+    client_t* found = *peer_index_find(table, addr);
+    return found == &tombstone ? NULL : found;
+}
+
+err_t peer_table_add_locked(peer_table_t table[static 1],
+                            const struct sockaddr_in addr[static 1],
+                            client_t* peer[static 1])
+{
+    client_t** slot = peer_index_find(table, addr);
+    if (*slot != NULL && *slot != &tombstone)
+    {
+        *peer = *slot;
+        return DISFS_ERR_PEER_EXISTS;
+    }
+    if (table->free_list == NULL)
+    {
+        err_t ret = peer_slab_grow(table);
+        if (ret != DISFS_SUCCESS)
+        {
+            return ret;
+        }
+    }
+    err_t ret = peer_index_reserve(table);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    slot = peer_index_find(table, addr);
+
+    client_t* client = table->free_list;
+    table->free_list = client->next;
+    *client = (client_t){.addr = *addr};
+    if (*slot == NULL)
+    {
+        table->index_used++;
+    }
+    *slot = client;
+    table->count++;
+    *peer = client;
+    return DISFS_SUCCESS;
+}
+
+err_t peer_table_add(peer_table_t table[static 1],
+                     const struct sockaddr_in addr[static 1],
+                     client_t* peer[static 1])
+{
+    pthread_mutex_lock(&table->lock);
+    err_t ret = peer_table_add_locked(table, addr, peer);
+    pthread_mutex_unlock(&table->lock);
+    return ret;
+}
+
+err_t peer_table_rekey_locked(peer_table_t table[static 1],
+                              client_t peer[static 1],
+                              const struct sockaddr_in addr[static 1])
+{
+    client_t** slot = peer_index_find(table, addr);
+    if (*slot == peer)
+    {
+        return DISFS_SUCCESS;
+    }
+    if (*slot != NULL && *slot != &tombstone)
+    {
+        return DISFS_ERR_PEER_EXISTS;
+    }
+    err_t ret = peer_index_reserve(table);
+    if (ret != DISFS_SUCCESS)
+    {
+        return ret;
+    }
+    peer_table_detach_locked(table, peer);
+    slot = peer_index_find(table, addr);
+    if (*slot == NULL)
+    {
+        table->index_used++;
+    }
+    *slot = peer;
+    peer->addr = *addr;
+    return DISFS_SUCCESS;
+}
+
+void peer_table_detach_locked(peer_table_t table[static 1],
+                              client_t peer[static 1])
+{
+    client_t** slot = peer_index_find(table, &peer->addr);
+    if (*slot == peer)
+    {
+        *slot = &tombstone;
+    }
+}
+
+void peer_table_remove(peer_table_t table[static 1], client_t peer[static 1])
+{
+    pthread_mutex_lock(&table->lock);
+    /* detached peer may share address with peer which replaced it */
+    peer_table_detach_locked(table, peer);
+    table->count--;
+    peer->next = table->free_list;
+    table->free_list = peer;
+    pthread_mutex_unlock(&table->lock);
+}
+
+int32_t peer_table_contains(peer_table_t table[static 1],
+                            const struct sockaddr_in addr[static 1])
+{
+    pthread_mutex_lock(&table->lock);
+    client_t* found = peer_table_find_locked(table, addr);
+    pthread_mutex_unlock(&table->lock);
+    return found != NULL;
+}
+
+uint32_t peer_table_count(peer_table_t table[static 1])
+{
+    pthread_mutex_lock(&table->lock);
+    uint32_t count = table->count;
+    pthread_mutex_unlock(&table->lock);
+    return count;
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "peer_cache.h"
+#include "checksum.h"
+#include "logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PEER_CACHE_MAGIC 0x4143505346534944ULL /* "DISFSPCA" */
+#define PEER_CACHE_VERSION 1
+
+/* file header, followed by count entries */
+typedef struct peer_cache_header_t
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t checksum; /* CRC32C of entries */
+    uint32_t _reserved;
+} peer_cache_header_t;
+
+static peer_cache_entry_t*
+peer_cache_find(peer_cache_t cache[static 1], uint32_t ip, uint16_t tcp_port);
+static void peer_cache_remove(peer_cache_t cache[static 1],
+                              peer_cache_entry_t entry[static 1]);
+static int peer_cache_compare(const void* a, const void* b);
+
+err_t peer_cache_open(peer_cache_t cache[static 1], const char* path,
+                      uint64_t now_s)
+{
+    if (strlen(path) >= PEER_CACHE_PATH_MAX)
+    {
+        LOG_ERROR("Peer cache path %s is too long\n", path);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    *cache = (peer_cache_t){};
+    pthread_mutex_init(&cache->lock, NULL);
+    snprintf(cache->path, sizeof(cache->path), "%s", path);
+
+    int32_t fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+        {
+            LOG_WARNING("Cannot open peer cache %s: errno=%d : %s\n", path,
+                        errno, strerror(errno));
+        }
+        return DISFS_SUCCESS;
+    }
+    peer_cache_header_t header;
+    peer_cache_entry_t entries[PEER_CACHE_MAX];
+    int32_t valid =
+        read(fd, &header, sizeof(header)) == sizeof(header) &&
+        header.magic == PEER_CACHE_MAGIC &&
+        header.version == PEER_CACHE_VERSION && header.count <= PEER_CACHE_MAX;
+    uint64_t size = valid ? header.count * sizeof(*entries) : 0;
+    valid = valid && read(fd, entries, size) == (ssize_t)size &&
+            crc32c(0, entries, size) == header.checksum;
+    close(fd);
+    if (!valid)
+    {
+        LOG_WARNING("Peer cache %s is corrupted, starting without it\n", path);
+        return DISFS_SUCCESS;
+    }
+    for (uint32_t i = 0; i < header.count; i++)
+    {
+        if (entries[i].last_seen + PEER_CACHE_MAX_AGE_S >= now_s)
+        {
+            cache->entries[cache->count++] = entries[i];
+        }
+    }
+    cache->dirty = cache->count != header.count;
+    return DISFS_SUCCESS;
+}
+
+void peer_cache_close(peer_cache_t cache[static 1])
+{
+    peer_cache_save(cache);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+/* written next to the file and renamed over it, so file is always whole */
+err_t peer_cache_save(peer_cache_t cache[static 1])
+{
+    pthread_mutex_lock(&cache->lock);
+    if (!cache->dirty)
+    {
+        pthread_mutex_unlock(&cache->lock);
+        return DISFS_SUCCESS;
+    }
+    uint64_t size = cache->count * sizeof(*cache->entries);
+    peer_cache_header_t header = {
+        .magic = PEER_CACHE_MAGIC,
+        .version = PEER_CACHE_VERSION,
+        .count = cache->count,
+        .checksum = crc32c(0, cache->entries, size),
+    };
+    char tmp[PEER_CACHE_PATH_MAX + sizeof(".tmp")];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cache->path);
+    err_t ret = DISFS_SUCCESS;
+    int32_t fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || write(fd, &header, sizeof(header)) != sizeof(header) ||
+        write(fd, cache->entries, size) != (ssize_t)size || fsync(fd) < 0 ||
+        rename(tmp, cache->path) < 0)
+    {
+        LOG_ERROR("Cannot write peer cache %s: errno=%d : %s\n", cache->path,
+                  errno, strerror(errno));
+        ret = DISFS_ERR_IO;
+        unlink(tmp);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    cache->dirty = ret != DISFS_SUCCESS;
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+void peer_cache_learn(peer_cache_t cache[static 1],
+                      const struct sockaddr_in addr[static 1],
+                      uint16_t tcp_port, uint64_t now_s)
+{
+    pthread_mutex_lock(&cache->lock);
+    uint16_t udp_port = ntohs(addr->sin_port);
+    peer_cache_entry_t* entry =
+        peer_cache_find(cache, addr->sin_addr.s_addr, tcp_port);
+    if (entry != NULL)
+    {
+        if (entry->udp_port != udp_port)
+        {
+            entry->udp_port = udp_port;
+            cache->dirty = 1;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        return;
+    }
+    if (cache->count == PEER_CACHE_MAX)
+    {
+        entry = &cache->entries[0];
+        for (uint32_t i = 1; i < cache->count; i++)
+        {
+            if (cache->entries[i].last_seen < entry->last_seen)
+            {
+                entry = &cache->entries[i];
+            }
+        }
+        peer_cache_remove(cache, entry);
+    }
+    cache->entries[cache->count++] = (peer_cache_entry_t){
+        .ip = addr->sin_addr.s_addr,
+        .udp_port = udp_port,
+        .tcp_port = tcp_port,
+        .last_seen = now_s,
+    };
+    cache->dirty = 1;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void peer_cache_result(peer_cache_t cache[static 1],
+                       const struct sockaddr_in addr[static 1],
+                       int32_t success, uint64_t now_s)
+{
+    pthread_mutex_lock(&cache->lock);
+    peer_cache_entry_t* entry = peer_cache_find(
+        cache, addr->sin_addr.s_addr, ntohs(addr->sin_port));
+    if (entry != NULL && success)
+    {
+        entry->successes++;
+        entry->failures = 0;
+        entry->last_seen = now_s;
+        cache->dirty = 1;
+    }
+    else if (entry != NULL && ++entry->failures >= PEER_CACHE_MAX_FAILURES)
+    {
+        peer_cache_remove(cache, entry);
+        cache->dirty = 1;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+uint32_t peer_cache_list(peer_cache_t cache[static 1],
+                         peer_cache_entry_t* entries, uint32_t capacity)
+{
+    pthread_mutex_lock(&cache->lock);
+    peer_cache_entry_t sorted[PEER_CACHE_MAX];
+    memcpy(sorted, cache->entries, cache->count * sizeof(*sorted));
+    qsort(sorted, cache->count, sizeof(*sorted), peer_cache_compare);
+    uint32_t count = cache->count < capacity ? cache->count : capacity;
+    memcpy(entries, sorted, count * sizeof(*entries));
+    pthread_mutex_unlock(&cache->lock);
+    return count;
+}
+
+static peer_cache_entry_t*
+peer_cache_find(peer_cache_t cache[static 1], uint32_t ip, uint16_t tcp_port)
+{
+    for (uint32_t i = 0; i < cache->count; i++)
+    {
+        if (cache->entries[i].ip == ip &&
+            cache->entries[i].tcp_port == tcp_port)
+        {
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* order of entries does not matter, last one takes place of removed */
+static void peer_cache_remove(peer_cache_t cache[static 1],
+                              peer_cache_entry_t entry[static 1])
+{
+    *entry = cache->entries[--cache->count];
+}
+
+static int peer_cache_compare(const void* a, const void* b)
+{
+    const peer_cache_entry_t* x = a;
+    const peer_cache_entry_t* y = b;
+    if (x->failures != y->failures)
+    {
+        return x->failures < y->failures ? -1 : 1;
+    }
+    if (x->successes != y->successes)
+    {
+        return x->successes > y->successes ? -1 : 1;
+    }
+    if (x->last_seen != y->last_seen)
+    {
+        return x->last_seen > y->last_seen ? -1 : 1;
+    }
+    return 0;
+}
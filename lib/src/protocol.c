@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "protocol.h"
+#include "err_codes.h"
+#include "logger.h"
+
+void proto_header_encode(const proto_header_t header[static 1],
+                         uint8_t out[static PROTO_HEADER_SIZE])
+{
+    out[0] = header->version;
+    out[1] = header->flags;
+    proto_put_u16(out + 2, header->type);
+    proto_put_u32(out + 4, header->length);
+    proto_put_u64(out + 8, header->request_id);
+}
+
+err_t proto_header_decode(proto_header_t header[static 1],
+                          const uint8_t in[static PROTO_HEADER_SIZE])
+{
+    header->version = in[0];
+    header->flags = in[1];
+    header->type = proto_get_u16(in + 2);
+    header->length = proto_get_u32(in + 4);
+    header->request_id = proto_get_u64(in + 8);
+    if (header->version != PROTO_VERSION)
+    {
+        LOG_ERROR("Frame with unsupported protocol version %u\n",
+                  header->version);
+        return DISFS_ERR_PROTO;
+    }
+    if (header->length > PROTO_MAX_PAYLOAD)
+    {
+        LOG_ERROR("Frame payload too big: %u\n", header->length);
+        return DISFS_ERR_PROTO;
+    }
+    return DISFS_SUCCESS;
+}
+
+err_t proto_process(ring_buffer_t rx[static 1],
+                    proto_verify_t verify[static 1], proto_dispatch_fn dispatch,
+                    void* arg)
+{
+    while (ring_buffer_used(rx) >= PROTO_HEADER_SIZE)
+    {
+        proto_frame_t frame;
+        const uint8_t* data = ring_buffer_read_ptr(rx);
+        err_t ret = proto_header_decode(&frame.header, data);
+        if (ret != DISFS_SUCCESS)
+        {
+            return ret;
+        }
+        if (verify->folded == 0)
+        {
+            checksum_init(&verify->sum,
+                          proto_checksum_kind(frame.header.flags));
+        }
+        uint64_t covered = PROTO_HEADER_SIZE + (uint64_t)frame.header.length;
+        uint64_t available = ring_buffer_used(rx);
+        uint64_t fold = available < covered ? available : covered;
+        checksum_update(&verify->sum, data + verify->folded,
+                        fold - verify->folded);
+        verify->folded = fold;
+        uint64_t frame_len = covered + PROTO_TRAILER_SIZE;
+        if (available < frame_len)
+        {
+            break;
+        }
+        verify->folded = 0;
+        uint32_t expected = proto_get_u32(data + covered);
+        if (checksum_final(&verify->sum) != expected)
+        {
+            LOG_ERROR("Frame %lu of type %u has wrong checksum\n",
+                      frame.header.request_id, frame.header.type);
+            return DISFS_ERR_CORRUPT;
+        }
+        frame.payload = data + PROTO_HEADER_SIZE;
+        ret = dispatch(arg, &frame);
+        ring_buffer_consume(rx, frame_len);
+        if (ret != DISFS_SUCCESS)
+        {
+            return ret == PROTO_STOP ? DISFS_SUCCESS : ret;
+        }
+    }
+    return DISFS_SUCCESS;
+}
@@ -0,0 +1,601 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "read_plan.h"
+#include "buf_pool.h"
+#include "connection.h"
+#include "hash_ring.h"
+#include "logger.h"
+#include "sha256.h"
+#include "wire.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#define READ_PLAN_HEDGE_DEFAULT_MS 50
+/* samples of peer needed before its own p95 decides hedging */
+#define READ_PLAN_MIN_SAMPLES 16
+/* latency history is halved once it holds this many samples */
+#define READ_PLAN_LATENCY_SAMPLES 1024
+#define READ_PLAN_NO_PEER UINT32_MAX
+
+struct read_plan_op_t;
+
+/* single request for chunk sent to one owner */
+typedef struct read_plan_attempt_t
+{
+    struct read_plan_op_t* op;
+    uint64_t sent_ns;
+    struct sockaddr_in addr;
+    uint32_t chunk; /* index of chunk in file */
+    uint32_t peer;  /* index into peers of plan */
+    uint8_t hedge;
+    uint8_t cancelled; /* cancel was posted, no other owner is tried */
+    char _padded[6];
+} read_plan_attempt_t;
+
+/* chunk of read window, slot i holds every window-th chunk */
+typedef struct read_plan_slot_t
+{
+    chunk_hash_t hash;
+    struct buf_t* data;
+    read_plan_attempt_t* attempts[2]; /* primary and hedge in flight */
+    uint64_t hedge_ns; /* when duplicate is sent, 0 when it is not */
+    err_t status;      /* of last failed attempt until slot is done */
+    uint32_t chunk;
+    uint32_t length;
+    uint32_t owner_count;
+    uint32_t tried; /* bit of every owner asked already */
+    uint8_t done;
+    uint8_t retry;       /* attempt failed, reader asks next owner */
+    uint8_t retry_hedge; /* failed attempt was duplicate */
+    char _padded[5];
+    struct sockaddr_in owners[READ_PLAN_MAX_REPLICAS];
+} read_plan_slot_t;
+
+/* state of one read_plan_read, guarded by plan lock */
+typedef struct read_plan_op_t
+{
+    read_plan_t* plan;
+    read_plan_slot_t* slots;
+    pthread_cond_t changed;
+    uint32_t outstanding; /* attempts which did not complete yet */
+    char _padded[4];
+} read_plan_op_t;
+
+static uint32_t read_plan_peer(read_plan_t plan[static 1],
+                               const struct sockaddr_in addr[static 1]);
+static uint64_t read_plan_hedge_ns(const read_plan_t plan[static 1],
+                                   uint32_t peer);
+static void read_plan_record(read_plan_t plan[static 1], uint32_t peer,
+                             uint64_t ns);
+static void read_plan_start(read_plan_op_t op[static 1],
+                            read_plan_slot_t slot[static 1], uint32_t chunk,
+                            const chunk_hash_t hash[static 1]);
+static err_t read_plan_send(read_plan_op_t op[static 1],
+                            read_plan_slot_t slot[static 1], uint8_t hedge);
+static void read_plan_cancel(read_plan_op_t op[static 1],
+                             read_plan_slot_t slot[static 1]);
+static void read_plan_fetched(void* ctx, client_t* client, err_t status,
+                              const proto_frame_t* reply);
+static void read_plan_wait(read_plan_op_t op[static 1], uint64_t until_ns);
+
+err_t _internal_read_plan_init(read_plan_t plan[static 1],
+                               struct connection_t* conn,
+                               read_plan_params_opt params)
+{
+    *plan = (read_plan_t){
+        .conn = conn,
+        .store = params.store,
+        .window = params.window ? params.window : READ_PLAN_DEFAULT_WINDOW,
+        .replicas =
+            params.replicas ? params.replicas : READ_PLAN_DEFAULT_REPLICAS,
+        .timeout_ms = params.timeout_ms,
+        .hedge_default_ms = params.hedge_default_ms
+                                ? params.hedge_default_ms
+                                : READ_PLAN_HEDGE_DEFAULT_MS,
+        .disable_hedging = params.disable_hedging,
+    };
+    if (plan->replicas > READ_PLAN_MAX_REPLICAS)
+    {
+        LOG_ERROR("Read plan supports at most %u replicas, %u requested\n",
+                  READ_PLAN_MAX_REPLICAS, plan->replicas);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    pthread_mutex_init(&plan->lock, NULL);
+    return DISFS_SUCCESS;
+}
+
+void read_plan_destroy(read_plan_t plan[static 1])
+{
+    free(plan->peers);
+    pthread_mutex_destroy(&plan->lock);
+    *plan = (read_plan_t){};
+}
+
+/* peers are only added, cluster is small enough for linear search */
+static uint32_t read_plan_peer(read_plan_t plan[static 1],
+                               const struct sockaddr_in addr[static 1])
+{
+    for (uint32_t i = 0; i < plan->peer_count; i++)
+    {
+        if (plan->peers[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            plan->peers[i].addr.sin_port == addr->sin_port)
+        {
+            return i;
+        }
+    }
+    if (plan->peer_count == plan->peer_capacity)
+    {
+        uint32_t capacity = plan->peer_capacity ? plan->peer_capacity * 2 : 8;
+        read_plan_peer_t* peers =
+            realloc(plan->peers, capacity * sizeof(*peers));
+        if (peers == NULL)
+        {
+            LOG_ERROR("Cannot grow read plan to %u peers\n", capacity);
+            return READ_PLAN_NO_PEER;
+        }
+        plan->peers = peers;
+        plan->peer_capacity = capacity;
+    }
+    plan->peers[plan->peer_count] = (read_plan_peer_t){.addr = *addr};
+    return plan->peer_count++;
+}
+
+static uint64_t read_plan_hedge_ns(const read_plan_t plan[static 1],
+                                   uint32_t peer)
+{
+    const metrics_histogram_t* latency = &plan->peers[peer].latency;
+    if (latency->count < READ_PLAN_MIN_SAMPLES)
+    {
+        return (uint64_t)plan->hedge_default_ms * 1000000ULL;
+    }
+    return metrics_quantile(latency, READ_PLAN_HEDGE_QUANTILE);
+}
+
+/*
+ * Halving keeps shape of distribution while recent samples outweigh old ones,
+ * so peer whose disk got slow gets later hedges within a few hundred reads.
+ */
+static void read_plan_record(read_plan_t plan[static 1], uint32_t peer,
+                             uint64_t ns)
+{
+    metrics_histogram_t* latency = &plan->peers[peer].latency;
+    if (latency->count >= READ_PLAN_LATENCY_SAMPLES)
+    {
+        latency->count = 0;
+        for (uint32_t i = 0; i < METRICS_BUCKETS; i++)
+        {
+            latency->buckets[i] /= 2;
+            latency->count += latency->buckets[i];
+        }
+        latency->sum /= 2;
+    }
+    latency->buckets[metrics_bucket(ns)]++;
+    latency->count++;
+    latency->sum += ns;
+    latency->max = ns > latency->max ? ns : latency->max;
+}
+
+/*
+ * Local store is read first as no peer can beat it, otherwise remote owners
+ * are asked. Called with lock held, lock is released while reading local
+ * chunk, slot has no attempts yet so no completion can touch it.
+ */
+static void read_plan_start(read_plan_op_t op[static 1],
+                            read_plan_slot_t slot[static 1], uint32_t chunk,
+                            const chunk_hash_t hash[static 1])
+{
+    read_plan_t* plan = op->plan;
+    *slot = (read_plan_slot_t){.hash = *hash, .chunk = chunk};
+    hash_ring_node_t owners[READ_PLAN_MAX_REPLICAS];
+    uint32_t count = hash_ring_lookup(&plan->conn->ring,
+                                      hash_ring_key(hash->bytes), owners,
+                                      plan->replicas);
+    uint8_t local = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (owners[i].local)
+        {
+            local = 1;
+            continue;
+        }
+        slot->owners[slot->owner_count++] = owners[i].addr;
+    }
+
+    if (local && plan->store)
+    {
+        pthread_mutex_unlock(&plan->lock);
+        buf_t* buf = buf_alloc(CHUNK_MAX_SIZE);
+        uint32_t length = 0;
+        err_t ret = buf ? chunk_store_get(plan->store, hash, buf->data,
+                                          CHUNK_MAX_SIZE, &length)
+                        : DISFS_ERR_ALLOC;
+        pthread_mutex_lock(&plan->lock);
+        if (ret == DISFS_SUCCESS)
+        {
+            slot->data = buf;
+            slot->length = length;
+            slot->done = 1;
+            plan->stats.local_chunks++;
+            return;
+        }
+        buf_unref(buf);
+    }
+
+    err_t ret = read_plan_send(op, slot, 0);
+    if (ret != DISFS_SUCCESS)
+    {
+        slot->status = ret;
+        slot->done = 1;
+    }
+}
+
+/*
+ * Ask least busy owner which was not asked yet, ties go to owner with shorter
+ * hedge delay. Owner which cannot be reached right away is skipped.
+ */
+static err_t read_plan_send(read_plan_op_t op[static 1],
+                            read_plan_slot_t slot[static 1], uint8_t hedge)
+{
+    read_plan_t* plan = op->plan;
+    err_t ret = DISFS_ERR_NOT_FOUND;
+    for (;;)
+    {
+        uint32_t best = READ_PLAN_NO_PEER;
+        uint32_t best_peer = READ_PLAN_NO_PEER;
+        uint64_t best_hedge = 0;
+        for (uint32_t i = 0; i < slot->owner_count; i++)
+        {
+            if (slot->tried & (1u << i))
+            {
+                continue;
+            }
+            uint32_t peer = read_plan_peer(plan, &slot->owners[i]);
+            if (peer == READ_PLAN_NO_PEER)
+            {
+                return DISFS_ERR_ALLOC;
+            }
+            uint64_t hedge_ns = read_plan_hedge_ns(plan, peer);
+            if (best == READ_PLAN_NO_PEER ||
+                plan->peers[peer].inflight <
+                    plan->peers[best_peer].inflight ||
+                (plan->peers[peer].inflight ==
+                     plan->peers[best_peer].inflight &&
+                 hedge_ns < best_hedge))
+            {
+                best = i;
+                best_peer = peer;
+                best_hedge = hedge_ns;
+            }
+        }
+        if (best == READ_PLAN_NO_PEER)
+        {
+            return ret;
+        }
+        slot->tried |= 1u << best;
+
+        read_plan_attempt_t* attempt = malloc(sizeof(*attempt));
+        if (attempt == NULL)
+        {
+            LOG_ERROR("Cannot allocate chunk request\n");
+            return DISFS_ERR_ALLOC;
+        }
+        *attempt = (read_plan_attempt_t){
+            .op = op,
+            .sent_ns = metrics_now_ns(),
+            .addr = slot->owners[best],
+            .chunk = slot->chunk,
+            .peer = best_peer,
+            .hedge = hedge,
+        };
+        /* completion waits for lock, so attempt is linked before it runs */
+        ret = connection_call(plan->conn, &attempt->addr, PROTO_MSG_CHUNK_GET,
+                              slot->hash.bytes, CHUNK_HASH_SIZE,
+                              plan->timeout_ms, read_plan_fetched, attempt);
+        if (ret != DISFS_SUCCESS)
+        {
+            free(attempt);
+            continue;
+        }
+        plan->peers[best_peer].inflight++;
+        plan->stats.requests++;
+        op->outstanding++;
+        slot->attempts[slot->attempts[0] ? 1 : 0] = attempt;
+        /* lone request is duplicated while some owner was not asked yet */
+        slot->hedge_ns = 0;
+        if (!plan->disable_hedging &&
+            (slot->attempts[0] == NULL || slot->attempts[1] == NULL) &&
+            slot->tried != (1u << slot->owner_count) - 1)
+        {
+            slot->hedge_ns = attempt->sent_ns + best_hedge;
+        }
+        return DISFS_SUCCESS;
+    }
+}
+
+/*
+ * Completions of cancelled attempts only release them. Called by reader only,
+ * completions never call back into connection.
+ */
+static void read_plan_cancel(read_plan_op_t op[static 1],
+                             read_plan_slot_t slot[static 1])
+{
+    slot->hedge_ns = 0;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        read_plan_attempt_t* attempt = slot->attempts[i];
+        slot->attempts[i] = NULL;
+        if (attempt == NULL)
+        {
+            continue;
+        }
+        attempt->cancelled = 1;
+        op->plan->stats.cancelled++;
+        connection_cancel(op->plan->conn, &attempt->addr, read_plan_fetched,
+                          attempt);
+    }
+}
+
+/*
+ * Completion only records result, retry and cancel of losing attempt are
+ * left to reader, as completion may run where connection cannot be called,
+ * e.g. while peer is dropped or connection closed.
+ */
+static void read_plan_fetched(void* ctx, client_t* client, err_t status,
+                              const proto_frame_t* reply)
+{
+    read_plan_attempt_t* attempt = ctx;
+    read_plan_op_t* op = attempt->op;
+    read_plan_t* plan = op->plan;
+    uint64_t elapsed = metrics_now_ns() - attempt->sent_ns;
+
+    /* chunk is decoded, verified and copied before lock */
+    buf_t* buf = NULL;
+    uint32_t length = 0;
+    chunk_hash_t hash = {};
+    if (status == DISFS_SUCCESS)
+    {
+        wire_chunk_data_t data = {};
+        if (reply->header.type != PROTO_MSG_CHUNK_DATA ||
+            wire_chunk_data_decode(&data, reply->payload,
+                                   reply->header.length) != DISFS_SUCCESS ||
+            data.data.length > CHUNK_MAX_SIZE)
+        {
+            status = DISFS_ERR_PROTO;
+        }
+        else if (sha256(data.data.data, data.data.length, hash.bytes),
+                 memcmp(hash.bytes, data.hash.data, CHUNK_HASH_SIZE) != 0)
+        {
+            LOG_WARNING("Chunk from %s does not match its hash\n",
+                        client->ip);
+            status = DISFS_ERR_CORRUPT;
+        }
+        else if ((buf = buf_alloc(data.data.length)) == NULL)
+        {
+            status = DISFS_ERR_ALLOC;
+        }
+        else
+        {
+            length = (uint32_t)data.data.length;
+            memcpy(buf->data, data.data.data, length);
+        }
+    }
+
+    pthread_mutex_lock(&plan->lock);
+    plan->peers[attempt->peer].inflight--;
+    /* cancelled reply was at least this slow, which keeps p95 honest */
+    if (status == DISFS_SUCCESS || status == DISFS_ERR_CANCELLED)
+    {
+        read_plan_record(plan, attempt->peer, elapsed);
+    }
+    read_plan_slot_t* slot = &op->slots[attempt->chunk % plan->window];
+    if (slot->chunk == attempt->chunk && !attempt->cancelled)
+    {
+        /* reader cancels only attempts still linked to slot */
+        slot->attempts[slot->attempts[0] == attempt ? 0 : 1] = NULL;
+    }
+    if (slot->chunk == attempt->chunk && !slot->done && !attempt->cancelled)
+    {
+        if (status == DISFS_SUCCESS &&
+            memcmp(hash.bytes, slot->hash.bytes, CHUNK_HASH_SIZE) != 0)
+        {
+            status = DISFS_ERR_PROTO;
+        }
+        if (status == DISFS_SUCCESS)
+        {
+            slot->data = buf;
+            slot->length = length;
+            slot->status = DISFS_SUCCESS;
+            slot->done = 1;
+            slot->hedge_ns = 0;
+            buf = NULL;
+            plan->stats.hedge_wins += attempt->hedge;
+        }
+        else
+        {
+            slot->status = status;
+            slot->retry = 1;
+            slot->retry_hedge = attempt->hedge;
+        }
+    }
+    op->outstanding--;
+    pthread_cond_signal(&op->changed);
+    pthread_mutex_unlock(&plan->lock);
+    buf_unref(buf);
+    free(attempt);
+}
+
+/* condition uses monotonic clock, as hedge deadlines do */
+static void read_plan_wait(read_plan_op_t op[static 1], uint64_t until_ns)
+{
+    if (until_ns == UINT64_MAX)
+    {
+        pthread_cond_wait(&op->changed, &op->plan->lock);
+        return;
+    }
+    struct timespec deadline = {.tv_sec = (time_t)(until_ns / 1000000000ULL),
+                                .tv_nsec = (long)(until_ns % 1000000000ULL)};
+    pthread_cond_timedwait(&op->changed, &op->plan->lock, &deadline);
+}
+
+err_t read_plan_read(read_plan_t plan[static 1], const chunk_hash_t* hashes,
+                     uint32_t count, read_plan_sink_fn sink, void* ctx)
+{
+    read_plan_op_t op = {.plan = plan};
+    op.slots = calloc(plan->window, sizeof(*op.slots));
+    if (op.slots == NULL)
+    {
+        LOG_ERROR("Cannot allocate read window of %u chunks\n", plan->window);
+        return DISFS_ERR_ALLOC;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&op.changed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    err_t ret = DISFS_SUCCESS;
+    uint32_t next = 0;    /* first chunk not started */
+    uint32_t deliver = 0; /* first chunk not passed to sink */
+    pthread_mutex_lock(&plan->lock);
+    plan->stats.reads++;
+    while (deliver < count && ret == DISFS_SUCCESS)
+    {
+        while (next < count && next - deliver < plan->window)
+        {
+            read_plan_start(&op, &op.slots[next % plan->window], next,
+                            &hashes[next]);
+            next++;
+        }
+        read_plan_slot_t* slot = &op.slots[deliver % plan->window];
+        if (slot->done)
+        {
+            read_plan_cancel(&op, slot);
+            ret = slot->status;
+            if (ret == DISFS_SUCCESS)
+            {
+                plan->stats.chunks++;
+                plan->stats.bytes += slot->length;
+                pthread_mutex_unlock(&plan->lock);
+                ret = sink(ctx, deliver, slot->data->data, slot->length);
+                pthread_mutex_lock(&plan->lock);
+            }
+            buf_unref(slot->data);
+            slot->data = NULL;
+            deliver++;
+            continue;
+        }
+
+        /*
+           losers of finished chunks are cancelled, failed requests move to
+           next owner and late ones are duplicated, then sleep until next
+           duplicate is due
+         */
+        uint64_t now = metrics_now_ns();
+        uint64_t wake = UINT64_MAX;
+        for (uint32_t i = deliver; i < next; i++)
+        {
+            read_plan_slot_t* pending = &op.slots[i % plan->window];
+            if (pending->done)
+            {
+                read_plan_cancel(&op, pending);
+                continue;
+            }
+            if (pending->retry)
+            {
+                pending->retry = 0;
+                if (read_plan_send(&op, pending, pending->retry_hedge) ==
+                    DISFS_SUCCESS)
+                {
+                    plan->stats.retries++;
+                }
+                else if (pending->attempts[0] == NULL &&
+                         pending->attempts[1] == NULL)
+                {
+                    /* error of last owner asked is error of chunk */
+                    pending->done = 1;
+                    wake = now;
+                    continue;
+                }
+            }
+            if (pending->hedge_ns == 0)
+            {
+                continue;
+            }
+            if (pending->hedge_ns > now)
+            {
+                wake = pending->hedge_ns < wake ? pending->hedge_ns : wake;
+                continue;
+            }
+            pending->hedge_ns = 0;
+            if (read_plan_send(&op, pending, 1) == DISFS_SUCCESS)
+            {
+                plan->stats.hedges++;
+            }
+        }
+        if (wake <= now)
+        {
+            continue;
+        }
+        read_plan_wait(&op, wake);
+    }
+
+    /* requests of failed read are not waited for */
+    for (uint32_t i = deliver; i < next; i++)
+    {
+        read_plan_slot_t* slot = &op.slots[i % plan->window];
+        read_plan_cancel(&op, slot);
+        buf_unref(slot->data);
+        slot->data = NULL;
+    }
+    while (op.outstanding)
+    {
+        pthread_cond_wait(&op.changed, &plan->lock);
+    }
+    plan->stats.errors += ret != DISFS_SUCCESS;
+    pthread_mutex_unlock(&plan->lock);
+    if (ret != DISFS_SUCCESS)
+    {
+        LOG_ERROR("Read of %u chunks failed at chunk %u : %lld\n", count,
+                  deliver ? deliver - 1 : 0, ret);
+    }
+    pthread_cond_destroy(&op.changed);
+    free(op.slots);
+    return ret;
+}
+
+void read_plan_stats(read_plan_t plan[static 1],
+                     read_plan_stats_t stats[static 1])
+{
+    pthread_mutex_lock(&plan->lock);
+    *stats = plan->stats;
+    pthread_mutex_unlock(&plan->lock);
+}
+
+void read_plan_report(read_plan_t plan[static 1],
+                      metrics_writer_t writer[static 1])
+{
+    pthread_mutex_lock(&plan->lock);
+    const read_plan_stats_t* s = &plan->stats;
+    metrics_printf(writer,
+                   "read_plan reads=%lu chunks=%lu bytes=%lu "
+                   "local_chunks=%lu requests=%lu hedges=%lu hedge_wins=%lu "
+                   "cancelled=%lu retries=%lu errors=%lu\n",
+                   s->reads, s->chunks, s->bytes, s->local_chunks,
+                   s->requests, s->hedges, s->hedge_wins, s->cancelled,
+                   s->retries, s->errors);
+    for (uint32_t i = 0; i < plan->peer_count; i++)
+    {
+        const read_plan_peer_t* peer = &plan->peers[i];
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer->addr.sin_addr, ip, sizeof(ip));
+        metrics_printf(writer,
+                       "read_plan_peer %s:%u inflight=%u samples=%lu "
+                       "hedge_ns=%lu\n",
+                       ip, ntohs(peer->addr.sin_port), peer->inflight,
+                       peer->latency.count, read_plan_hedge_ns(plan, i));
+    }
+    pthread_mutex_unlock(&plan->lock);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ring_buffer.h"
+#include "err_codes.h"
+#include "logger.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+err_t ring_buffer_create(ring_buffer_t rb[static 1], uint64_t capacity)
+{
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        capacity % page != 0)
+    {
+        LOG_ERROR("Invalid ring buffer capacity %lu\n", capacity);
+        return DISFS_ERR_INVALID_ARG;
+    }
+
+    int32_t fd = memfd_create("disfs-ring", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("Cannot create memfd for ring buffer: errno=%d : %s\n", errno,
+                  strerror(errno));
+        return DISFS_ERR_ALLOC;
+    }
+    if (ftruncate(fd, (off_t)capacity) < 0)
+    {
+        LOG_ERROR("Cannot resize ring buffer memfd: errno=%d : %s\n", errno,
+                  strerror(errno));
+        close(fd);
+        return DISFS_ERR_ALLOC;
+    }
+
+    /* reserve address space for both halves, then map the file twice */
+    uint8_t* base = mmap(NULL, capacity * 2, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR("Cannot reserve ring buffer memory: errno=%d : %s\n", errno,
+                  strerror(errno));
+        close(fd);
+        return DISFS_ERR_ALLOC;
+    }
+    void* lower = mmap(base, capacity, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_FIXED, fd, 0);
+    void* upper = mmap(base + capacity, capacity, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd);
+    if (lower == MAP_FAILED || upper == MAP_FAILED)
+    {
+        LOG_ERROR("Cannot map ring buffer mirror: errno=%d : %s\n", errno,
+                  strerror(errno));
+        munmap(base, capacity * 2);
+        return DISFS_ERR_ALLOC;
+    }
+
+    rb->base = base;
+    rb->capacity = capacity;
+    rb->head = 0;
+    rb->tail = 0;
+    return DISFS_SUCCESS;
+}
+
+void ring_buffer_destroy(ring_buffer_t rb[static 1])
+{
+    if (rb->base)
+    {
+        munmap(rb->base, rb->capacity * 2);
+    }
+    rb->base = NULL;
+    rb->capacity = 0;
+    rb->head = 0;
+    rb->tail = 0;
+}
@@ -4,12 +4,20 @@
  */
 
 #include "udp_discovery.h"
+#include "checksum.h"
 #include "err_codes.h"
 #include "logger.h"
+#include "protocol.h"
+#include "wire.h"
 #include <stdlib.h>
 #include <time.h>
 
-#define LEN 44
+_Static_assert(UDP_DISCOVERY_PACKET_SIZE == WIRE_FIXED_SIZE(discovery),
+               "Discovery packet does not match its wire schema");
+_Static_assert(UDP_DISCOVERY_PACKET_SIZE <= UDP_BATCH_PACKET_SIZE,
+               "Discovery packet does not fit udp batch datagram");
+
+static void udp_batch_reset(udp_batch_t batch[static 1], uint32_t index);
 
 err_t udp_discovery_packet_create(UDP_packet packet[static 1], int32_t tcp_port,
                                   const char* hostname,
@@ -29,53 +37,193 @@ err_t udp_discovery_packet_create(UDP_packet packet[static 1], int32_t tcp_port,
     return DISFS_SUCCESS;
 }
 
-err_t udp_discovery_packet_serialize(UDP_packet packet[static 1], char* buffer,
-                                     int64_t buffer_len)
+err_t udp_discovery_packet_serialize(const UDP_packet packet[static 1],
+                                     char* buffer, int64_t buffer_len)
 {
-    ASSERT(buffer_len >= LEN,
-           "Invalid size of buffer for udp packet serialize\n");
+    if (buffer_len < UDP_DISCOVERY_PACKET_SIZE)
+    {
+        LOG_ERROR("Invalid size of buffer for udp packet serialize\n");
+        return DISFS_ERR_INVALID_ARG;
+    }
     if (packet->hostname_len > UDP_DISCOVERY_HOSTNAME_MAX_LEN)
     {
         LOG_ERROR("Hostname is longer than maximum allowed hostname\n");
         return DISFS_ERR_INVALID_ARG;
     }
-    memset(buffer, 0, LEN);
-    size_t int_len = sizeof(int);
-    memcpy(buffer, &packet->tcp_port, int_len);
-    buffer += int_len;
-    memcpy(buffer, &packet->magic_number, int_len);
-    buffer += int_len;
-    memcpy(buffer, &packet->protocol_version, int_len);
-    buffer += int_len;
-    memcpy(buffer, &packet->timestamp.tv_nsec, int_len);
-    buffer += int_len;
-    memcpy(buffer, &packet->timestamp.tv_sec, int_len);
-    buffer += int_len;
-    memcpy(buffer, &packet->hostname_len, int_len);
-    buffer += int_len;
-    memcpy(buffer, &packet->hostname, (size_t)packet->hostname_len);
-    return DISFS_SUCCESS;
+    /* negative values are sign extended and rejected by encoder */
+    wire_discovery_t msg = {
+        .tcp_port = (uint64_t)(int64_t)packet->tcp_port,
+        .magic = packet->magic_number,
+        .version = (uint64_t)(int64_t)packet->protocol_version,
+        .timestamp_nsec = (uint64_t)packet->timestamp.tv_nsec,
+        .timestamp_sec = (uint64_t)packet->timestamp.tv_sec,
+        .hostname_len = packet->hostname_len,
+        .hostname = {.data = (const uint8_t*)packet->hostname,
+                     .length = packet->hostname_len},
+    };
+    uint64_t length;
+    err_t ret = wire_discovery_encode(&msg, (uint8_t*)buffer,
+                                      (uint64_t)buffer_len, &length);
+    if (ret == DISFS_SUCCESS)
+    {
+        proto_put_u32((uint8_t*)buffer + length - CHECKSUM_SIZE,
+                      crc32c(0, buffer, length - CHECKSUM_SIZE));
+    }
+    return ret;
 }
 
 err_t udp_discovery_packet_deserialize(UDP_packet packet[static 1],
-                                       char* buffer, int64_t buffer_len)
+                                       const char* buffer, int64_t buffer_len)
 {
-    ASSERT(buffer_len >= LEN,
-           "Invalid size of buffer for udp packet serialize\n");
-    size_t int_len = sizeof(int);
-    memcpy(&packet->tcp_port, buffer, int_len);
-    buffer += int_len;
-    memcpy(&packet->magic_number, buffer, int_len);
-    buffer += int_len;
-    memcpy(&packet->protocol_version, buffer, int_len);
-    buffer += int_len;
-    memcpy(&packet->timestamp.tv_nsec, buffer, int_len);
-    buffer += int_len;
-    memcpy(&packet->timestamp.tv_sec, buffer, int_len);
-    buffer += int_len;
-    memcpy(&packet->hostname_len, buffer, int_len);
-    buffer += int_len;
-    memset(packet->hostname, 0, UDP_DISCOVERY_HOSTNAME_MAX_LEN);
-    memcpy(packet->hostname, buffer, (size_t)packet->hostname_len);
+    wire_discovery_t msg;
+    uint64_t consumed;
+    /* newer versions may append fields */
+    if (buffer_len < 0 ||
+        wire_decode(&wire_discovery_schema, &msg, (const uint8_t*)buffer,
+                    (uint64_t)buffer_len, &consumed) != DISFS_SUCCESS ||
+        msg.hostname_len > UDP_DISCOVERY_HOSTNAME_MAX_LEN)
+    {
+        return DISFS_ERR_PROTO;
+    }
+    if (crc32c(0, buffer, UDP_DISCOVERY_PACKET_SIZE - CHECKSUM_SIZE) !=
+        msg.checksum)
+    {
+        return DISFS_ERR_CORRUPT;
+    }
+    *packet = (UDP_packet){
+        .tcp_port = (int32_t)msg.tcp_port,
+        .protocol_version = (int32_t)msg.version,
+        .magic_number = (uint32_t)msg.magic,
+        .hostname_len = (uint32_t)msg.hostname_len,
+        .timestamp = {.tv_sec = (time_t)msg.timestamp_sec,
+                      .tv_nsec = (long)msg.timestamp_nsec},
+    };
+    memcpy(packet->hostname, msg.hostname.data, msg.hostname_len);
     return DISFS_SUCCESS;
 }
+
+udp_batch_t* udp_batch_create(void)
+{
+    udp_batch_t* batch = calloc(1, sizeof(*batch));
+    if (batch == NULL)
+    {
+        LOG_ERROR("Cannot allocate udp batch\n");
+    }
+    return batch;
+}
+
+void udp_batch_free(udp_batch_t* batch)
+{
+    free(batch);
+}
+
+/* kernel overwrites lengths, so headers are set up before every call */
+static void udp_batch_reset(udp_batch_t batch[static 1], uint32_t index)
+{
+    batch->iov[index] = (struct iovec){.iov_base = batch->data[index],
+                                       .iov_len = UDP_BATCH_PACKET_SIZE};
+    batch->msgs[index] = (struct mmsghdr){
+        .msg_hdr = {.msg_name = &batch->addrs[index],
+                    .msg_namelen = sizeof(batch->addrs[index]),
+                    .msg_iov = &batch->iov[index],
+                    .msg_iovlen = 1}};
+}
+
+uint32_t udp_batch_recv(udp_batch_t batch[static 1], int32_t fd)
+{
+    for (uint32_t i = 0; i < UDP_BATCH_SIZE; i++)
+    {
+        udp_batch_reset(batch, i);
+    }
+    int32_t n = recvmmsg(fd, batch->msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (n < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            LOG_ERROR("Cannot receive udp batch: errno=%d : %s\n", errno,
+                      strerror(errno));
+        }
+        n = 0;
+    }
+    batch->count = (uint32_t)n;
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        /* truncated datagram is dropped as empty one */
+        if (batch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+            batch->msgs[i].msg_len = 0;
+        }
+    }
+    return batch->count;
+}
+
+uint8_t* udp_batch_prepare(udp_batch_t batch[static 1],
+                           const struct sockaddr_in addr[static 1])
+{
+    if (batch->count == UDP_BATCH_SIZE)
+    {
+        return NULL;
+    }
+    udp_batch_reset(batch, batch->count);
+    batch->addrs[batch->count] = *addr;
+    return batch->data[batch->count];
+}
+
+void udp_batch_commit(udp_batch_t batch[static 1], uint32_t length)
+{
+    ASSERT((batch->count < UDP_BATCH_SIZE && length <= UDP_BATCH_PACKET_SIZE),
+           "Commit of udp datagram without prepared buffer\n");
+    batch->iov[batch->count].iov_len = length;
+    batch->count++;
+}
+
+err_t udp_batch_send(udp_batch_t batch[static 1], int32_t fd)
+{
+    err_t ret = DISFS_SUCCESS;
+    uint32_t sent = 0;
+    while (sent < batch->count)
+    {
+        int32_t n = sendmmsg(fd, batch->msgs + sent, batch->count - sent,
+                             MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            /* single bad destination must not hold back the rest */
+            LOG_WARNING("Cannot send udp datagram: errno=%d : %s\n", errno,
+                        strerror(errno));
+            ret = DISFS_ERR_SOCK;
+            n = 1;
+        }
+        sent += (uint32_t)n;
+    }
+    batch->count = 0;
+    return ret;
+}
+
+uint32_t udp_discovery_packet_deserialize_batch(
+    udp_batch_t batch[static 1], UDP_packet packets[static UDP_BATCH_SIZE])
+{
+    uint32_t valid = 0;
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        packets[i] = (UDP_packet){};
+        if (udp_discovery_packet_deserialize(&packets[i],
+                                             (const char*)batch->data[i],
+                                             batch->msgs[i].msg_len) !=
+            DISFS_SUCCESS)
+        {
+            continue;
+        }
+        if (packets[i].magic_number != UDP_DISCOVERY_PACKET_MAGIC_NUMBER ||
+            packets[i].protocol_version != UDP_DISCOVERY_PROTOCOL_VERSION)
+        {
+            packets[i] = (UDP_packet){};
+            continue;
+        }
+        valid++;
+    }
+    return valid;
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "wire.h"
+#include "logger.h"
+#include <stddef.h>
+#include <string.h>
+
+static uint32_t wire_int_size(uint16_t kind);
+static void wire_put(uint8_t* out, uint64_t value, uint32_t size);
+static uint64_t wire_get(const uint8_t* in, uint32_t size);
+static err_t wire_check(const wire_schema_t schema[static 1],
+                        const wire_field_t field[static 1],
+                        const uint8_t* msg);
+
+#define WIRE_FIELD(m, k, name, n)                                              \
+    {.kind = WIRE_##k,                                                         \
+     .size = (n),                                                              \
+     .offset = offsetof(wire_##m##_t, name)},
+#define WIRE_DEFINE(msg, FIELDS)                                               \
+    static const wire_field_t wire_##msg##_fields[] = {                        \
+        FIELDS(WIRE_FIELD, msg)};                                              \
+    const wire_schema_t wire_##msg##_schema = {                                \
+        .name = #msg,                                                          \
+        .fields = wire_##msg##_fields,                                         \
+        .field_count = sizeof(wire_##msg##_fields) /                           \
+                       sizeof(wire_##msg##_fields[0]),                         \
+        .fixed_size = wire_##msg##_fixed_size,                                 \
+    };
+
+WIRE_MESSAGES(WIRE_DEFINE)
+
+/* U8..U64 are 1 << kind bytes, 0 for byte fields */
+static uint32_t wire_int_size(uint16_t kind)
+{
+    return kind <= WIRE_U64 ? 1u << kind : 0;
+}
+
+static void wire_put(uint8_t* out, uint64_t value, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t wire_get(const uint8_t* in, uint32_t size)
+{
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+/* value has to fit into its field, nothing is silently truncated */
+static err_t wire_check(const wire_schema_t schema[static 1],
+                        const wire_field_t field[static 1],
+                        const uint8_t* msg)
+{
+    uint32_t size = wire_int_size(field->kind);
+    if (size > 0)
+    {
+        uint64_t value;
+        memcpy(&value, msg + field->offset, sizeof(value));
+        if (size < 8 && value >> (8 * size) != 0)
+        {
+            LOG_ERROR("Field of %s message does not fit %u bytes\n",
+                      schema->name, size);
+            return DISFS_ERR_INVALID_ARG;
+        }
+        return DISFS_SUCCESS;
+    }
+    const wire_blob_t* blob = (const wire_blob_t*)(msg + field->offset);
+    if ((field->kind == WIRE_BYTES && blob->length > field->size) ||
+        (field->kind == WIRE_BLOB16 && blob->length > UINT16_MAX))
+    {
+        LOG_ERROR("Bytes of %s message are too long: %lu\n", schema->name,
+                  blob->length);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    return DISFS_SUCCESS;
+}
+
+uint64_t wire_size(const wire_schema_t schema[static 1], const void* msg)
+{
+    uint64_t size = schema->fixed_size;
+    for (uint32_t i = 0; i < schema->field_count; i++)
+    {
+        const wire_field_t* field = &schema->fields[i];
+        if (field->kind == WIRE_BLOB16 || field->kind == WIRE_TAIL)
+        {
+            const wire_blob_t* blob =
+                (const wire_blob_t*)((const uint8_t*)msg + field->offset);
+            size += blob->length;
+        }
+    }
+    return size;
+}
+
+err_t wire_decode(const wire_schema_t schema[static 1], void* msg,
+                  const uint8_t* data, uint64_t length, uint64_t* consumed)
+{
+    uint64_t pos = 0;
+    for (uint32_t i = 0; i < schema->field_count; i++)
+    {
+        const wire_field_t* field = &schema->fields[i];
+        uint8_t* member = (uint8_t*)msg + field->offset;
+        uint32_t size = wire_int_size(field->kind);
+        if (size > 0)
+        {
+            if (length - pos < size)
+            {
+                return DISFS_ERR_PROTO;
+            }
+            uint64_t value = wire_get(data + pos, size);
+            memcpy(member, &value, sizeof(value));
+            pos += size;
+            continue;
+        }
+        wire_blob_t blob = {.data = data + pos, .length = length - pos};
+        if (field->kind == WIRE_BYTES)
+        {
+            blob.length = field->size;
+        }
+        else if (field->kind == WIRE_BLOB16)
+        {
+            if (length - pos < 2)
+            {
+                return DISFS_ERR_PROTO;
+            }
+            blob = (wire_blob_t){.data = data + pos + 2,
+                                 .length = wire_get(data + pos, 2)};
+            pos += 2;
+        }
+        if (length - pos < blob.length)
+        {
+            return DISFS_ERR_PROTO;
+        }
+        memcpy(member, &blob, sizeof(blob));
+        pos += blob.length;
+    }
+    if (consumed == NULL)
+    {
+        return pos == length ? DISFS_SUCCESS : DISFS_ERR_PROTO;
+    }
+    *consumed = pos;
+    return DISFS_SUCCESS;
+}
+
+err_t wire_encode(const wire_schema_t schema[static 1], const void* msg,
+                  uint8_t* out, uint64_t capacity, uint64_t length[static 1])
+{
+    uint64_t size = wire_size(schema, msg);
+    if (size > capacity)
+    {
+        LOG_ERROR("Buffer of %lu bytes is too small for %s message of %lu\n",
+                  capacity, schema->name, size);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    uint64_t pos = 0;
+    for (uint32_t i = 0; i < schema->field_count; i++)
+    {
+        const wire_field_t* field = &schema->fields[i];
+        const uint8_t* member = (const uint8_t*)msg + field->offset;
+        err_t ret = wire_check(schema, field, msg);
+        if (ret != DISFS_SUCCESS)
+        {
+            return ret;
+        }
+        uint32_t int_size = wire_int_size(field->kind);
+        if (int_size > 0)
+        {
+            uint64_t value;
+            memcpy(&value, member, sizeof(value));
+            wire_put(out + pos, value, int_size);
+            pos += int_size;
+            continue;
+        }
+        wire_blob_t blob;
+        memcpy(&blob, member, sizeof(blob));
+        if (field->kind == WIRE_BLOB16)
+        {
+            wire_put(out + pos, blob.length, 2);
+            pos += 2;
+        }
+        if (blob.length > 0)
+        {
+            memcpy(out + pos, blob.data, blob.length);
+        }
+        pos += blob.length;
+        if (field->kind == WIRE_BYTES)
+        {
+            memset(out + pos, 0, field->size - blob.length);
+            pos += field->size - blob.length;
+        }
+    }
+    *length = pos;
+    return DISFS_SUCCESS;
+}
+
+err_t wire_encode_iov(const wire_schema_t schema[static 1], const void* msg,
+                      uint8_t* scratch, uint32_t scratch_size,
+                      struct iovec* iov, uint32_t iov_capacity,
+                      uint32_t iov_count[static 1])
+{
+    if (scratch_size < schema->fixed_size)
+    {
+        LOG_ERROR("Scratch of %u bytes is too small for %s message\n",
+                  scratch_size, schema->name);
+        return DISFS_ERR_INVALID_ARG;
+    }
+    uint32_t count = 0;
+    uint32_t pos = 0;
+    uint32_t run = 0; /* start of scratch bytes not yet in iov */
+    for (uint32_t i = 0; i < schema->field_count; i++)
+    {
+        const wire_field_t* field = &schema->fields[i];
+        const uint8_t* member = (const uint8_t*)msg + field->offset;
+        err_t ret = wire_check(schema, field, msg);
+        if (ret != DISFS_SUCCESS)
+        {
+            return ret;
+        }
+        uint32_t int_size = wire_int_size(field->kind);
+        if (int_size > 0)
+        {
+            uint64_t value;
+            memcpy(&value, member, sizeof(value));
+            wire_put(scratch + pos, value, int_size);
+            pos += int_size;
+            continue;
+        }
+        wire_blob_t blob;
+        memcpy(&blob, member, sizeof(blob));
+        if (field->kind == WIRE_BYTES)
+        {
+            /* short enough to copy, zero padding has to live somewhere */
+            if (blob.length > 0)
+            {
+                memcpy(scratch + pos, blob.data, blob.length);
+            }
+            memset(scratch + pos + blob.length, 0,
+                   field->size - blob.length);
+            pos += field->size;
+            continue;
+        }
+        if (field->kind == WIRE_BLOB16)
+        {
+            wire_put(scratch + pos, blob.length, 2);
+            pos += 2;
+        }
+        if (blob.length == 0)
+        {
+            continue;
+        }
+        if (iov_capacity - count < (pos > run ? 2u : 1u))
+        {
+            return DISFS_ERR_INVALID_ARG;
+        }
+        if (pos > run)
+        {
+            iov[count++] = (struct iovec){.iov_base = scratch + run,
+                                          .iov_len = pos - run};
+            run = pos;
+        }
+        iov[count++] = (struct iovec){.iov_base = (void*)(uintptr_t)blob.data,
+                                      .iov_len = blob.length};
+    }
+    if (pos > run)
+    {
+        if (count == iov_capacity)
+        {
+            return DISFS_ERR_INVALID_ARG;
+        }
+        iov[count++] = (struct iovec){.iov_base = scratch + run,
+                                      .iov_len = pos - run};
+    }
+    *iov_count = count;
+    return DISFS_SUCCESS;
+}
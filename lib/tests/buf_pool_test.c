@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "buf_pool.h"
+#include <pthread.h>
+#include <string.h>
+
+#define HANDOFF_COUNT 10000
+#define HANDOFF_SLOTS 64
+
+typedef struct handoff_t
+{
+    buf_t* slots[HANDOFF_SLOTS];
+    uint32_t head;
+    uint32_t tail;
+} handoff_t;
+
+static void alloc_test(void** state)
+{
+    (void)state;
+    uint64_t sizes[] = {0, 1, 256, 257, 4096, 65536,
+                        BUF_POOL_MAX_SIZE + BUF_POOL_HEADROOM};
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        buf_t* buf = buf_alloc(sizes[i]);
+        assert_non_null(buf);
+        assert_true(buf->capacity >= sizes[i]);
+        assert_int_equal(buf->refs, 1);
+        assert_int_equal(buf->length, 0);
+        assert_ptr_equal(buf_of(buf->data), buf);
+        memset(buf->data, 0xA5, sizes[i]);
+        buf_unref(buf);
+    }
+    assert_null(buf_alloc(BUF_POOL_MAX_SIZE + BUF_POOL_HEADROOM + 1));
+    buf_unref(NULL);
+}
+
+static void reuse_test(void** state)
+{
+    (void)state;
+    buf_t* bufs[256];
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        bufs[i] = buf_alloc(1024);
+    }
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        buf_unref(bufs[i]);
+    }
+
+    /* warm pool serves steady traffic without growing */
+    buf_pool_stats_t before;
+    buf_pool_stats(&before);
+    for (uint32_t round = 0; round < 1000; round++)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            bufs[i] = buf_alloc(1024);
+            assert_non_null(bufs[i]);
+        }
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            buf_unref(bufs[i]);
+        }
+    }
+    buf_pool_stats_t after;
+    buf_pool_stats(&after);
+    assert_int_equal(after.slabs, before.slabs);
+}
+
+static void refcount_test(void** state)
+{
+    (void)state;
+    buf_t* buf = buf_alloc(100);
+    buf_ref(buf);
+    buf_unref(buf);
+    /* still owned by second reference, pool must not hand it out */
+    buf_t* other = buf_alloc(100);
+    assert_ptr_not_equal(other, buf);
+    buf_unref(other);
+    buf_unref(buf);
+    assert_ptr_equal(buf_alloc(100), buf);
+    buf_unref(buf);
+}
+
+static void* handoff_consumer(void* arg)
+{
+    handoff_t* handoff = arg;
+    for (uint32_t i = 0; i < HANDOFF_COUNT; i++)
+    {
+        uint32_t tail = handoff->tail;
+        while (__atomic_load_n(&handoff->head, __ATOMIC_ACQUIRE) == tail)
+        {
+        }
+        buf_t* buf = handoff->slots[tail % HANDOFF_SLOTS];
+        __atomic_store_n(&handoff->tail, tail + 1, __ATOMIC_RELEASE);
+        uint32_t value;
+        memcpy(&value, buf->data, sizeof(value));
+        if (value != i || buf->length != sizeof(value))
+        {
+            return (void*)1;
+        }
+        buf_unref(buf);
+    }
+    return NULL;
+}
+
+static void handoff_test(void** state)
+{
+    (void)state;
+    static handoff_t handoff;
+    pthread_t th;
+    assert_int_equal(
+        pthread_create(&th, NULL, handoff_consumer, &handoff), 0);
+    for (uint32_t i = 0; i < HANDOFF_COUNT; i++)
+    {
+        buf_t* buf = buf_alloc(sizeof(i));
+        assert_non_null(buf);
+        memcpy(buf->data, &i, sizeof(i));
+        buf->length = sizeof(i);
+        uint32_t head = handoff.head;
+        while (head - __atomic_load_n(&handoff.tail, __ATOMIC_ACQUIRE) ==
+               HANDOFF_SLOTS)
+        {
+        }
+        handoff.slots[head % HANDOFF_SLOTS] = buf;
+        __atomic_store_n(&handoff.head, head + 1, __ATOMIC_RELEASE);
+    }
+    void* failed;
+    pthread_join(th, &failed);
+    assert_null(failed);
+
+    /* consumer cache went back to global pool when its thread exited */
+    buf_pool_stats_t stats;
+    buf_pool_stats(&stats);
+    assert_true(stats.global_free > 0);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(alloc_test),
+        cmocka_unit_test(reuse_test),
+        cmocka_unit_test(refcount_test),
+        cmocka_unit_test(handoff_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
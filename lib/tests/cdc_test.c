@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "cdc.h"
+#include "sha256.h"
+#include "test_cluster.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DATA_SIZE (1024 * 1024)
+#define MAX_CHUNKS (DATA_SIZE / CDC_MIN_SIZE + 1)
+
+typedef struct chunking_t
+{
+    uint32_t count;
+    uint32_t lengths[MAX_CHUNKS];
+    uint8_t hashes[MAX_CHUNKS][SHA256_DIGEST_SIZE];
+} chunking_t;
+
+static void split(const uint8_t* data, uint32_t length,
+                  chunking_t chunking[static 1])
+{
+    chunking->count = 0;
+    for (uint32_t offset = 0; offset < length;)
+    {
+        uint32_t cut = cdc_cut(data + offset, length - offset);
+        assert_true(chunking->count < MAX_CHUNKS);
+        chunking->lengths[chunking->count] = cut;
+        sha256(data + offset, cut, chunking->hashes[chunking->count]);
+        chunking->count++;
+        offset += cut;
+    }
+}
+
+static void scalar_test(void** state)
+{
+    (void)state;
+    uint8_t* data = malloc(DATA_SIZE);
+    test_random_data(data, DATA_SIZE, 1);
+    /* odd ends exercise tail of two byte steps */
+    for (uint32_t offset = 0; offset < DATA_SIZE;)
+    {
+        uint32_t left = DATA_SIZE - offset;
+        uint32_t cut = cdc_cut(data + offset, left);
+        assert_int_equal(cut, cdc_cut_scalar(data + offset, left));
+        for (uint32_t short_end = 1; short_end < 16; short_end += 3)
+        {
+            uint32_t length = cut + short_end;
+            length = length < left ? length : left;
+            assert_int_equal(cdc_cut(data + offset, length),
+                             cdc_cut_scalar(data + offset, length));
+        }
+        offset += cut;
+    }
+    free(data);
+}
+
+static void bounds_test(void** state)
+{
+    (void)state;
+    uint8_t* data = malloc(DATA_SIZE);
+    chunking_t* chunking = malloc(sizeof(*chunking));
+    test_random_data(data, DATA_SIZE, 2);
+    split(data, DATA_SIZE, chunking);
+    for (uint32_t i = 0; i + 1 < chunking->count; i++)
+    {
+        assert_true(chunking->lengths[i] > CDC_MIN_SIZE);
+        assert_true(chunking->lengths[i] <= CDC_MAX_SIZE);
+    }
+    uint32_t average = DATA_SIZE / chunking->count;
+    assert_true(average > CDC_AVG_SIZE / 2 && average < CDC_AVG_SIZE * 2);
+
+    /* data without content to cut on is cut at the largest size */
+    memset(data, 0, DATA_SIZE);
+    assert_int_equal(cdc_cut(data, DATA_SIZE), CDC_MAX_SIZE);
+    assert_int_equal(cdc_cut(data, 100), 100);
+    assert_int_equal(cdc_cut(data, 0), 0);
+    free(chunking);
+    free(data);
+}
+
+/* bytes inserted into file change only chunks around them */
+static void edit_test(void** state)
+{
+    (void)state;
+    uint8_t* data = malloc(DATA_SIZE);
+    uint8_t* edited = malloc(DATA_SIZE + 10);
+    chunking_t* before = malloc(sizeof(*before));
+    chunking_t* after = malloc(sizeof(*after));
+    test_random_data(data, DATA_SIZE, 3);
+    memcpy(edited, data, DATA_SIZE / 2);
+    memcpy(edited + DATA_SIZE / 2, "0123456789", 10);
+    memcpy(edited + DATA_SIZE / 2 + 10, data + DATA_SIZE / 2, DATA_SIZE / 2);
+    split(data, DATA_SIZE, before);
+    split(edited, DATA_SIZE + 10, after);
+
+    uint32_t changed = 0;
+    for (uint32_t i = 0; i < after->count; i++)
+    {
+        uint32_t found = 0;
+        for (uint32_t j = 0; j < before->count && !found; j++)
+        {
+            found = memcmp(after->hashes[i], before->hashes[j],
+                           SHA256_DIGEST_SIZE) == 0;
+        }
+        changed += !found;
+    }
+    assert_true(before->count > 16);
+    assert_true(changed >= 1 && changed <= 2);
+    free(after);
+    free(before);
+    free(edited);
+    free(data);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(scalar_test),
+        cmocka_unit_test(bounds_test),
+        cmocka_unit_test(edit_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "checksum.h"
+#include "test_cluster.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* longer than three long streams, so every path of every kernel is used */
+#define DATA_SIZE (100 * 1024)
+#define ROUNDS 300
+
+static void known_values_test(void** state)
+{
+    (void)state;
+    for (int32_t impl = CHECKSUM_IMPL_SCALAR; impl < CHECKSUM_IMPL_MAX; impl++)
+    {
+        if (checksum_select_impl(impl) == DISFS_SUCCESS)
+        {
+            assert_int_equal(crc32c(0, "123456789", 9), 0xE3069283);
+            assert_int_equal(crc32c(0, "", 0), 0);
+        }
+    }
+    assert_int_equal(checksum_select_impl(CHECKSUM_IMPL_MAX),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(checksum_select_impl(CHECKSUM_IMPL_AUTO), DISFS_SUCCESS);
+    assert_int_equal(xxh32("", 0, 0), 0x02CC5D05);
+    const char* text = "Nobody inspects the spammish repetition";
+    assert_int_equal(xxh32(text, strlen(text), 0), 0xE2293B2F);
+}
+
+static void kernels_test(void** state)
+{
+    (void)state;
+    uint8_t* data = malloc(DATA_SIZE);
+    test_random_data(data, DATA_SIZE, 1);
+    /* random unaligned ranges against scalar result */
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        uint32_t offset = (uint32_t)rand() % 64;
+        uint32_t length = (uint32_t)rand() % (DATA_SIZE - offset);
+        checksum_select_impl(CHECKSUM_IMPL_SCALAR);
+        uint32_t expected = crc32c(0, data + offset, length);
+        for (int32_t impl = CHECKSUM_IMPL_SSE42; impl < CHECKSUM_IMPL_MAX;
+             impl++)
+        {
+            if (checksum_select_impl(impl) == DISFS_SUCCESS)
+            {
+                assert_int_equal(crc32c(0, data + offset, length), expected);
+            }
+        }
+    }
+    checksum_select_impl(CHECKSUM_IMPL_AUTO);
+    free(data);
+}
+
+static void incremental_test(void** state)
+{
+    (void)state;
+    uint8_t* data = malloc(DATA_SIZE);
+    test_random_data(data, DATA_SIZE, 2);
+    for (uint32_t kind = 0; kind < CHECKSUM_KIND_MAX; kind++)
+    {
+        checksum_t whole;
+        checksum_init(&whole, kind);
+        checksum_update(&whole, data, DATA_SIZE);
+        /* pieces as they would arrive from socket */
+        for (uint32_t round = 0; round < 20; round++)
+        {
+            checksum_t sum;
+            checksum_init(&sum, kind);
+            for (uint32_t done = 0; done < DATA_SIZE;)
+            {
+                uint32_t piece = (uint32_t)rand() % 3000;
+                piece = piece > DATA_SIZE - done ? DATA_SIZE - done : piece;
+                checksum_update(&sum, data + done, piece);
+                done += piece;
+            }
+            assert_int_equal(checksum_final(&sum), checksum_final(&whole));
+        }
+    }
+    free(data);
+}
+
+static void combine_test(void** state)
+{
+    (void)state;
+    uint8_t* data = malloc(DATA_SIZE);
+    test_random_data(data, DATA_SIZE, 3);
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        uint32_t split = (uint32_t)rand() % DATA_SIZE;
+        uint32_t first = crc32c(0, data, split);
+        uint32_t second = crc32c(0, data + split, DATA_SIZE - split);
+        assert_int_equal(crc32c_combine(first, second, DATA_SIZE - split),
+                         crc32c(0, data, DATA_SIZE));
+    }
+    free(data);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(known_values_test),
+        cmocka_unit_test(kernels_test),
+        cmocka_unit_test(incremental_test),
+        cmocka_unit_test(combine_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
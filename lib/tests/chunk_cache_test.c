@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "chunk_cache.h"
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHUNK_SIZE 4000
+#define HOT_CHUNKS 32
+#define SCAN_CHUNKS 2048
+#define READERS 8
+
+/* stands for peers, chunk i is CHUNK_SIZE bytes of value i */
+typedef struct fake_remote_t
+{
+    uint32_t fetches;
+    uint32_t corrupt; /* serve wrong data */
+    uint32_t deferred; /* leave fill to test */
+} fake_remote_t;
+
+typedef struct reader_t
+{
+    chunk_cache_t* cache;
+    const chunk_hash_t* hash;
+    err_t ret;
+    uint32_t length;
+} reader_t;
+
+static void chunk_data(uint32_t i, uint8_t data[static CHUNK_SIZE],
+                       chunk_hash_t hash[static 1])
+{
+    memset(data, 0, CHUNK_SIZE);
+    memcpy(data, &i, sizeof(i));
+    sha256(data, CHUNK_SIZE, hash->bytes);
+}
+
+static void fake_fetch(void* ctx, chunk_cache_t* cache,
+                       const chunk_hash_t hash[static 1])
+{
+    fake_remote_t* remote = ctx;
+    __atomic_add_fetch(&remote->fetches, 1, __ATOMIC_RELAXED);
+    if (remote->deferred)
+    {
+        return;
+    }
+    /* every chunk of test is found among first ones */
+    static chunk_hash_t known[SCAN_CHUNKS + HOT_CHUNKS];
+    static uint32_t known_count;
+    uint8_t data[CHUNK_SIZE];
+    for (; known_count < SCAN_CHUNKS + HOT_CHUNKS; known_count++)
+    {
+        chunk_data(known_count, data, &known[known_count]);
+    }
+    for (uint32_t i = 0; i < SCAN_CHUNKS + HOT_CHUNKS; i++)
+    {
+        if (memcmp(known[i].bytes, hash->bytes, CHUNK_HASH_SIZE) == 0)
+        {
+            chunk_data(i, data, &known[i]);
+            data[CHUNK_SIZE - 1] ^= (uint8_t)remote->corrupt;
+            chunk_cache_fill(cache, hash, DISFS_SUCCESS, data, CHUNK_SIZE);
+            return;
+        }
+    }
+    chunk_cache_fill(cache, hash, DISFS_ERR_NOT_FOUND, NULL, 0);
+}
+
+static err_t read_chunk(chunk_cache_t cache[static 1], uint32_t i)
+{
+    uint8_t expected[CHUNK_SIZE];
+    uint8_t data[CHUNK_SIZE];
+    chunk_hash_t hash;
+    chunk_data(i, expected, &hash);
+    uint32_t length = 0;
+    err_t ret = chunk_cache_get(cache, &hash, data, sizeof(data), &length);
+    if (ret == DISFS_SUCCESS)
+    {
+        assert_int_equal(length, CHUNK_SIZE);
+        assert_memory_equal(data, expected, CHUNK_SIZE);
+    }
+    return ret;
+}
+
+static void read_through_test(void** state)
+{
+    (void)state;
+    fake_remote_t remote = {};
+    chunk_cache_t cache;
+    assert_int_equal(
+        chunk_cache_init(&cache, 1024 * 1024, fake_fetch, &remote),
+        DISFS_SUCCESS);
+    assert_int_equal(read_chunk(&cache, 1), DISFS_SUCCESS);
+    assert_int_equal(read_chunk(&cache, 1), DISFS_SUCCESS);
+    assert_int_equal(read_chunk(&cache, 1), DISFS_SUCCESS);
+    assert_int_equal(remote.fetches, 1);
+
+    uint8_t small[16];
+    chunk_hash_t hash;
+    uint8_t data[CHUNK_SIZE];
+    chunk_data(1, data, &hash);
+    uint32_t length;
+    assert_int_equal(chunk_cache_get(&cache, &hash, small, sizeof(small),
+                                     &length),
+                     DISFS_ERR_INVALID_ARG);
+
+    chunk_cache_stats_t stats;
+    chunk_cache_stats(&cache, &stats);
+    assert_int_equal(stats.misses, 1);
+    assert_int_equal(stats.hits, 3);
+    assert_int_equal(stats.bytes_fetched, CHUNK_SIZE);
+    assert_int_equal(stats.bytes_saved, 3 * CHUNK_SIZE);
+    assert_int_equal(stats.resident_chunks, 1);
+    chunk_cache_destroy(&cache);
+}
+
+static void fetch_error_test(void** state)
+{
+    (void)state;
+    fake_remote_t remote = {.corrupt = 1};
+    chunk_cache_t cache;
+    chunk_cache_init(&cache, 1024 * 1024, fake_fetch, &remote);
+    /* chunk not matching its hash is never cached */
+    assert_int_equal(read_chunk(&cache, 2), DISFS_ERR_CORRUPT);
+    assert_int_equal(read_chunk(&cache, 2), DISFS_ERR_CORRUPT);
+    assert_int_equal(remote.fetches, 2);
+    remote.corrupt = 0;
+    assert_int_equal(read_chunk(&cache, 2), DISFS_SUCCESS);
+
+    uint8_t data[CHUNK_SIZE];
+    chunk_hash_t unknown = {.bytes = {0xFF}};
+    uint32_t length;
+    assert_int_equal(
+        chunk_cache_get(&cache, &unknown, data, sizeof(data), &length),
+        DISFS_ERR_NOT_FOUND);
+
+    chunk_cache_stats_t stats;
+    chunk_cache_stats(&cache, &stats);
+    assert_int_equal(stats.fetch_errors, 3);
+    assert_int_equal(stats.resident_chunks, 1);
+    chunk_cache_destroy(&cache);
+}
+
+static void budget_test(void** state)
+{
+    (void)state;
+    fake_remote_t remote = {};
+    chunk_cache_t cache;
+    const uint64_t capacity = 256 * 1024;
+    chunk_cache_init(&cache, capacity, fake_fetch, &remote);
+    for (uint32_t i = 0; i < SCAN_CHUNKS; i++)
+    {
+        assert_int_equal(read_chunk(&cache, i), DISFS_SUCCESS);
+        chunk_cache_stats_t stats;
+        chunk_cache_stats(&cache, &stats);
+        assert_true(stats.resident_bytes <= capacity);
+    }
+    chunk_cache_stats_t stats;
+    chunk_cache_stats(&cache, &stats);
+    assert_true(stats.evictions > 0);
+    assert_int_equal(stats.resident_chunks + stats.evictions, SCAN_CHUNKS);
+    chunk_cache_destroy(&cache);
+}
+
+static void scan_resistance_test(void** state)
+{
+    (void)state;
+    fake_remote_t remote = {};
+    chunk_cache_t cache;
+    chunk_cache_init(&cache, 1024 * 1024, fake_fetch, &remote);
+    /* hot chunks are read twice, so they are frequent */
+    for (uint32_t round = 0; round < 2; round++)
+    {
+        for (uint32_t i = 0; i < HOT_CHUNKS; i++)
+        {
+            read_chunk(&cache, SCAN_CHUNKS + i);
+        }
+    }
+    /* single pass over data much larger than cache */
+    for (uint32_t i = 0; i < SCAN_CHUNKS; i++)
+    {
+        read_chunk(&cache, i);
+    }
+    uint32_t fetches = remote.fetches;
+    for (uint32_t i = 0; i < HOT_CHUNKS; i++)
+    {
+        read_chunk(&cache, SCAN_CHUNKS + i);
+    }
+    assert_int_equal(remote.fetches, fetches);
+    chunk_cache_destroy(&cache);
+}
+
+static void* reader(void* arg)
+{
+    reader_t* r = arg;
+    uint8_t data[CHUNK_SIZE];
+    r->ret = chunk_cache_get(r->cache, r->hash, data, sizeof(data), &r->length);
+    return NULL;
+}
+
+static void coalesce_test(void** state)
+{
+    (void)state;
+    fake_remote_t remote = {.deferred = 1};
+    chunk_cache_t cache;
+    chunk_cache_init(&cache, 1024 * 1024, fake_fetch, &remote);
+    uint8_t data[CHUNK_SIZE];
+    chunk_hash_t hash;
+    chunk_data(3, data, &hash);
+
+    pthread_t threads[READERS];
+    reader_t readers[READERS];
+    for (uint32_t i = 0; i < READERS; i++)
+    {
+        readers[i] = (reader_t){.cache = &cache, .hash = &hash};
+        pthread_create(&threads[i], NULL, reader, &readers[i]);
+    }
+    /* all readers wait for single fetch */
+    chunk_cache_stats_t stats = {};
+    while (stats.misses + stats.coalesced < READERS)
+    {
+        usleep(1000);
+        chunk_cache_stats(&cache, &stats);
+    }
+    chunk_cache_fill(&cache, &hash, DISFS_SUCCESS, data, CHUNK_SIZE);
+    for (uint32_t i = 0; i < READERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        assert_int_equal(readers[i].ret, DISFS_SUCCESS);
+        assert_int_equal(readers[i].length, CHUNK_SIZE);
+    }
+    assert_int_equal(remote.fetches, 1);
+    chunk_cache_stats(&cache, &stats);
+    assert_int_equal(stats.misses, 1);
+    assert_int_equal(stats.coalesced, READERS - 1);
+    assert_int_equal(stats.bytes_saved, (READERS - 1) * CHUNK_SIZE);
+    chunk_cache_destroy(&cache);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(read_through_test),
+        cmocka_unit_test(fetch_error_test),
+        cmocka_unit_test(budget_test),
+        cmocka_unit_test(scan_resistance_test),
+        cmocka_unit_test(coalesce_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "chunk_store.h"
+#include "err_codes.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHUNKS 3000
+
+static int setup(void** state)
+{
+    char* dir = strdup("/tmp/disfs_chunk_store_XXXXXX");
+    if (mkdtemp(dir) == NULL)
+    {
+        free(dir);
+        return -1;
+    }
+    *state = dir;
+    return 0;
+}
+
+static int teardown(void** state)
+{
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", (char*)*state);
+    free(*state);
+    return system(cmd);
+}
+
+static void put_get_reopen_test(void** state)
+{
+    const char* dir = *state;
+    chunk_store_t store;
+    assert_int_equal(chunk_store_open(&store, dir), DISFS_SUCCESS);
+
+    chunk_hash_t* hashes = calloc(CHUNKS, sizeof(*hashes));
+    char data[64];
+    for (uint32_t i = 0; i < CHUNKS; i++)
+    {
+        int32_t len = snprintf(data, sizeof(data), "chunk number %u", i);
+        assert_int_equal(
+            chunk_store_put(&store, data, (uint32_t)len, &hashes[i]),
+            DISFS_SUCCESS);
+    }
+    /* same content is stored once */
+    chunk_hash_t again;
+    assert_int_equal(chunk_store_put(&store, "chunk number 7", 14, &again),
+                     DISFS_SUCCESS);
+    assert_memory_equal(again.bytes, hashes[7].bytes, CHUNK_HASH_SIZE);
+    assert_int_equal(store.index->count, CHUNKS);
+    chunk_store_close(&store);
+
+    /* index survives restart without rescanning pack */
+    assert_int_equal(chunk_store_open(&store, dir), DISFS_SUCCESS);
+    for (uint32_t i = 0; i < CHUNKS; i++)
+    {
+        char expected[64];
+        int32_t len = snprintf(expected, sizeof(expected), "chunk number %u", i);
+        uint32_t length = 0;
+        assert_int_equal(chunk_store_get(&store, &hashes[i], data,
+                                         sizeof(data), &length),
+                         DISFS_SUCCESS);
+        assert_int_equal(length, len);
+        assert_memory_equal(data, expected, length);
+    }
+    chunk_hash_t missing = {};
+    chunk_location_t location;
+    assert_int_equal(chunk_store_lookup(&store, &missing, &location),
+                     DISFS_ERR_NOT_FOUND);
+    chunk_store_close(&store);
+    free(hashes);
+}
+
+static void put_file_test(void** state)
+{
+    const char* dir = *state;
+    char path[128];
+    snprintf(path, sizeof(path), "%s/input", dir);
+    uint32_t size = CHUNK_MAX_SIZE * 2 + 100;
+    uint8_t* content = malloc(size);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        content[i] = (uint8_t)(i * 31);
+    }
+    int32_t fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert_true(write(fd, content, size) == size);
+    lseek(fd, 0, SEEK_SET);
+
+    chunk_store_t store;
+    assert_int_equal(chunk_store_open(&store, dir), DISFS_SUCCESS);
+    chunk_hash_t hashes[4];
+    uint64_t count = 0;
+    assert_int_equal(chunk_store_put_file(&store, fd, hashes, 4, &count),
+                     DISFS_SUCCESS);
+    assert_int_equal(count, 3);
+
+    uint8_t* out = malloc(CHUNK_MAX_SIZE);
+    uint32_t length = 0;
+    assert_int_equal(
+        chunk_store_get(&store, &hashes[2], out, CHUNK_MAX_SIZE, &length),
+        DISFS_SUCCESS);
+    assert_int_equal(length, 100);
+    assert_memory_equal(out, content + CHUNK_MAX_SIZE * 2, 100);
+
+    chunk_store_close(&store);
+    close(fd);
+    free(out);
+    free(content);
+}
+
+/* index reached disk, tail of pack it points at did not */
+static void short_pack_test(void** state)
+{
+    const char* dir = *state;
+    chunk_store_t store;
+    assert_int_equal(chunk_store_open(&store, dir), DISFS_SUCCESS);
+    chunk_hash_t* hashes = calloc(CHUNKS, sizeof(*hashes));
+    char data[64];
+    for (uint32_t i = 0; i < CHUNKS; i++)
+    {
+        int32_t len = snprintf(data, sizeof(data), "chunk number %u", i);
+        assert_int_equal(
+            chunk_store_put(&store, data, (uint32_t)len, &hashes[i]),
+            DISFS_SUCCESS);
+    }
+    chunk_location_t location;
+    assert_int_equal(
+        chunk_store_lookup(&store, &hashes[CHUNKS / 2], &location),
+        DISFS_SUCCESS);
+    chunk_store_close(&store);
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/chunks.pack", dir);
+    assert_int_equal(truncate(path, (off_t)location.offset + 1), 0);
+    assert_int_equal(chunk_store_open(&store, dir), DISFS_SUCCESS);
+    assert_int_equal(store.index->count, CHUNKS / 2);
+    assert_int_equal(store.index->pack_size, location.offset);
+    uint32_t length = 0;
+    for (uint32_t i = 0; i < CHUNKS; i++)
+    {
+        assert_int_equal(chunk_store_get(&store, &hashes[i], data,
+                                         sizeof(data), &length),
+                         i < CHUNKS / 2 ? DISFS_SUCCESS
+                                        : DISFS_ERR_NOT_FOUND);
+    }
+    /* dropped chunk is stored again after the kept ones */
+    int32_t len = snprintf(data, sizeof(data), "chunk number %u", CHUNKS / 2);
+    assert_int_equal(chunk_store_put(&store, data, (uint32_t)len,
+                                     &hashes[CHUNKS / 2]),
+                     DISFS_SUCCESS);
+    assert_int_equal(chunk_store_get(&store, &hashes[CHUNKS / 2], data,
+                                     sizeof(data), &length),
+                     DISFS_SUCCESS);
+    assert_int_equal(length, len);
+    chunk_store_close(&store);
+    free(hashes);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(put_get_reopen_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(put_file_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(short_pack_test, setup, teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
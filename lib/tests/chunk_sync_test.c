@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "cdc.h"
+#include "chunk_sync.h"
+#include "connection.h"
+#include "test_cluster.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NODES 2
+#define FILE_SIZE (512 * 1024)
+#define MAX_HASHES 256
+#define BASE_PORT 23600
+
+/* node 0 pushes files to node 1 */
+typedef struct cluster_t
+{
+    connection_t nodes[NODES];
+    chunk_store_t stores[NODES];
+    char dirs[NODES][TEST_CLUSTER_DIR_MAX];
+    struct sockaddr_in target;
+} cluster_t;
+
+static cluster_t* start_cluster(int32_t port)
+{
+    cluster_t* cluster = calloc(1, sizeof(*cluster));
+    assert_non_null(cluster);
+    for (uint32_t n = 0; n < NODES; n++)
+    {
+        test_cluster_store(&cluster->nodes[n], &cluster->stores[n],
+                           cluster->dirs[n]);
+        test_cluster_join(&cluster->nodes[n], n, NODES, port);
+    }
+    test_cluster_wait(&cluster->nodes[0], NODES - 1);
+    cluster->target = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t)(port + 1)),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    return cluster;
+}
+
+static void stop_cluster(cluster_t* cluster)
+{
+    for (uint32_t n = 0; n < NODES; n++)
+    {
+        test_cluster_leave(&cluster->nodes[n], &cluster->stores[n],
+                           cluster->dirs[n]);
+    }
+    free(cluster);
+}
+
+/* content is split by chunk store of node 0, as file written to it is */
+static uint64_t put_file(cluster_t cluster[static 1], const uint8_t* content,
+                         uint32_t size, chunk_hash_t hashes[MAX_HASHES])
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/file", cluster->dirs[0]);
+    int32_t fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert_true(fd >= 0);
+    assert_true(write(fd, content, size) == size);
+    lseek(fd, 0, SEEK_SET);
+    uint64_t count = 0;
+    assert_int_equal(chunk_store_put_file(&cluster->stores[0], fd, hashes,
+                                          MAX_HASHES, &count),
+                     DISFS_SUCCESS);
+    close(fd);
+    return count;
+}
+
+static void assert_synced(cluster_t cluster[static 1],
+                          const chunk_hash_t* hashes, uint64_t count)
+{
+    for (uint64_t i = 0; i < count; i++)
+    {
+        chunk_location_t location;
+        assert_int_equal(
+            chunk_store_lookup(&cluster->stores[1], &hashes[i], &location),
+            DISFS_SUCCESS);
+    }
+}
+
+static void edit_test(void** state)
+{
+    (void)state;
+    cluster_t* cluster = start_cluster(BASE_PORT);
+    uint8_t* content = malloc(FILE_SIZE + 100);
+    uint64_t seed = 7;
+    for (uint32_t i = 0; i < FILE_SIZE; i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        content[i] = (uint8_t)(seed >> 56);
+    }
+    chunk_hash_t hashes[MAX_HASHES];
+    uint64_t count = put_file(cluster, content, FILE_SIZE, hashes);
+    chunk_sync_stats_t stats;
+    assert_int_equal(chunk_sync_push(&cluster->nodes[0], &cluster->target,
+                                     &cluster->stores[0], hashes, count,
+                                     &stats),
+                     DISFS_SUCCESS);
+    assert_int_equal(stats.chunks, count);
+    assert_int_equal(stats.sent, count);
+    assert_int_equal(stats.sent_bytes, FILE_SIZE);
+    assert_int_equal(stats.present_bytes, 0);
+    assert_synced(cluster, hashes, count);
+
+    /* 100 bytes inserted in the middle, peer gets the changed chunks only */
+    memmove(content + FILE_SIZE / 2 + 100, content + FILE_SIZE / 2,
+            FILE_SIZE / 2);
+    memset(content + FILE_SIZE / 2, 'x', 100);
+    count = put_file(cluster, content, FILE_SIZE + 100, hashes);
+    assert_int_equal(chunk_sync_push(&cluster->nodes[0], &cluster->target,
+                                     &cluster->stores[0], hashes, count,
+                                     &stats),
+                     DISFS_SUCCESS);
+    assert_int_equal(stats.chunks, count);
+    assert_true(stats.sent >= 1 && stats.sent <= 2);
+    assert_int_equal(stats.sent_bytes + stats.present_bytes, FILE_SIZE + 100);
+    assert_true(stats.manifest_bytes < stats.sent_bytes);
+    assert_synced(cluster, hashes, count);
+
+    /* nothing left to send */
+    assert_int_equal(chunk_sync_push(&cluster->nodes[0], &cluster->target,
+                                     &cluster->stores[0], hashes, count,
+                                     &stats),
+                     DISFS_SUCCESS);
+    assert_int_equal(stats.sent, 0);
+    free(content);
+    stop_cluster(cluster);
+}
+
+static void duplicate_test(void** state)
+{
+    (void)state;
+    cluster_t* cluster = start_cluster(BASE_PORT + 10);
+    /* zeros are cut into equal chunks of the largest size */
+    uint8_t* content = calloc(1, FILE_SIZE);
+    chunk_hash_t hashes[MAX_HASHES];
+    uint64_t count = put_file(cluster, content, FILE_SIZE, hashes);
+    assert_int_equal(count, FILE_SIZE / CDC_MAX_SIZE);
+    chunk_sync_stats_t stats;
+    assert_int_equal(chunk_sync_push(&cluster->nodes[0], &cluster->target,
+                                     &cluster->stores[0], hashes, count,
+                                     &stats),
+                     DISFS_SUCCESS);
+    assert_int_equal(stats.chunks, 1);
+    assert_int_equal(stats.sent, 1);
+
+    /* chunk missing on both sides fails the sync */
+    chunk_hash_t unknown[2] = {hashes[0], {.bytes = {1, 2, 3}}};
+    assert_int_equal(chunk_sync_push(&cluster->nodes[0], &cluster->target,
+                                     &cluster->stores[0], unknown, 2, &stats),
+                     DISFS_ERR_NOT_FOUND);
+    free(content);
+    stop_cluster(cluster);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(edit_test),
+        cmocka_unit_test(duplicate_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "compress.h"
+#include "test_cluster.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DATA_SIZE (200 * 1024)
+/* worst case growth of incompressible data, one run byte per 255 */
+#define BOUND(length) ((length) + (length) / 255 + 16)
+#define FUZZ_ROUNDS 5000
+
+static const char* const words[] = {"chunk ", "replica ", "metadata ",
+                                    "inode ",  "peer ",    "\n",
+                                    "frame ",  "ring ",    "directory "};
+
+static uint8_t* text_data(void)
+{
+    uint8_t* data = malloc(DATA_SIZE);
+    for (uint32_t used = 0; used < DATA_SIZE;)
+    {
+        const char* word = words[(uint32_t)rand() % 9];
+        uint32_t length = (uint32_t)strlen(word);
+        length = length > DATA_SIZE - used ? DATA_SIZE - used : length;
+        memcpy(data + used, word, length);
+        used += length;
+    }
+    return data;
+}
+
+static void roundtrip(const uint8_t* data, uint64_t length)
+{
+    uint8_t* packed = malloc(BOUND(length));
+    uint8_t* restored = malloc(length + 1);
+    uint64_t size = compress_lz(data, length, packed, BOUND(length));
+    assert_true(size > 0);
+    assert_int_equal(decompress_lz(packed, size, restored, length),
+                     DISFS_SUCCESS);
+    assert_memory_equal(restored, data, length);
+    /* block has to expand to exactly expected length */
+    if (length > 0)
+    {
+        assert_int_equal(decompress_lz(packed, size, restored, length - 1),
+                         DISFS_ERR_PROTO);
+    }
+    assert_int_equal(decompress_lz(packed, size, restored, length + 1),
+                     DISFS_ERR_PROTO);
+    free(packed);
+    free(restored);
+}
+
+static void roundtrip_test(void** state)
+{
+    (void)state;
+    uint8_t* text = text_data();
+    uint8_t* noise = malloc(DATA_SIZE);
+    test_random_data(noise, DATA_SIZE, 1);
+    uint8_t* run = calloc(DATA_SIZE, 1);
+    /* lengths around every boundary of block format */
+    for (uint64_t length = 0; length < 600; length++)
+    {
+        roundtrip(text, length);
+        roundtrip(noise, length);
+        roundtrip(run, length);
+    }
+    roundtrip(text, DATA_SIZE);
+    roundtrip(noise, DATA_SIZE);
+    roundtrip(run, DATA_SIZE);
+    /* matches further than longest offset */
+    memcpy(run + DATA_SIZE - 1000, noise, 1000);
+    memcpy(run, noise, 1000);
+    roundtrip(run, DATA_SIZE);
+    free(text);
+    free(noise);
+    free(run);
+}
+
+static void ratio_test(void** state)
+{
+    (void)state;
+    uint8_t* text = text_data();
+    uint8_t* noise = malloc(DATA_SIZE);
+    test_random_data(noise, DATA_SIZE, 2);
+    uint8_t* packed = malloc(BOUND(DATA_SIZE));
+    assert_in_range(compress_lz(text, DATA_SIZE, packed, DATA_SIZE), 1,
+                    DATA_SIZE / 2);
+    /* capacity below input rejects incompressible data */
+    assert_int_equal(compress_lz(noise, DATA_SIZE, packed, DATA_SIZE - 1), 0);
+    assert_int_equal(compress_lz(text, DATA_SIZE, packed, 100), 0);
+    free(text);
+    free(noise);
+    free(packed);
+}
+
+static void malformed_test(void** state)
+{
+    (void)state;
+    uint8_t* text = text_data();
+    uint8_t* packed = malloc(BOUND(DATA_SIZE));
+    uint8_t* restored = malloc(DATA_SIZE);
+    /* flipped bits never make decoder touch memory outside buffers */
+    for (uint32_t round = 0; round < FUZZ_ROUNDS; round++)
+    {
+        uint64_t length = (uint64_t)rand() % 4096;
+        uint64_t size = compress_lz(text, length, packed, BOUND(length));
+        packed[(uint64_t)rand() % size] ^= (uint8_t)(1 << (rand() % 8));
+        decompress_lz(packed, size, restored, length);
+        decompress_lz(packed, (uint64_t)rand() % (size + 1), restored, length);
+    }
+    /* offset before start of output */
+    const uint8_t bad_offset[] = {0x10, 'a', 0x09, 0x00};
+    assert_int_equal(decompress_lz(bad_offset, sizeof(bad_offset), restored, 5),
+                     DISFS_ERR_PROTO);
+    /* length continuation cut off */
+    const uint8_t cut[] = {0xF0, 0xFF};
+    assert_int_equal(decompress_lz(cut, sizeof(cut), restored, 300),
+                     DISFS_ERR_PROTO);
+    free(text);
+    free(packed);
+    free(restored);
+}
+
+static void worthwhile_test(void** state)
+{
+    (void)state;
+    uint8_t* text = text_data();
+    uint8_t* noise = malloc(DATA_SIZE);
+    test_random_data(noise, DATA_SIZE, 3);
+    assert_true(compress_worthwhile(text, DATA_SIZE));
+    assert_false(compress_worthwhile(noise, DATA_SIZE));
+    assert_false(compress_worthwhile(text, COMPRESS_MIN_LENGTH - 1));
+    /* known compressed format is rejected without compressing */
+    memcpy(text, "\x28\xB5\x2F\xFD", 4);
+    assert_false(compress_worthwhile(text, DATA_SIZE));
+    free(text);
+    free(noise);
+}
+
+static void adapt_test(void** state)
+{
+    (void)state;
+    compress_adapt_t adapt;
+    compress_adapt_init(&adapt);
+    assert_true(compress_adapt_wants(&adapt));
+    /* good ratio at low cost keeps compressing */
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        compress_adapt_record(&adapt, 65536, 20000, 100000);
+        assert_true(compress_adapt_wants(&adapt));
+    }
+    /* single incompressible frame does not switch it off */
+    compress_adapt_record(&adapt, 65536, 0, 100000);
+    assert_true(compress_adapt_wants(&adapt));
+
+    /* incompressible stream does, and probes back off */
+    uint32_t skipped = 0;
+    for (uint32_t probe = 0; probe < 4; probe++)
+    {
+        while (compress_adapt_wants(&adapt))
+        {
+            compress_adapt_record(&adapt, 65536, 0, 20000);
+        }
+        uint32_t frames = 0;
+        while (!compress_adapt_wants(&adapt))
+        {
+            compress_adapt_skip(&adapt);
+            frames++;
+        }
+        assert_true(frames > skipped);
+        skipped = frames;
+    }
+    /* probe with compressible data switches it on again */
+    compress_adapt_record(&adapt, 65536, 20000, 100000);
+    assert_true(compress_adapt_wants(&adapt));
+
+    /* expensive compression is dropped even with fair ratio */
+    compress_adapt_init(&adapt);
+    compress_adapt_record(&adapt, 65536, 50000, 100000000);
+    assert_false(compress_adapt_wants(&adapt));
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(roundtrip_test),  cmocka_unit_test(ratio_test),
+        cmocka_unit_test(malformed_test),  cmocka_unit_test(worthwhile_test),
+        cmocka_unit_test(adapt_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "connection.h"
+#include "io_backend.h"
+#include "test_cluster.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BASE_PORT 23800
+#define REACTORS 4
+
+static uint32_t open_fds(void)
+{
+    DIR* dir = opendir("/proc/self/fd");
+    assert_non_null(dir);
+    uint32_t count = 0;
+    while (readdir(dir) != NULL)
+    {
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+/* failed create releases everything, so same ports can be used right after */
+static void create_fail_test(void** state)
+{
+    (void)state;
+    connection_t* conn = calloc(1, sizeof(*conn));
+    uint32_t fds = open_fds();
+
+    /* fails before any reactor exists */
+    assert_int_equal(create_connection(conn, .port_tcp = BASE_PORT,
+                                       .port_udp = BASE_PORT + 1,
+                                       .tx_high_watermark = 1024,
+                                       .tx_low_watermark = 2048),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(open_fds(), fds);
+
+    /* fails once every reactor listens */
+    memset(conn, 0, sizeof(*conn));
+    assert_int_not_equal(
+        create_connection(conn, .port_tcp = BASE_PORT,
+                          .port_udp = BASE_PORT + 1,
+                          .reactor_threads = REACTORS,
+                          .stats_path = "/nonexistent/disfs.sock"),
+        DISFS_SUCCESS);
+    assert_int_equal(open_fds(), fds);
+
+    memset(conn, 0, sizeof(*conn));
+    assert_int_equal(create_connection(conn, .port_tcp = BASE_PORT,
+                                       .port_udp = BASE_PORT + 1,
+                                       .reactor_threads = REACTORS),
+                     DISFS_SUCCESS);
+    close_connection(conn);
+    assert_int_equal(open_fds(), fds);
+    free(conn);
+}
+
+/* connect to listening port of node on loopback, returns errno or 0 */
+static int32_t try_connect(int32_t port)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons((uint16_t)port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    int32_t fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert_true(fd >= 0);
+    int32_t ret = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    int32_t error = ret < 0 ? errno : 0;
+    close(fd);
+    return error;
+}
+
+/* closed node no longer takes connections of its port, with any backend */
+static void port_release_test(int32_t kind)
+{
+    connection_t* conn = calloc(1, sizeof(*conn));
+    for (uint32_t round = 0; round < 8; round++)
+    {
+        memset(conn, 0, sizeof(*conn));
+        err_t ret = create_connection(conn, .port_tcp = BASE_PORT + 10,
+                                      .port_udp = BASE_PORT + 11,
+                                      .reactor_threads = REACTORS,
+                                      .io_backend = kind);
+        if (ret != DISFS_SUCCESS && kind == IO_BACKEND_URING)
+        {
+            free(conn);
+            skip();
+        }
+        assert_int_equal(ret, DISFS_SUCCESS);
+        assert_int_equal(try_connect(BASE_PORT + 10), 0);
+        close_connection(conn);
+        assert_int_equal(try_connect(BASE_PORT + 10), ECONNREFUSED);
+    }
+    free(conn);
+}
+
+static void epoll_port_release_test(void** state)
+{
+    (void)state;
+    port_release_test(IO_BACKEND_EPOLL);
+}
+
+static void uring_port_release_test(void** state)
+{
+    (void)state;
+    port_release_test(IO_BACKEND_URING);
+}
+
+/*
+ * Both nodes learn about each other and connect at about the same time, each
+ * keeps single link which serves both directions.
+ */
+static void mutual_connect_test(void** state)
+{
+    (void)state;
+    connection_t* nodes = calloc(2, sizeof(*nodes));
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        test_cluster_join(&nodes[i], i, 2, BASE_PORT + 20);
+    }
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        test_cluster_wait(&nodes[i], 1);
+    }
+    /* duplicate links are released by periodic peer check */
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        if (peer_table_count(&nodes[0].peers) == 1 &&
+            peer_table_count(&nodes[1].peers) == 1)
+        {
+            break;
+        }
+        usleep(20000);
+    }
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        assert_int_equal(peer_table_count(&nodes[i].peers), 1);
+        assert_int_equal(connection_established_count(&nodes[i]), 1);
+    }
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        close_connection(&nodes[i]);
+    }
+    free(nodes);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(create_fail_test),
+        cmocka_unit_test(epoll_port_release_test),
+        cmocka_unit_test(uring_port_release_test),
+        cmocka_unit_test(mutual_connect_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
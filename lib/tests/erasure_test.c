@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "erasure.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* odd length exercises tails of every kernel */
+#define FRAGMENT_SIZE 20011
+#define RANDOM_ROUNDS 200
+
+typedef struct stripe_t
+{
+    uint8_t* fragments[ERASURE_MAX_SHARDS];
+    uint8_t* copies[ERASURE_MAX_SHARDS];
+    uint32_t total;
+    char _padded[4];
+} stripe_t;
+
+static void stripe_init(stripe_t stripe[static 1], const erasure_t* code)
+{
+    stripe->total = code->data_shards + code->parity_shards;
+    for (uint32_t i = 0; i < stripe->total; i++)
+    {
+        stripe->fragments[i] = malloc(FRAGMENT_SIZE);
+        stripe->copies[i] = malloc(FRAGMENT_SIZE);
+        for (uint32_t j = 0; j < FRAGMENT_SIZE; j++)
+        {
+            stripe->fragments[i][j] = (uint8_t)rand();
+        }
+    }
+    erasure_encode(code, (const uint8_t* const*)stripe->fragments,
+                   stripe->fragments + code->data_shards, FRAGMENT_SIZE);
+    for (uint32_t i = 0; i < stripe->total; i++)
+    {
+        memcpy(stripe->copies[i], stripe->fragments[i], FRAGMENT_SIZE);
+    }
+}
+
+static void stripe_destroy(stripe_t stripe[static 1])
+{
+    for (uint32_t i = 0; i < stripe->total; i++)
+    {
+        free(stripe->fragments[i]);
+        free(stripe->copies[i]);
+    }
+}
+
+static void erase_and_restore(const erasure_t* code, stripe_t stripe[static 1],
+                              uint32_t erased)
+{
+    for (uint32_t i = 0; i < stripe->total; i++)
+    {
+        if (erased & (1u << i))
+        {
+            memset(stripe->fragments[i], 0xA5, FRAGMENT_SIZE);
+        }
+    }
+    assert_int_equal(erasure_decode(code, stripe->fragments, erased,
+                                    FRAGMENT_SIZE),
+                     DISFS_SUCCESS);
+    for (uint32_t i = 0; i < stripe->total; i++)
+    {
+        assert_memory_equal(stripe->fragments[i], stripe->copies[i],
+                            FRAGMENT_SIZE);
+    }
+}
+
+static void kernels_test(void** state)
+{
+    (void)state;
+    erasure_t code;
+    assert_int_equal(erasure_init(&code, 10, 4), DISFS_SUCCESS);
+    assert_int_equal(erasure_select_kernel(ERASURE_KERNEL_SCALAR),
+                     DISFS_SUCCESS);
+    stripe_t stripe;
+    stripe_init(&stripe, &code);
+    /* every kernel cpu supports produces parity of scalar one */
+    for (int32_t kernel = ERASURE_KERNEL_SSSE3; kernel < ERASURE_KERNEL_MAX;
+         kernel++)
+    {
+        if (erasure_select_kernel(kernel) != DISFS_SUCCESS)
+        {
+            continue;
+        }
+        assert_int_equal(erasure_active_kernel(), kernel);
+        for (uint32_t i = 10; i < 14; i++)
+        {
+            memset(stripe.fragments[i], 0, FRAGMENT_SIZE);
+        }
+        erasure_encode(&code, (const uint8_t* const*)stripe.fragments,
+                       stripe.fragments + 10, FRAGMENT_SIZE);
+        for (uint32_t i = 10; i < 14; i++)
+        {
+            assert_memory_equal(stripe.fragments[i], stripe.copies[i],
+                                FRAGMENT_SIZE);
+        }
+        erase_and_restore(&code, &stripe, 0x2C01);
+    }
+    stripe_destroy(&stripe);
+    assert_int_equal(erasure_select_kernel(ERASURE_KERNEL_MAX),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(erasure_select_kernel(ERASURE_KERNEL_AUTO),
+                     DISFS_SUCCESS);
+}
+
+static void all_erasures_test(void** state)
+{
+    (void)state;
+    erasure_t code;
+    assert_int_equal(erasure_init(&code, 4, 2), DISFS_SUCCESS);
+    stripe_t stripe;
+    stripe_init(&stripe, &code);
+    for (uint32_t erased = 0; erased < (1u << 6); erased++)
+    {
+        if (__builtin_popcount(erased) <= 2)
+        {
+            erase_and_restore(&code, &stripe, erased);
+        }
+    }
+    /* more losses than parity fragments cannot be restored */
+    assert_int_equal(erasure_decode(&code, stripe.fragments, 0x07,
+                                    FRAGMENT_SIZE),
+                     DISFS_ERR_INVALID_ARG);
+    stripe_destroy(&stripe);
+}
+
+static void random_erasures_test(void** state)
+{
+    (void)state;
+    erasure_t code;
+    assert_int_equal(erasure_init(&code, 10, 4), DISFS_SUCCESS);
+    stripe_t stripe;
+    stripe_init(&stripe, &code);
+    for (uint32_t round = 0; round < RANDOM_ROUNDS; round++)
+    {
+        uint32_t erased = 0;
+        uint32_t losses = 1 + (uint32_t)rand() % 4;
+        while ((uint32_t)__builtin_popcount(erased) < losses)
+        {
+            erased |= 1u << ((uint32_t)rand() % 14);
+        }
+        erase_and_restore(&code, &stripe, erased);
+    }
+    stripe_destroy(&stripe);
+}
+
+static void update_test(void** state)
+{
+    (void)state;
+    erasure_t code;
+    assert_int_equal(erasure_init(&code, 6, 3), DISFS_SUCCESS);
+    stripe_t stripe;
+    stripe_init(&stripe, &code);
+    /* rewrite range of fragment 2 and patch parity from difference */
+    const uint32_t offset = 1000;
+    const uint32_t length = 10007;
+    uint8_t* old_data = malloc(length);
+    memcpy(old_data, stripe.fragments[2] + offset, length);
+    for (uint32_t i = 0; i < length; i++)
+    {
+        stripe.fragments[2][offset + i] = (uint8_t)rand();
+    }
+    uint8_t* parity[3];
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        parity[i] = stripe.fragments[6 + i] + offset;
+    }
+    erasure_update(&code, 2, old_data, stripe.fragments[2] + offset, parity,
+                   length);
+    free(old_data);
+
+    erasure_encode(&code, (const uint8_t* const*)stripe.fragments,
+                   stripe.copies + 6, FRAGMENT_SIZE);
+    for (uint32_t i = 6; i < 9; i++)
+    {
+        assert_memory_equal(stripe.fragments[i], stripe.copies[i],
+                            FRAGMENT_SIZE);
+    }
+    stripe_destroy(&stripe);
+}
+
+static void invalid_test(void** state)
+{
+    (void)state;
+    erasure_t code;
+    assert_int_equal(erasure_init(&code, 0, 2), DISFS_ERR_INVALID_ARG);
+    assert_int_equal(erasure_init(&code, 4, 0), DISFS_ERR_INVALID_ARG);
+    assert_int_equal(erasure_init(&code, 12, 5), DISFS_ERR_INVALID_ARG);
+    assert_int_equal(erasure_init(&code, 12, 4), DISFS_SUCCESS);
+    assert_int_equal(erasure_init(&code, 1, 15), DISFS_SUCCESS);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(kernels_test),
+        cmocka_unit_test(all_erasures_test),
+        cmocka_unit_test(random_erasures_test),
+        cmocka_unit_test(update_test),
+        cmocka_unit_test(invalid_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "hash_ring.h"
+#include <stdlib.h>
+
+#define NODES 10
+#define KEYS 100000
+
+static void lookup_distinct_test(void** state)
+{
+    (void)state;
+    hash_ring_t ring;
+    hash_ring_init(&ring, 0);
+    hash_ring_node_t owners[3];
+    assert_int_equal(hash_ring_lookup(&ring, 42, owners, 3), 0);
+
+    for (uint64_t id = 1; id <= NODES; id++)
+    {
+        struct sockaddr_in addr = {.sin_port = (uint16_t)id};
+        assert_int_equal(hash_ring_add(&ring, id, &addr), DISFS_SUCCESS);
+    }
+    assert_int_equal(hash_ring_add(&ring, 3, NULL), DISFS_ERR_PEER_EXISTS);
+
+    for (uint64_t key = 0; key < 1000; key++)
+    {
+        assert_int_equal(
+            hash_ring_lookup(&ring, hash_ring_mix(key), owners, 3), 3);
+        assert_true(owners[0].id != owners[1].id);
+        assert_true(owners[1].id != owners[2].id);
+        assert_true(owners[0].id != owners[2].id);
+        assert_int_equal(owners[0].addr.sin_port, owners[0].id);
+        assert_false(owners[0].local);
+    }
+    hash_ring_destroy(&ring);
+}
+
+static void balance_and_movement_test(void** state)
+{
+    (void)state;
+    hash_ring_t ring;
+    hash_ring_init(&ring, 0);
+    for (uint64_t id = 1; id <= NODES; id++)
+    {
+        hash_ring_add(&ring, id, NULL);
+    }
+
+    uint64_t* before = calloc(KEYS, sizeof(*before));
+    uint32_t load[NODES + 2] = {};
+    hash_ring_node_t owner;
+    for (uint64_t key = 0; key < KEYS; key++)
+    {
+        hash_ring_lookup(&ring, hash_ring_mix(key), &owner, 1);
+        before[key] = owner.id;
+        load[owner.id]++;
+    }
+    for (uint64_t id = 1; id <= NODES; id++)
+    {
+        /* every node owns its share within 30% */
+        assert_in_range(load[id], KEYS / NODES * 7 / 10,
+                        KEYS / NODES * 13 / 10);
+    }
+
+    /* joining node takes keys only for itself */
+    hash_ring_add(&ring, NODES + 1, NULL);
+    uint32_t moved = 0;
+    for (uint64_t key = 0; key < KEYS; key++)
+    {
+        hash_ring_lookup(&ring, hash_ring_mix(key), &owner, 1);
+        if (owner.id != before[key])
+        {
+            assert_int_equal(owner.id, NODES + 1);
+            moved++;
+        }
+    }
+    assert_in_range(moved, KEYS / (NODES + 1) / 2, KEYS / (NODES + 1) * 2);
+
+    /* leaving restores previous placement */
+    assert_int_equal(hash_ring_remove(&ring, NODES + 1), DISFS_SUCCESS);
+    for (uint64_t key = 0; key < KEYS; key++)
+    {
+        hash_ring_lookup(&ring, hash_ring_mix(key), &owner, 1);
+        assert_int_equal(owner.id, before[key]);
+    }
+    free(before);
+    hash_ring_destroy(&ring);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(lookup_distinct_test),
+        cmocka_unit_test(balance_and_movement_test),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "inflight.h"
+#include <stdlib.h>
+
+#define MANY_REQUESTS 1000
+
+static void complete(void* ctx, struct client_t* client, err_t status,
+                     const proto_frame_t* reply)
+{
+    (void)ctx;
+    (void)client;
+    (void)status;
+    (void)reply;
+}
+
+static void out_of_order_test(void** state)
+{
+    (void)state;
+    inflight_t table = {};
+    uint64_t ids[3];
+    int32_t ctx[3];
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        assert_int_equal(
+            inflight_add(&table, 100 + i, complete, &ctx[i], &ids[i]),
+            DISFS_SUCCESS);
+        assert_true(ids[i] != 0);
+    }
+    assert_int_equal(table.count, 3);
+
+    /* replies complete requests in any order, each exactly once */
+    inflight_entry_t entry;
+    const uint32_t order[] = {2, 0, 1};
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        assert_int_equal(inflight_take(&table, ids[order[i]], &entry),
+                         DISFS_SUCCESS);
+        assert_ptr_equal(entry.ctx, &ctx[order[i]]);
+        assert_ptr_equal(entry.fn, complete);
+        assert_int_equal(inflight_take(&table, ids[order[i]], &entry),
+                         DISFS_ERR_NOT_FOUND);
+    }
+    assert_int_equal(table.count, 0);
+    assert_int_equal(inflight_take(&table, 0, &entry), DISFS_ERR_NOT_FOUND);
+    inflight_destroy(&table);
+}
+
+static void stale_id_test(void** state)
+{
+    (void)state;
+    inflight_t table = {};
+    uint64_t old_id;
+    uint64_t new_id;
+    inflight_entry_t entry;
+    inflight_add(&table, 100, complete, NULL, &old_id);
+    inflight_take(&table, old_id, &entry);
+
+    /* slot is reused, late reply to its previous request matches nothing */
+    inflight_add(&table, 100, complete, NULL, &new_id);
+    assert_int_equal((uint32_t)new_id, (uint32_t)old_id);
+    assert_true(new_id != old_id);
+    assert_int_equal(inflight_take(&table, old_id, &entry),
+                     DISFS_ERR_NOT_FOUND);
+    assert_int_equal(inflight_take(&table, new_id, &entry), DISFS_SUCCESS);
+    inflight_destroy(&table);
+}
+
+static void deadline_test(void** state)
+{
+    (void)state;
+    inflight_t table = {};
+    uint64_t* ids = calloc(MANY_REQUESTS, sizeof(*ids));
+    assert_non_null(ids);
+    assert_true(inflight_next_deadline(&table) == UINT64_MAX);
+    /* deadlines are shuffled and table grows past its initial capacity */
+    for (uint64_t i = 0; i < MANY_REQUESTS; i++)
+    {
+        uint64_t deadline = (i * 7919) % MANY_REQUESTS;
+        assert_int_equal(inflight_add(&table, deadline, complete,
+                                      (void*)(uintptr_t)deadline, &ids[i]),
+                         DISFS_SUCCESS);
+    }
+    /* every other request is answered before its deadline */
+    inflight_entry_t entry;
+    for (uint64_t i = 0; i < MANY_REQUESTS; i += 2)
+    {
+        assert_int_equal(inflight_take(&table, ids[i], &entry),
+                         DISFS_SUCCESS);
+    }
+    assert_int_equal(table.count, MANY_REQUESTS / 2);
+
+    /* rest expires in deadline order and only once deadline passed */
+    uint64_t now = 0;
+    uint64_t last = 0;
+    uint32_t expired = 0;
+    while (table.count > 0)
+    {
+        uint64_t next = inflight_next_deadline(&table);
+        assert_true(next >= last);
+        if (next > now)
+        {
+            assert_int_equal(inflight_expire(&table, now, &entry), 0);
+            now = next;
+            continue;
+        }
+        assert_int_equal(inflight_expire(&table, now, &entry), 1);
+        assert_int_equal(entry.deadline_ms, next);
+        assert_int_equal((uintptr_t)entry.ctx, next);
+        last = next;
+        expired++;
+    }
+    assert_int_equal(expired, MANY_REQUESTS / 2);
+    free(ids);
+    inflight_destroy(&table);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(out_of_order_test),
+        cmocka_unit_test(stale_id_test),
+        cmocka_unit_test(deadline_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "io_backend.h"
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WAIT_MS 1000
+
+static void init_or_skip(io_backend_t backend[static 1], int32_t kind)
+{
+    if (io_backend_init(backend, kind) != DISFS_SUCCESS)
+    {
+        skip();
+    }
+    assert_int_equal(backend->kind, kind);
+}
+
+static void receive_test(int32_t kind)
+{
+    io_backend_t backend;
+    init_or_skip(&backend, kind);
+    int32_t fds[2];
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds),
+                     0);
+    event_source_t source = {.kind = EVENT_KIND_PEER, .fd = fds[0]};
+    assert_int_equal(io_backend_add(&backend, &source, IO_WANT_RECV),
+                     DISFS_SUCCESS);
+
+    io_event_t events[4];
+    assert_int_equal(write(fds[1], "payload", 7), 7);
+    assert_int_equal(io_backend_wait(&backend, events, 4, WAIT_MS), 1);
+    assert_ptr_equal(events[0].source, &source);
+    if (kind == IO_BACKEND_URING)
+    {
+        /* data was already received by kernel */
+        assert_int_equal(events[0].type, IO_EVENT_RECEIVED);
+        assert_int_equal(events[0].result, 7);
+        assert_memory_equal(events[0].data, "payload", 7);
+    }
+    else
+    {
+        char buffer[16];
+        assert_int_equal(events[0].type, IO_EVENT_READY);
+        assert_true(events[0].result & IO_WANT_READ);
+        assert_int_equal(read(fds[0], buffer, sizeof(buffer)), 7);
+    }
+
+    /* writable is only reported while wanted */
+    assert_int_equal(
+        io_backend_modify(&backend, &source, IO_WANT_RECV | IO_WANT_WRITE),
+        DISFS_SUCCESS);
+    assert_int_equal(io_backend_wait(&backend, events, 4, WAIT_MS), 1);
+    assert_int_equal(events[0].type, IO_EVENT_READY);
+    assert_int_equal(events[0].result, IO_WANT_WRITE);
+    assert_int_equal(io_backend_modify(&backend, &source, IO_WANT_RECV),
+                     DISFS_SUCCESS);
+    assert_int_equal(io_backend_wait(&backend, events, 4, 10), 0);
+
+    close(fds[1]);
+    assert_int_equal(io_backend_wait(&backend, events, 4, WAIT_MS), 1);
+    if (kind == IO_BACKEND_URING)
+    {
+        assert_int_equal(events[0].type, IO_EVENT_CLOSED);
+    }
+    else
+    {
+        assert_true(events[0].result & IO_WANT_READ);
+    }
+    io_backend_remove(&backend, &source);
+    /* completions of removed source are never reported */
+    assert_int_equal(io_backend_wait(&backend, events, 4, 10), 0);
+    assert_int_equal(source.inflight, 0);
+    close(fds[0]);
+    io_backend_destroy(&backend);
+}
+
+/* collect data reported by events, readable socket is read by owner */
+static uint32_t pause_collect(io_backend_t backend[static 1], int32_t fd,
+                              char received[static 16], uint32_t length,
+                              int32_t timeout_ms)
+{
+    io_event_t events[4];
+    int32_t count = io_backend_wait(backend, events, 4, timeout_ms);
+    for (int32_t i = 0; i < count; i++)
+    {
+        if (events[i].type == IO_EVENT_RECEIVED)
+        {
+            assert_true(length + (uint32_t)events[i].result <= 16);
+            memcpy(received + length, events[i].data,
+                   (size_t)events[i].result);
+            length += (uint32_t)events[i].result;
+        }
+        else if (events[i].result & IO_WANT_READ)
+        {
+            ssize_t readed = read(fd, received + length, 16 - length);
+            assert_true(readed > 0);
+            length += (uint32_t)readed;
+        }
+    }
+    return length;
+}
+
+static void pause_test(int32_t kind)
+{
+    io_backend_t backend;
+    init_or_skip(&backend, kind);
+    int32_t fds[2];
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds),
+                     0);
+    event_source_t source = {.kind = EVENT_KIND_PEER, .fd = fds[0]};
+    assert_int_equal(io_backend_add(&backend, &source, IO_WANT_RECV),
+                     DISFS_SUCCESS);
+
+    /* receive is stopped while source still waits for writable */
+    char received[16];
+    uint32_t length = 0;
+    assert_int_equal(io_backend_modify(&backend, &source, IO_WANT_WRITE),
+                     DISFS_SUCCESS);
+    assert_int_equal(write(fds[1], "abc", 3), 3);
+    for (int32_t i = 0; i < 10; i++)
+    {
+        length = pause_collect(&backend, fds[0], received, length, 10);
+    }
+    /* io_uring may report bytes it received before receive was cancelled */
+    if (kind == IO_BACKEND_EPOLL)
+    {
+        assert_int_equal(length, 0);
+    }
+
+    /* nothing is lost or reordered once receive is wanted again */
+    assert_int_equal(io_backend_modify(&backend, &source, IO_WANT_RECV),
+                     DISFS_SUCCESS);
+    assert_int_equal(write(fds[1], "def", 3), 3);
+    for (int32_t i = 0; i < 10 && length < 6; i++)
+    {
+        length = pause_collect(&backend, fds[0], received, length, WAIT_MS);
+    }
+    assert_int_equal(length, 6);
+    assert_memory_equal(received, "abcdef", 6);
+
+    io_backend_remove(&backend, &source);
+    for (int32_t i = 0; i < 10 && source.inflight > 0; i++)
+    {
+        io_backend_wait(&backend, (io_event_t[4]){}, 4, 10);
+    }
+    assert_int_equal(source.inflight, 0);
+    close(fds[0]);
+    close(fds[1]);
+    io_backend_destroy(&backend);
+}
+
+static void epoll_receive_test(void** state)
+{
+    (void)state;
+    receive_test(IO_BACKEND_EPOLL);
+}
+
+static void uring_receive_test(void** state)
+{
+    (void)state;
+    receive_test(IO_BACKEND_URING);
+}
+
+static void epoll_pause_test(void** state)
+{
+    (void)state;
+    pause_test(IO_BACKEND_EPOLL);
+}
+
+static void uring_pause_test(void** state)
+{
+    (void)state;
+    pause_test(IO_BACKEND_URING);
+}
+
+static void uring_remove_test(void** state)
+{
+    (void)state;
+    io_backend_t backend;
+    init_or_skip(&backend, IO_BACKEND_URING);
+    int32_t fds[2];
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds),
+                     0);
+    event_source_t source = {.kind = EVENT_KIND_PEER, .fd = fds[0]};
+    io_event_t events[4];
+    io_backend_add(&backend, &source, IO_WANT_RECV);
+    assert_int_equal(io_backend_wait(&backend, events, 4, 10), 0);
+    assert_int_equal(source.inflight, 1);
+
+    /* pending multishot receive is cancelled and owner is released after */
+    io_backend_remove(&backend, &source);
+    close(fds[0]);
+    for (int32_t i = 0; i < 10 && source.inflight > 0; i++)
+    {
+        assert_int_equal(io_backend_wait(&backend, events, 4, 10), 0);
+    }
+    assert_int_equal(source.inflight, 0);
+    close(fds[1]);
+    io_backend_destroy(&backend);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(epoll_receive_test),
+        cmocka_unit_test(uring_receive_test),
+        cmocka_unit_test(epoll_pause_test),
+        cmocka_unit_test(uring_pause_test),
+        cmocka_unit_test(uring_remove_test),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
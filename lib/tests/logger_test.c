@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#include "logger.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define THREADS 4
+#define MESSAGES 500
+#define OUTPUT_MAX (1024 * 1024)
+
+typedef struct capture_t
+{
+    char path[32];
+    int stderr_fd;
+    int fd;
+} capture_t;
+
+static int setup(void** state)
+{
+    capture_t* capture = calloc(1, sizeof(*capture));
+    strcpy(capture->path, "/tmp/disfs_logger_XXXXXX");
+    capture->fd = mkstemp(capture->path);
+    if (capture->fd < 0)
+    {
+        free(capture);
+        return -1;
+    }
+    capture->stderr_fd = dup(STDERR_FILENO);
+    dup2(capture->fd, STDERR_FILENO);
+    *state = capture;
+    return 0;
+}
+
+static int teardown(void** state)
+{
+    capture_t* capture = *state;
+    logger_flush();
+    dup2(capture->stderr_fd, STDERR_FILENO);
+    close(capture->stderr_fd);
+    close(capture->fd);
+    unlink(capture->path);
+    free(capture);
+    return 0;
+}
+
+static char* read_output(capture_t capture[static 1])
+{
+    logger_flush();
+    char* out = calloc(1, OUTPUT_MAX);
+    ssize_t n = pread(capture->fd, out, OUTPUT_MAX - 1, 0);
+    assert_true(n >= 0);
+    return out;
+}
+
+static void format_test(void** state)
+{
+    char transient[16];
+    strcpy(transient, "transient");
+    LOG_INFO("int %d unsigned %u hex %#x pad [%5d] [%-4s] [%03d]\n", -42, 7u,
+             255, 12, "ab", 5);
+    LOG_WARNING("string %s null %s precision %.3s\n", transient, (char*)NULL,
+                "abcdef");
+    /* string is copied, so later change of buffer is not visible */
+    strcpy(transient, "changed");
+    LOG_ERROR("float %.2f long %ld min %lld ptr %p\n", 1.5, -1L,
+              (long long)INT64_MIN, (void*)0x10);
+    LOG_ERROR("no arguments 100%%\n");
+    LOG_ERROR("missing %d\n");
+
+    char* out = read_output(*state);
+    assert_non_null(strstr(out, "[INFO] "));
+    assert_non_null(strstr(out, "logger_test.c:"));
+    assert_non_null(strstr(
+        out, "  --  int -42 unsigned 7 hex 0xff pad [   12] [ab  ] [005]\n"));
+    assert_non_null(
+        strstr(out, "string transient null (null) precision abc\n"));
+    assert_non_null(strstr(
+        out, "float 1.50 long -1 min -9223372036854775808 ptr 0x10\n"));
+    assert_non_null(strstr(out, "no arguments 100%\n"));
+    assert_non_null(strstr(out, "missing (missing)\n"));
+    free(out);
+}
+
+static void* log_thread(void* arg)
+{
+    uint64_t id = (uint64_t)arg;
+    for (uint32_t i = 0; i < MESSAGES; i++)
+    {
+        LOG_INFO("thread %lu message %u\n", id, i);
+    }
+    return NULL;
+}
+
+static void threads_test(void** state)
+{
+    pthread_t threads[THREADS];
+    for (uint64_t i = 0; i < THREADS; i++)
+    {
+        pthread_create(&threads[i], NULL, log_thread, (void*)i);
+    }
+    for (uint32_t i = 0; i < THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* every message is written once, in order of its thread */
+    char* out = read_output(*state);
+    for (uint64_t id = 0; id < THREADS; id++)
+    {
+        const char* last = out;
+        for (uint32_t i = 0; i < MESSAGES; i++)
+        {
+            char message[64];
+            snprintf(message, sizeof(message), "thread %lu message %u\n", id,
+                     i);
+            const char* found = strstr(out, message);
+            assert_non_null(found);
+            assert_true(found >= last);
+            assert_null(strstr(found + 1, message));
+            last = found;
+        }
+    }
+    assert_null(strstr(out, "dropped"));
+    free(out);
+}
+
+/*
+ * Error logged right before abort reaches stderr, with records before it.
+ * Runs first, so logger of child is started after fork.
+ */
+static void abort_test(void** state)
+{
+    capture_t* capture = *state;
+    pid_t pid = fork();
+    assert_true(pid >= 0);
+    if (pid == 0)
+    {
+        signal(SIGABRT, SIG_DFL);
+        LOG_INFO("before error\n");
+        LOG_ERROR("error %d\n", 1);
+        abort();
+    }
+    int status = 0;
+    assert_int_equal(waitpid(pid, &status, 0), pid);
+    assert_true(WIFSIGNALED(status));
+    char* out = calloc(1, OUTPUT_MAX);
+    assert_true(pread(capture->fd, out, OUTPUT_MAX - 1, 0) >= 0);
+    const char* before = strstr(out, "before error\n");
+    assert_non_null(before);
+    assert_true(strstr(out, "error 1\n") > before);
+    free(out);
+}
+
+static void disabled_level_test(void** state)
+{
+    uint32_t evaluated = 0;
+    LOG_DEBUG("debug %u\n", ++evaluated);
+    LOG_TRACE("trace %u\n", ++evaluated);
+    assert_int_equal(evaluated, 0);
+    LOG_INFO("info %u\n", ++evaluated);
+    assert_int_equal(evaluated, 1);
+
+    char* out = read_output(*state);
+    assert_null(strstr(out, "debug"));
+    assert_null(strstr(out, "trace"));
+    assert_non_null(strstr(out, "info 1\n"));
+    free(out);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(abort_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(format_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(threads_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(disabled_level_test, setup, teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "membership.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define NODES 8
+#define BASE_PORT 23100
+#define PERIOD_MS 100
+#define STEP_MS 10
+
+typedef struct test_node_t
+{
+    membership_t membership;
+    struct sockaddr_in addr;
+    int32_t fd;
+    int32_t running;
+    uint32_t dead_events;
+    char _padded[4];
+} test_node_t;
+
+static test_node_t nodes[NODES];
+
+static void node_event(void* ctx, const member_t member[static 1])
+{
+    test_node_t* node = ctx;
+    if (member->state == MEMBER_DEAD)
+    {
+        node->dead_events++;
+    }
+}
+
+static void start_nodes(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        test_node_t* node = &nodes[i];
+        *node = (test_node_t){.running = 1};
+        node->addr = (struct sockaddr_in){
+            .sin_family = AF_INET,
+            .sin_port = htons((uint16_t)(BASE_PORT + i)),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+        node->fd = socket(AF_INET, SOCK_DGRAM, 0);
+        assert_true(node->fd >= 0);
+        assert_int_equal(bind(node->fd, (struct sockaddr*)&node->addr,
+                              sizeof(node->addr)),
+                         0);
+        assert_int_equal(membership_init(&node->membership, node->fd,
+                                         node->addr.sin_addr,
+                                         (uint16_t)(BASE_PORT + i),
+                                         (uint16_t)(BASE_PORT + 1000 + i),
+                                         PERIOD_MS, node_event, node),
+                         DISFS_SUCCESS);
+    }
+}
+
+static void stop_nodes(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        membership_destroy(&nodes[i].membership);
+        close(nodes[i].fd);
+    }
+}
+
+/* delivers pending packets and runs timers of running nodes */
+static void step(uint32_t count, uint64_t now_ms)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        test_node_t* node = &nodes[i];
+        uint8_t buffer[MEMBERSHIP_MAX_PACKET];
+        struct sockaddr_in from;
+        socklen_t len = sizeof(from);
+        ssize_t n;
+        while ((n = recvfrom(node->fd, buffer, sizeof(buffer), MSG_DONTWAIT,
+                             (struct sockaddr*)&from, &len)) >= 0)
+        {
+            if (node->running)
+            {
+                membership_receive(&node->membership, buffer, (uint32_t)n,
+                                   &from, now_ms);
+            }
+        }
+        if (node->running)
+        {
+            membership_tick(&node->membership, now_ms);
+        }
+    }
+}
+
+static uint32_t live_members(uint32_t count, uint32_t expected)
+{
+    uint32_t nodes_ok = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (nodes[i].running &&
+            membership_live_count(&nodes[i].membership) == expected)
+        {
+            nodes_ok++;
+        }
+    }
+    return nodes_ok;
+}
+
+/* every node was told only about first node */
+static uint64_t converge(uint32_t count, uint64_t now_ms)
+{
+    for (uint32_t i = 1; i < count; i++)
+    {
+        membership_join(&nodes[i].membership, &nodes[0].addr,
+                        BASE_PORT + 1000, now_ms);
+    }
+    uint64_t deadline = now_ms + 100 * PERIOD_MS;
+    while (live_members(count, count - 1) < count && now_ms < deadline)
+    {
+        now_ms += STEP_MS;
+        step(count, now_ms);
+    }
+    assert_int_equal(live_members(count, count - 1), count);
+    return now_ms;
+}
+
+static void join_test(void** state)
+{
+    (void)state;
+    start_nodes(NODES);
+    converge(NODES, 1000);
+    for (uint32_t i = 0; i < NODES; i++)
+    {
+        const membership_t* membership = &nodes[i].membership;
+        for (uint32_t j = 0; j < membership->count; j++)
+        {
+            uint16_t port = ntohs(membership->members[j].addr.sin_port);
+            assert_int_equal(membership->members[j].tcp_port, port + 1000);
+            assert_int_equal(membership->members[j].state, MEMBER_ALIVE);
+        }
+    }
+    stop_nodes(NODES);
+}
+
+static void failure_test(void** state)
+{
+    (void)state;
+    start_nodes(NODES);
+    uint64_t now = converge(NODES, 1000);
+    nodes[3].running = 0;
+    uint64_t failed = now;
+
+    /* probe within two rounds, suspicion timeout and its dissemination */
+    uint64_t bound = 2 * NODES * PERIOD_MS + 3 * PERIOD_MS * 3 +
+                     10 * PERIOD_MS;
+    while (live_members(NODES, NODES - 2) < NODES - 1 &&
+           now < failed + bound)
+    {
+        now += STEP_MS;
+        step(NODES, now);
+    }
+    assert_int_equal(live_members(NODES, NODES - 2), NODES - 1);
+    for (uint32_t i = 0; i < NODES; i++)
+    {
+        if (i != 3)
+        {
+            assert_int_equal(nodes[i].dead_events, 1);
+        }
+    }
+
+    /* restarted node comes back with higher incarnation */
+    nodes[3].running = 1;
+    membership_join(&nodes[3].membership, &nodes[0].addr, BASE_PORT + 1000,
+                    now);
+    uint64_t deadline = now + 100 * PERIOD_MS;
+    while (live_members(NODES, NODES - 1) < NODES && now < deadline)
+    {
+        now += STEP_MS;
+        step(NODES, now);
+    }
+    assert_int_equal(live_members(NODES, NODES - 1), NODES);
+    assert_true(nodes[3].membership.incarnation > 0);
+    stop_nodes(NODES);
+}
+
+static void refute_test(void** state)
+{
+    (void)state;
+    start_nodes(3);
+    uint64_t now = converge(3, 1000);
+
+    /* short stall gets node suspected, not declared dead */
+    nodes[0].running = 0;
+    uint64_t resume = now + 4 * PERIOD_MS;
+    while (now < resume)
+    {
+        now += STEP_MS;
+        step(3, now);
+    }
+    uint32_t suspected = 0;
+    for (uint32_t i = 1; i < 3; i++)
+    {
+        const membership_t* membership = &nodes[i].membership;
+        for (uint32_t j = 0; j < membership->count; j++)
+        {
+            suspected += membership->members[j].state == MEMBER_SUSPECT;
+        }
+    }
+    assert_true(suspected > 0);
+
+    nodes[0].running = 1;
+    uint64_t deadline = now + 20 * PERIOD_MS;
+    while (now < deadline)
+    {
+        now += STEP_MS;
+        step(3, now);
+    }
+    assert_true(nodes[0].membership.incarnation > 0);
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        assert_int_equal(nodes[i].dead_events, 0);
+        const membership_t* membership = &nodes[i].membership;
+        for (uint32_t j = 0; j < membership->count; j++)
+        {
+            assert_int_equal(membership->members[j].state, MEMBER_ALIVE);
+        }
+    }
+    stop_nodes(3);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(join_test),
+        cmocka_unit_test(failure_test),
+        cmocka_unit_test(refute_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
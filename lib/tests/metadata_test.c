@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "metadata.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FILES 5000
+
+static int setup(void** state)
+{
+    char* dir = strdup("/tmp/disfs_metadata_XXXXXX");
+    if (mkdtemp(dir) == NULL)
+    {
+        free(dir);
+        return -1;
+    }
+    *state = dir;
+    return 0;
+}
+
+static int teardown(void** state)
+{
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", (char*)*state);
+    free(*state);
+    return system(cmd);
+}
+
+typedef struct list_ctx_t
+{
+    uint32_t listed;
+    uint32_t budget;
+} list_ctx_t;
+
+static int32_t count_entry(void* ctx, const char* name, uint16_t name_len,
+                           const meta_attr_t attr[static 1])
+{
+    (void)name;
+    (void)name_len;
+    (void)attr;
+    list_ctx_t* list = ctx;
+    if (list->budget == 0)
+    {
+        return 1;
+    }
+    list->budget--;
+    list->listed++;
+    return 0;
+}
+
+static void tree_ops_test(void** state)
+{
+    meta_t meta;
+    meta_attr_t attr;
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_lookup(&meta, "/", &attr), DISFS_SUCCESS);
+    assert_int_equal(attr.ino, META_ROOT_INO);
+    assert_int_equal(attr.type, META_TYPE_DIR);
+
+    assert_int_equal(meta_create(&meta, "/a", META_TYPE_DIR, &attr),
+                     DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/a/b", META_TYPE_DIR, &attr),
+                     DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/a/b/f", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    uint32_t file = attr.ino;
+    assert_int_equal(meta_create(&meta, "/a/b/f", META_TYPE_FILE, &attr),
+                     DISFS_ERR_EXISTS);
+    assert_int_equal(meta_create(&meta, "/a/b/f/x", META_TYPE_FILE, &attr),
+                     DISFS_ERR_NOT_DIR);
+    assert_int_equal(meta_create(&meta, "/missing/x", META_TYPE_FILE, &attr),
+                     DISFS_ERR_NOT_FOUND);
+    assert_int_equal(meta_create(&meta, "/a/..", META_TYPE_FILE, &attr),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(meta_lookup(&meta, "//a///b/f", &attr), DISFS_SUCCESS);
+    assert_int_equal(attr.ino, file);
+
+    chunk_hash_t hashes[3];
+    memset(hashes, 0xab, sizeof(hashes));
+    assert_int_equal(meta_set_chunks(&meta, "/a/b/f", 3000, hashes, 3),
+                     DISFS_SUCCESS);
+    chunk_hash_t out[3];
+    uint32_t count = 0;
+    assert_int_equal(meta_get_chunks(&meta, "/a/b/f", out, 3, &count),
+                     DISFS_SUCCESS);
+    assert_int_equal(count, 3);
+    assert_memory_equal(out, hashes, sizeof(hashes));
+
+    assert_int_equal(meta_rename(&meta, "/a", "/a/b/c"),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(meta_rename(&meta, "/a/b/f", "/g"), DISFS_SUCCESS);
+    assert_int_equal(meta_lookup(&meta, "/a/b/f", &attr), DISFS_ERR_NOT_FOUND);
+    assert_int_equal(meta_lookup(&meta, "/g", &attr), DISFS_SUCCESS);
+    assert_int_equal(attr.ino, file);
+    assert_int_equal(attr.size, 3000);
+
+    assert_int_equal(meta_remove(&meta, "/a"), DISFS_ERR_NOT_EMPTY);
+    assert_int_equal(meta_remove(&meta, "/a/b"), DISFS_SUCCESS);
+    assert_int_equal(meta_remove(&meta, "/a"), DISFS_SUCCESS);
+    assert_int_equal(meta_remove(&meta, "/"), DISFS_ERR_INVALID_ARG);
+    /* freed inode is reused */
+    assert_int_equal(meta_create(&meta, "/h", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    assert_true(attr.ino < file);
+    meta_close(&meta);
+}
+
+static void replay_and_snapshot_test(void** state)
+{
+    meta_t meta;
+    meta_attr_t attr;
+    char path[64];
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/dir", META_TYPE_DIR, &attr),
+                     DISFS_SUCCESS);
+    for (uint32_t i = 0; i < FILES; i++)
+    {
+        snprintf(path, sizeof(path), "/dir/file%u", i);
+        assert_int_equal(meta_create(&meta, path, META_TYPE_FILE, &attr),
+                         DISFS_SUCCESS);
+    }
+    meta_close(&meta);
+
+    /* tree is rebuilt from log alone */
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta.live_inodes, FILES + 2);
+    assert_int_equal(meta_snapshot(&meta), DISFS_SUCCESS);
+    assert_int_equal(meta.wal_size, 0);
+    for (uint32_t i = 0; i < FILES; i += 2)
+    {
+        snprintf(path, sizeof(path), "/dir/file%u", i);
+        assert_int_equal(meta_remove(&meta, path), DISFS_SUCCESS);
+    }
+    assert_int_equal(meta_rename(&meta, "/dir/file1", "/moved"),
+                     DISFS_SUCCESS);
+    meta_close(&meta);
+
+    /* snapshot is mapped and log tail is replayed on top of it */
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_lookup(&meta, "/dir/file0", &attr),
+                     DISFS_ERR_NOT_FOUND);
+    assert_int_equal(meta_lookup(&meta, "/dir/file3", &attr), DISFS_SUCCESS);
+    assert_int_equal(meta_lookup(&meta, "/moved", &attr), DISFS_SUCCESS);
+    /* small budget makes listing resume from cookie many times */
+    list_ctx_t list = {};
+    uint32_t cookie = 0;
+    do
+    {
+        list.budget = 7;
+        assert_int_equal(meta_list(&meta, "/dir", count_entry, &list, &cookie),
+                         DISFS_SUCCESS);
+    } while (cookie != 0);
+    assert_int_equal(list.listed, FILES / 2 - 1);
+    assert_int_equal(meta_list(&meta, "/moved", count_entry, &list, &cookie),
+                     DISFS_ERR_NOT_DIR);
+
+    /* mutations after load do not touch snapshot file */
+    assert_int_equal(meta_create(&meta, "/dir/new", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    meta_close(&meta);
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_lookup(&meta, "/dir/new", &attr), DISFS_SUCCESS);
+    assert_int_equal(meta.live_inodes, FILES / 2 + 3);
+    meta_close(&meta);
+}
+
+static void torn_log_test(void** state)
+{
+    meta_t meta;
+    meta_attr_t attr;
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/kept", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/torn", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    uint64_t size = meta.wal_size;
+    meta_close(&meta);
+
+    /* crash in the middle of last record */
+    char path[128];
+    snprintf(path, sizeof(path), "%s/meta.wal", (char*)*state);
+    assert_int_equal(truncate(path, (off_t)size - 3), 0);
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_lookup(&meta, "/kept", &attr), DISFS_SUCCESS);
+    assert_int_equal(meta_lookup(&meta, "/torn", &attr), DISFS_ERR_NOT_FOUND);
+    assert_int_equal(meta_create(&meta, "/torn", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    meta_close(&meta);
+}
+
+static void policy_test(void** state)
+{
+    meta_t meta;
+    meta_attr_t attr;
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/dir", META_TYPE_DIR, &attr),
+                     DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/dir/f", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    assert_int_equal(attr.data_shards, 0);
+    assert_int_equal(meta_set_policy(&meta, "/dir", 4, 2),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(meta_set_policy(&meta, "/dir/f", 4, 0),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(meta_set_policy(&meta, "/dir/f", 12, 6),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(meta_set_policy(&meta, "/dir/f", 10, 4), DISFS_SUCCESS);
+    meta_close(&meta);
+
+    /* policy is replayed from log, then kept by snapshot */
+    for (uint32_t round = 0; round < 2; round++)
+    {
+        assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+        assert_int_equal(meta_lookup(&meta, "/dir/f", &attr), DISFS_SUCCESS);
+        assert_int_equal(attr.data_shards, 10);
+        assert_int_equal(attr.parity_shards, 4);
+        assert_int_equal(meta_snapshot(&meta), DISFS_SUCCESS);
+        meta_close(&meta);
+    }
+}
+
+/* tables mapped from snapshot end short of their reservation, then grow */
+static void grow_after_snapshot_test(void** state)
+{
+    meta_t meta;
+    meta_attr_t attr;
+    chunk_hash_t hashes[400] = {};
+    char path[64];
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/f", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/g", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    assert_int_equal(meta_set_chunks(&meta, "/f", 1, hashes, 1),
+                     DISFS_SUCCESS);
+    assert_int_equal(meta_snapshot(&meta), DISFS_SUCCESS);
+    meta_close(&meta);
+
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    for (uint32_t i = 0; i < 400; i++)
+    {
+        hashes[i].bytes[0] = (uint8_t)i;
+    }
+    assert_int_equal(meta_set_chunks(&meta, "/g", 400, hashes, 400),
+                     DISFS_SUCCESS);
+    for (uint32_t i = 0; i < FILES; i++)
+    {
+        snprintf(path, sizeof(path), "/file_with_a_rather_long_name_%u", i);
+        assert_int_equal(meta_create(&meta, path, META_TYPE_FILE, &attr),
+                         DISFS_SUCCESS);
+    }
+    uint32_t count = 0;
+    chunk_hash_t read[400];
+    assert_int_equal(meta_get_chunks(&meta, "/g", read, 400, &count),
+                     DISFS_SUCCESS);
+    assert_int_equal(count, 400);
+    assert_int_equal(read[399].bytes[0], (uint8_t)399);
+    assert_int_equal(meta_get_chunks(&meta, "/f", read, 400, &count),
+                     DISFS_SUCCESS);
+    assert_int_equal(count, 1);
+    assert_int_equal(meta_lookup(&meta, "/file_with_a_rather_long_name_0",
+                                 &attr),
+                     DISFS_SUCCESS);
+    meta_close(&meta);
+}
+
+typedef struct creator_t
+{
+    meta_t* meta;
+    uint32_t id;
+    uint32_t failed;
+} creator_t;
+
+static void* creator(void* arg)
+{
+    creator_t* creator = arg;
+    meta_attr_t attr;
+    char path[64];
+    for (uint32_t i = 0; i < FILES / 10; i++)
+    {
+        snprintf(path, sizeof(path), "/c%u_%u", creator->id, i);
+        if (meta_create(creator->meta, path, META_TYPE_FILE, &attr) !=
+            DISFS_SUCCESS)
+        {
+            creator->failed++;
+        }
+    }
+    return NULL;
+}
+
+/* mutation returns only once its record is synced */
+static void commit_test(void** state)
+{
+    meta_t meta;
+    meta_attr_t attr;
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/f", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    assert_int_equal(meta.synced_lsn, meta.lsn);
+
+    creator_t creators[4];
+    pthread_t threads[4];
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        creators[i] = (creator_t){.meta = &meta, .id = i};
+        assert_int_equal(
+            pthread_create(&threads[i], NULL, creator, &creators[i]), 0);
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+        assert_int_equal(creators[i].failed, 0);
+    }
+    assert_int_equal(meta.synced_lsn, meta.lsn);
+    assert_int_equal(meta.lsn, 4 * (FILES / 10) + 1);
+    meta_close(&meta);
+}
+
+typedef struct snapshotter_t
+{
+    meta_t* meta;
+    volatile int run;
+    uint32_t snapshots;
+} snapshotter_t;
+
+static void* snapshotter(void* arg)
+{
+    snapshotter_t* snap = arg;
+    while (snap->run)
+    {
+        if (meta_snapshot(snap->meta) == DISFS_SUCCESS)
+        {
+            snap->snapshots++;
+        }
+    }
+    return NULL;
+}
+
+/* mutations go on into new log while snapshot is written */
+static void snapshot_during_mutations_test(void** state)
+{
+    meta_t meta;
+    meta_attr_t attr;
+    char path[64];
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    snapshotter_t snap = {.meta = &meta, .run = 1};
+    pthread_t th;
+    assert_int_equal(pthread_create(&th, NULL, snapshotter, &snap), 0);
+    for (uint32_t i = 0; i < FILES; i++)
+    {
+        snprintf(path, sizeof(path), "/file%u", i);
+        assert_int_equal(meta_create(&meta, path, META_TYPE_FILE, &attr),
+                         DISFS_SUCCESS);
+    }
+    snap.run = 0;
+    pthread_join(th, NULL);
+    assert_true(snap.snapshots > 0);
+    meta_close(&meta);
+
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta.live_inodes, FILES + 1);
+    for (uint32_t i = 0; i < FILES; i++)
+    {
+        snprintf(path, sizeof(path), "/file%u", i);
+        assert_int_equal(meta_lookup(&meta, path, &attr), DISFS_SUCCESS);
+    }
+    meta_close(&meta);
+}
+
+/* crash after snapshot switched log, before snapshot was renamed */
+static void rotated_log_test(void** state)
+{
+    meta_t meta;
+    meta_attr_t attr;
+    char wal[128];
+    char next[128];
+    snprintf(wal, sizeof(wal), "%s/meta.wal", (char*)*state);
+    snprintf(next, sizeof(next), "%s/meta.wal.next", (char*)*state);
+    assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+    assert_int_equal(meta_create(&meta, "/old", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    uint64_t old_size = meta.wal_size;
+    assert_int_equal(meta_create(&meta, "/new", META_TYPE_FILE, &attr),
+                     DISFS_SUCCESS);
+    uint64_t size = meta.wal_size;
+    meta_close(&meta);
+
+    /* second record goes to new log, old log ends before it */
+    uint8_t record[256];
+    assert_true(size - old_size <= sizeof(record));
+    int32_t fd = open(wal, O_RDONLY);
+    assert_true(fd >= 0);
+    assert_int_equal(pread(fd, record, size - old_size, (off_t)old_size),
+                     (ssize_t)(size - old_size));
+    close(fd);
+    fd = open(next, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert_true(fd >= 0);
+    assert_int_equal(write(fd, record, size - old_size),
+                     (ssize_t)(size - old_size));
+    close(fd);
+    assert_int_equal(truncate(wal, (off_t)old_size), 0);
+
+    for (uint32_t round = 0; round < 2; round++)
+    {
+        assert_int_equal(meta_open(&meta, *state), DISFS_SUCCESS);
+        assert_int_equal(access(next, F_OK), -1);
+        assert_int_equal(meta.wal_size, size);
+        assert_int_equal(meta_lookup(&meta, "/old", &attr), DISFS_SUCCESS);
+        assert_int_equal(meta_lookup(&meta, "/new", &attr), DISFS_SUCCESS);
+        meta_close(&meta);
+    }
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(tree_ops_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(replay_and_snapshot_test, setup,
+                                        teardown),
+        cmocka_unit_test_setup_teardown(torn_log_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(policy_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(grow_after_snapshot_test, setup,
+                                        teardown),
+        cmocka_unit_test_setup_teardown(snapshot_during_mutations_test, setup,
+                                        teardown),
+        cmocka_unit_test_setup_teardown(rotated_log_test, setup, teardown),
+        cmocka_unit_test_setup_teardown(commit_test, setup, teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define THREADS 4
+#define EVENTS 1000000
+#define VALUES 100000
+
+static void histogram_test(void** state)
+{
+    (void)state;
+    metrics_t metrics;
+    assert_int_equal(metrics_init(&metrics), DISFS_SUCCESS);
+    metrics_shard_t* shard = metrics_shard(&metrics);
+    assert_non_null(shard);
+    for (uint64_t i = 1; i <= VALUES; i++)
+    {
+        metrics_record(shard, METRIC_LOOP_NS, i);
+    }
+    metrics_record(shard, METRIC_PEER_RTT_NS, 0);
+    metrics_record(shard, METRIC_PEER_RTT_NS, UINT64_MAX);
+
+    metrics_shard_t* total = malloc(sizeof(*total));
+    metrics_collect(&metrics, total);
+    const metrics_histogram_t* h = &total->histograms[METRIC_LOOP_NS];
+    assert_int_equal(h->count, VALUES);
+    assert_int_equal(h->max, VALUES);
+    assert_int_equal(h->sum, (uint64_t)VALUES * (VALUES + 1) / 2);
+    /* quantile is upper bound of bucket, at most 1/16 above exact value */
+    double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        uint64_t exact = (uint64_t)(quantiles[i] * VALUES);
+        uint64_t value = metrics_quantile(h, quantiles[i]);
+        assert_true(value >= exact);
+        assert_true(value <= exact + exact / 16);
+    }
+    assert_int_equal(metrics_quantile(h, 1.0), VALUES);
+    assert_int_equal(metrics_quantile(h, 0.0), 1);
+
+    const metrics_histogram_t* rtt = &total->histograms[METRIC_PEER_RTT_NS];
+    assert_int_equal(rtt->count, 2);
+    assert_int_equal(metrics_quantile(rtt, 0.5), 0);
+    assert_int_equal(metrics_quantile(rtt, 1.0), UINT64_MAX);
+    free(total);
+    metrics_destroy(&metrics);
+}
+
+static void* count_thread(void* arg)
+{
+    metrics_shard_t* shard = metrics_shard(arg);
+    for (uint32_t i = 0; i < EVENTS; i++)
+    {
+        metrics_add(shard, METRIC_BYTES_IN, 3);
+        metrics_add(shard, METRIC_FRAMES_IN, 1);
+    }
+    return NULL;
+}
+
+static void threads_test(void** state)
+{
+    (void)state;
+    metrics_t metrics;
+    assert_int_equal(metrics_init(&metrics), DISFS_SUCCESS);
+    pthread_t threads[THREADS];
+    for (uint32_t i = 0; i < THREADS; i++)
+    {
+        pthread_create(&threads[i], NULL, count_thread, &metrics);
+    }
+    for (uint32_t i = 0; i < THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    /* shards outlive their threads */
+    metrics_shard_t* total = malloc(sizeof(*total));
+    metrics_collect(&metrics, total);
+    assert_int_equal(total->counters[METRIC_BYTES_IN], 3ULL * THREADS * EVENTS);
+    assert_int_equal(total->counters[METRIC_FRAMES_IN], THREADS * EVENTS);
+    assert_int_equal(total->counters[METRIC_ACCEPTS], 0);
+    free(total);
+    metrics_destroy(&metrics);
+}
+
+static void report_peers(void* ctx, metrics_writer_t writer[static 1])
+{
+    metrics_printf(writer, "peer %s\n", (const char*)ctx);
+}
+
+static void serve_test(void** state)
+{
+    (void)state;
+    metrics_t metrics;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/disfs_metrics_%d.sock", getpid());
+    assert_int_equal(metrics_init(&metrics), DISFS_SUCCESS);
+    metrics_shard_t* shard = metrics_shard(&metrics);
+    metrics_add(shard, METRIC_ACCEPTS, 7);
+    metrics_record(shard, METRIC_LOOP_NS, 1000);
+    assert_int_equal(metrics_serve(&metrics, path, report_peers, "node-b"),
+                     DISFS_SUCCESS);
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert_int_equal(connect(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    char report[8192] = {};
+    size_t used = 0;
+    ssize_t n;
+    while ((n = read(fd, report + used, sizeof(report) - 1 - used)) > 0)
+    {
+        used += (size_t)n;
+    }
+    close(fd);
+    assert_non_null(strstr(report, "accepts 7\n"));
+    assert_non_null(strstr(report, "bytes_in 0\n"));
+    assert_non_null(strstr(report, "loop_ns count=1 mean=1000 "));
+    assert_non_null(strstr(report, "peer node-b\n"));
+
+    metrics_destroy(&metrics);
+    assert_int_not_equal(access(path, F_OK), 0);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(histogram_test),
+        cmocka_unit_test(threads_test),
+        cmocka_unit_test(serve_test),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "connection.h"
+#include "metrics.h"
+#include "peer_cache.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BASE_PORT 23700
+/* announcements and probes are too rare to matter during test */
+#define QUIET_INTERVAL_MS 60000
+
+static void cache_path(char path[static 32])
+{
+    snprintf(path, 32, "/tmp/disfs_peers_XXXXXX");
+    int32_t fd = mkstemp(path);
+    assert_true(fd >= 0);
+    close(fd);
+    unlink(path);
+}
+
+static struct sockaddr_in peer_addr(const char* ip, uint16_t port)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(port)};
+    assert_int_equal(inet_pton(AF_INET, ip, &addr.sin_addr), 1);
+    return addr;
+}
+
+static void roundtrip_test(void** state)
+{
+    (void)state;
+    char path[32];
+    cache_path(path);
+    peer_cache_t cache;
+    assert_int_equal(peer_cache_open(&cache, path, 1000), DISFS_SUCCESS);
+    assert_int_equal(cache.count, 0);
+
+    struct sockaddr_in udp_a = peer_addr("10.0.0.1", 8000);
+    struct sockaddr_in udp_b = peer_addr("10.0.0.2", 8000);
+    struct sockaddr_in tcp_a = peer_addr("10.0.0.1", 9000);
+    struct sockaddr_in tcp_b = peer_addr("10.0.0.2", 9000);
+    peer_cache_learn(&cache, &udp_b, 9000, 1000);
+    peer_cache_learn(&cache, &udp_a, 9000, 1000);
+    peer_cache_result(&cache, &tcp_a, 1, 1005);
+    peer_cache_result(&cache, &tcp_a, 1, 1010);
+    peer_cache_result(&cache, &tcp_b, 0, 1010);
+    /* member moved to other udp port */
+    udp_a.sin_port = htons(8001);
+    peer_cache_learn(&cache, &udp_a, 9000, 1010);
+    assert_int_equal(peer_cache_save(&cache), DISFS_SUCCESS);
+    peer_cache_close(&cache);
+
+    assert_int_equal(peer_cache_open(&cache, path, 1020), DISFS_SUCCESS);
+    peer_cache_entry_t entries[PEER_CACHE_MAX];
+    assert_int_equal(peer_cache_list(&cache, entries, PEER_CACHE_MAX), 2);
+    assert_int_equal(entries[0].ip, tcp_a.sin_addr.s_addr);
+    assert_int_equal(entries[0].udp_port, 8001);
+    assert_int_equal(entries[0].tcp_port, 9000);
+    assert_int_equal(entries[0].successes, 2);
+    assert_int_equal(entries[0].failures, 0);
+    assert_int_equal(entries[0].last_seen, 1010);
+    assert_int_equal(entries[1].ip, tcp_b.sin_addr.s_addr);
+    assert_int_equal(entries[1].failures, 1);
+    assert_int_equal(peer_cache_list(&cache, entries, 1), 1);
+    peer_cache_close(&cache);
+
+    /* peers not seen for too long are not loaded */
+    assert_int_equal(
+        peer_cache_open(&cache, path, 1001 + PEER_CACHE_MAX_AGE_S),
+        DISFS_SUCCESS);
+    assert_int_equal(cache.count, 1);
+    peer_cache_close(&cache);
+    unlink(path);
+}
+
+static void corrupt_test(void** state)
+{
+    (void)state;
+    char path[32];
+    cache_path(path);
+    peer_cache_t cache;
+    assert_int_equal(peer_cache_open(&cache, path, 1000), DISFS_SUCCESS);
+    struct sockaddr_in udp = peer_addr("10.0.0.1", 8000);
+    peer_cache_learn(&cache, &udp, 9000, 1000);
+    peer_cache_close(&cache);
+
+    /* flipped bit of entry, then truncated entry, both give empty cache */
+    int32_t fd = open(path, O_RDWR);
+    assert_true(fd >= 0);
+    uint8_t byte;
+    off_t size = lseek(fd, 0, SEEK_END);
+    assert_int_equal(pread(fd, &byte, 1, size - 1), 1);
+    byte ^= 1;
+    assert_int_equal(pwrite(fd, &byte, 1, size - 1), 1);
+    assert_int_equal(peer_cache_open(&cache, path, 1000), DISFS_SUCCESS);
+    assert_int_equal(cache.count, 0);
+    peer_cache_close(&cache);
+    assert_int_equal(ftruncate(fd, size - 1), 0);
+    assert_int_equal(peer_cache_open(&cache, path, 1000), DISFS_SUCCESS);
+    assert_int_equal(cache.count, 0);
+    peer_cache_close(&cache);
+    close(fd);
+    unlink(path);
+}
+
+static void forget_test(void** state)
+{
+    (void)state;
+    char path[32];
+    cache_path(path);
+    peer_cache_t cache;
+    assert_int_equal(peer_cache_open(&cache, path, 1000), DISFS_SUCCESS);
+    struct sockaddr_in udp = peer_addr("10.0.0.1", 8000);
+    struct sockaddr_in tcp = peer_addr("10.0.0.1", 9000);
+    peer_cache_learn(&cache, &udp, 9000, 1000);
+    for (uint32_t i = 0; i + 1 < PEER_CACHE_MAX_FAILURES; i++)
+    {
+        peer_cache_result(&cache, &tcp, 0, 1000);
+    }
+    assert_int_equal(cache.count, 1);
+    peer_cache_result(&cache, &tcp, 0, 1000);
+    assert_int_equal(cache.count, 0);
+    /* unknown peer is not added by result */
+    peer_cache_result(&cache, &tcp, 1, 1000);
+    assert_int_equal(cache.count, 0);
+
+    /* full cache forgets the least recently seen peer */
+    for (uint16_t i = 0; i <= PEER_CACHE_MAX; i++)
+    {
+        udp.sin_port = htons((uint16_t)(8000 + i));
+        peer_cache_learn(&cache, &udp, (uint16_t)(9000 + i), 1000 + i);
+    }
+    assert_int_equal(cache.count, PEER_CACHE_MAX);
+    peer_cache_entry_t entries[PEER_CACHE_MAX];
+    peer_cache_list(&cache, entries, PEER_CACHE_MAX);
+    assert_int_equal(entries[0].tcp_port, 9000 + PEER_CACHE_MAX);
+    assert_int_equal(entries[PEER_CACHE_MAX - 1].tcp_port, 9001);
+    peer_cache_close(&cache);
+    unlink(path);
+}
+
+static void start_node(connection_t conn[static 1], uint32_t node,
+                       uint32_t discovery_interval_ms, const char* cache)
+{
+    memset(conn, 0, sizeof(*conn));
+    assert_int_equal(
+        create_connection(conn, .port_tcp = BASE_PORT + (int32_t)node,
+                          .port_udp = BASE_PORT + 50 + (int32_t)node,
+                          .discovery_ip = "127.0.0.1",
+                          .discovery_port = BASE_PORT + 50,
+                          .discovery_ports = 2,
+                          .discovery_interval_ms = discovery_interval_ms,
+                          .probe_interval_ms = QUIET_INTERVAL_MS,
+                          .peer_cache_path = cache),
+        DISFS_SUCCESS);
+}
+
+/* ms until node has outbound peer, waiting at most timeout_ms */
+static uint64_t wait_connected(connection_t conn[static 1],
+                               uint32_t timeout_ms)
+{
+    uint64_t start = metrics_now_ns();
+    uint64_t elapsed = 0;
+    while (connection_established_count(conn) == 0 &&
+           elapsed < timeout_ms * 1000000ULL)
+    {
+        usleep(1000);
+        elapsed = metrics_now_ns() - start;
+    }
+    return elapsed / 1000000;
+}
+
+/* restarted node connects to cached peer with no announcement and no probe */
+static void rejoin_test(void** state)
+{
+    (void)state;
+    char path[32];
+    cache_path(path);
+    connection_t* nodes = calloc(2, sizeof(*nodes));
+    /* invalid parameters are rejected before cache is opened */
+    assert_int_equal(create_connection(&nodes[1], .port_tcp = BASE_PORT + 1,
+                                       .port_udp = BASE_PORT + 51,
+                                       .frame_checksum = CHECKSUM_KIND_MAX,
+                                       .peer_cache_path = path),
+                     DISFS_ERR_INVALID_ARG);
+    assert_null(nodes[1].peer_cache);
+    start_node(&nodes[0], 0, 50, NULL);
+    start_node(&nodes[1], 1, 50, path);
+    assert_true(wait_connected(&nodes[1], 5000) < 5000);
+    close_connection(&nodes[1]);
+
+    /* without cache node waits for discovery */
+    start_node(&nodes[1], 1, QUIET_INTERVAL_MS, NULL);
+    assert_true(wait_connected(&nodes[1], 500) >= 500);
+    close_connection(&nodes[1]);
+
+    start_node(&nodes[1], 1, QUIET_INTERVAL_MS, path);
+    assert_true(wait_connected(&nodes[1], 1000) < 1000);
+    close_connection(&nodes[1]);
+    close_connection(&nodes[0]);
+    free(nodes);
+    unlink(path);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(roundtrip_test),
+        cmocka_unit_test(corrupt_test),
+        cmocka_unit_test(forget_test),
+        cmocka_unit_test(rejoin_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
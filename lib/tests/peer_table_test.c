@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "peer.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#define PEERS 5000
+
+static struct sockaddr_in make_addr(uint32_t ip, uint16_t port)
+{
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(ip);
+    addr.sin_port = htons(port);
+    return addr;
+}
+
+static void add_find_remove_test(void** state)
+{
+    (void)state;
+    peer_table_t table;
+    assert_int_equal(peer_table_init(&table), DISFS_SUCCESS);
+
+    client_t** added = calloc(PEERS, sizeof(*added));
+    for (uint32_t i = 0; i < PEERS; i++)
+    {
+        struct sockaddr_in addr = make_addr(0x0a000000 + i, 8080);
+        assert_int_equal(peer_table_add(&table, &addr, &added[i]),
+                         DISFS_SUCCESS);
+        added[i]->source.fd = (int32_t)i;
+    }
+    assert_int_equal(peer_table_count(&table), PEERS);
+
+    /* pointers stay stable while table grows */
+    for (uint32_t i = 0; i < PEERS; i++)
+    {
+        assert_int_equal(added[i]->source.fd, i);
+    }
+
+    struct sockaddr_in dup = make_addr(0x0a000000 + 42, 8080);
+    client_t* existing = NULL;
+    assert_int_equal(peer_table_add(&table, &dup, &existing),
+                     DISFS_ERR_PEER_EXISTS);
+    assert_ptr_equal(existing, added[42]);
+
+    /* same ip on another port is another peer */
+    struct sockaddr_in other_port = make_addr(0x0a000000 + 42, 8081);
+    assert_false(peer_table_contains(&table, &other_port));
+
+    for (uint32_t i = 0; i < PEERS; i += 2)
+    {
+        peer_table_remove(&table, added[i]);
+    }
+    assert_int_equal(peer_table_count(&table), PEERS / 2);
+    for (uint32_t i = 0; i < PEERS; i++)
+    {
+        struct sockaddr_in addr = make_addr(0x0a000000 + i, 8080);
+        assert_int_equal(peer_table_contains(&table, &addr), i % 2);
+    }
+
+    free(added);
+    peer_table_destroy(&table);
+}
+
+/* inbound peer takes listening address of its node from detached one */
+static void rekey_test(void** state)
+{
+    (void)state;
+    peer_table_t table;
+    assert_int_equal(peer_table_init(&table), DISFS_SUCCESS);
+
+    struct sockaddr_in node = make_addr(0x0a000001, 8080);
+    struct sockaddr_in source = make_addr(0x0a000001, 40000);
+    client_t* outbound = NULL;
+    client_t* inbound = NULL;
+    assert_int_equal(peer_table_add(&table, &node, &outbound), DISFS_SUCCESS);
+    assert_int_equal(peer_table_add(&table, &source, &inbound),
+                     DISFS_SUCCESS);
+
+    peer_table_lock(&table);
+    assert_int_equal(peer_table_rekey_locked(&table, inbound, &node),
+                     DISFS_ERR_PEER_EXISTS);
+    peer_table_detach_locked(&table, outbound);
+    assert_int_equal(peer_table_rekey_locked(&table, inbound, &node),
+                     DISFS_SUCCESS);
+    assert_int_equal(peer_table_rekey_locked(&table, inbound, &node),
+                     DISFS_SUCCESS);
+    assert_ptr_equal(peer_table_find_locked(&table, &node), inbound);
+    assert_null(peer_table_find_locked(&table, &source));
+    peer_table_unlock(&table);
+    assert_int_equal(peer_table_count(&table), 2);
+
+    /* removing detached peer leaves one which replaced it */
+    peer_table_remove(&table, outbound);
+    assert_int_equal(peer_table_count(&table), 1);
+    assert_true(peer_table_contains(&table, &node));
+    peer_table_remove(&table, inbound);
+    assert_int_equal(peer_table_count(&table), 0);
+    assert_false(peer_table_contains(&table, &node));
+
+    peer_table_destroy(&table);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(add_find_remove_test),
+        cmocka_unit_test(rekey_test),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "protocol.h"
+#include "ring_buffer.h"
+#include <string.h>
+
+#define RING_SIZE (64 * 1024)
+
+typedef struct
+{
+    int32_t frames;
+    uint64_t last_request_id;
+    uint32_t last_length;
+    const uint8_t* last_payload;
+} dispatch_result;
+
+static err_t count_dispatch(void* arg, const proto_frame_t frame[static 1])
+{
+    dispatch_result* res = arg;
+    res->frames++;
+    res->last_request_id = frame->header.request_id;
+    res->last_length = frame->header.length;
+    res->last_payload = frame->payload;
+    return DISFS_SUCCESS;
+}
+
+static err_t stop_dispatch(void* arg, const proto_frame_t frame[static 1])
+{
+    count_dispatch(arg, frame);
+    return PROTO_STOP;
+}
+
+static void push_frame(ring_buffer_t rb[static 1], uint16_t type,
+                       uint64_t request_id, const char* payload, uint32_t len)
+{
+    proto_header_t header = {.version = PROTO_VERSION,
+                             .type = type,
+                             .length = len,
+                             .request_id = request_id};
+    uint8_t* frame = ring_buffer_write_ptr(rb);
+    proto_header_encode(&header, frame);
+    memcpy(frame + PROTO_HEADER_SIZE, payload, len);
+    proto_put_u32(frame + PROTO_HEADER_SIZE + len,
+                  crc32c(0, frame, PROTO_HEADER_SIZE + len));
+    ring_buffer_produce(rb, PROTO_HEADER_SIZE + len + PROTO_TRAILER_SIZE);
+}
+
+static void header_roundtrip_test(void** state)
+{
+    (void)state;
+    proto_header_t header = {.version = PROTO_VERSION,
+                             .flags = 0x3,
+                             .type = PROTO_MSG_PING,
+                             .length = 1234,
+                             .request_id = 0x0102030405060708};
+    uint8_t raw[PROTO_HEADER_SIZE];
+    proto_header_encode(&header, raw);
+    assert_int_equal(raw[8], 0x08);
+    assert_int_equal(raw[15], 0x01);
+
+    proto_header_t decoded = {};
+    assert_int_equal(proto_header_decode(&decoded, raw), DISFS_SUCCESS);
+    assert_int_equal(decoded.flags, header.flags);
+    assert_int_equal(decoded.type, header.type);
+    assert_int_equal(decoded.length, header.length);
+    assert_true(decoded.request_id == header.request_id);
+
+    raw[0] = PROTO_VERSION + 1;
+    assert_int_equal(proto_header_decode(&decoded, raw), DISFS_ERR_PROTO);
+}
+
+static void partial_frame_test(void** state)
+{
+    (void)state;
+    ring_buffer_t rb = {};
+    assert_int_equal(ring_buffer_create(&rb, RING_SIZE), DISFS_SUCCESS);
+
+    ring_buffer_t staging = {};
+    assert_int_equal(ring_buffer_create(&staging, RING_SIZE), DISFS_SUCCESS);
+    push_frame(&staging, PROTO_MSG_PING, 7, "hello", 5);
+    push_frame(&staging, PROTO_MSG_PING, 8, "world!", 6);
+    uint64_t total = ring_buffer_used(&staging);
+
+    /* deliver two coalesced frames byte by byte */
+    proto_verify_t verify = {};
+    dispatch_result res = {};
+    for (uint64_t i = 0; i < total; i++)
+    {
+        *ring_buffer_write_ptr(&rb) = ring_buffer_read_ptr(&staging)[i];
+        ring_buffer_produce(&rb, 1);
+        assert_int_equal(proto_process(&rb, &verify, count_dispatch, &res),
+                         DISFS_SUCCESS);
+        if (i < PROTO_HEADER_SIZE + 5 + PROTO_TRAILER_SIZE - 1)
+        {
+            assert_int_equal(res.frames, 0);
+        }
+    }
+    assert_int_equal(res.frames, 2);
+    assert_int_equal(res.last_request_id, 8);
+    assert_int_equal(res.last_length, 6);
+    assert_memory_equal(res.last_payload, "world!", 6);
+    assert_int_equal(ring_buffer_used(&rb), 0);
+
+    ring_buffer_destroy(&staging);
+    ring_buffer_destroy(&rb);
+}
+
+static void wrapped_frame_test(void** state)
+{
+    (void)state;
+    ring_buffer_t rb = {};
+    assert_int_equal(ring_buffer_create(&rb, RING_SIZE), DISFS_SUCCESS);
+
+    /* move positions close to the end so next frame wraps around */
+    ring_buffer_produce(&rb, RING_SIZE - 4);
+    ring_buffer_consume(&rb, RING_SIZE - 4);
+
+    proto_verify_t verify = {};
+    dispatch_result res = {};
+    push_frame(&rb, PROTO_MSG_PONG, 42, "wrapped payload", 15);
+    assert_int_equal(proto_process(&rb, &verify, count_dispatch, &res),
+                     DISFS_SUCCESS);
+    assert_int_equal(res.frames, 1);
+    assert_memory_equal(res.last_payload, "wrapped payload", 15);
+
+    ring_buffer_destroy(&rb);
+}
+
+static void stop_test(void** state)
+{
+    (void)state;
+    ring_buffer_t rb = {};
+    assert_int_equal(ring_buffer_create(&rb, RING_SIZE), DISFS_SUCCESS);
+    push_frame(&rb, PROTO_MSG_PING, 1, "one", 3);
+    push_frame(&rb, PROTO_MSG_PING, 2, "two", 3);
+
+    /* frames after stopping one wait in ring for next call */
+    proto_verify_t verify = {};
+    dispatch_result res = {};
+    assert_int_equal(proto_process(&rb, &verify, stop_dispatch, &res),
+                     DISFS_SUCCESS);
+    assert_int_equal(res.frames, 1);
+    assert_int_equal(res.last_request_id, 1);
+    assert_int_equal(ring_buffer_used(&rb),
+                     PROTO_HEADER_SIZE + 3 + PROTO_TRAILER_SIZE);
+    assert_int_equal(proto_process(&rb, &verify, count_dispatch, &res),
+                     DISFS_SUCCESS);
+    assert_int_equal(res.frames, 2);
+    assert_int_equal(res.last_request_id, 2);
+    assert_int_equal(ring_buffer_used(&rb), 0);
+
+    ring_buffer_destroy(&rb);
+}
+
+static void corrupt_frame_test(void** state)
+{
+    (void)state;
+    ring_buffer_t rb = {};
+    assert_int_equal(ring_buffer_create(&rb, RING_SIZE), DISFS_SUCCESS);
+    push_frame(&rb, PROTO_MSG_PING, 1, "intact", 6);
+    push_frame(&rb, PROTO_MSG_PING, 2, "damaged", 7);
+
+    /* flipped payload bit stops processing before dispatch */
+    ring_buffer_write_ptr(&rb)[-PROTO_TRAILER_SIZE - 1] ^= 0x10;
+    proto_verify_t verify = {};
+    dispatch_result res = {};
+    assert_int_equal(proto_process(&rb, &verify, count_dispatch, &res),
+                     DISFS_ERR_CORRUPT);
+    assert_int_equal(res.frames, 1);
+    assert_int_equal(res.last_request_id, 1);
+
+    ring_buffer_destroy(&rb);
+}
+
+static void xxh32_frame_test(void** state)
+{
+    (void)state;
+    ring_buffer_t rb = {};
+    assert_int_equal(ring_buffer_create(&rb, RING_SIZE), DISFS_SUCCESS);
+    proto_header_t header = {.version = PROTO_VERSION,
+                             .flags = PROTO_FLAG_XXH32,
+                             .type = PROTO_MSG_PING,
+                             .length = 4,
+                             .request_id = 3};
+    uint8_t* frame = ring_buffer_write_ptr(&rb);
+    proto_header_encode(&header, frame);
+    memcpy(frame + PROTO_HEADER_SIZE, "ping", 4);
+    proto_put_u32(frame + PROTO_HEADER_SIZE + 4,
+                  xxh32(frame, PROTO_HEADER_SIZE + 4, 0));
+    ring_buffer_produce(&rb, PROTO_HEADER_SIZE + 4 + PROTO_TRAILER_SIZE);
+
+    proto_verify_t verify = {};
+    dispatch_result res = {};
+    assert_int_equal(proto_process(&rb, &verify, count_dispatch, &res),
+                     DISFS_SUCCESS);
+    assert_int_equal(res.frames, 1);
+    assert_int_equal(ring_buffer_used(&rb), 0);
+
+    ring_buffer_destroy(&rb);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(header_roundtrip_test),
+        cmocka_unit_test(partial_frame_test),
+        cmocka_unit_test(wrapped_frame_test),
+        cmocka_unit_test(stop_test),
+        cmocka_unit_test(corrupt_frame_test),
+        cmocka_unit_test(xxh32_frame_test),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
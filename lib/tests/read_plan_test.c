@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "connection.h"
+#include "read_plan.h"
+#include "test_cluster.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NODES 3
+#define CHUNKS 64
+#define CHUNK_SIZE 8192
+#define BASE_PORT 23400
+
+/* node 0 reads, the others serve chunks in their role */
+typedef enum node_role
+{
+    ROLE_READER = 0,
+    ROLE_STORE = 1,  /* holds every chunk */
+    ROLE_EMPTY = 2,  /* holds none, replies with error */
+    ROLE_SILENT = 3, /* never replies, as peer with stuck disk */
+} node_role;
+
+typedef struct cluster_t
+{
+    connection_t nodes[NODES];
+    chunk_store_t stores[NODES];
+    char dirs[NODES][TEST_CLUSTER_DIR_MAX];
+    chunk_hash_t hashes[CHUNKS];
+    read_plan_t plan;
+} cluster_t;
+
+typedef struct sink_t
+{
+    uint32_t next;
+    uint32_t bad;
+} sink_t;
+
+/* read running in its own thread */
+typedef struct reader_t
+{
+    cluster_t* cluster;
+    sink_t sink;
+    err_t ret;
+} reader_t;
+
+static void chunk_data(uint32_t i, uint8_t data[static CHUNK_SIZE])
+{
+    for (uint32_t j = 0; j < CHUNK_SIZE; j++)
+    {
+        data[j] = (uint8_t)(i * 7 + j / 64);
+    }
+}
+
+static err_t silent_get(void* ctx, client_t client[static 1],
+                        const proto_frame_t frame[static 1])
+{
+    (void)ctx;
+    (void)client;
+    (void)frame;
+    return DISFS_SUCCESS;
+}
+
+static err_t check_sink(void* ctx, uint32_t index, const void* data,
+                        uint32_t length)
+{
+    sink_t* sink = ctx;
+    uint8_t expected[CHUNK_SIZE];
+    chunk_data(index, expected);
+    if (index != sink->next++ || length != CHUNK_SIZE ||
+        memcmp(data, expected, CHUNK_SIZE) != 0)
+    {
+        sink->bad++;
+    }
+    return DISFS_SUCCESS;
+}
+
+static err_t stop_sink(void* ctx, uint32_t index, const void* data,
+                       uint32_t length)
+{
+    (void)data;
+    (void)length;
+    return index == *(uint32_t*)ctx ? DISFS_ERR_IO : DISFS_SUCCESS;
+}
+
+/* every test gets own ports, so sockets of previous one cannot interfere */
+static cluster_t* start_cluster(const node_role roles[static NODES],
+                                int32_t port, uint32_t hedge_default_ms)
+{
+    cluster_t* cluster = calloc(1, sizeof(*cluster));
+    assert_non_null(cluster);
+    uint8_t data[CHUNK_SIZE];
+    for (uint32_t n = 0; n < NODES; n++)
+    {
+        connection_t* node = &cluster->nodes[n];
+        if (roles[n] == ROLE_STORE || roles[n] == ROLE_EMPTY)
+        {
+            test_cluster_store(node, &cluster->stores[n], cluster->dirs[n]);
+        }
+        for (uint32_t i = 0; i < CHUNKS && roles[n] == ROLE_STORE; i++)
+        {
+            chunk_data(i, data);
+            assert_int_equal(chunk_store_put(&cluster->stores[n], data,
+                                             CHUNK_SIZE, &cluster->hashes[i]),
+                             DISFS_SUCCESS);
+        }
+        if (roles[n] == ROLE_SILENT)
+        {
+            connection_register_handler(node, PROTO_MSG_CHUNK_GET, silent_get,
+                                        NULL);
+        }
+        test_cluster_join(node, n, NODES, port);
+    }
+    test_cluster_wait(&cluster->nodes[0], NODES - 1);
+    /* every chunk has all nodes as owners, reader itself stores nothing */
+    assert_int_equal(read_plan_init(&cluster->plan, &cluster->nodes[0],
+                                    .window = 8, .replicas = NODES,
+                                    .hedge_default_ms = hedge_default_ms),
+                     DISFS_SUCCESS);
+    return cluster;
+}
+
+static void stop_cluster(cluster_t* cluster)
+{
+    read_plan_destroy(&cluster->plan);
+    for (uint32_t n = 0; n < NODES; n++)
+    {
+        test_cluster_leave(&cluster->nodes[n], &cluster->stores[n],
+                           cluster->dirs[n]);
+    }
+    free(cluster);
+}
+
+static void striped_read_test(void** state)
+{
+    (void)state;
+    const node_role roles[NODES] = {ROLE_READER, ROLE_STORE, ROLE_STORE};
+    cluster_t* cluster = start_cluster(roles, BASE_PORT, 0);
+    sink_t sink = {};
+    for (uint32_t round = 0; round < 4; round++)
+    {
+        sink = (sink_t){};
+        assert_int_equal(read_plan_read(&cluster->plan, cluster->hashes,
+                                        CHUNKS, check_sink, &sink),
+                         DISFS_SUCCESS);
+        assert_int_equal(sink.next, CHUNKS);
+        assert_int_equal(sink.bad, 0);
+    }
+    /* both replicas served part of every read */
+    read_plan_t* plan = &cluster->plan;
+    assert_int_equal(plan->peer_count, 2);
+    assert_true(plan->peers[0].latency.count > CHUNKS / 2);
+    assert_true(plan->peers[1].latency.count > CHUNKS / 2);
+    assert_int_equal(plan->peers[0].inflight + plan->peers[1].inflight, 0);
+
+    /* sink error stops read and is returned */
+    uint32_t stop = 20;
+    assert_int_equal(read_plan_read(plan, cluster->hashes, CHUNKS, stop_sink,
+                                    &stop),
+                     DISFS_ERR_IO);
+    read_plan_stats_t stats;
+    read_plan_stats(plan, &stats);
+    assert_int_equal(stats.reads, 5);
+    assert_int_equal(stats.chunks, CHUNKS * 4 + stop + 1);
+    assert_int_equal(stats.errors, 1);
+    stop_cluster(cluster);
+}
+
+static void hedge_test(void** state)
+{
+    (void)state;
+    const node_role roles[NODES] = {ROLE_READER, ROLE_STORE, ROLE_SILENT};
+    cluster_t* cluster = start_cluster(roles, BASE_PORT + 10, 20);
+    sink_t sink = {};
+    uint64_t start = metrics_now_ns();
+    assert_int_equal(read_plan_read(&cluster->plan, cluster->hashes, CHUNKS,
+                                    check_sink, &sink),
+                     DISFS_SUCCESS);
+    uint64_t elapsed = metrics_now_ns() - start;
+    assert_int_equal(sink.next, CHUNKS);
+    assert_int_equal(sink.bad, 0);
+
+    /* requests stuck on silent peer were duplicated and then cancelled, so
+       read took nowhere near request timeout */
+    read_plan_stats_t stats;
+    read_plan_stats(&cluster->plan, &stats);
+    assert_true(stats.hedges > 0);
+    assert_true(stats.hedge_wins > 0);
+    assert_true(stats.cancelled >= stats.hedge_wins);
+    assert_true(elapsed < 2000000000ULL);
+    for (uint32_t i = 0; i < cluster->plan.peer_count; i++)
+    {
+        assert_int_equal(cluster->plan.peers[i].inflight, 0);
+    }
+    stop_cluster(cluster);
+}
+
+static void retry_test(void** state)
+{
+    (void)state;
+    const node_role roles[NODES] = {ROLE_READER, ROLE_STORE, ROLE_EMPTY};
+    cluster_t* cluster = start_cluster(roles, BASE_PORT + 20, 0);
+    sink_t sink = {};
+    assert_int_equal(read_plan_read(&cluster->plan, cluster->hashes, CHUNKS,
+                                    check_sink, &sink),
+                     DISFS_SUCCESS);
+    assert_int_equal(sink.next, CHUNKS);
+    assert_int_equal(sink.bad, 0);
+    read_plan_stats_t stats;
+    read_plan_stats(&cluster->plan, &stats);
+    assert_true(stats.retries > 0);
+
+    /* chunk no owner has fails the read with error of last owner */
+    chunk_hash_t missing[2] = {cluster->hashes[0], {.bytes = {1, 2, 3}}};
+    sink = (sink_t){};
+    assert_int_equal(read_plan_read(&cluster->plan, missing, 2, check_sink,
+                                    &sink),
+                     DISFS_ERR_NOT_FOUND);
+    assert_int_equal(sink.next, 1);
+    stop_cluster(cluster);
+}
+
+static void* read_thread(void* arg)
+{
+    reader_t* reader = arg;
+    reader->ret = read_plan_read(&reader->cluster->plan,
+                                 reader->cluster->hashes, CHUNKS, check_sink,
+                                 &reader->sink);
+    return NULL;
+}
+
+/*
+ * Silent peer is dropped as member declared dead while it holds requests of
+ * read, their completions move them to the other replica.
+ */
+static void evict_test(void** state)
+{
+    (void)state;
+    const node_role roles[NODES] = {ROLE_READER, ROLE_STORE, ROLE_SILENT};
+    cluster_t* cluster = start_cluster(roles, BASE_PORT + 30, 0);
+    /* nothing but eviction ends requests stuck on silent peer */
+    read_plan_destroy(&cluster->plan);
+    assert_int_equal(read_plan_init(&cluster->plan, &cluster->nodes[0],
+                                    .window = 8, .replicas = NODES,
+                                    .timeout_ms = 60000,
+                                    .disable_hedging = 1),
+                     DISFS_SUCCESS);
+    reader_t reader = {.cluster = cluster};
+    pthread_t th;
+    assert_int_equal(pthread_create(&th, NULL, read_thread, &reader), 0);
+
+    struct sockaddr_in silent = {.sin_family = AF_INET,
+                                 .sin_port = htons(BASE_PORT + 32)};
+    inet_pton(AF_INET, "127.0.0.1", &silent.sin_addr);
+    uint32_t stuck = 0;
+    for (uint32_t i = 0; i < 200 && stuck == 0; i++)
+    {
+        usleep(10000);
+        read_plan_t* plan = &cluster->plan;
+        pthread_mutex_lock(&plan->lock);
+        for (uint32_t p = 0; p < plan->peer_count; p++)
+        {
+            if (plan->peers[p].addr.sin_port == silent.sin_port)
+            {
+                stuck = plan->peers[p].inflight;
+            }
+        }
+        pthread_mutex_unlock(&plan->lock);
+    }
+    assert_true(stuck > 0);
+    peer_table_t* peers = &cluster->nodes[0].peers;
+    peer_table_lock(peers);
+    client_t* client = peer_table_find_locked(peers, &silent);
+    assert_non_null(client);
+    client->evict = 1;
+    peer_table_unlock(peers);
+
+    uint64_t start = metrics_now_ns();
+    assert_int_equal(pthread_join(th, NULL), 0);
+    assert_int_equal(reader.ret, DISFS_SUCCESS);
+    assert_int_equal(reader.sink.next, CHUNKS);
+    assert_int_equal(reader.sink.bad, 0);
+    assert_true(metrics_now_ns() - start < 10000000000ULL);
+    read_plan_stats_t stats;
+    read_plan_stats(&cluster->plan, &stats);
+    assert_true(stats.retries >= stuck);
+    stop_cluster(cluster);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(striped_read_test),
+        cmocka_unit_test(hedge_test),
+        cmocka_unit_test(retry_test),
+        cmocka_unit_test(evict_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
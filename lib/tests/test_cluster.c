@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "test_cluster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void test_cluster_store(connection_t node[static 1],
+                        chunk_store_t store[static 1],
+                        char dir[static TEST_CLUSTER_DIR_MAX])
+{
+    snprintf(dir, TEST_CLUSTER_DIR_MAX, "/tmp/disfs_test_XXXXXX");
+    assert_non_null(mkdtemp(dir));
+    assert_int_equal(chunk_store_open(store, dir), DISFS_SUCCESS);
+    chunk_store_attach(store, node);
+}
+
+void test_cluster_join(connection_t node[static 1], uint32_t index,
+                       uint32_t nodes, int32_t port)
+{
+    assert_int_equal(create_connection(node, .port_tcp = port + (int32_t)index,
+                                       .port_udp = port + 50 + (int32_t)index,
+                                       .discovery_ip = "127.0.0.1",
+                                       .discovery_port = port + 50,
+                                       .discovery_ports = nodes,
+                                       .discovery_interval_ms = 50,
+                                       .probe_interval_ms = 100),
+                     DISFS_SUCCESS);
+}
+
+void test_cluster_wait(connection_t node[static 1], uint32_t peers)
+{
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        if (connection_established_count(node) == peers)
+        {
+            break;
+        }
+        usleep(20000);
+    }
+    assert_int_equal(connection_established_count(node), peers);
+}
+
+void test_cluster_leave(connection_t node[static 1],
+                        chunk_store_t store[static 1],
+                        char dir[static TEST_CLUSTER_DIR_MAX])
+{
+    close_connection(node);
+    if (dir[0])
+    {
+        char cmd[64];
+        chunk_store_close(store);
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+        assert_int_equal(system(cmd), 0);
+    }
+}
+
+void test_random_data(uint8_t* data, uint32_t length, uint64_t seed)
+{
+    for (uint32_t i = 0; i < length; i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[i] = (uint8_t)(seed >> 56);
+    }
+}
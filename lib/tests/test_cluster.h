@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISFS_TEST_CLUSTER_H_
+#define DISFS_TEST_CLUSTER_H_
+
+#include "chunk_store.h"
+#include "connection.h"
+#include <stdint.h>
+
+#define TEST_CLUSTER_DIR_MAX 32
+
+/**
+ * @brief give node chunk store in new temporary directory dir, must be called
+ *        before node joins
+ */
+void test_cluster_store(connection_t node[static 1],
+                        chunk_store_t store[static 1],
+                        char dir[static TEST_CLUSTER_DIR_MAX]);
+
+/**
+ * @brief start node index of nodes on loopback, it listens on tcp port
+ *        port + index and udp port port + 50 + index, and announces itself
+ *        to udp ports of the others
+ */
+void test_cluster_join(connection_t node[static 1], uint32_t index,
+                       uint32_t nodes, int32_t port);
+
+/**
+ * @brief wait until node has established connection to peers nodes
+ */
+void test_cluster_wait(connection_t node[static 1], uint32_t peers);
+
+/**
+ * @brief close node and remove its chunk store, if it has one
+ */
+void test_cluster_leave(connection_t node[static 1],
+                        chunk_store_t store[static 1],
+                        char dir[static TEST_CLUSTER_DIR_MAX]);
+
+/**
+ * @brief fill data with length pseudo random bytes, same seed gives same bytes
+ */
+void test_random_data(uint8_t* data, uint32_t length, uint64_t seed);
+
+#endif
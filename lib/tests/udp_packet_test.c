@@ -13,7 +13,11 @@
 #include "err_codes.h"
 #include "time.h"
 #include "udp_discovery.h"
+#include <arpa/inet.h>
 #include <stdio.h>
+#include <unistd.h>
+
+#define BATCH_PORT 23300
 
 static void udp_create_test(void** state)
 {
@@ -62,10 +66,14 @@ static void udp_serialize_deserialize_test(void** state)
     UDP_packet packet = {};
     assert_int_equal(udp_discovery_packet_create(&packet, 8080, "TEST", 4),
                      DISFS_SUCCESS);
-    char serialized[44];
-    udp_discovery_packet_serialize(&packet, serialized, 44);
+    char serialized[UDP_DISCOVERY_PACKET_SIZE];
+    assert_int_equal(udp_discovery_packet_serialize(&packet, serialized,
+                                                    UDP_DISCOVERY_PACKET_SIZE),
+                     DISFS_SUCCESS);
     UDP_packet packet2 = {};
-    udp_discovery_packet_deserialize(&packet2, serialized, 44);
+    assert_int_equal(udp_discovery_packet_deserialize(
+                         &packet2, serialized, UDP_DISCOVERY_PACKET_SIZE),
+                     DISFS_SUCCESS);
     assert_int_equal(packet2.tcp_port, packet.tcp_port);
     assert_int_equal(packet2.magic_number, packet.magic_number);
     assert_int_equal(packet2.protocol_version, packet.protocol_version);
@@ -75,11 +83,124 @@ static void udp_serialize_deserialize_test(void** state)
     assert_string_equal(packet.hostname, packet2.hostname);
 }
 
+static void udp_serialize_bounds_test(void** state)
+{
+    (void)state;
+    UDP_packet packet = {};
+    assert_int_equal(udp_discovery_packet_create(&packet, 8080, "TEST", 4),
+                     DISFS_SUCCESS);
+    /* seconds past 2038 survive the wire */
+    packet.timestamp.tv_sec = (time_t)1 << 40;
+    char serialized[UDP_DISCOVERY_PACKET_SIZE];
+    assert_int_equal(udp_discovery_packet_serialize(
+                         &packet, serialized, UDP_DISCOVERY_PACKET_SIZE - 1),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(udp_discovery_packet_serialize(&packet, serialized,
+                                                    UDP_DISCOVERY_PACKET_SIZE),
+                     DISFS_SUCCESS);
+    /* little endian regardless of host */
+    assert_memory_equal(serialized, "\x90\x1F\0\0\xAE\0\0\0", 8);
+
+    UDP_packet decoded = {};
+    assert_int_equal(udp_discovery_packet_deserialize(
+                         &decoded, serialized, UDP_DISCOVERY_PACKET_SIZE - 1),
+                     DISFS_ERR_PROTO);
+    assert_int_equal(udp_discovery_packet_deserialize(
+                         &decoded, serialized, UDP_DISCOVERY_PACKET_SIZE),
+                     DISFS_SUCCESS);
+    assert_int_equal(decoded.timestamp.tv_sec, (time_t)1 << 40);
+
+    /* hostname length beyond hostname field */
+    serialized[24] = UDP_DISCOVERY_HOSTNAME_MAX_LEN + 1;
+    assert_int_equal(udp_discovery_packet_deserialize(
+                         &decoded, serialized, UDP_DISCOVERY_PACKET_SIZE),
+                     DISFS_ERR_PROTO);
+}
+
+static void udp_checksum_test(void** state)
+{
+    (void)state;
+    UDP_packet packet = {};
+    assert_int_equal(udp_discovery_packet_create(&packet, 8080, "TEST", 4),
+                     DISFS_SUCCESS);
+    char serialized[UDP_DISCOVERY_PACKET_SIZE];
+    assert_int_equal(udp_discovery_packet_serialize(&packet, serialized,
+                                                    UDP_DISCOVERY_PACKET_SIZE),
+                     DISFS_SUCCESS);
+    /* any flipped bit of any field is caught */
+    UDP_packet decoded = {};
+    for (uint32_t i = 0; i < UDP_DISCOVERY_PACKET_SIZE * 8; i++)
+    {
+        serialized[i / 8] ^= (char)(1 << (i % 8));
+        assert_int_not_equal(udp_discovery_packet_deserialize(
+                                 &decoded, serialized,
+                                 UDP_DISCOVERY_PACKET_SIZE),
+                             DISFS_SUCCESS);
+        serialized[i / 8] ^= (char)(1 << (i % 8));
+    }
+    assert_int_equal(udp_discovery_packet_deserialize(
+                         &decoded, serialized, UDP_DISCOVERY_PACKET_SIZE),
+                     DISFS_SUCCESS);
+}
+
+static void udp_batch_test(void** state)
+{
+    (void)state;
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(BATCH_PORT),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    int32_t rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int32_t tx = socket(AF_INET, SOCK_DGRAM, 0);
+    assert_int_equal(bind(rx, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    udp_batch_t* batch = udp_batch_create();
+    assert_non_null(batch);
+    assert_int_equal(udp_batch_recv(batch, rx), 0);
+
+    /* announcements interleaved with foreign datagrams */
+    for (uint32_t i = 0; i < UDP_BATCH_SIZE; i++)
+    {
+        uint8_t* buffer = udp_batch_prepare(batch, &addr);
+        assert_non_null(buffer);
+        UDP_packet packet = {};
+        udp_discovery_packet_create(&packet, (int32_t)(9000 + i), "TEST", 4);
+        udp_discovery_packet_serialize(&packet, (char*)buffer,
+                                       UDP_BATCH_PACKET_SIZE);
+        udp_batch_commit(batch, i % 4 == 3 ? 8 : UDP_DISCOVERY_PACKET_SIZE);
+    }
+    assert_null(udp_batch_prepare(batch, &addr));
+    assert_int_equal(udp_batch_send(batch, tx), DISFS_SUCCESS);
+    assert_int_equal(batch->count, 0);
+
+    UDP_packet packets[UDP_BATCH_SIZE];
+    assert_int_equal(udp_batch_recv(batch, rx), UDP_BATCH_SIZE);
+    assert_int_equal(udp_discovery_packet_deserialize_batch(batch, packets),
+                     UDP_BATCH_SIZE / 4 * 3);
+    for (uint32_t i = 0; i < UDP_BATCH_SIZE; i++)
+    {
+        if (i % 4 == 3)
+        {
+            assert_int_equal(packets[i].magic_number, 0);
+            continue;
+        }
+        assert_int_equal(packets[i].tcp_port, 9000 + i);
+        assert_string_equal(packets[i].hostname, "TEST");
+        assert_int_equal(batch->addrs[i].sin_addr.s_addr,
+                         htonl(INADDR_LOOPBACK));
+    }
+    assert_int_equal(udp_batch_recv(batch, rx), 0);
+    udp_batch_free(batch);
+    close(rx);
+    close(tx);
+}
+
 int main(void)
 {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(udp_create_test),
         cmocka_unit_test(udp_serialize_deserialize_test),
+        cmocka_unit_test(udp_serialize_bounds_test),
+        cmocka_unit_test(udp_checksum_test),
+        cmocka_unit_test(udp_batch_test),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2025 Piotr Miszta
+ * SPDX-License-Identifier: MIT
+ */
+
+// clang-foramt off
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+// clang-format on
+#include "err_codes.h"
+#include "wire.h"
+#include <string.h>
+
+#define WIRE_SCHEMA_PTR(msg, FIELDS) &wire_##msg##_schema,
+
+static const wire_schema_t* schemas[] = {WIRE_MESSAGES(WIRE_SCHEMA_PTR)};
+
+static void schema_test(void** state)
+{
+    (void)state;
+    for (uint32_t i = 0; i < sizeof(schemas) / sizeof(schemas[0]); i++)
+    {
+        const wire_schema_t* schema = schemas[i];
+        uint32_t fixed = 0;
+        for (uint32_t j = 0; j < schema->field_count; j++)
+        {
+            const wire_field_t* field = &schema->fields[j];
+            /* nothing can follow rest of message */
+            if (field->kind == WIRE_TAIL)
+            {
+                assert_int_equal(j, schema->field_count - 1);
+            }
+            fixed += field->kind <= WIRE_U64    ? 1u << field->kind
+                     : field->kind == WIRE_BYTES ? field->size
+                     : field->kind == WIRE_BLOB16 ? 2
+                                                  : 0;
+        }
+        assert_int_equal(fixed, schema->fixed_size);
+    }
+    /* layouts which predate schema */
+    assert_int_equal(WIRE_FIXED_SIZE(error), 8);
+    assert_int_equal(WIRE_FIXED_SIZE(chunk_data), 32);
+    assert_int_equal(WIRE_FIXED_SIZE(meta_attr), 32);
+    assert_int_equal(WIRE_FIXED_SIZE(meta_entry), 34);
+    assert_int_equal(WIRE_FIXED_SIZE(membership), 32);
+    assert_int_equal(WIRE_FIXED_SIZE(member_update), 16);
+    assert_int_equal(WIRE_FIXED_SIZE(discovery), 56);
+}
+
+static void little_endian_test(void** state)
+{
+    (void)state;
+    wire_meta_list_t list = {
+        .cookie = 0x01020304,
+        .path = {.data = (const uint8_t*)"/a", .length = 2}};
+    uint8_t out[16];
+    uint64_t length;
+    assert_int_equal(wire_meta_list_encode(&list, out, sizeof(out), &length),
+                     DISFS_SUCCESS);
+    assert_int_equal(length, 6);
+    assert_memory_equal(out, "\x04\x03\x02\x01/a", 6);
+
+    wire_discovery_t discovery = {.tcp_port = 8080,
+                                  .timestamp_sec = 0x123456789AULL,
+                                  .hostname_len = 2,
+                                  .hostname = {.data = (const uint8_t*)"ab",
+                                               .length = 2}};
+    uint8_t packet[WIRE_FIXED_SIZE(discovery)];
+    memset(packet, 0xFF, sizeof(packet));
+    assert_int_equal(
+        wire_discovery_encode(&discovery, packet, sizeof(packet), &length),
+        DISFS_SUCCESS);
+    assert_int_equal(length, sizeof(packet));
+    assert_memory_equal(packet + 16, "\x9A\x78\x56\x34\x12\0\0\0", 8);
+    /* short hostname is zero padded */
+    assert_memory_equal(packet + 28, "ab\0\0", 4);
+
+    wire_discovery_t decoded;
+    assert_int_equal(wire_discovery_decode(&decoded, packet, sizeof(packet)),
+                     DISFS_SUCCESS);
+    assert_int_equal(decoded.tcp_port, 8080);
+    assert_int_equal(decoded.timestamp_sec, 0x123456789AULL);
+    assert_int_equal(decoded.hostname.length, 24);
+    assert_ptr_equal(decoded.hostname.data, packet + 28);
+}
+
+static void bounds_test(void** state)
+{
+    (void)state;
+    wire_meta_rename_t rename = {
+        .from = {.data = (const uint8_t*)"/old", .length = 4},
+        .to = {.data = (const uint8_t*)"/new", .length = 4}};
+    uint8_t out[16];
+    uint64_t length;
+    assert_int_equal(
+        wire_meta_rename_encode(&rename, out, sizeof(out), &length),
+        DISFS_SUCCESS);
+    assert_int_equal(length, 10);
+    assert_int_equal(wire_meta_rename_encode(&rename, out, 9, &length),
+                     DISFS_ERR_INVALID_ARG);
+
+    wire_meta_rename_t decoded;
+    for (uint64_t i = 0; i < 6; i++)
+    {
+        assert_int_equal(wire_meta_rename_decode(&decoded, out, i),
+                         DISFS_ERR_PROTO);
+    }
+    assert_int_equal(wire_meta_rename_decode(&decoded, out, length),
+                     DISFS_SUCCESS);
+    assert_memory_equal(decoded.from.data, "/old", 4);
+    assert_int_equal(decoded.to.length, 4);
+    assert_memory_equal(decoded.to.data, "/new", 4);
+
+    /* source length pointing past end of message */
+    out[0] = 0xFF;
+    assert_int_equal(wire_meta_rename_decode(&decoded, out, length),
+                     DISFS_ERR_PROTO);
+
+    uint8_t attr[WIRE_FIXED_SIZE(meta_attr) + 1] = {};
+    wire_meta_attr_t meta_attr;
+    assert_int_equal(wire_meta_attr_decode(&meta_attr, attr, sizeof(attr) - 2),
+                     DISFS_ERR_PROTO);
+    /* trailing bytes are error unless caller asks for consumed length */
+    assert_int_equal(wire_meta_attr_decode(&meta_attr, attr, sizeof(attr)),
+                     DISFS_ERR_PROTO);
+    uint64_t consumed;
+    assert_int_equal(wire_decode(&wire_meta_attr_schema, &meta_attr, attr,
+                                 sizeof(attr), &consumed),
+                     DISFS_SUCCESS);
+    assert_int_equal(consumed, WIRE_FIXED_SIZE(meta_attr));
+
+    /* values are never truncated silently */
+    meta_attr = (wire_meta_attr_t){.type = 256};
+    assert_int_equal(wire_meta_attr_encode(&meta_attr, attr, sizeof(attr),
+                                           &length),
+                     DISFS_ERR_INVALID_ARG);
+    meta_attr = (wire_meta_attr_t){
+        .reserved = {.data = (const uint8_t*)"four", .length = 4}};
+    assert_int_equal(wire_meta_attr_encode(&meta_attr, attr, sizeof(attr),
+                                           &length),
+                     DISFS_ERR_INVALID_ARG);
+}
+
+static void iov_test(void** state)
+{
+    (void)state;
+    uint8_t data[1000];
+    for (uint32_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)i;
+    }
+    wire_meta_rename_t rename = {
+        .from = {.data = data, .length = 100},
+        .to = {.data = data + 100, .length = 900}};
+    uint8_t scratch[WIRE_FIXED_SIZE(meta_rename)];
+    struct iovec iov[4];
+    uint32_t count;
+    assert_int_equal(wire_encode_iov(&wire_meta_rename_schema, &rename,
+                                     scratch, sizeof(scratch), iov, 2, &count),
+                     DISFS_ERR_INVALID_ARG);
+    assert_int_equal(wire_encode_iov(&wire_meta_rename_schema, &rename,
+                                     scratch, sizeof(scratch), iov, 4, &count),
+                     DISFS_SUCCESS);
+    /* length prefix from scratch, both paths referenced without copy */
+    assert_int_equal(count, 3);
+    assert_ptr_equal(iov[0].iov_base, scratch);
+    assert_ptr_equal(iov[1].iov_base, data);
+    assert_ptr_equal(iov[2].iov_base, data + 100);
+
+    uint8_t flat[1100];
+    uint8_t gathered[1100];
+    uint64_t length;
+    uint64_t gathered_length = 0;
+    assert_int_equal(
+        wire_meta_rename_encode(&rename, flat, sizeof(flat), &length),
+        DISFS_SUCCESS);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memcpy(gathered + gathered_length, iov[i].iov_base, iov[i].iov_len);
+        gathered_length += iov[i].iov_len;
+    }
+    assert_int_equal(gathered_length, length);
+    assert_memory_equal(gathered, flat, length);
+
+    /* empty variable field adds no iovec */
+    wire_chunk_data_t chunk = {.hash = {.data = data, .length = 32},
+                               .data = {.data = data, .length = 0}};
+    uint8_t hash_scratch[WIRE_FIXED_SIZE(chunk_data)];
+    assert_int_equal(wire_encode_iov(&wire_chunk_data_schema, &chunk,
+                                     hash_scratch, sizeof(hash_scratch), iov,
+                                     4, &count),
+                     DISFS_SUCCESS);
+    assert_int_equal(count, 1);
+    assert_int_equal(iov[0].iov_len, 32);
+}
+
+static void lazy_test(void** state)
+{
+    (void)state;
+    const char* names[] = {"a", "bb", "ccc"};
+    uint8_t buffer[256];
+    uint64_t used = 0;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        wire_meta_entry_t entry = {
+            .ino = i + 1,
+            .size = 100 * i,
+            .name = {.data = (const uint8_t*)names[i], .length = i + 1}};
+        uint64_t length;
+        assert_int_equal(wire_meta_entry_encode(&entry, buffer + used,
+                                                sizeof(buffer) - used,
+                                                &length),
+                         DISFS_SUCCESS);
+        used += length;
+    }
+
+    /* entries are walked in place, names stay in buffer */
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        wire_meta_entry_t entry;
+        uint64_t consumed;
+        assert_int_equal(wire_decode(&wire_meta_entry_schema, &entry,
+                                     buffer + offset, used - offset,
+                                     &consumed),
+                         DISFS_SUCCESS);
+        assert_int_equal(entry.ino, i + 1);
+        assert_int_equal(entry.size, 100 * i);
+        assert_int_equal(entry.name.length, i + 1);
+        assert_memory_equal(entry.name.data, names[i], i + 1);
+        assert_ptr_equal(entry.name.data,
+                         buffer + offset + WIRE_FIXED_SIZE(meta_entry));
+        offset += consumed;
+    }
+    assert_int_equal(offset, used);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(schema_test),
+        cmocka_unit_test(little_endian_test),
+        cmocka_unit_test(bounds_test),
+        cmocka_unit_test(iov_test),
+        cmocka_unit_test(lazy_test),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}